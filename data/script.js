@@ -1,8 +1,9 @@
 let tempChart;
 let fanChart;
 const maxDataPoints = 90; // Max points to display on graph
-const maxRawRecords = 900; // 15 minutes history @ 1s interval
-let rawHistory = []; // Buffer for raw 1s data
+const historyWindowMs = 15 * 60 * 1000; // Time span of the graphs
+const historyPoints = 2 * maxDataPoints; // Points loaded from /api/history
+let rawHistory = []; // Records oldest first: {time, temps, fans}
 
 function initCharts() {
     // Temperature Chart
@@ -152,150 +153,229 @@ function refreshCharts(labels, tData, fData) {
 
 function processHistory() {
     const count = rawHistory.length;
-    const target = maxDataPoints;
-    
     const labels = [];
-    const tData = {}; 
-    const fData = {}; 
-    
-    if (count > 0) {
-        rawHistory[0].thermistors.forEach(t => tData[t.id] = []);
-        rawHistory[0].fans.forEach((f, i) => {
-            fData[`Fan ${i+1} RPM`] = [];
-            fData[`Fan ${i+1} Duty`] = [];
-        });
+    const tData = {};
+    const fData = {};
+    if (count === 0) {
+        refreshCharts(labels, tData, fData);
+        return;
     }
-    
-    if (count <= target) {
-        rawHistory.forEach(record => {
-            labels.push(record.timestamp);
-            record.thermistors.forEach(t => tData[t.id].push(parseFloat(t.temp)));
-            record.fans.forEach((f, i) => {
-                fData[`Fan ${i+1} RPM`].push(parseInt(f.rpm));
-                fData[`Fan ${i+1} Duty`].push(parseFloat(f.duty));
+
+    // Series of the newest record; older ones may lack some
+    const newest = rawHistory[count - 1];
+    Object.keys(newest.temps).forEach(id => tData[id] = []);
+    Object.keys(newest.fans).forEach(label => fData[label] = []);
+
+    // Points evenly spaced in time, each a weighted average of the records
+    // within one spacing of it (Kernel Smoothing) to prevent flicker. This
+    // also blends the sparser points from /api/history with the 1s live ones.
+    const start = rawHistory[0].time;
+    const target = newest.time > start ? Math.min(maxDataPoints, count) : 1;
+    const step = target > 1 ? (newest.time - start) / (target - 1) : 1;
+    let first = 0;
+
+    for (let i = 0; i < target; i++) {
+        const center = start + i * step;
+        while (first < count - 1 && rawHistory[first].time <= center - step) first++;
+
+        const tSums = {};
+        const fSums = {};
+        Object.keys(tData).forEach(k => tSums[k] = { sum: 0, weight: 0 });
+        Object.keys(fData).forEach(k => fSums[k] = { sum: 0, weight: 0 });
+        const accumulate = (sums, values, weight) => {
+            Object.keys(sums).forEach(k => {
+                const value = values[k];
+                if (value === undefined || isNaN(value)) return;
+                sums[k].sum += value * weight;
+                sums[k].weight += weight;
             });
-        });
-    } else {
-        // Weighted resampling (Kernel Smoothing) to prevent flicker
-        const ratio = (count - 1) / (target - 1);
-        const radius = ratio; // Window radius
+        };
 
-        for (let i = 0; i < target; i++) {
-            const center = i * ratio;
-            
-            // Determine range of input indices that contribute to this output point
-            const start = Math.ceil(center - radius);
-            const end = Math.floor(center + radius);
-            
-            const safeStart = Math.max(0, start);
-            const safeEnd = Math.min(count - 1, end);
-            
-            let totalWeight = 0;
-            const tSums = {};
-            const fSums = {};
-            
-            // Initialize sums
-            Object.keys(tData).forEach(k => tSums[k] = 0);
-            Object.keys(fData).forEach(k => fSums[k] = 0);
+        // Accumulate weighted values
+        for (let j = first; j < count && rawHistory[j].time < center + step; j++) {
+            const weight = 1 - Math.abs(rawHistory[j].time - center) / step;
+            if (weight <= 0) continue;
+            accumulate(tSums, rawHistory[j].temps, weight);
+            accumulate(fSums, rawHistory[j].fans, weight);
+        }
 
-            // Accumulate weighted values
-            for (let j = safeStart; j <= safeEnd; j++) {
-                const weight = 1 - Math.abs(j - center) / radius;
-                if (weight <= 0) continue;
-                
-                totalWeight += weight;
-                
-                const record = rawHistory[j];
-                
-                record.thermistors.forEach(t => {
-                    tSums[t.id] += parseFloat(t.temp) * weight;
-                });
-                
-                record.fans.forEach((f, idx) => {
-                    fSums[`Fan ${idx+1} RPM`] += parseInt(f.rpm) * weight;
-                    fSums[`Fan ${idx+1} Duty`] += parseFloat(f.duty) * weight;
-                });
-            }
-            
-            // Normalize and store
-            if (totalWeight > 0) {
-                const nearestIndex = Math.round(center);
-                labels.push(rawHistory[Math.min(count-1, nearestIndex)].timestamp);
-                
-                Object.keys(tSums).forEach(id => {
-                    tData[id].push((tSums[id] / totalWeight).toFixed(1));
-                });
-                
-                Object.keys(fSums).forEach(label => {
-                    if (label.includes('RPM')) {
-                        fData[label].push(Math.round(fSums[label] / totalWeight));
-                    } else {
-                        fData[label].push((fSums[label] / totalWeight).toFixed(1));
-                    }
-                });
+        // Normalize and store (a gap where a series has no value)
+        labels.push(new Date(center).toLocaleTimeString());
+        Object.keys(tSums).forEach(id => {
+            const s = tSums[id];
+            tData[id].push(s.weight > 0 ? (s.sum / s.weight).toFixed(1) : null);
+        });
+        Object.keys(fSums).forEach(label => {
+            const s = fSums[label];
+            if (s.weight === 0) {
+                fData[label].push(null);
+            } else if (label.includes('RPM')) {
+                fData[label].push(Math.round(s.sum / s.weight));
+            } else {
+                fData[label].push((s.sum / s.weight).toFixed(1));
             }
-        }
+        });
     }
-    
+
     refreshCharts(labels, tData, fData);
 }
 
-function updateStatus() {
-    fetch('/api/status')
+// Add a record to the history, dropping those older than the graphs show
+function addHistoryRecord(record) {
+    rawHistory.push(record);
+    while (rawHistory[0].time < record.time - historyWindowMs) {
+        rawHistory.shift();
+    }
+}
+
+// Fill the graphs with the device's recent history on page load, so they do
+// not start empty. Points are [ageMs, temps..., duty, rpm per fan].
+function loadHistory() {
+    fetch(`/api/history?points=${historyPoints}`)
         .then(response => response.json())
         .then(data => {
-            // Update Text UI immediately
-            const tempGrid = document.getElementById('temp-grid');
-            tempGrid.innerHTML = '';
-            data.thermistors.forEach(t => {
-                tempGrid.innerHTML += `
-                    <div class="fan-card">
-                        <h3>${t.id}</h3>
-                        <div class="fan-status">
-                            <strong>Temp:</strong> ${t.temp} &deg;C
-                        </div>
-                    </div>`;
+            const now = Date.now();
+            // Live records that arrived meanwhile are newer
+            const oldestLive = rawHistory.length > 0 ? rawHistory[0].time : Infinity;
+            const value = v => v === null ? NaN : v;
+            const records = [];
+            data.points.forEach(point => {
+                const record = { time: now - point[0], temps: {}, fans: {} };
+                if (record.time >= oldestLive) return;
+                data.thermistors.forEach((id, i) => record.temps[id] = value(point[1 + i]));
+                for (let i = 0; i < data.fans; i++) {
+                    const column = 1 + data.thermistors.length + 2 * i;
+                    record.fans[`Fan ${i+1} RPM`] = value(point[column + 1]);
+                    record.fans[`Fan ${i+1} Duty`] = value(point[column]);
+                }
+                records.push(record);
             });
+            const live = rawHistory;
+            rawHistory = [];
+            records.concat(live).forEach(addHistoryRecord);
+            processHistory();
+        })
+        .catch(console.error);
+}
 
-            const fanGrid = document.getElementById('fan-grid');
-            fanGrid.innerHTML = '';
-            data.fans.forEach((f, index) => {
-                fanGrid.innerHTML += `
-                    <div class="fan-card">
-                        <h3>Fan ${index + 1}</h3>
-                        <div class="fan-status">
-                            <strong>Duty Cycle:</strong> ${f.duty}%<br>
-                            <strong>RPM:</strong> ${f.rpm}
-                        </div>
-                    </div>`;
-            });
+function renderStatus(data) {
+    // Update Text UI immediately
+    const tempGrid = document.getElementById('temp-grid');
+    tempGrid.innerHTML = '';
+    data.thermistors.forEach(t => {
+        tempGrid.innerHTML += `
+            <div class="fan-card">
+                <h3>${t.id}</h3>
+                <div class="fan-status">
+                    <strong>Temp:</strong> ${t.temp} &deg;C
+                </div>
+            </div>`;
+    });
 
-            document.getElementById('logger-output').textContent = data.logs;
+    const fanGrid = document.getElementById('fan-grid');
+    fanGrid.innerHTML = '';
+    data.fans.forEach((f, index) => {
+        fanGrid.innerHTML += `
+            <div class="fan-card">
+                <h3>Fan ${index + 1}</h3>
+                <div class="fan-status">
+                    <strong>Duty Cycle:</strong> ${f.duty}%<br>
+                    <strong>RPM:</strong> ${f.rpm}
+                </div>
+            </div>`;
+    });
 
-            const form = document.getElementById('control-form');
-            if (data.overrideEnabled) {
-                form.style.display = 'block';
-            } else {
-                form.style.display = 'none';
-            }
+    if (data.logSeq !== logCursor || data.bootId !== logBootId) {
+        fetchLogs(data.logSeq, data.bootId);
+    }
 
-            // Add to history and update charts
-            const now = new Date().toLocaleTimeString();
-            data.timestamp = now;
-            
-            rawHistory.push(data);
-            if (rawHistory.length > maxRawRecords) {
-                rawHistory.shift();
+    const form = document.getElementById('control-form');
+    if (data.overrideEnabled) {
+        form.style.display = 'block';
+    } else {
+        form.style.display = 'none';
+    }
+
+    // Add to history and update charts
+    const record = { time: Date.now(), temps: {}, fans: {} };
+    data.thermistors.forEach(t => record.temps[t.id] = parseFloat(t.temp));
+    data.fans.forEach((f, i) => {
+        record.fans[`Fan ${i+1} RPM`] = parseInt(f.rpm);
+        record.fans[`Fan ${i+1} Duty`] = parseFloat(f.duty);
+    });
+    addHistoryRecord(record);
+    processHistory();
+}
+
+const maxLogLines = 200;
+let logLines = [];
+let logCursor = 0; // Sequence number of the newest line shown
+let logBootId = null; // Boot the cursor belongs to
+let logFetching = false;
+
+// Start over: the device restarted and its log numbering did too
+function resetLogs(bootId) {
+    logLines = [];
+    logCursor = 0;
+    logBootId = bootId;
+}
+
+// Fetch only the log lines after the ones already shown
+function fetchLogs(latest, bootId) {
+    if (logFetching) return;
+    // bootId is 0 without the perf logger; the cursor passing the newest
+    // line still shows a restart then
+    if (bootId !== logBootId || latest < logCursor) resetLogs(bootId);
+    logFetching = true;
+    fetch(`/api/logs?after=${logCursor}`)
+        .then(response => response.json())
+        .then(data => {
+            if (data.bootId !== logBootId) {
+                // Restarted since the status: these follow a stale cursor
+                resetLogs(data.bootId);
+                return;
             }
-            
-            processHistory();
+            logLines = logLines.concat(data.lines).slice(-maxLogLines);
+            logCursor = data.seq;
+            document.getElementById('logger-output').textContent = logLines.join('\n');
         })
+        .catch(console.error)
+        .finally(() => { logFetching = false; });
+}
+
+function updateStatus() {
+    fetch('/api/status')
+        .then(response => response.json())
+        .then(renderStatus)
         .catch(console.error);
 }
 
+let pollTimer = null;
+
+function startPolling() {
+    if (pollTimer === null) {
+        updateStatus();
+        pollTimer = setInterval(updateStatus, 1000);
+    }
+}
+
+// Live updates pushed once per control tick; polls instead if the browser
+// lacks EventSource or the device turns the subscription down
+function startEvents() {
+    if (!window.EventSource) {
+        startPolling();
+        return;
+    }
+    const events = new EventSource('/api/events');
+    events.onmessage = event => renderStatus(JSON.parse(event.data));
+    events.onerror = () => {
+        if (events.readyState === EventSource.CLOSED) {
+            startPolling();
+        }
+    };
+}
+
 // Initialize
 initCharts();
-// Update every second
-setInterval(updateStatus, 1000);
-// Initial call
-updateStatus();
+loadHistory();
+startEvents();
@@ -1,24 +1,97 @@
 #include "fan_controller.h"
 
+#include <LittleFS.h>
+
+#include "flight_recorder.h"
 #include "logger.h"
 
-FanController::FanController(const std::vector<PWMFan*>& fans,
-                             const std::vector<PWMFan*>& pumps,
-                             Thermistor* ambient_temp,
-                             Thermistor* coolant_in_temp,
-                             Thermistor* coolant_out_temp)
-    : fans_(fans),
-      pumps_(pumps),
-      ambient_temp_(ambient_temp),
-      coolant_in_temp_(coolant_in_temp),
-      coolant_out_temp_(coolant_out_temp),
-      current_delta_t_(0.0f),
-      target_fan_speed_(0.0f),
-      control_task_handle_(nullptr) {
-  Logger::println("FanController initialized");
+namespace {
+
+// On-flash layout of the persisted config: header followed by the raw struct.
+// The size field rejects files written by a firmware with a different layout,
+// the topology hash those written for other channels (min_duty_percent is
+// indexed by channel), which then fall back to the topology's defaults.
+struct __attribute__((packed)) ConfigFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t topology_hash;  // TopologyChannelHash() of the topology
+};
+
+constexpr uint32_t kConfigMagic = 0x46434346;  // "FCCF"
+constexpr uint16_t kConfigVersion = 2;
+
+}  // namespace
+
+FanController::FanController(const Topology& topology,
+                             const std::vector<PWMFan*>& fans,
+                             const std::vector<Thermistor*>& sensors)
+    : topology_(topology),
+      fan_count_(0),
+      sensor_count_(0),
+      failed_sensor_mask_(0),
+      tick_count_(0),
+      tick_time_us_total_(0),
+      control_task_handle_(nullptr),
+      config_(MakeDefaultConfig(topology)) {
+  // Pumps keep the loop flowing, so their topology minimum is a hard floor
+  for (int i = 0; i < kMaxFanChannels; i++) {
+    min_duty_floor_[i] = i < topology_.fan_count && topology_.fans[i].is_pump
+                             ? topology_.fans[i].min_duty_percent
+                             : 0.0f;
+  }
+
+  fan_count_ = min((int)fans.size(), topology_.fan_count);
+  for (int i = 0; i < fan_count_; i++) {
+    fans_[i] = fans[i];
+    fan_zone_mask_[i] = 0;
+    StatusOr<float> min_res = fans_[i]->GetMinDutyCycle();
+    applied_min_duty_[i] = min_res.ok() ? min_res.value() : 0.0f;
+  }
+
+  sensor_count_ = min((int)sensors.size(), topology_.sensor_count);
+  for (int i = 0; i < sensor_count_; i++) {
+    sensors_[i] = sensors[i];
+    sensor_errors_[i] = 0;
+  }
+
+  for (int z = 0; z < topology_.zone_count; z++) {
+    const ZoneSpec& zone = topology_.zones[z];
+    for (int i = 0; i < zone.fan_count; i++) {
+      if (zone.fans[i] < fan_count_) fan_zone_mask_[zone.fans[i]] |= 1 << z;
+    }
+    zone_delta_t_[z] = 0.0f;
+    zone_target_fan_speed_[z] = 0.0f;
+  }
+
+  Logger::println("FanController initialized with " + String(fan_count_) +
+                  " fans, " + String(sensor_count_) + " sensors, " +
+                  String(topology_.zone_count) + " zones");
+}
+
+float FanController::GetDeltaT() const {
+  float delta_t = 0.0f;
+  for (int z = 0; z < topology_.zone_count; z++) {
+    delta_t = max(delta_t, (float)zone_delta_t_[z]);
+  }
+  return delta_t;
+}
+
+float FanController::GetTargetFanSpeed() const {
+  float speed = 0.0f;
+  for (int z = 0; z < topology_.zone_count; z++) {
+    speed = max(speed, (float)zone_target_fan_speed_[z]);
+  }
+  return speed;
 }
 
 void FanController::Start() {
+  Status status = LoadConfig();
+  if (!status.ok()) {
+    Logger::println("FanController: Using default config (" +
+                    status.message() + ")");
+  }
+
   Logger::println("Starting FanController task...");
   // Create FreeRTOS task for fan control (runs every second)
   xTaskCreate(ControlTask,           // Task function
@@ -41,154 +114,247 @@ void FanController::ControlTask(void* parameter) {
   FanController* controller = static_cast<FanController*>(parameter);
 
   while (true) {
-    controller->UpdateFanSpeeds();
-    vTaskDelay(pdMS_TO_TICKS(kUpdateIntervalMs));
+    uint32_t interval_ms;
+    unsigned long start_us = micros();
+    {
+      // Pin one consistent config for the whole tick
+      RcuCell<ControllerConfig>::ReadGuard config(controller->config_);
+      controller->UpdateFanSpeeds(*config);
+      interval_ms = config->update_interval_ms;
+    }
+    uint32_t elapsed_us = micros() - start_us;
+    controller->tick_time_us_total_ =
+        controller->tick_time_us_total_ + elapsed_us;
+    controller->tick_count_ = controller->tick_count_ + 1;
+    vTaskDelay(pdMS_TO_TICKS(interval_ms));
   }
 }
 
-void FanController::UpdateFanSpeeds() {
-  // Read temperatures from all thermistors
-  StatusOr<float> ambient_temp_result = ambient_temp_->GetSampledTemperature();
-  StatusOr<float> coolant_in_temp_result =
-      coolant_in_temp_->GetSampledTemperature();
-  StatusOr<float> coolant_out_temp_result =
-      coolant_out_temp_->GetSampledTemperature();
-
-  // Check if all temperature readings are valid
-  if (!ambient_temp_result.ok()) {
-    Logger::println(String("FanController: Ambient temp error: ") +
-                    ambient_temp_result.status().message());
-    for (auto fan : fans_) {
-      fan->SetDutyCycle(kMaxFanSpeedPercent);
-    }
-    return;
+ControllerConfig FanController::MakeDefaultConfig(
+    const Topology& topology) const {
+  ControllerConfig config = DefaultControllerConfig();
+  for (int i = 0; i < topology.fan_count; i++) {
+    config.min_duty_percent[i] = topology.fans[i].min_duty_percent;
+  }
+  return config;
+}
+
+Status FanController::UpdateConfig(const ControllerConfig& config) {
+  const char* error = ValidateControllerConfig(config, min_duty_floor_);
+  if (error != nullptr) {
+    return Status::InvalidArgument(error);
   }
 
-  // Check if at least one coolant sensor is working
-  if (!coolant_in_temp_result.ok() && !coolant_out_temp_result.ok()) {
-    Logger::println("FanController: Both coolant sensors failed!");
-    for (auto fan : fans_) {
-      fan->SetDutyCycle(kMaxFanSpeedPercent);
-    }
-    return;
+  if (!config_.Publish(config)) {
+    return Status(StatusCode::kInternalError, "Config busy, try again");
   }
-  if (!coolant_in_temp_result.ok()) {
-    Logger::println(String("FanController: Coolant In temp error: ") +
-                    coolant_in_temp_result.status().message());
+  Logger::println("FanController: Config updated");
+
+  // Already live, so a failed save is reported as such, not as a rejection
+  Status saved = SaveConfig(config);
+  if (!saved.ok()) {
+    Logger::println("FanController: Config not saved: " + saved.message());
+    return Status(StatusCode::kInternalError,
+                  "Config applied but not saved (lost on reboot): " +
+                      saved.message());
   }
-  if (!coolant_out_temp_result.ok()) {
-    Logger::println(String("FanController: Coolant Out temp error: ") +
-                    coolant_out_temp_result.status().message());
+  return OkStatus();
+}
+
+Status FanController::SaveConfig(const ControllerConfig& config) {
+  File f = LittleFS.open(kConfigPath, "w");
+  if (!f) {
+    return Status(StatusCode::kInternalError, "Failed to open config file");
   }
 
-  float ambient_temp = ambient_temp_result.value();
-  float highest_coolant_temp = 0.0f;
+  ConfigFileHeader header = {kConfigMagic, kConfigVersion,
+                             sizeof(ControllerConfig),
+                             TopologyChannelHash(topology_)};
+  size_t written = f.write((const uint8_t*)&header, sizeof(header));
+  written += f.write((const uint8_t*)&config, sizeof(config));
+  f.close();
 
-  if (coolant_in_temp_result.ok() && coolant_out_temp_result.ok()) {
-    highest_coolant_temp =
-        max(coolant_in_temp_result.value(), coolant_out_temp_result.value());
-  } else if (coolant_in_temp_result.ok()) {
-    highest_coolant_temp = coolant_in_temp_result.value();
-  } else {
-    highest_coolant_temp = coolant_out_temp_result.value();
+  if (written != sizeof(header) + sizeof(config)) {
+    return Status(StatusCode::kInternalError, "Short write to config file");
   }
+  return OkStatus();
+}
 
-  // Calculate DeltaT: difference between ambient and highest coolant
-  // temperature
-  float delta_t = highest_coolant_temp - ambient_temp;
+Status FanController::LoadConfig() {
+  if (!LittleFS.begin(true)) {
+    return Status(StatusCode::kInternalError, "LittleFS mount failed");
+  }
+  if (!LittleFS.exists(kConfigPath)) {
+    return Status(StatusCode::kInternalError, "No saved config");
+  }
 
-  // Ensure DeltaT is not negative
-  if (delta_t < 0.0f) {
-    delta_t = 0.0f;
+  File f = LittleFS.open(kConfigPath, "r");
+  if (!f) {
+    return Status(StatusCode::kInternalError, "Failed to open config file");
   }
 
-  current_delta_t_ = delta_t;
+  ConfigFileHeader header;
+  ControllerConfig config;
+  bool complete =
+      f.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+      header.magic == kConfigMagic && header.version == kConfigVersion &&
+      header.size == sizeof(ControllerConfig) &&
+      f.read((uint8_t*)&config, sizeof(config)) == sizeof(config);
+  f.close();
+
+  if (!complete) {
+    return Status(StatusCode::kInternalError, "Saved config incompatible");
+  }
+  if (header.topology_hash != TopologyChannelHash(topology_)) {
+    return Status(StatusCode::kInternalError,
+                  "Saved config is for other fans (topology changed)");
+  }
 
-  // Calculate target fan speed intensity (0-100%) based on DeltaT and water
-  // temperature
-  float fan_speed_intensity = CalculateFanSpeed(delta_t, highest_coolant_temp);
-  target_fan_speed_ = fan_speed_intensity;
+  const char* error = ValidateControllerConfig(config, min_duty_floor_);
+  if (error != nullptr) {
+    return Status::InvalidArgument(error);
+  }
+  if (!config_.Publish(config)) {
+    return Status(StatusCode::kInternalError, "Config busy");
+  }
 
-  // Apply fan speed to fans, scaling to their individual minimums
-  ApplyFanSpeed(fans_, fan_speed_intensity, "Fan");
+  Logger::println("FanController: Loaded saved config");
+  return OkStatus();
+}
 
-  // Apply fan speed to pumps, scaling to their individual minimums
-  // Currently, pumps run at the same speed as fans.
-  ApplyFanSpeed(pumps_, fan_speed_intensity, "Pump");
+void FanController::UpdateFanSpeeds(const ControllerConfig& config) {
+  // Read every sensor exactly once per tick
+  float temps[kMaxSensors];
+  bool valid[kMaxSensors];
+  String log_msg = "FanController:";
+  uint32_t failed_sensors = 0;
+  for (int i = 0; i < sensor_count_; i++) {
+    StatusOr<float> result = sensors_[i]->GetSampledTemperature();
+    valid[i] = result.ok();
+    temps[i] = valid[i] ? result.value() : 0.0f;
+    if (!valid[i]) {
+      Logger::println(String("FanController: ") + topology_.sensors[i].id +
+                      " temp error: " + result.status().message());
+      sensor_errors_[i] = sensor_errors_[i] + 1;
+      // Capture what led up to it, once per failure
+      failed_sensors |= 1u << i;
+      if (!(failed_sensor_mask_ & (1u << i))) {
+        FlightRecorder::Trigger(kFlightTriggerSensorError, i);
+      }
+    }
+    log_msg += String(i == 0 ? " " : ", ") + topology_.sensors[i].id + "=" +
+               (valid[i] ? String(temps[i], 1) : String("ERR")) + "C";
+  }
 
-  // Log status periodically (every update)
-  String in_str = coolant_in_temp_result.ok()
-                      ? String(coolant_in_temp_result.value(), 1)
-                      : "ERR";
-  String out_str = coolant_out_temp_result.ok()
-                       ? String(coolant_out_temp_result.value(), 1)
-                       : "ERR";
+  failed_sensor_mask_ = failed_sensors;
 
-  String log_msg = String("FanController: CAmb=") + String(ambient_temp, 1) +
-                   "C, " + "CIn=" + in_str + "C, " + "COut=" + out_str + "C, " +
-                   "DT=" + String(delta_t, 1) + "C";
+  // Evaluate zones
+  uint8_t failed_zones = 0;
+  for (int z = 0; z < topology_.zone_count; z++) {
+    if (!UpdateZone(config, z, temps, valid)) {
+      failed_zones |= 1 << z;
+    }
+    log_msg += String(", DT(") + topology_.zones[z].id +
+               ")=" + String((float)zone_delta_t_[z], 1) + "C";
+  }
 
-  for (size_t i = 0; i < fans_.size(); i++) {
-    auto res = fans_[i]->GetDutyCycle();
-    String str = res.ok() ? String(res.value(), 1) : "ERR";
-    log_msg += ", F" + String(i + 1) + "=" + str + "%";
+  // One pass over all channels: follow the most demanding zone, or run at
+  // full speed if any of the fan's zones lost its sensors
+  for (int i = 0; i < fan_count_; i++) {
+    if (fan_zone_mask_[i] & failed_zones) {
+      fans_[i]->SetDutyCycle(kMaxFanSpeedPercent);
+    } else {
+      float intensity = 0.0f;
+      for (int z = 0; z < topology_.zone_count; z++) {
+        if (fan_zone_mask_[i] & (1 << z)) {
+          intensity = max(intensity, (float)zone_target_fan_speed_[z]);
+        }
+      }
+      ApplyFanSpeed(config, i, intensity);
+    }
   }
 
-  for (size_t i = 0; i < pumps_.size(); i++) {
-    auto res = pumps_[i]->GetDutyCycle();
-    String str = res.ok() ? String(res.value(), 1) : "ERR";
-    log_msg += ", Pmp" + String(i + 1) + "=" + str + "%";
+  FanBankSnapshot bank;
+  FanBank::Instance().Snapshot(&bank);
+  for (int i = 0; i < fan_count_; i++) {
+    log_msg += String(", ") + topology_.fans[i].id + "=" +
+               String(bank.duty[fans_[i]->GetChannel()], 1) + "%";
   }
 
   Logger::println(log_msg);
 }
 
-void FanController::ApplyFanSpeed(const std::vector<PWMFan*>& fans,
-                                  float intensity, const String& type_name) {
-  for (size_t i = 0; i < fans.size(); i++) {
-    float min_duty = 0.0f;
-    StatusOr<float> min_res = fans[i]->GetMinDutyCycle();
-    if (min_res.ok()) min_duty = min_res.value();
+bool FanController::UpdateZone(const ControllerConfig& config, int zone,
+                               const float* temps, const bool* valid) {
+  const ZoneSpec& spec = topology_.zones[zone];
+  float values[kMaxSensors];
+  bool values_valid[kMaxSensors];
 
-    float target = min_duty + (intensity / 100.0f) * (100.0f - min_duty);
-    Status status = fans[i]->SetTargetDutyCycle(target);
+  // Aggregate coolant temperature over the sensors that currently work
+  for (int i = 0; i < spec.sensor_count; i++) {
+    values[i] = temps[spec.sensors[i]];
+    values_valid[i] = spec.sensors[i] < sensor_count_ && valid[spec.sensors[i]];
+  }
+  float coolant_temp = 0.0f;
+  if (!AggregateReadings(spec.aggregation, values, values_valid, spec.weights,
+                         spec.sensor_count, &coolant_temp)) {
+    Logger::println(String("FanController: All coolant sensors failed in ") +
+                    spec.id + "!");
+    return false;
+  }
 
-    if (!status.ok()) {
-      Logger::println(String("FanController: ") + type_name + " " +
-                      String(i + 1) + " error: " + status.message());
+  // Reference temperature (mean); a zone without references only uses the
+  // absolute water temperature
+  float delta_t = 0.0f;
+  if (spec.reference_count > 0) {
+    for (int i = 0; i < spec.reference_count; i++) {
+      values[i] = temps[spec.references[i]];
+      values_valid[i] =
+          spec.references[i] < sensor_count_ && valid[spec.references[i]];
+    }
+    float reference_temp = 0.0f;
+    if (!AggregateReadings(kAggregationMean, values, values_valid, nullptr,
+                           spec.reference_count, &reference_temp)) {
+      Logger::println(String("FanController: Reference sensors failed in ") +
+                      spec.id + "!");
+      return false;
     }
+    delta_t = coolant_temp - reference_temp;
   }
-}
-
-float FanController::CalculateFanSpeed(float delta_t, float water_temp) {
-  // Hybrid formula: considers both deltaT and absolute water temperature
-  // This ensures fans ramp up earlier on hot ambient days
 
-  // Factor 1: DeltaT contribution (0.0 to 1.0)
-  if (delta_t < kMinDeltaT) delta_t = kMinDeltaT;
-  float delta_t_factor = (delta_t - kMinDeltaT) / (kMaxDeltaT - kMinDeltaT);
-  if (delta_t_factor > 1.0f) delta_t_factor = 1.0f;
+  // Ensure DeltaT is not negative
+  if (delta_t < 0.0f) {
+    delta_t = 0.0f;
+  }
 
-  // Factor 2: Absolute water temperature contribution (0.0 to 1.0)
-  float water_temp_factor =
-      (water_temp - kBaseWaterTemp) / (kMaxWaterTemp - kBaseWaterTemp);
-  if (water_temp_factor > 1.0f) water_temp_factor = 1.0f;
-  if (water_temp_factor < 0.0f) water_temp_factor = 0.0f;
+  zone_delta_t_[zone] = delta_t;
+  zone_target_fan_speed_[zone] =
+      CalculateFanSpeed(config, delta_t, coolant_temp);
+  return true;
+}
 
-  // Combine factors with weighting
-  float combined_factor =
-      (kDeltaTWeight * delta_t_factor) + (kWaterTempWeight * water_temp_factor);
+void FanController::ApplyFanSpeed(const ControllerConfig& config, int channel,
+                                  float intensity) {
+  PWMFan* fan = fans_[channel];
+  float min_duty = applied_min_duty_[channel];
+
+  // Push a changed minimum down to the fan so its own clamp agrees
+  if (config.min_duty_percent[channel] != min_duty) {
+    Status status = fan->SetMinDutyCycle(config.min_duty_percent[channel]);
+    if (status.ok()) {
+      min_duty = config.min_duty_percent[channel];
+      applied_min_duty_[channel] = min_duty;
+    } else {
+      Logger::println(String("FanController: ") + topology_.fans[channel].id +
+                      " min error: " + status.message());
+    }
+  }
 
-  // Calculate final speed intensity (0-100%)
-  float speed = combined_factor * 100.0f;
+  float target = ScaleToMinimumDuty(intensity, min_duty);
+  Status status = fan->SetTargetDutyCycle(target);
 
-  // Clamp to valid range
-  if (speed < 0.0f) {
-    speed = 0.0f;
+  if (!status.ok()) {
+    Logger::println(String("FanController: ") + topology_.fans[channel].id +
+                    " error: " + status.message());
   }
-  if (speed > 100.0f) {
-    speed = 100.0f;
-  }
-
-  return speed;
 }
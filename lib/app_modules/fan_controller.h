@@ -7,104 +7,154 @@
 
 #include <vector>
 
+#include "controller_config.h"
 #include "pwm_fan.h"
+#include "rcu_cell.h"
+#include "status.h"
 #include "thermistor.h"
+#include "topology.h"
 
 // FanController - Automatic fan speed control based on water cooling
 // temperatures
 //
-// Controls 3 case fans and 1 water pump based on coolant and ambient
-// temperatures. Uses a hybrid algorithm that considers both temperature
+// Controls any number of fans and pumps (up to kMaxFanChannels) from any
+// number of thermistors (up to kMaxSensors), grouped into zones by a Topology.
+// Each zone uses a hybrid algorithm that considers both temperature
 // differential (DeltaT) and absolute water temperature to handle varying
 // ambient conditions.
 //
-// Temperature Inputs:
-// - Ambient (A0): Outside air temperature
-// - Coolant In (A1): Water temperature before CPU/GPU
-// - Coolant Out (A2): Water temperature after CPU/GPU and radiator
+// Zones (see topology.h):
+// - Reference sensors (e.g. ambient air) are averaged
+// - Coolant sensors are combined with the zone's aggregation (max, mean or
+//   weighted mean) over the sensors currently reporting valid readings
+// - DeltaT = aggregated coolant temperature - reference temperature
+// - A fan follows the highest intensity of the zones it belongs to
 //
 // Speed Calculation:
 // Fan speed is determined by weighted combination of two factors:
-// - DeltaT Factor (70% weight): Difference between ambient and highest water
-// temp
-//   * 0°C DeltaT = minimum speed, 10°C+ DeltaT = maximum contribution
-// - Water Temp Factor (30% weight): Absolute water temperature boost
-//   * 22°C water = baseline, 35°C+ water = maximum contribution
+// - DeltaT Factor: Difference between reference and aggregated water temp
+// - Water Temp Factor: Absolute water temperature boost
+// (see CalculateFanSpeed in controller_config.h for the exact curve)
 //
 // This hybrid approach ensures fans ramp up appropriately even when ambient is
 // warm (e.g., 26°C ambient, 32°C water yields higher fan speed than pure DeltaT
 // would suggest)
 //
 // Configuration:
-// - Fans 1-3: 35% minimum speed (case fans)
-// - Fan 4 (pump): 50% minimum speed (never drops below for flow assurance)
-// - Update interval: 1 second
-// - Error handling: Sets all fans to 100% if any thermistor reports error
+// - Weights, thresholds, update interval and per-channel minimum speeds live in
+//   a ControllerConfig published through an RcuCell. The control task pins one
+//   consistent copy per tick without taking a lock; UpdateConfig() swaps in a
+//   new copy that takes effect on the next tick.
+// - The config is persisted to LittleFS (/controller_config.bin) and restored
+//   by Start(). Minimum speeds default to the topology's fan minimums.
+// - Error handling: Sets a zone's fans to 100% if all of its coolant sensors
+//   or all of its reference sensors report errors
+//
+// Per-fan state is kept in fixed arrays indexed by topology fan index, so a
+// control tick is a single pass over the channels.
 //
 class FanController {
  public:
-  // Constructor takes vectors of fans and pumps
-  // Pumps have special minimum speed requirements and are not controlled by
-  // temperature
-  FanController(const std::vector<PWMFan*>& fans,
-                const std::vector<PWMFan*>& pumps, Thermistor* ambient_temp,
-                Thermistor* coolant_in_temp, Thermistor* coolant_out_temp);
+  // fans[i] and sensors[i] are the devices described by topology.fans[i] and
+  // topology.sensors[i].
+  FanController(const Topology& topology, const std::vector<PWMFan*>& fans,
+                const std::vector<Thermistor*>& sensors);
 
   ~FanController();
 
   // Start the control task
   void Start();
 
-  // Get the current DeltaT (temperature differential)
-  float GetDeltaT() const { return current_delta_t_; }
+  // Get the current DeltaT (highest across zones)
+  float GetDeltaT() const;
+
+  // Get the current target fan speed percentage (highest across zones)
+  float GetTargetFanSpeed() const;
+
+  // Per zone DeltaT and target intensity
+  int GetZoneCount() const { return topology_.zone_count; }
+  float GetZoneDeltaT(int zone) const { return zone_delta_t_[zone]; }
+  float GetZoneTargetFanSpeed(int zone) const {
+    return zone_target_fan_speed_[zone];
+  }
+
+  // Get a copy of the active configuration
+  ControllerConfig GetConfig() const { return config_.Snapshot(); }
+
+  // Validate, publish and persist a new configuration. Takes effect on the
+  // next control tick. InvalidArgument if it was rejected; any other error
+  // says whether it is live. A pump's minimum may not go below its topology
+  // min_duty.
+  Status UpdateConfig(const ControllerConfig& config);
+
+  // Number of controlled channels (topology fans, including pumps)
+  int GetChannelCount() const { return fan_count_; }
+
+  // The sensors, fans and zones controlled
+  const Topology& GetTopology() const { return topology_; }
 
-  // Get the current target fan speed percentage
-  float GetTargetFanSpeed() const { return target_fan_speed_; }
+  // Control ticks completed since Start(); changes once per update interval
+  uint32_t GetTickCount() const { return tick_count_; }
+
+  // Failed readings of topology sensor `i` since Start()
+  uint32_t GetSensorErrorCount(int i) const { return sensor_errors_[i]; }
+
+  // Time the control task spent in its ticks since Start(); wraps like
+  // micros()
+  uint32_t GetTickTimeUsTotal() const { return tick_time_us_total_; }
 
  private:
-  // Fan pointers
-  std::vector<PWMFan*> fans_;
-  std::vector<PWMFan*> pumps_;
+  Topology topology_;
+
+  // Per-channel state, indexed by topology fan index
+  int fan_count_;
+  PWMFan* fans_[kMaxFanChannels];
+  uint8_t fan_zone_mask_[kMaxFanChannels];  // Bit z set: fan is in zone z
+  float applied_min_duty_[kMaxFanChannels];  // Last minimum pushed to the fan
+  float min_duty_floor_[kMaxFanChannels];    // Lowest configurable minimum
 
-  // Thermistor pointers
-  Thermistor* ambient_temp_;
-  Thermistor* coolant_in_temp_;
-  Thermistor* coolant_out_temp_;
+  // Sensors, indexed by topology sensor index
+  int sensor_count_;
+  Thermistor* sensors_[kMaxSensors];
+  uint32_t failed_sensor_mask_;  // Bit i set: sensor i failed last tick
+  volatile uint32_t sensor_errors_[kMaxSensors];
 
   // Current state
-  volatile float current_delta_t_;
-  volatile float target_fan_speed_;
+  volatile float zone_delta_t_[kMaxZones];
+  volatile float zone_target_fan_speed_[kMaxZones];
+  volatile uint32_t tick_count_;
+  volatile uint32_t tick_time_us_total_;
 
   // FreeRTOS task handle
   TaskHandle_t control_task_handle_;
 
-  // Control parameters
+  // Active control parameters (lock-free for the control task)
+  RcuCell<ControllerConfig> config_;
+
   static constexpr float kMaxFanSpeedPercent = 100.0f;
-  static constexpr float kMinDeltaT =
-      5.0f;  // DeltaT below which kDeltaTWeight has no effect
-  static constexpr float kMaxDeltaT = 8.0f;  // DeltaT at which fans run at 100%
-  static constexpr float kBaseWaterTemp =
-      25.0f;  // Reference water temp (comfortable baseline)
-  static constexpr float kMaxWaterTemp =
-      30.0f;  // Water temp at which we add maximum boost
-  static constexpr float kDeltaTWeight = 0.4f;  // 40% weight on deltaT
-  static constexpr float kWaterTempWeight =
-      0.6f;  // 60% weight on absolute water temp
-  static constexpr unsigned long kUpdateIntervalMs =
-      1000;  // Update every second
+  static constexpr const char* kConfigPath = "/controller_config.bin";
 
   // FreeRTOS task function
   static void ControlTask(void* parameter);
 
   // Update fan speeds based on current temperatures
-  void UpdateFanSpeeds();
+  void UpdateFanSpeeds(const ControllerConfig& config);
+
+  // Compute a zone's intensity from this tick's sensor readings. Returns false
+  // if the zone has no usable coolant or reference reading.
+  bool UpdateZone(const ControllerConfig& config, int zone, const float* temps,
+                  const bool* valid);
+
+  // Helper to apply an intensity to one channel, scaled to its minimum
+  void ApplyFanSpeed(const ControllerConfig& config, int channel,
+                     float intensity);
 
-  // Helper to apply speed to a group of fans
-  void ApplyFanSpeed(const std::vector<PWMFan*>& fans, float intensity,
-                     const String& type_name);
+  // Build the defaults, taking minimum speeds from the topology
+  ControllerConfig MakeDefaultConfig(const Topology& topology) const;
 
-  // Calculate target fan speed based on DeltaT and water temperature
-  float CalculateFanSpeed(float delta_t, float water_temp);
+  // Persist / restore the active configuration
+  Status SaveConfig(const ControllerConfig& config);
+  Status LoadConfig();
 };
 
 #endif  // FAN_CONTROLLER_H
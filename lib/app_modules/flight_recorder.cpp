@@ -0,0 +1,383 @@
+#include "flight_recorder.h"
+
+#include <LittleFS.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+
+#include <algorithm>
+
+#include "logger.h"
+
+// Sample rate and ring size. At 50 Hz with 4 fans and 3 sensors a sample is
+// 18 bytes, so 16 KiB holds about 18 s.
+#ifndef FLIGHT_RECORDER_RATE_HZ
+#define FLIGHT_RECORDER_RATE_HZ 50
+#endif
+#ifndef FLIGHT_RECORDER_BYTES
+#define FLIGHT_RECORDER_BYTES 16384
+#endif
+
+// Capture window around a trigger
+#define FLIGHT_RECORDER_PRE_MS 10000
+#define FLIGHT_RECORDER_POST_MS 5000
+
+#define FLIGHT_RECORDER_HOLDOFF_MS 60000  // Min time between captures
+#define FLIGHT_RECORDER_MAX_CAPTURES 8    // Older capture files are deleted
+#define FLIGHT_RECORDER_MAX_SLOPE 0.5f    // C/s
+#define FLIGHT_RECORDER_SLOPE_WINDOW_S 5
+
+#define CAPTURE_PREFIX "perf_capture_"
+#define MIN_VALID_UNIX_TIME 1577836800  // 2020-01-01; earlier means no NTP yet
+
+namespace {
+
+// The ring's storage; static so its size shows up in the link map
+uint8_t ring_storage[FLIGHT_RECORDER_BYTES];
+
+// Index of a capture file name (with or without leading slash), or -1
+int ParseCaptureIndex(const String& name) {
+  int start = name.startsWith("/") ? 1 : 0;
+  int prefix_len = strlen(CAPTURE_PREFIX);
+  if (name.substring(start, start + prefix_len) != CAPTURE_PREFIX ||
+      !name.endsWith(".dat")) {
+    return -1;
+  }
+  return name.substring(start + prefix_len, name.length() - 4).toInt();
+}
+
+uint8_t EncodeDutyCycle(float duty_percent) {
+  if (duty_percent < 0.0f) return 0;
+  if (duty_percent > 100.0f) return 255;
+  return (uint8_t)(duty_percent * 255.0f / 100.0f);
+}
+
+}  // namespace
+
+FlightRecorder* FlightRecorder::instance_ = nullptr;
+
+FlightRecorder::FlightRecorder(const std::vector<PWMFan*>& fans,
+                               const std::vector<Thermistor*>& thermistors,
+                               uint32_t boot_id)
+    : fan_count_(std::min((int)fans.size(), kMaxFanChannels)),
+      sensor_count_(std::min((int)thermistors.size(), kMaxSensors)),
+      boot_id_(boot_id),
+      sample_size_(FlightSampleSize(fan_count_, sensor_count_)),
+      ring_(ring_storage, sizeof(ring_storage), sample_size_,
+            FLIGHT_RECORDER_PRE_MS * FLIGHT_RECORDER_RATE_HZ / 1000,
+            FLIGHT_RECORDER_POST_MS * FLIGHT_RECORDER_RATE_HZ / 1000),
+      detector_(FLIGHT_RECORDER_MAX_SLOPE, FLIGHT_RECORDER_SLOPE_WINDOW_S),
+      last_trigger_ms_(0),
+      pending_reason_(kFlightTriggerNone),
+      pending_index_(0),
+      capture_state_(kCaptureIdle),
+      writer_task_handle_(nullptr),
+      next_index_(0) {
+  for (int i = 0; i < fan_count_; i++) {
+    fans_[i] = fans[i];
+    last_pulses_[i] = 0;  // Set by Start()
+  }
+  for (int i = 0; i < sensor_count_; i++) thermistors_[i] = thermistors[i];
+  memset(&capture_, 0, sizeof(capture_));
+  memset(&stats_, 0, sizeof(stats_));
+  captures_mutex_ = xSemaphoreCreateMutex();
+}
+
+void FlightRecorder::Start() {
+  // Pulse deltas start from the current counts
+  float duty[kMaxBankChannels];
+  uint32_t pulses[kMaxBankChannels];
+  FanBank::Instance().SampleCounters(duty, pulses);
+  for (int i = 0; i < fan_count_; i++) {
+    last_pulses_[i] = pulses[fans_[i]->GetChannel()];
+  }
+
+  // Catalog the captures of earlier boots
+  File root = LittleFS.open("/");
+  File file = root.openNextFile();
+  while (file) {
+    int index = ParseCaptureIndex(file.name());
+    if (index >= 0) {
+      FlightCaptureInfo info;
+      memset(&info, 0, sizeof(info));
+      info.index = index;
+      info.bytes = file.size();
+      FlightCaptureHeader header;
+      if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+          header.magic == kFlightCaptureMagic) {
+        info.boot_id = header.boot_id;
+        info.trigger_uptime_ms = header.trigger_uptime_ms;
+        info.reason = header.reason;
+        info.reason_index = header.reason_index;
+      }
+      captures_.push_back(info);
+      next_index_ = std::max(next_index_, index + 1);
+    }
+    file = root.openNextFile();
+  }
+  std::sort(captures_.begin(), captures_.end(),
+            [](const FlightCaptureInfo& a, const FlightCaptureInfo& b) {
+              return a.index < b.index;
+            });
+
+  Logger::printf(
+      "FlightRecorder: %d Hz, %u bytes per sample, %d samples in RAM, "
+      "%d captures on flash",
+      FLIGHT_RECORDER_RATE_HZ, (unsigned)sample_size_, ring_.capacity(),
+      (int)captures_.size());
+
+  xTaskCreate(WriterTask, "FlightWriteTask", 4096, this, 1,
+              &writer_task_handle_);
+  // Above the 1 s tasks, so the sample period stays steady
+  xTaskCreate(SamplingTask, "FlightSampleTask", 4096, this, 2, NULL);
+  instance_ = this;
+}
+
+void FlightRecorder::Trigger(FlightTriggerReason reason, int index) {
+  FlightRecorder* recorder = instance_;
+  if (recorder == nullptr) return;
+  portENTER_CRITICAL(&recorder->lock_);
+  if (recorder->pending_reason_ == kFlightTriggerNone) {
+    recorder->pending_reason_ = reason;
+    recorder->pending_index_ = index;
+  } else {
+    recorder->stats_.triggers_ignored++;
+  }
+  portEXIT_CRITICAL(&recorder->lock_);
+}
+
+FlightRecorderStats FlightRecorder::GetStats() const {
+  portENTER_CRITICAL(&lock_);
+  FlightRecorderStats stats = stats_;
+  portEXIT_CRITICAL(&lock_);
+  return stats;
+}
+
+std::vector<FlightCaptureInfo> FlightRecorder::GetCaptures() const {
+  xSemaphoreTake(captures_mutex_, portMAX_DELAY);
+  std::vector<FlightCaptureInfo> captures = captures_;
+  xSemaphoreGive(captures_mutex_);
+  return captures;
+}
+
+void FlightRecorder::SamplingTask(void* parameter) {
+  FlightRecorder* recorder = (FlightRecorder*)parameter;
+
+  TickType_t xLastWakeTime;
+  const TickType_t xFrequency = pdMS_TO_TICKS(1000 / FLIGHT_RECORDER_RATE_HZ);
+  xLastWakeTime = xTaskGetTickCount();
+  int ticks = 0;
+
+  for (;;) {
+    vTaskDelayUntil(&xLastWakeTime, xFrequency);
+
+    unsigned long start_us = micros();
+    uint64_t uptime_ms = esp_timer_get_time() / 1000;
+
+    // Take the ring back once WriterTask is done with it
+    if (recorder->capture_state_ == kCaptureWritten) {
+      recorder->ring_.Release();
+      recorder->capture_state_ = kCaptureIdle;
+    }
+
+    bool stored = recorder->TakeSample(uptime_ms);
+    if (++ticks >= FLIGHT_RECORDER_RATE_HZ) {
+      ticks = 0;
+      recorder->CheckTriggers();
+    }
+    recorder->HandleTrigger(uptime_ms);
+
+    if (recorder->ring_.frozen() &&
+        recorder->capture_state_ == kCaptureIdle) {
+      recorder->capture_state_ = kCaptureWriting;
+      xTaskNotifyGive(recorder->writer_task_handle_);
+    }
+
+    uint32_t elapsed_us = micros() - start_us;
+    portENTER_CRITICAL(&recorder->lock_);
+    if (stored) {
+      recorder->stats_.samples++;
+    } else {
+      recorder->stats_.samples_dropped++;
+    }
+    recorder->stats_.sample_time_us_total += elapsed_us;
+    if (elapsed_us > recorder->stats_.sample_time_us_max) {
+      recorder->stats_.sample_time_us_max = elapsed_us;
+    }
+    portEXIT_CRITICAL(&recorder->lock_);
+  }
+}
+
+bool FlightRecorder::TakeSample(uint64_t uptime_ms) {
+  float duty[kMaxBankChannels];
+  uint32_t pulses[kMaxBankChannels];
+  FanBank::Instance().SampleCounters(duty, pulses);
+
+  uint8_t sample[FlightSampleSize(kMaxFanChannels, kMaxSensors)];
+  uint32_t uptime = (uint32_t)uptime_ms;
+  memcpy(sample, &uptime, sizeof(uptime));
+  uint8_t* duties = sample + sizeof(uptime);
+  uint8_t* deltas = duties + fan_count_;
+  for (int i = 0; i < fan_count_; i++) {
+    uint8_t ch = fans_[i]->GetChannel();
+    uint32_t delta = pulses[ch] - last_pulses_[i];
+    last_pulses_[i] = pulses[ch];
+    duties[i] = EncodeDutyCycle(duty[ch]);
+    deltas[i] = delta > UINT8_MAX ? UINT8_MAX : (uint8_t)delta;
+  }
+  uint8_t* millivolts = deltas + fan_count_;
+  for (int i = 0; i < sensor_count_; i++) {
+    uint32_t mv = thermistors_[i]->ReadMilliVolts();
+    uint16_t value = mv > UINT16_MAX ? UINT16_MAX : (uint16_t)mv;
+    memcpy(millivolts + i * sizeof(value), &value, sizeof(value));
+  }
+
+  return ring_.Add(sample);
+}
+
+void FlightRecorder::CheckTriggers() {
+  FanBankSnapshot bank;
+  FanBank::Instance().Snapshot(&bank);
+  int32_t rpm[kMaxFanChannels];
+  for (int i = 0; i < fan_count_; i++) {
+    rpm[i] = bank.rpm[fans_[i]->GetChannel()];
+  }
+
+  float temps[kMaxSensors];
+  bool valid[kMaxSensors];
+  for (int i = 0; i < sensor_count_; i++) {
+    StatusOr<float> t = thermistors_[i]->GetSampledTemperature();
+    valid[i] = t.ok();
+    temps[i] = valid[i] ? t.value() : 0.0f;
+  }
+
+  int index = 0;
+  FlightTriggerReason reason = detector_.Check(rpm, fan_count_, temps, valid,
+                                               sensor_count_, &index);
+  if (reason != kFlightTriggerNone) Trigger(reason, index);
+}
+
+void FlightRecorder::HandleTrigger(uint64_t uptime_ms) {
+  portENTER_CRITICAL(&lock_);
+  FlightTriggerReason reason = pending_reason_;
+  int index = pending_index_;
+  pending_reason_ = kFlightTriggerNone;
+  portEXIT_CRITICAL(&lock_);
+  if (reason == kFlightTriggerNone) return;
+
+  bool holdoff = last_trigger_ms_ != 0 &&
+                 uptime_ms - last_trigger_ms_ < FLIGHT_RECORDER_HOLDOFF_MS;
+  bool started = !holdoff && ring_.Trigger();
+  portENTER_CRITICAL(&lock_);
+  if (started) {
+    stats_.triggers++;
+  } else {
+    stats_.triggers_ignored++;
+  }
+  portEXIT_CRITICAL(&lock_);
+  if (!started) return;
+
+  last_trigger_ms_ = uptime_ms;
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+
+  // Filled in now; WriterTask adds the sample counts
+  capture_.magic = kFlightCaptureMagic;
+  capture_.version = kFlightCaptureVersion;
+  capture_.header_size = sizeof(FlightCaptureHeader);
+  capture_.fan_count = fan_count_;
+  capture_.sensor_count = sensor_count_;
+  capture_.sample_size = sample_size_;
+  capture_.sample_rate_hz = FLIGHT_RECORDER_RATE_HZ;
+  capture_.reason = reason;
+  capture_.reason_index = index;
+  capture_.boot_id = boot_id_;
+  capture_.trigger_uptime_ms = uptime_ms;
+  capture_.trigger_wall_clock_ms =
+      tv.tv_sec < MIN_VALID_UNIX_TIME
+          ? 0
+          : (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  Logger::printf("FlightRecorder: %s trigger (%d), capturing",
+                 FlightTriggerName(reason), index);
+}
+
+void FlightRecorder::WriterTask(void* parameter) {
+  FlightRecorder* recorder = (FlightRecorder*)parameter;
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (recorder->capture_state_ != kCaptureWriting) continue;
+
+    // The frozen ring is ours until capture_state_ says written
+    unsigned long start_us = micros();
+    recorder->WriteCapture();
+    uint32_t elapsed_us = micros() - start_us;
+
+    portENTER_CRITICAL(&recorder->lock_);
+    recorder->stats_.write_time_us_last = elapsed_us;
+    if (elapsed_us > recorder->stats_.write_time_us_max) {
+      recorder->stats_.write_time_us_max = elapsed_us;
+    }
+    portEXIT_CRITICAL(&recorder->lock_);
+
+    recorder->capture_state_ = kCaptureWritten;
+  }
+}
+
+void FlightRecorder::WriteCapture() {
+  const uint8_t* first;
+  const uint8_t* second;
+  size_t first_bytes, second_bytes;
+  uint32_t trigger_sample;
+  ring_.GetCapture(&first, &first_bytes, &second, &second_bytes,
+                   &trigger_sample);
+  FlightCaptureHeader header = capture_;
+  header.sample_count = ring_.capture_samples();
+  header.trigger_sample = trigger_sample;
+
+  xSemaphoreTake(captures_mutex_, portMAX_DELAY);
+  int index = next_index_++;
+  xSemaphoreGive(captures_mutex_);
+
+  String path = GetFileName(index);
+  File f = LittleFS.open(path, "w");
+  size_t expected = sizeof(header) + first_bytes + second_bytes;
+  size_t written = 0;
+  if (f) {
+    written = f.write((const uint8_t*)&header, sizeof(header));
+    written += f.write(first, first_bytes);
+    if (second_bytes > 0) written += f.write(second, second_bytes);
+    f.close();
+  }
+  if (written != expected) {
+    Logger::println("FlightRecorder: Failed to write " + path);
+    LittleFS.remove(path);
+    return;
+  }
+
+  FlightCaptureInfo info;
+  info.index = index;
+  info.bytes = written;
+  info.boot_id = header.boot_id;
+  info.trigger_uptime_ms = header.trigger_uptime_ms;
+  info.reason = header.reason;
+  info.reason_index = header.reason_index;
+
+  // Keep the newest captures only
+  xSemaphoreTake(captures_mutex_, portMAX_DELAY);
+  captures_.push_back(info);
+  while ((int)captures_.size() > FLIGHT_RECORDER_MAX_CAPTURES) {
+    LittleFS.remove(GetFileName(captures_.front().index));
+    captures_.erase(captures_.begin());
+  }
+  xSemaphoreGive(captures_mutex_);
+
+  portENTER_CRITICAL(&lock_);
+  stats_.captures_written++;
+  portEXIT_CRITICAL(&lock_);
+  Logger::println("FlightRecorder: Wrote " + path + " (" + String(written) +
+                  " bytes)");
+}
+
+String FlightRecorder::GetFileName(int index) {
+  return "/" CAPTURE_PREFIX + String(index) + ".dat";
+}
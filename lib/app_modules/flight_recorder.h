@@ -0,0 +1,141 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <vector>
+
+#include "flight_capture.h"
+#include "pwm_fan.h"
+#include "thermistor.h"
+#include "topology.h"
+
+// Sampling statistics, for measuring the cost of recording
+struct FlightRecorderStats {
+  uint32_t samples;          // Samples stored in the ring
+  uint32_t samples_dropped;  // Samples lost while a capture was being written
+  uint32_t sample_time_us_total;  // SamplingTask time spent per sample
+  uint32_t sample_time_us_max;
+  uint32_t triggers;          // Triggers that started a capture
+  uint32_t triggers_ignored;  // Triggers during a capture or the holdoff
+  uint32_t captures_written;
+  uint32_t write_time_us_last;  // Flash time of the last capture
+  uint32_t write_time_us_max;
+};
+
+// A capture file on LittleFS
+struct FlightCaptureInfo {
+  int index;  // "/perf_capture_<index>.dat"
+  uint32_t bytes;
+  uint32_t boot_id;
+  uint64_t trigger_uptime_ms;
+  uint8_t reason;  // FlightTriggerReason
+  uint8_t reason_index;
+};
+
+// FlightRecorder - High-rate ring buffer of fan and sensor signals, saved to
+// flash when something goes wrong
+//
+// The 1 s perf log cannot show what happens during a fan stall or a sensor
+// glitch. SamplingTask records every fan's duty cycle and tach pulses and
+// every thermistor's raw ADC millivolts at FLIGHT_RECORDER_RATE_HZ into a
+// FlightRing in a static FLIGHT_RECORDER_BYTES buffer (flight_capture.h), so
+// the RAM cost is fixed at build time.
+//
+// A trigger freezes FLIGHT_RECORDER_PRE_MS before and FLIGHT_RECORDER_POST_MS
+// after it, and WriterTask saves the window as "/perf_capture_<n>.dat"
+// (downloadable from the perf log server like the logs). Triggers are:
+// - a sensor starting to fail in FanController::UpdateFanSpeeds() (Trigger())
+// - a spinning fan's RPM dropping to 0, checked once a second
+// - a temperature changing faster than FLIGHT_RECORDER_MAX_SLOPE C/s over
+//   FLIGHT_RECORDER_SLOPE_WINDOW_S, checked once a second
+//
+// Samples arriving while a capture is being written are dropped (and
+// counted). Triggers within FLIGHT_RECORDER_HOLDOFF_MS of the last capture
+// are ignored, and only the newest FLIGHT_RECORDER_MAX_CAPTURES files are
+// kept, so a flapping sensor cannot wear out the flash.
+class FlightRecorder {
+ public:
+  FlightRecorder(const std::vector<PWMFan*>& fans,
+                 const std::vector<Thermistor*>& thermistors,
+                 uint32_t boot_id);
+
+  // Find existing captures and start recording; LittleFS must be mounted
+  void Start();
+
+  // Request a capture from any task. Does nothing until a recorder has
+  // started.
+  static void Trigger(FlightTriggerReason reason, int index);
+
+  // The started recorder, or nullptr
+  static FlightRecorder* Running() { return instance_; }
+
+  // Copy of the sampling statistics
+  FlightRecorderStats GetStats() const;
+
+  // Capture files, oldest first
+  std::vector<FlightCaptureInfo> GetCaptures() const;
+
+  // "/perf_capture_<index>.dat"
+  static String GetFileName(int index);
+
+  // Bytes per sample and samples the ring holds
+  size_t sample_size() const { return sample_size_; }
+  int ring_samples() const { return ring_.capacity(); }
+
+ private:
+  // Who owns the frozen ring: SamplingTask hands it to WriterTask and takes
+  // it back once the capture is on flash
+  enum CaptureState { kCaptureIdle, kCaptureWriting, kCaptureWritten };
+
+  // Task functions
+  static void SamplingTask(void* parameter);
+  static void WriterTask(void* parameter);
+
+  // Append one sample to the ring. Returns false if it was dropped.
+  bool TakeSample(uint64_t uptime_ms);
+
+  // Once a second: fan stall and temperature slope checks
+  void CheckTriggers();
+
+  // Start a capture for the pending trigger, if any
+  void HandleTrigger(uint64_t uptime_ms);
+
+  // Save the frozen ring as the next capture file
+  void WriteCapture();
+
+  static FlightRecorder* instance_;
+
+  PWMFan* fans_[kMaxFanChannels];
+  int fan_count_;
+  Thermistor* thermistors_[kMaxSensors];
+  int sensor_count_;
+  uint32_t boot_id_;
+
+  size_t sample_size_;
+  FlightRing ring_;                // Used by SamplingTask only
+  FlightTriggerDetector detector_;  // Used by SamplingTask only
+  uint32_t last_pulses_[kMaxFanChannels];
+  uint64_t last_trigger_ms_;  // 0 if none yet
+
+  // Trigger waiting for SamplingTask, and the capture it started
+  FlightTriggerReason pending_reason_;
+  int pending_index_;
+  FlightCaptureHeader capture_;
+
+  volatile CaptureState capture_state_;
+  TaskHandle_t writer_task_handle_;
+
+  std::vector<FlightCaptureInfo> captures_;  // Oldest first
+  int next_index_;
+  SemaphoreHandle_t captures_mutex_;  // Guards captures_ and next_index_
+  FlightRecorderStats stats_;
+
+  // Guards stats_ and the pending trigger
+  mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif  // FLIGHT_RECORDER_H
@@ -5,22 +5,78 @@
 #include <LittleFS.h>
 #include <WiFi.h>
 
+#include <cmath>
+
+#include "flight_recorder.h"
+#include "http_event_server.h"
+#include "http_router.h"
 #include "logger.h"
+#include "metrics_writer.h"
+#include "perf_logger.h"
 #include "secrets.h"
+#include "static_assets.h"
+#include "status_binary.h"
+#include "status_history.h"
+#include "status_json.h"
 #include "thermistor.h"
 
-WiFiServer server(80);  // Create server on port 80
+#define HTTP_PORT 80
+#define HTTP_MAX_CONNECTIONS 4  // lwIP has few sockets; others wait to connect
+                                // (up to 3 may be held by /api/events)
+#define HTTP_TIMEOUT_MS 5000    // To receive a request, or between sends
+#define HTTP_POLL_MS 10         // Longest wait for socket events per loop()
+
+// Connections stay open for the client's next request (an idle one gives its
+// slot up to a new client); 0 closes after every response
+#ifndef HTTP_KEEP_ALIVE_MS
+#define HTTP_KEEP_ALIVE_MS 5000
+#endif
+#ifndef HTTP_MAX_REQUESTS_PER_CONNECTION
+#define HTTP_MAX_REQUESTS_PER_CONNECTION 100
+#endif
+
+#define STATUS_JSON_BUFFER_BYTES 256  // On the loop task's stack
+#define STATUS_EVENT_RETRY_MS 3000     // EventSource reconnect delay
+
+// Most points /api/history returns (about 50 bytes each, held in RAM until
+// sent)
+#ifndef STATUS_HISTORY_MAX_POINTS
+#define STATUS_HISTORY_MAX_POINTS 300
+#endif
+
+// Room for the rendered /metrics body (a few KB with the default topology)
+#ifndef METRICS_BUFFER_BYTES
+#define METRICS_BUFFER_BYTES 8192
+#endif
+
+// Assets are revalidated on every use (a 304 from RAM when unchanged), so a
+// filesystem upload shows up on the next page load
+#ifndef STATIC_ASSET_CACHE_CONTROL
+#define STATIC_ASSET_CACHE_CONTROL "no-cache"
+#endif
+
+// Global pointers to fans (topology order)
+std::vector<PWMFan*> g_fans;
+
+// Global pointers to thermistors (topology order)
+std::vector<Thermistor*> g_thermistors;
+
+// Global pointer to the fan controller (for /api/config)
+FanController* g_controller = nullptr;
 
-// Global pointers to fans
-PWMFan* g_fan1 = nullptr;
-PWMFan* g_fan2 = nullptr;
-PWMFan* g_fan3 = nullptr;
-PWMFan* g_fan4 = nullptr;
+void addRoutes();
 
-// Global pointers to thermistors
-Thermistor* g_temp1 = nullptr;
-Thermistor* g_temp2 = nullptr;
-Thermistor* g_temp3 = nullptr;
+uint32_t httpClockMs() { return millis(); }
+
+// The web UI files, hashed at boot
+StaticAssetTable g_assets;
+
+// Every endpoint, this file's and those other modules add
+HttpRouter routes;
+
+// Serves every connection, on every port, from handle_http_request()
+HttpEventServer server(HTTP_MAX_CONNECTIONS, HTTP_TIMEOUT_MS,
+                       HttpRouter::Handle, &routes, httpClockMs);
 
 void setup_wifi() {
   // Check for default credentials
@@ -50,272 +106,755 @@ void setup_wifi() {
     Logger::println();
     Logger::println("WiFi connected successfully!");
     Logger::println(WiFi.localIP());
+
+    // Sync the wall clock (UTC) in the background; used to timestamp logs
+    configTime(0, 0, "pool.ntp.org");
   } else {
     Logger::println();
     Logger::println("Failed to connect to WiFi");
   }
 }
 
-void setup_http_server(PWMFan* fan1, PWMFan* fan2, PWMFan* fan3, PWMFan* fan4,
-                       Thermistor* temp1, Thermistor* temp2,
-                       Thermistor* temp3) {
+// Size and hash of a file, false if it cannot be opened
+bool hashFile(const String& path, uint32_t* size, uint32_t* hash) {
+  File file = LittleFS.open(path, "r");
+  if (!file || file.isDirectory()) return false;
+  uint8_t buffer[512];
+  *size = 0;
+  *hash = kStaticAssetHashSeed;
+  int n;
+  while ((n = file.read(buffer, sizeof(buffer))) > 0) {
+    *hash = StaticAssetHash(buffer, n, *hash);
+    *size += n;
+  }
+  file.close();
+  return true;
+}
+
+// Hash the web UI files once, for ETags
+void loadStaticAssets() {
+  struct AssetFile {
+    const char* path;
+    const char* content_type;
+  };
+  const AssetFile kAssets[] = {
+      {"/index.html", "text/html"},
+      {"/style.css", "text/css"},
+      {"/script.js", "application/javascript"},
+  };
+
+  g_assets.Clear();
+  for (const AssetFile& asset : kAssets) {
+    uint32_t size;
+    uint32_t hash;
+    if (!hashFile(asset.path, &size, &hash)) {
+      Logger::println(String("Missing web asset: ") + asset.path);
+      continue;
+    }
+    String gzip_path = String(asset.path) + ".gz";
+    uint32_t gzip_size = 0;
+    if (LittleFS.exists(gzip_path)) {
+      File file = LittleFS.open(gzip_path, "r");
+      gzip_size = file.size();
+      file.close();
+    }
+    g_assets.Add(asset.path, asset.content_type, hash, size, gzip_size);
+  }
+}
+
+void setup_http_server(const std::vector<PWMFan*>& fans,
+                       const std::vector<Thermistor*>& thermistors,
+                       FanController* controller) {
   // Store fan pointers
-  g_fan1 = fan1;
-  g_fan2 = fan2;
-  g_fan3 = fan3;
-  g_fan4 = fan4;
+  g_fans = fans;
 
   // Store thermistor pointers
-  g_temp1 = temp1;
-  g_temp2 = temp2;
-  g_temp3 = temp3;
+  g_thermistors = thermistors;
+
+  g_controller = controller;
 
-  // Initialize HTTP server
-  server.begin();
-  Logger::println("HTTP Server started on port 80");
+  // Initialize HTTP server, and the perf log downloads' old port
+  server.SetKeepAlive(HTTP_KEEP_ALIVE_MS, HTTP_MAX_REQUESTS_PER_CONNECTION);
+  if (server.Listen(HTTP_PORT)) {
+    Logger::println("HTTP Server started on port " + String(HTTP_PORT));
+  } else {
+    Logger::println("HTTP Server failed to listen on port " +
+                    String(HTTP_PORT));
+  }
+  if (!server.Listen(PerfLogger::kLegacyPort, PerfLogger::kRoutePrefix)) {
+    Logger::println("HTTP Server failed to listen on port " +
+                    String(PerfLogger::kLegacyPort));
+  }
 
   if (!LittleFS.begin()) {
     Logger::println("An Error has occurred while mounting LittleFS");
   }
+
+  loadStaticAssets();
+  addRoutes();
 }
 
-// Helper to serve file
-void serveFile(WiFiClient& client, const char* path, const char* contentType) {
-  if (LittleFS.exists(path)) {
-    File file = LittleFS.open(path, "r");
-    client.println("HTTP/1.1 200 OK");
-    client.println("Content-Type: " + String(contentType));
-    client.println("Connection: close");
-    client.println();
-    while (file.available()) {
-      client.write(file.read());
-    }
-    file.close();
-  } else {
-    client.println("HTTP/1.1 404 Not Found");
-    client.println("Connection: close");
-    client.println();
-    client.println("File Not Found");
+HttpRouter* http_routes() { return &routes; }
+
+// Streams an open file as a response body
+class FileBodySource : public HttpBodySource {
+ public:
+  explicit FileBodySource(File file) : file_(file) {}
+  ~FileBodySource() override { file_.close(); }
+
+  size_t Read(uint8_t* out, size_t size) override {
+    int n = file_.read(out, size);
+    return n > 0 ? n : 0;
   }
-  client.stop();
+
+ private:
+  File file_;
+};
+
+// Helper to serve a plain-text error
+void serveError(HttpResponse* response, const char* status,
+                const String& message) {
+  response->Begin(status, "Content-Type: text/plain\r\n");
+  response->Print((message + "\n").c_str());
 }
 
-// Helper to serve JSON status
-void serveJSONStatus(WiFiClient& client) {
-  client.println("HTTP/1.1 200 OK");
-  client.println("Content-Type: application/json");
-  client.println("Connection: close");
-  client.println();
+// Helper to serve a web UI file: the pre-gzipped variant when the client
+// takes it, or 304 when it already has the current one
+void serveAsset(HttpResponse* response, const HttpRequest& request,
+                const StaticAsset& asset) {
+  StaticAssetResponse answer = PrepareStaticAssetResponse(
+      asset, request.Header("Accept-Encoding"),
+      request.Header("If-None-Match"), STATIC_ASSET_CACHE_CONTROL);
+  if (answer.not_modified) {
+    response->Begin(answer.status, answer.headers);
+    return;
+  }
 
-  String json = "{";
+  String path = String(asset.path) + (answer.gzip ? ".gz" : "");
+  File file = LittleFS.open(path, "r");
+  if (!file || file.isDirectory()) {
+    serveError(response, "404 Not Found", "File Not Found");
+    return;
+  }
+  response->Begin(answer.status, answer.headers);
+  size_t size = file.size();
+  response->Stream(std::unique_ptr<HttpBodySource>(new FileBodySource(file)),
+                   size);
+}
 
-  // Thermistors
-  json += "\"thermistors\":[";
-  Thermistor* temps[3] = {g_temp1, g_temp2, g_temp3};
-  for (int i = 0; i < 3; i++) {
-    if (i > 0) json += ",";
-    json += "{";
-    if (temps[i]) {
-      json += "\"id\":\"" + temps[i]->GetId() + "\",";
-      StatusOr<float> t = temps[i]->GetSampledTemperature();
-      if (t.ok()) {
-        json += "\"temp\":\"" + String(t.value(), 1) + "\"";
-      } else {
-        json += "\"temp\":\"ERR\"";
-      }
-    } else {
-      json += "\"id\":\"Temp " + String(i + 1) + "\",\"temp\":\"N/A\"";
-    }
-    json += "}";
+// Appends writer output to a response body
+bool appendToResponse(const char* data, size_t size, void* context) {
+  ((HttpResponse*)context)->Write(data, size);
+  return true;
+}
+
+// The perf log's boot counter, which tells clients the log numbering
+// restarted; 0 when the perf logger is not running
+uint32_t bootId() {
+  PerfLogger* logger = PerfLogger::Running();
+  return logger != nullptr ? logger->GetBootId() : 0;
+}
+
+// Write the current status document
+void writeStatus(JsonWriter* json) {
+  StatusSensorReading sensors[kMaxSensors];
+  int sensorCount = min((int)g_thermistors.size(), kMaxSensors);
+  for (int i = 0; i < sensorCount; i++) {
+    StatusOr<float> t = g_thermistors[i]->GetSampledTemperature();
+    sensors[i].id = g_thermistors[i]->GetId().c_str();
+    sensors[i].ok = t.ok();
+    sensors[i].temp = t.ok() ? t.value() : 0.0f;
   }
-  json += "],";
 
-  // Fans
-  json += "\"fans\":[";
-  PWMFan* fans[4] = {g_fan1, g_fan2, g_fan3, g_fan4};
-  for (int i = 0; i < 4; i++) {
-    if (i > 0) json += ",";
-    json += "{";
-    if (fans[i]) {
-      StatusOr<float> d = fans[i]->GetDutyCycle();
-      StatusOr<int> r = fans[i]->GetRpm();
-      json += "\"duty\":\"" + (d.ok() ? String(d.value(), 1) : "ERR") + "\",";
-      json += "\"rpm\":\"" + (r.ok() ? String(r.value()) : "ERR") + "\"";
-    } else {
-      json += "\"duty\":\"N/A\",\"rpm\":\"N/A\"";
-    }
-    json += "}";
+  StatusFanReading fans[kMaxFanChannels];
+  int fanCount = min((int)g_fans.size(), kMaxFanChannels);
+  FanBankSnapshot bank;
+  FanBank::Instance().Snapshot(&bank);
+  for (int i = 0; i < fanCount; i++) {
+    uint8_t ch = g_fans[i]->GetChannel();
+    fans[i].duty = bank.duty[ch];
+    fans[i].rpm = bank.rpm[ch];
   }
-  json += "],";
 
-  // Logs
-  String logs = Logger::get();
-  logs.replace("\"", "\\\"");
-  logs.replace("\n", "\\n");
-  logs.replace("\r", "");
-  json += "\"logs\":\"" + logs + "\",";
+  StatusDocument status = {};
+  status.sensors = sensors;
+  status.sensor_count = sensorCount;
+  status.fans = fans;
+  status.fan_count = fanCount;
+  status.log_seq = Logger::sequence();
+  status.boot_id = bootId();
+#if ENABLE_OVERRIDING_FAN_SPEEDS
+  status.override_enabled = true;
+#endif
+  WriteStatusJson(status, json);
+}
+
+// Helper to serve JSON status, written straight into the response
+void serveJSONStatus(HttpResponse* response) {
+  response->Begin("200 OK", "Content-Type: application/json\r\n");
+  char buffer[STATUS_JSON_BUFFER_BYTES];
+  JsonWriter json(buffer, sizeof(buffer), appendToResponse, response);
+  writeStatus(&json);
+  json.Flush();
+}
 
+// Helper to serve the binary status (status_binary.h) for scrapers: the
+// JSON status plus targets, zones and controller state, encoded on the stack
+void serveBinaryStatus(HttpResponse* response) {
+  if (g_controller == nullptr) {
+    response->Begin("503 Service Unavailable");
+    return;
+  }
+  const Topology& topology = g_controller->GetTopology();
+  StatusBinaryState state = {};
+  state.uptime_ms = millis();
+  state.tick_count = g_controller->GetTickCount();
+  state.log_seq = Logger::sequence();
 #if ENABLE_OVERRIDING_FAN_SPEEDS
-  json += "\"overrideEnabled\":true";
-#else
-  json += "\"overrideEnabled\":false";
+  state.override_enabled = true;
 #endif
+  state.delta_t = g_controller->GetDeltaT();
+  state.target_intensity = g_controller->GetTargetFanSpeed();
+
+  state.sensor_count = min((int)g_thermistors.size(), kMaxSensors);
+  for (int i = 0; i < state.sensor_count; i++) {
+    StatusOr<float> t = g_thermistors[i]->GetSampledTemperature();
+    state.sensors[i].id = g_thermistors[i]->GetId().c_str();
+    state.sensors[i].ok = t.ok();
+    state.sensors[i].temp = t.ok() ? t.value() : 0.0f;
+  }
+
+  state.fan_count = min((int)g_fans.size(), topology.fan_count);
+  FanBankSnapshot bank;
+  FanBank::Instance().Snapshot(&bank);
+  for (int i = 0; i < state.fan_count; i++) {
+    StatusBinaryFanState& fan = state.fans[i];
+    uint8_t ch = g_fans[i]->GetChannel();
+    fan.id = topology.fans[i].id;
+    fan.duty = bank.duty[ch];
+    fan.target = bank.target[ch];
+    fan.rpm = bank.rpm[ch];
+    fan.overridden = g_fans[i]->IsOverridden();
+    fan.pump = topology.fans[i].is_pump;
+  }
 
-  json += "}";
-  client.print(json);
-  client.stop();
+  state.zone_count = topology.zone_count;
+  for (int z = 0; z < state.zone_count; z++) {
+    const ZoneSpec& zone = topology.zones[z];
+    state.zones[z].id = zone.id;
+    state.zones[z].delta_t = g_controller->GetZoneDeltaT(z);
+    state.zones[z].target_intensity = g_controller->GetZoneTargetFanSpeed(z);
+    for (int i = 0; i < zone.fan_count; i++) {
+      if (zone.fans[i] < state.fan_count) {
+        state.fans[zone.fans[i]].zone_mask |= 1 << z;
+      }
+    }
+  }
+
+  uint8_t buffer[kStatusBinaryMaxSize];
+  size_t size = EncodeStatusBinary(state, buffer, sizeof(buffer));
+  response->Begin("200 OK", "Content-Type: application/octet-stream\r\n");
+  response->Write(buffer, size);
 }
 
-void handle_http_request() {
-  // Check if a client has connected
-  WiFiClient client = server.available();
-
-  if (client) {
-    Logger::println("New client connected");
-
-    String request = "";
-    String postData = "";
-    String path = "/";
-    boolean isPost = false;
-    int contentLength = 0;
-
-    // Read the HTTP request
-    while (client.connected()) {
-      if (client.available()) {
-        String line = client.readStringUntil('\n');
-
-        if (line.startsWith("GET") || line.startsWith("POST")) {
-          request = line;
-          if (line.startsWith("POST")) {
-            isPost = true;
-          }
-          // Extract path
-          int space1 = line.indexOf(' ');
-          int space2 = line.indexOf(' ', space1 + 1);
-          if (space1 != -1 && space2 != -1) {
-            path = line.substring(space1 + 1, space2);
-          }
-        }
+// Helper to serve the log lines after ?after=N (all of them without it, or
+// when N is from before a reboot)
+void serveLogs(HttpResponse* response, const char* target) {
+  uint32_t after =
+      strtoul(HttpQueryParam(target, "after").c_str(), nullptr, 10);
+  if (after > Logger::sequence()) after = 0;
+
+  response->Begin("200 OK", "Content-Type: application/json\r\n");
+  char buffer[STATUS_JSON_BUFFER_BYTES];
+  JsonWriter json(buffer, sizeof(buffer), appendToResponse, response);
+  LogLinesJson lines;
+  BeginLogLinesJson(&lines, &json, after, bootId());
+  Logger::forEachAfter(after, AddLogLineJson, &lines);
+  EndLogLinesJson(&lines);
+  json.Flush();
+}
 
-        if (line.startsWith("Content-Length:")) {
-          contentLength = line.substring(15).toInt();
-        }
+// Helper to subscribe to status events (Server-Sent Events): the full status
+// now, then one event per control tick from publishStatusEvent()
+void serveStatusEvents(HttpResponse* response) {
+  response->Begin("200 OK",
+                  "Content-Type: text/event-stream\r\n"
+                  "Cache-Control: no-cache\r\n");
+  char buffer[STATUS_JSON_BUFFER_BYTES];
+  snprintf(buffer, sizeof(buffer), "retry: %d\ndata: ", STATUS_EVENT_RETRY_MS);
+  response->Print(buffer);
+  JsonWriter json(buffer, sizeof(buffer), appendToResponse, response);
+  writeStatus(&json);
+  json.Flush();
+  response->Print("\n\n");
+  response->Subscribe();
+}
 
-        // Empty line indicates end of headers
-        if (line == "\r" || line.length() == 1) {
-          // If POST, read the body
-          if (isPost && contentLength > 0) {
-            char bodyBuf[contentLength + 1];
-            int index = 0;
-            unsigned long timeout = millis() + 1000;
-            while (index < contentLength && millis() < timeout) {
-              if (client.available()) {
-                bodyBuf[index++] = client.read();
-              }
-            }
-            bodyBuf[index] = '\0';
-            postData = String(bodyBuf);
-          }
-          break;
-        }
+// Appends writer output to a std::string
+bool appendToString(const char* data, size_t size, void* context) {
+  ((std::string*)context)->append(data, size);
+  return true;
+}
+
+struct HistoryRequest {
+  JsonWriter* json;
+  int points;
+};
+
+// Writes the /api/history document while PerfLogger holds the history
+void writeHistory(const StatusHistory& history, void* context) {
+  HistoryRequest* request = (HistoryRequest*)context;
+  const char* ids[kMaxSensors];
+  int sensorCount = min((int)g_thermistors.size(), kMaxSensors);
+  for (int i = 0; i < sensorCount; i++) {
+    ids[i] = g_thermistors[i]->GetId().c_str();
+  }
+  WriteStatusHistoryJson(history, request->points, ids, sensorCount,
+                         g_fans.size(), request->json);
+  request->json->Flush();
+}
+
+// Helper to serve the recent history for the charts, reduced to ?points=N
+// (at most STATUS_HISTORY_MAX_POINTS, also the default)
+void serveHistory(HttpResponse* response, const char* target) {
+  PerfLogger* logger = PerfLogger::Running();
+  if (logger == nullptr) {
+    serveError(response, "503 Service Unavailable", "Perf logger not running");
+    return;
+  }
+  int points = atoi(HttpQueryParam(target, "points").c_str());
+  if (points <= 0 || points > STATUS_HISTORY_MAX_POINTS) {
+    points = STATUS_HISTORY_MAX_POINTS;
+  }
+
+  response->Begin("200 OK", "Content-Type: application/json\r\n");
+  char buffer[STATUS_JSON_BUFFER_BYTES];
+  JsonWriter json(buffer, sizeof(buffer), appendToResponse, response);
+  HistoryRequest request = {&json, points};
+  logger->ReadHistory(writeHistory, &request);
+}
+
+// Encode the status once per control tick and push it to every subscriber
+void publishStatusEvent() {
+  static uint32_t lastTick = 0;
+  static std::string frame;  // Keeps its capacity between ticks
+
+  if (g_controller == nullptr || server.subscribers() == 0) return;
+  uint32_t tick = g_controller->GetTickCount();
+  if (tick == lastTick) return;
+  lastTick = tick;
+
+  frame = "data: ";
+  char buffer[STATUS_JSON_BUFFER_BYTES];
+  JsonWriter json(buffer, sizeof(buffer), appendToString, &frame);
+  writeStatus(&json);
+  json.Flush();
+  frame += "\n\n";
+  server.Publish(frame.data(), frame.size());
+}
+
+// Writes the /metrics body (Prometheus text format) from the same sources as
+// the status endpoints, plus the counters of the tasks behind them
+void renderMetrics(MetricsWriter* metrics, void* context) {
+  (void)context;
+  const Topology& topology = g_controller->GetTopology();
+
+  int fanCount = min((int)g_fans.size(), topology.fan_count);
+  FanBankSnapshot bank;
+  FanBank::Instance().Snapshot(&bank);
+  metrics->Family("fan_controller_fan_duty_percent", "gauge",
+                  "Applied PWM duty cycle");
+  for (int i = 0; i < fanCount; i++) {
+    metrics->Sample("fan_controller_fan_duty_percent", "fan",
+                    topology.fans[i].id, bank.duty[g_fans[i]->GetChannel()]);
+  }
+  metrics->Family("fan_controller_fan_target_percent", "gauge",
+                  "Duty cycle the fan is ramping towards");
+  for (int i = 0; i < fanCount; i++) {
+    metrics->Sample("fan_controller_fan_target_percent", "fan",
+                    topology.fans[i].id, bank.target[g_fans[i]->GetChannel()]);
+  }
+  metrics->Family("fan_controller_fan_rpm", "gauge", "Tachometer speed");
+  for (int i = 0; i < fanCount; i++) {
+    metrics->Sample("fan_controller_fan_rpm", "fan", topology.fans[i].id,
+                    (int64_t)bank.rpm[g_fans[i]->GetChannel()]);
+  }
+  metrics->Family("fan_controller_fan_overridden", "gauge",
+                  "1 if the duty cycle is set by hand");
+  for (int i = 0; i < fanCount; i++) {
+    metrics->Sample("fan_controller_fan_overridden", "fan",
+                    topology.fans[i].id,
+                    (int64_t)(g_fans[i]->IsOverridden() ? 1 : 0));
+  }
+
+  // A failed sensor has no temperature sample
+  int sensorCount = min((int)g_thermistors.size(), kMaxSensors);
+  metrics->Family("fan_controller_temperature_celsius", "gauge",
+                  "Sampled sensor temperature");
+  for (int i = 0; i < sensorCount; i++) {
+    StatusOr<float> t = g_thermistors[i]->GetSampledTemperature();
+    if (!t.ok()) continue;
+    metrics->Sample("fan_controller_temperature_celsius", "sensor",
+                    g_thermistors[i]->GetId().c_str(), t.value());
+  }
+  metrics->Family("fan_controller_sensor_errors_total", "counter",
+                  "Failed sensor readings");
+  for (int i = 0; i < sensorCount; i++) {
+    metrics->Sample("fan_controller_sensor_errors_total", "sensor",
+                    g_thermistors[i]->GetId().c_str(),
+                    (int64_t)g_controller->GetSensorErrorCount(i));
+  }
+
+  metrics->Family("fan_controller_delta_t_celsius", "gauge",
+                  "Highest DeltaT across zones");
+  metrics->Sample("fan_controller_delta_t_celsius", g_controller->GetDeltaT());
+  metrics->Family("fan_controller_target_percent", "gauge",
+                  "Highest target intensity across zones");
+  metrics->Sample("fan_controller_target_percent",
+                  g_controller->GetTargetFanSpeed());
+  metrics->Family("fan_controller_zone_delta_t_celsius", "gauge",
+                  "Zone DeltaT");
+  for (int z = 0; z < topology.zone_count; z++) {
+    metrics->Sample("fan_controller_zone_delta_t_celsius", "zone",
+                    topology.zones[z].id, g_controller->GetZoneDeltaT(z));
+  }
+  metrics->Family("fan_controller_zone_target_percent", "gauge",
+                  "Zone target intensity");
+  for (int z = 0; z < topology.zone_count; z++) {
+    metrics->Sample("fan_controller_zone_target_percent", "zone",
+                    topology.zones[z].id,
+                    g_controller->GetZoneTargetFanSpeed(z));
+  }
+  metrics->Family("fan_controller_ticks_total", "counter",
+                  "Control ticks completed");
+  metrics->Sample("fan_controller_ticks_total",
+                  (int64_t)g_controller->GetTickCount());
+
+  // Time spent in each periodic task's work (each total wraps like micros())
+  PerfLogger* logger = PerfLogger::Running();
+  FlightRecorder* recorder = FlightRecorder::Running();
+  PerfLogStats log = logger != nullptr ? logger->GetStats() : PerfLogStats();
+  metrics->Family("fan_controller_task_busy_seconds_total", "counter",
+                  "Time a task spent working");
+  metrics->Sample("fan_controller_task_busy_seconds_total", "task", "control",
+                  g_controller->GetTickTimeUsTotal() / 1e6);
+  if (logger != nullptr) {
+    metrics->Sample("fan_controller_task_busy_seconds_total", "task",
+                    "perf_log", log.record_time_us_total / 1e6);
+    metrics->Sample("fan_controller_task_busy_seconds_total", "task",
+                    "perf_flush", log.flush_time_us_total / 1e6);
+  }
+  if (recorder != nullptr) {
+    metrics->Sample("fan_controller_task_busy_seconds_total", "task",
+                    "flight_sample",
+                    recorder->GetStats().sample_time_us_total / 1e6);
+  }
+
+  metrics->Family("fan_controller_uptime_seconds", "gauge", "Time since boot");
+  metrics->Sample("fan_controller_uptime_seconds", millis() / 1e3);
+  metrics->Family("fan_controller_heap_size_bytes", "gauge", "Heap size");
+  metrics->Sample("fan_controller_heap_size_bytes",
+                  (int64_t)ESP.getHeapSize());
+  metrics->Family("fan_controller_heap_free_bytes", "gauge", "Free heap");
+  metrics->Sample("fan_controller_heap_free_bytes",
+                  (int64_t)ESP.getFreeHeap());
+  metrics->Family("fan_controller_heap_min_free_bytes", "gauge",
+                  "Lowest free heap since boot");
+  metrics->Sample("fan_controller_heap_min_free_bytes",
+                  (int64_t)ESP.getMinFreeHeap());
+  metrics->Family("fan_controller_heap_max_alloc_bytes", "gauge",
+                  "Largest allocatable block");
+  metrics->Sample("fan_controller_heap_max_alloc_bytes",
+                  (int64_t)ESP.getMaxAllocHeap());
+
+  if (logger != nullptr) {
+    metrics->Family("fan_controller_perf_log_records_total", "counter",
+                    "Records accepted into the perf log buffer");
+    metrics->Sample("fan_controller_perf_log_records_total",
+                    (int64_t)log.records_logged);
+    metrics->Family("fan_controller_perf_log_records_dropped_total",
+                    "counter", "Perf log records lost before reaching flash");
+    metrics->Sample("fan_controller_perf_log_records_dropped_total",
+                    (int64_t)log.records_dropped);
+    metrics->Family("fan_controller_perf_log_rollups_dropped_total",
+                    "counter", "Perf log rollups lost before reaching flash");
+    metrics->Sample("fan_controller_perf_log_rollups_dropped_total",
+                    (int64_t)log.rollups_dropped);
+    metrics->Family("fan_controller_perf_log_flushes_total", "counter",
+                    "Perf log buffer flushes");
+    metrics->Sample("fan_controller_perf_log_flushes_total",
+                    (int64_t)log.flushes);
+    metrics->Family("fan_controller_perf_log_file_writes_total", "counter",
+                    "Perf log open/write/close cycles");
+    metrics->Sample("fan_controller_perf_log_file_writes_total",
+                    (int64_t)log.file_writes);
+    metrics->Family("fan_controller_perf_log_bytes_written_total", "counter",
+                    "Perf log bytes written to flash");
+    metrics->Sample("fan_controller_perf_log_bytes_written_total",
+                    (int64_t)log.bytes_written);
+    metrics->Family("fan_controller_perf_log_flush_seconds_max", "gauge",
+                    "Longest perf log flush");
+    metrics->Sample("fan_controller_perf_log_flush_seconds_max",
+                    log.flush_time_us_max / 1e6);
+  }
+
+  HttpServerStats http = server.stats();
+  metrics->Family("fan_controller_http_connections_total", "counter",
+                  "Connections accepted");
+  metrics->Sample("fan_controller_http_connections_total",
+                  (int64_t)http.connections);
+  metrics->Family("fan_controller_http_requests_total", "counter",
+                  "Requests handled");
+  metrics->Sample("fan_controller_http_requests_total",
+                  (int64_t)http.requests);
+  metrics->Family("fan_controller_http_bad_requests_total", "counter",
+                  "Malformed or oversized requests");
+  metrics->Sample("fan_controller_http_bad_requests_total",
+                  (int64_t)http.bad_requests);
+  metrics->Family("fan_controller_http_timeouts_total", "counter",
+                  "Connections closed at their deadline");
+  metrics->Sample("fan_controller_http_timeouts_total",
+                  (int64_t)http.timeouts);
+  metrics->Family("fan_controller_http_reused_requests_total", "counter",
+                  "Requests on a kept-alive connection");
+  metrics->Sample("fan_controller_http_reused_requests_total",
+                  (int64_t)http.reused);
+}
+
+// Helper to serve /metrics for Prometheus. The body is rendered at most once
+// per control tick into a static buffer; scrapes in between get a copy.
+void serveMetrics(HttpResponse* response) {
+  static char buffer[METRICS_BUFFER_BYTES];
+  static MetricsCache cache(buffer, sizeof(buffer));
+
+  if (g_controller == nullptr) {
+    cache.Invalidate();
+    response->Begin("503 Service Unavailable");
+    return;
+  }
+  size_t size;
+  const char* body =
+      cache.Get(g_controller->GetTickCount(), renderMetrics, nullptr, &size);
+  if (body == nullptr) {
+    Logger::println("Metrics do not fit METRICS_BUFFER_BYTES");
+    serveError(response, "500 Internal Server Error", "Metrics too large");
+    return;
+  }
+  response->Begin("200 OK",
+                  "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n");
+  response->Write(body, size);
+}
+
+// Helper to render the controller config as JSON
+String configToJSON(const ControllerConfig& config) {
+  String json = "{";
+  json += "\"update_interval_ms\":" + String(config.update_interval_ms) + ",";
+  json += "\"min_delta_t\":" + String(config.min_delta_t, 2) + ",";
+  json += "\"max_delta_t\":" + String(config.max_delta_t, 2) + ",";
+  json += "\"base_water_temp\":" + String(config.base_water_temp, 2) + ",";
+  json += "\"max_water_temp\":" + String(config.max_water_temp, 2) + ",";
+  json += "\"delta_t_weight\":" + String(config.delta_t_weight, 2) + ",";
+  json += "\"water_temp_weight\":" + String(config.water_temp_weight, 2) + ",";
+  json += "\"min_duty\":[";
+  int channels = min(g_controller->GetChannelCount(), kMaxFanChannels);
+  for (int i = 0; i < channels; i++) {
+    if (i > 0) json += ",";
+    json += String(config.min_duty_percent[i], 1);
+  }
+  json += "]}";
+  return json;
+}
+
+// Helper to serve the controller config
+// GET returns the active config, POST applies form fields on top of it, e.g.
+// max_delta_t=9&min_duty_4=55 (channels are 1-based: fans, then pumps)
+void serveConfig(HttpResponse* response, bool isPost, const String& postData) {
+  if (g_controller == nullptr) {
+    response->Begin("503 Service Unavailable");
+    return;
+  }
+
+  ControllerConfig config = g_controller->GetConfig();
+  Status status = OkStatus();
+
+  if (isPost) {
+    int start = 0;
+    while (status.ok() && start < (int)postData.length()) {
+      int end = postData.indexOf('&', start);
+      if (end < 0) end = postData.length();
+      String pair = postData.substring(start, end);
+      start = end + 1;
+
+      int eq = pair.indexOf('=');
+      if (eq <= 0) {
+        status = Status::InvalidArgument("Malformed field: " + pair);
+        continue;
+      }
+      String name = pair.substring(0, eq);
+      // The whole value must be a finite number ("", "abc" or "5x" is not 0)
+      String text = pair.substring(eq + 1);
+      char* parsed = nullptr;
+      float value = strtof(text.c_str(), &parsed);
+      if (text.length() == 0 || *parsed != '\0' || !std::isfinite(value)) {
+        status = Status::InvalidArgument("Malformed value for " + name);
+        continue;
+      }
+      const char* error =
+          SetControllerConfigField(&config, name.c_str(), value);
+      if (error != nullptr) {
+        status = Status::InvalidArgument(name + ": " + error);
       }
     }
+    if (status.ok()) {
+      status = g_controller->UpdateConfig(config);
+    }
+  }
+
+  if (status.ok()) {
+    String json = configToJSON(config);
+    response->Begin("200 OK", "Content-Type: application/json\r\n");
+    response->Write(json.c_str(), json.length());
+  } else if (status.code() == StatusCode::kInvalidArgument) {
+    serveError(response, "400 Bad Request", status.message());
+  } else {
+    serveError(response, "500 Internal Server Error", status.message());
+  }
+}
 
-    // Process POST data if present
 #if ENABLE_OVERRIDING_FAN_SPEEDS
-    if (isPost && postData.length() > 0) {
-      // Check for resets first
-      for (int i = 1; i <= 4; i++) {
-        String resetKey = "reset_fan" + String(i) + "=";
-        if (postData.indexOf(resetKey) >= 0) {
-          PWMFan* fan = nullptr;
-          if (i == 1)
-            fan = g_fan1;
-          else if (i == 2)
-            fan = g_fan2;
-          else if (i == 3)
-            fan = g_fan3;
-          else if (i == 4)
-            fan = g_fan4;
-
-          if (fan != nullptr) {
-            fan->Reset();
-            Logger::println(String("Fan ") + i + " override reset");
-          }
-        }
-      }
+// Helper to apply the fan override form, e.g. fan1=50&fan2=75&reset_fan3=1
+void applyFanOverrides(HttpResponse* response, const String& postData) {
+  int fanCount = g_fans.size();
+
+  // Check for resets first
+  for (int i = 1; i <= fanCount; i++) {
+    String resetKey = "reset_fan" + String(i) + "=";
+    if (postData.indexOf(resetKey) >= 0) {
+      g_fans[i - 1]->Reset();
+      Logger::println(String("Fan ") + i + " override reset");
+    }
+  }
 
-      // Parse duty cycles for each fan
-      // Expected format: fan1=50&fan2=75&fan3=25&fan4=100
-      for (int i = 1; i <= 4; i++) {
-        String fanKey = "fan" + String(i) + "=";
-        int fanIdx = postData.indexOf(fanKey);
-        if (fanIdx >= 0) {
-          int fanStart = fanIdx + fanKey.length();
-          int fanEnd = postData.indexOf('&', fanStart);
-          if (fanEnd < 0) fanEnd = postData.length();
-          String dutyStr = postData.substring(fanStart, fanEnd);
-          float newDuty = dutyStr.toFloat();
-
-          if (newDuty >= 0.0f && newDuty <= 100.0f) {
-            PWMFan* fan = nullptr;
-            if (i == 1)
-              fan = g_fan1;
-            else if (i == 2)
-              fan = g_fan2;
-            else if (i == 3)
-              fan = g_fan3;
-            else if (i == 4)
-              fan = g_fan4;
-
-            if (fan != nullptr) {
-              fan->LockDutyCycle();
-              Status status = fan->SetDutyCycle(newDuty, true);
-              if (status.ok()) {
-                Logger::println(String("Fan ") + i +
-                                " duty cycle set to: " + newDuty + "%");
-              } else {
-                Logger::println(String("Failed to set Fan ") + i + ": " +
-                                status.message());
-              }
-            }
-          }
+  // Parse duty cycles for each fan
+  // Expected format: fan1=50&fan2=75&fan3=25&fan4=100
+  for (int i = 1; i <= fanCount; i++) {
+    String fanKey = "fan" + String(i) + "=";
+    int fanIdx = postData.indexOf(fanKey);
+    if (fanIdx >= 0) {
+      int fanStart = fanIdx + fanKey.length();
+      int fanEnd = postData.indexOf('&', fanStart);
+      if (fanEnd < 0) fanEnd = postData.length();
+      String dutyStr = postData.substring(fanStart, fanEnd);
+      float newDuty = dutyStr.toFloat();
+
+      if (newDuty >= 0.0f && newDuty <= 100.0f) {
+        PWMFan* fan = g_fans[i - 1];
+        fan->LockDutyCycle();
+        Status status = fan->SetDutyCycle(newDuty, true);
+        if (status.ok()) {
+          Logger::println(String("Fan ") + i +
+                          " duty cycle set to: " + newDuty + "%");
+        } else {
+          Logger::println(String("Failed to set Fan ") + i + ": " +
+                          status.message());
         }
       }
-      // Redirect back to home after POST
-      client.println("HTTP/1.1 303 See Other");
-      client.println("Location: /");
-      client.println("Connection: close");
-      client.println();
-      client.stop();
-      Logger::println("Client disconnected");
-      return;
     }
+  }
+
+  // Redirect back to home after POST
+  response->Begin("303 See Other", "Location: /\r\n");
+}
 #endif
 
-    // Routing
-    if (path == "/" || path == "/index.html") {
-      serveFile(client, "/index.html", "text/html");
-    } else if (path == "/style.css") {
-      serveFile(client, "/style.css", "text/css");
-    } else if (path == "/script.js") {
-      serveFile(client, "/script.js", "application/javascript");
-    } else if (path == "/api/status") {
-      serveJSONStatus(client);
-    } else {
-      client.println("HTTP/1.1 404 Not Found");
-      client.println("Connection: close");
-      client.println();
-      client.println("File Not Found");
-      client.stop();
-    }
+// Serves the web UI file at the request path ("/" is index.html)
+void handleAsset(const HttpRequest& request, HttpResponse* response, void*) {
+  std::string path(request.target(), HttpPathLength(request.target()));
+  const StaticAsset* asset =
+      g_assets.Find(path == "/" ? "/index.html" : path.c_str());
+  if (asset != nullptr) {
+    serveAsset(response, request, *asset);
+  } else {
+    serveError(response, "404 Not Found", "File Not Found");
+  }
+}
 
-    Logger::println("Client disconnected");
+// Fills the route table with this file's endpoints
+void addRoutes() {
+  const char* assets[] = {"/", "/index.html", "/style.css", "/script.js"};
+  for (const char* path : assets) {
+    routes.Add("GET", path, handleAsset, nullptr);
   }
+  routes.Add(
+      "GET", "/api/status",
+      [](const HttpRequest&, HttpResponse* response, void*) {
+        serveJSONStatus(response);
+      },
+      nullptr);
+  routes.Add(
+      "GET", "/api/status.bin",
+      [](const HttpRequest&, HttpResponse* response, void*) {
+        serveBinaryStatus(response);
+      },
+      nullptr);
+  routes.Add(
+      "GET", "/api/logs",
+      [](const HttpRequest& request, HttpResponse* response, void*) {
+        serveLogs(response, request.target());
+      },
+      nullptr);
+  routes.Add(
+      "GET", "/api/history",
+      [](const HttpRequest& request, HttpResponse* response, void*) {
+        serveHistory(response, request.target());
+      },
+      nullptr);
+  routes.Add(
+      "GET", "/api/events",
+      [](const HttpRequest&, HttpResponse* response, void*) {
+        serveStatusEvents(response);
+      },
+      nullptr);
+  routes.Add(
+      "GET", "/metrics",
+      [](const HttpRequest&, HttpResponse* response, void*) {
+        serveMetrics(response);
+      },
+      nullptr);
+  routes.Add(
+      "GET", "/api/config",
+      [](const HttpRequest&, HttpResponse* response, void*) {
+        serveConfig(response, false, "");
+      },
+      nullptr);
+#if ENABLE_CONFIG_UPDATES
+  // Unauthenticated and persisted to flash, so only in builds that ask for it
+  routes.Add(
+      "POST", "/api/config",
+      [](const HttpRequest& request, HttpResponse* response, void*) {
+        serveConfig(response, true, request.body());
+      },
+      nullptr);
+#endif
+#if ENABLE_OVERRIDING_FAN_SPEEDS
+  routes.Add(
+      "POST", "/",
+      [](const HttpRequest& request, HttpResponse* response, void*) {
+        applyFanOverrides(response, request.body());
+      },
+      nullptr);
+#endif
+}
+
+void handle_http_request() {
+  // Waits for socket events instead of sleeping; a slow client holds only
+  // its own connection
+  server.Poll(HTTP_POLL_MS);
+  publishStatusEvent();
 }
 
 void stop_http_server() {
   // Stop the HTTP server
-  server.stop();
+  server.Stop();
   Logger::println("HTTP Server stopped");
 }
@@ -1,13 +1,20 @@
 #ifndef HTTP_SERVER_H
 #define HTTP_SERVER_H
 
+#include <vector>
+
+#include "fan_controller.h"
+#include "http_router.h"
 #include "pwm_fan.h"
 #include "thermistor.h"
 
 void setup_wifi();
-void setup_http_server(PWMFan* fan1, PWMFan* fan2, PWMFan* fan3, PWMFan* fan4,
-                       Thermistor* temp1, Thermistor* temp2, Thermistor* temp3);
+void setup_http_server(const std::vector<PWMFan*>& fans,
+                       const std::vector<Thermistor*>& thermistors,
+                       FanController* controller);
 void handle_http_request();
+// The server's route table, for modules to add their endpoints to
+HttpRouter* http_routes();
 void stop_http_server();
 
 #endif  // HTTP_SERVER_H
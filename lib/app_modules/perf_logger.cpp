@@ -1,31 +1,293 @@
 #include "perf_logger.h"
 
 #include <LittleFS.h>
-#include <WiFi.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <sys/time.h>
 
 #include <algorithm>
 
 #include "logger.h"
 
 #define LOG_INTERVAL_MS 1000
-#define RECORDS_PER_FILE 195  // < 4KB per file
-#define MAX_FILES 20
-#define SERVER_PORT 5599
+#define FLUSH_INTERVAL_MS 60000  // Max data-loss window on power cut
+#define MAX_FILE_BYTES 4096      // One LittleFS block per file
+#define RECOVERY_FILE "/perf_recover.tmp"  // Rewrite target during recovery
 
-PerfLogger::PerfLogger(PWMFan* fan1, PWMFan* fan2, PWMFan* fan3, PWMFan* pump,
-                       Thermistor* ambient, Thermistor* coolant_in,
-                       Thermistor* coolant_out) {
-  fans_[0] = fan1;
-  fans_[1] = fan2;
-  fans_[2] = fan3;
-  fans_[3] = pump;
+// Retention budget for all perf logs. A fixed size in bytes, or 0 to use a
+// share of the filesystem space that is free (or already used by logs) at boot
+#ifndef PERF_LOG_BUDGET_BYTES
+#define PERF_LOG_BUDGET_BYTES 0
+#endif
+#ifndef PERF_LOG_BUDGET_PERCENT
+#define PERF_LOG_BUDGET_PERCENT 50
+#endif
 
-  thermistors_[0] = ambient;
-  thermistors_[1] = coolant_in;
-  thermistors_[2] = coolant_out;
+// Budget shares of the stores (percent)
+#define RAW_BUDGET_SHARE 80
+#define MINUTE_BUDGET_SHARE 15
+#define HOUR_BUDGET_SHARE 5
 
-  current_file_index_ = 0;
-  current_record_count_ = 0;
+#define MIN_VALID_UNIX_TIME 1577836800  // 2020-01-01; earlier means no NTP yet
+
+// RAM history for /api/history, sizeof(PerfLogRecord) bytes per record
+#ifndef STATUS_HISTORY_SECONDS
+#define STATUS_HISTORY_SECONDS 900
+#endif
+#define STATUS_HISTORY_RECORDS (STATUS_HISTORY_SECONDS * 1000 / LOG_INTERVAL_MS)
+
+namespace {
+
+PerfLogRecord history_storage[STATUS_HISTORY_RECORDS];
+
+// More records than a raw file can hold
+constexpr uint64_t kMaxFileRecords =
+    MAX_FILE_BYTES / kPerfLogMinEncodedRecordSize;
+
+// A single open file as PerfLogStorage (the index is ignored)
+class OpenFile : public PerfLogStorage {
+ public:
+  explicit OpenFile(File file) : file_(file) {}
+  ~OpenFile() override { file_.close(); }
+  size_t Read(int index, uint32_t offset, uint8_t* out,
+              size_t size) override {
+    (void)index;
+    if (!file_.seek(offset)) return 0;
+    int n = file_.read(out, size);
+    return n > 0 ? n : 0;
+  }
+
+ private:
+  File file_;
+};
+
+// Streams file parts as the socket drains, logging the rate at the end
+class PartsBodySource : public HttpBodySource {
+ public:
+  PartsBodySource(const std::vector<PerfLogFilePart>& parts,
+                  std::unique_ptr<PerfLogStorage> storage, uint64_t length)
+      : storage_(std::move(storage)),
+        reader_(parts, storage_.get()),
+        length_(length),
+        start_us_(micros()) {}
+  ~PartsBodySource() override {
+    uint32_t elapsed_us = micros() - start_us_;
+    uint64_t sent = reader_.read();
+    Logger::printf("PerfLogger: Sent %u of %u bytes in %u us (%u KB/s)",
+                   (unsigned)sent, (unsigned)length_, (unsigned)elapsed_us,
+                   (unsigned)(elapsed_us > 0 ? sent * 1000 / elapsed_us : 0));
+  }
+
+  size_t Read(uint8_t* out, size_t size) override {
+    return reader_.Read(out, size);
+  }
+
+ private:
+  std::unique_ptr<PerfLogStorage> storage_;
+  PerfLogPartsReader reader_;
+  uint64_t length_;
+  unsigned long start_us_;
+};
+
+// CSV rows of a query, pending to be sent
+struct CsvRows {
+  std::string text;
+  uint32_t channel_mask;
+};
+
+void AppendToCsvRows(CsvRows* rows, const char* data, size_t size) {
+  rows->text.append(data, size);
+}
+
+void WriteRangeRow(uint32_t boot_id, const PerfLogSample& sample,
+                   void* context) {
+  CsvRows* rows = (CsvRows*)context;
+  char row[192];
+  int n = snprintf(row, sizeof(row), "%u,%llu,", (unsigned)boot_id,
+                   (unsigned long long)sample.uptime_ms);
+  if (sample.wall_clock_ms != 0) {
+    n += snprintf(row + n, sizeof(row) - n, "%lld",
+                  (long long)sample.wall_clock_ms);
+  }
+  int32_t channels[kPerfLogChannelCount];
+  PerfLogRecordToChannels(sample.record, channels);
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (!(rows->channel_mask & (1u << c))) continue;
+    row[n++] = ',';
+    n += FormatPerfLogChannel(c, channels[c], row + n, sizeof(row) - n);
+  }
+  row[n++] = '\n';
+  AppendToCsvRows(rows, row, n);
+}
+
+// /since rows are /range rows after the sequence number
+void WriteSinceRow(uint64_t seq, uint32_t boot_id, const PerfLogSample& sample,
+                   void* context) {
+  char prefix[24];
+  int n = snprintf(prefix, sizeof(prefix), "%llu,", (unsigned long long)seq);
+  AppendToCsvRows((CsvRows*)context, prefix, n);
+  WriteRangeRow(boot_id, sample, context);
+}
+
+void WriteSinceGap(uint64_t first, uint64_t last, void* context) {
+  char line[56];
+  int n = snprintf(line, sizeof(line), "# gap %llu-%llu\n",
+                   (unsigned long long)first, (unsigned long long)last);
+  AppendToCsvRows((CsvRows*)context, line, n);
+}
+
+// Streams the CSV of a query, running it a block of records at a time as
+// the socket drains
+class QueryBodySource : public HttpBodySource {
+ public:
+  QueryBodySource(const char* name, const std::string& columns,
+                  uint32_t channel_mask)
+      : name_(name), start_us_(micros()) {
+    rows_.text = columns;
+    rows_.channel_mask = channel_mask;
+  }
+
+  size_t Read(uint8_t* out, size_t size) override {
+    while (rows_.text.size() - sent_ < size) {
+      rows_.text.erase(0, sent_);
+      sent_ = 0;
+      if (!Step()) break;
+    }
+    size_t n = std::min(size, rows_.text.size() - sent_);
+    memcpy(out, rows_.text.data() + sent_, n);
+    sent_ += n;
+    return n;
+  }
+
+ protected:
+  // Run the query's next step into rows_. Returns false when it is done.
+  virtual bool Step() = 0;
+
+  // Log what the query did
+  void LogStats(const PerfLogRangeStats& stats, const char* error) {
+    Logger::printf(
+        "PerfLogger: %s sent %u records from %u blocks (%u bytes read) "
+        "in %u us",
+        name_, (unsigned)stats.records_matched, (unsigned)stats.blocks_read,
+        (unsigned)stats.bytes_read, (unsigned)(micros() - start_us_));
+    if (error != nullptr) {
+      Logger::printf("PerfLogger: %s error: %s", name_, error);
+    }
+  }
+
+  CsvRows rows_;
+
+ private:
+  const char* name_;
+  unsigned long start_us_;
+  size_t sent_ = 0;  // Of rows_.text
+};
+
+class RangeBodySource : public QueryBodySource {
+ public:
+  RangeBodySource(std::vector<PerfLogSegment> segments,
+                  std::unique_ptr<PerfLogStorage> storage,
+                  const PerfLogRangeQuery& query, const std::string& columns,
+                  uint32_t channel_mask)
+      : QueryBodySource("/range", columns, channel_mask),
+        segments_(std::move(segments)),
+        storage_(std::move(storage)),
+        cursor_(segments_, storage_.get(), query, WriteRangeRow, &rows_) {}
+  ~RangeBodySource() override { LogStats(cursor_.stats(), cursor_.error()); }
+
+ protected:
+  bool Step() override { return cursor_.Next(); }
+
+ private:
+  std::vector<PerfLogSegment> segments_;
+  std::unique_ptr<PerfLogStorage> storage_;
+  PerfLogRangeCursor cursor_;
+};
+
+class SinceBodySource : public QueryBodySource {
+ public:
+  SinceBodySource(std::vector<PerfLogSegment> segments,
+                  std::unique_ptr<PerfLogStorage> storage, uint64_t after_seq,
+                  const std::string& columns, uint32_t channel_mask)
+      : QueryBodySource("/since", columns, channel_mask),
+        segments_(std::move(segments)),
+        storage_(std::move(storage)),
+        cursor_(segments_, storage_.get(), after_seq, WriteSinceRow,
+                WriteSinceGap, &rows_) {}
+  ~SinceBodySource() override { LogStats(cursor_.stats(), cursor_.error()); }
+
+ protected:
+  bool Step() override { return cursor_.Next(); }
+
+ private:
+  std::vector<PerfLogSegment> segments_;
+  std::unique_ptr<PerfLogStorage> storage_;
+  PerfLogSinceCursor cursor_;
+};
+
+}  // namespace
+
+PerfLogger* PerfLogger::instance_ = nullptr;
+PerfLogger::WriteBuffer PerfLogger::buffers_[2];
+uint8_t PerfLogger::encode_buffer_[kPerfLogMaxBlockSize];
+
+PerfLogger::PerfLogger(const std::vector<PWMFan*>& fans,
+                       const std::vector<Thermistor*>& thermistors)
+    : rollups_{PerfLogRollup(60 * 1000), PerfLogRollup(3600 * 1000)},
+      history_(history_storage, STATUS_HISTORY_RECORDS) {
+  for (int i = 0; i < kLoggedFans; i++) {
+    fans_[i] = i < (int)fans.size() ? fans[i] : nullptr;
+  }
+  for (int i = 0; i < kLoggedThermistors; i++) {
+    thermistors_[i] = i < (int)thermistors.size() ? thermistors[i] : nullptr;
+  }
+
+  raw_store_.prefix = "perf_logger_";
+  raw_store_.budget_percent = RAW_BUDGET_SHARE;
+  rollup_stores_[kMinuteTier].prefix = "perf_minute_";
+  rollup_stores_[kMinuteTier].budget_percent = MINUTE_BUDGET_SHARE;
+  rollup_stores_[kHourTier].prefix = "perf_hour_";
+  rollup_stores_[kHourTier].budget_percent = HOUR_BUDGET_SHARE;
+  LogStore* stores[] = {&raw_store_, &rollup_stores_[kMinuteTier],
+                        &rollup_stores_[kHourTier]};
+  for (LogStore* store : stores) {
+    store->budget_bytes = 0;
+    store->last_uptime_ms = 0;
+  }
+  catalog_mutex_ = xSemaphoreCreateMutex();
+  boot_id_ = 0;
+  next_seq_ = 1;
+
+  buffers_[0].count = 0;
+  buffers_[0].rollup_count = 0;
+  buffers_[1].count = 0;
+  buffers_[1].rollup_count = 0;
+  active_buffer_ = 0;
+  flush_pending_ = false;
+  flush_task_handle_ = nullptr;
+  last_swap_ms_ = 0;
+  memset(&stats_, 0, sizeof(stats_));
+  history_mutex_ = xSemaphoreCreateMutex();
+}
+
+PerfLogger::~PerfLogger() {
+  if (instance_ == this) instance_ = nullptr;
+  vSemaphoreDelete(catalog_mutex_);
+  vSemaphoreDelete(history_mutex_);
+}
+
+PerfLogStats PerfLogger::GetStats() const {
+  portENTER_CRITICAL(&stats_lock_);
+  PerfLogStats stats = stats_;
+  portEXIT_CRITICAL(&stats_lock_);
+  return stats;
+}
+
+void PerfLogger::ReadHistory(
+    void (*read)(const StatusHistory& history, void* context), void* context) {
+  xSemaphoreTake(history_mutex_, portMAX_DELAY);
+  read(history_, context);
+  xSemaphoreGive(history_mutex_);
 }
 
 void PerfLogger::Start() {
@@ -34,84 +296,320 @@ void PerfLogger::Start() {
     return;
   }
 
-  // Scan for existing files to determine current index
-  int max_index = -1;
+  // Boot id lets readers tell the timelines of different boots apart
+  Preferences prefs;
+  prefs.begin("perf_logger", false);
+  boot_id_ = prefs.getUInt("boot_id", 0) + 1;
+  prefs.putUInt("boot_id", boot_id_);
+  // Sequence numbers continue past the reservation stored when the last file
+  // was started, or past the newest file if it holds more
+  next_seq_ = std::max<uint64_t>(prefs.getULong64("next_seq", 1), 1);
+  prefs.end();
+
+  OpenStores();
+
+  xTaskCreate(FlushTask, "PerfFlushTask", 4096, this, 1, &flush_task_handle_);
+  xTaskCreate(LoggingTask, "PerfLogTask", 4096, this, 1, NULL);
+  instance_ = this;
+}
+
+void PerfLogger::OpenStores() {
+  LogStore* stores[] = {&raw_store_, &rollup_stores_[kMinuteTier],
+                        &rollup_stores_[kHourTier]};
+
+  // A recovery interrupted by another power cut leaves its copy behind
+  if (LittleFS.exists(RECOVERY_FILE)) LittleFS.remove(RECOVERY_FILE);
+
+  // Catalog existing files in a single pass over the root directory
   File root = LittleFS.open("/");
   File file = root.openNextFile();
   while (file) {
-    String name = file.name();
-    if (name.startsWith("perf_logger_") && name.endsWith(".dat")) {
-      // Extract number
-      int start = 12;               // length of "perf_logger_"
-      int end = name.length() - 4;  // length of ".dat"
-      String numStr = name.substring(start, end);
-      int num = numStr.toInt();
-      if (num > max_index) {
-        max_index = num;
-      }
+    for (LogStore* store : stores) {
+      int index = ParseFileIndex(file.name(), store->prefix);
+      if (index < 0) continue;
+
+      PerfLogSegment segment;
+      ReadSegment(*store, index, file, &segment);
+      store->catalog.Add(segment);
+      break;
     }
     file = root.openNextFile();
   }
 
+  // Budget: what the logs use now plus what is still free
+  uint64_t log_bytes = 0;
+  for (LogStore* store : stores) {
+    store->catalog.Sort();
+    RecoverNewestFile(store);
+    log_bytes += store->catalog.allocated_bytes();
+  }
+  const PerfLogSegment* newest = raw_store_.catalog.newest();
+  if (newest != nullptr && newest->first_seq != 0) {
+    next_seq_ = std::max(next_seq_, newest->first_seq + newest->records);
+  }
+  uint64_t available = LittleFS.totalBytes() - LittleFS.usedBytes() + log_bytes;
+  uint64_t budget = PERF_LOG_BUDGET_BYTES > 0
+                        ? (uint64_t)PERF_LOG_BUDGET_BYTES
+                        : available * PERF_LOG_BUDGET_PERCENT / 100;
+
   // Always start a new file on initialization to avoid mixing logs
-  if (max_index >= 0) {
-    current_file_index_ = max_index + 1;
-  } else {
-    current_file_index_ = 0;
+  for (LogStore* store : stores) {
+    store->budget_bytes = budget * store->budget_percent / 100;
+    StartNextFile(store);
   }
-  current_record_count_ = 0;
 
-  // Ensure we have space for the new file
-  RotateFiles();
+  Logger::printf("PerfLogger: Starting at file index %d, budget %u bytes",
+                 raw_store_.catalog.newest()->index, (unsigned)budget);
+}
+
+void PerfLogger::ReadSegment(const LogStore& store, int index, File& file,
+                             PerfLogSegment* segment) {
+  *segment = PerfLogSegment();
+  segment->index = index;
+  segment->bytes = file.size();
+  PerfLogFileHeader header;
+  uint8_t data[kPerfLogEncodedHeaderSize];
+  int n = file.read(data, sizeof(data));
+  if (n <= 0 || ParsePerfLogHeader(data, n, &header) != nullptr) return;
 
-  Logger::println("PerfLogger: Starting at file index " +
-                  String(current_file_index_) + " record " +
-                  String(current_record_count_));
+  segment->version = header.version;
+  segment->boot_id = header.boot_id;
+  segment->start_uptime_ms = header.start_uptime_ms;
+  segment->end_uptime_ms = header.start_uptime_ms;
+  segment->wall_clock_start_ms = header.wall_clock_base_ms;
+  segment->first_seq = header.first_seq;
 
-  xTaskCreate(LoggingTask, "PerfLogTask", 4096, this, 1, NULL);
-  xTaskCreate(ServerTask, "PerfServerTask", 4096, this, 1, NULL);
+  // Index the blocks of raw files from their headers alone
+  if (&store == &raw_store_ && header.version >= kPerfLogVersion) {
+    StoreFiles files(store);
+    uint32_t end_offset_ms;
+    IndexPerfLogBlocks(&files, index, header.version, header.header_size,
+                       segment->bytes, &segment->blocks, &end_offset_ms,
+                       &segment->records);
+    segment->end_uptime_ms += end_offset_ms;
+  }
 }
 
-void PerfLogger::RotateFiles() {
-  // List all perf logger files
-  std::vector<int> file_indices;
-  File root = LittleFS.open("/");
-  File file = root.openNextFile();
-  while (file) {
-    String name = file.name();
-    if (name.startsWith("perf_logger_") && name.endsWith(".dat")) {
-      // Extract number
-      // Note: LittleFS file names might include leading slash
-      int prefixLen = name.startsWith("/perf_logger_") ? 13 : 12;
-      int start = prefixLen;
-      int end = name.length() - 4;
-      String numStr = name.substring(start, end);
-      file_indices.push_back(numStr.toInt());
+void PerfLogger::RecoverNewestFile(LogStore* store) {
+  // Only the file being appended to when power was lost can end in a torn
+  // write, and it is at most MAX_FILE_BYTES, so recovery takes the same time
+  // however many files the store has
+  PerfLogSegment* newest = store->catalog.newest();
+  if (newest == nullptr || newest->bytes > MAX_FILE_BYTES) return;
+  int index = newest->index;
+  String path = GetFileName(*store, index);
+
+  std::vector<uint8_t> data(newest->bytes);
+  File f = LittleFS.open(path, "r");
+  if (!f) return;
+  int n = f.read(data.data(), data.size());
+  f.close();
+  if (n < 0) return;
+
+  size_t valid = PerfLogValidLength(data.data(), n);
+  PerfLogFileHeader header;
+  size_t records_start = ParsePerfLogHeader(data.data(), n, &header) == nullptr
+                             ? header.header_size
+                             : 0;
+  if (valid <= records_start) {
+    // Nothing to keep; the next file reuses the index
+    LittleFS.remove(path);
+    store->catalog.PopNewest();
+    Logger::println("PerfLogger: Removed empty log file " + path);
+    return;
+  }
+  if (valid == (size_t)n) return;
+
+  // Rewrite the intact prefix to a copy and swap it in, so a power cut
+  // during recovery cannot lose the file
+  File copy = LittleFS.open(RECOVERY_FILE, "w");
+  if (!copy) return;
+  size_t written = copy.write(data.data(), valid);
+  copy.close();
+  if (written != valid || !LittleFS.rename(RECOVERY_FILE, path)) {
+    LittleFS.remove(RECOVERY_FILE);
+    return;
+  }
+
+  store->catalog.PopNewest();
+  f = LittleFS.open(path, "r");
+  PerfLogSegment segment;
+  ReadSegment(*store, index, f, &segment);
+  f.close();
+  store->catalog.Add(segment);
+  Logger::printf("PerfLogger: Cut torn write off %s (%d -> %u bytes)",
+                 path.c_str(), n, (unsigned)valid);
+}
+
+void PerfLogger::StartNextFile(LogStore* store) {
+  // Make room for a full new file; never evicts the newest one
+  std::vector<int> evicted;
+  xSemaphoreTake(catalog_mutex_, portMAX_DELAY);
+  store->catalog.AppendNext();
+  PerfLogSegment segment;
+  while (store->catalog.PopOldestOver(store->budget_bytes, MAX_FILE_BYTES,
+                                      &segment)) {
+    evicted.push_back(segment.index);
+  }
+  xSemaphoreGive(catalog_mutex_);
+
+  for (int index : evicted) {
+    String path = GetFileName(*store, index);
+    LittleFS.remove(path);
+    Logger::println("PerfLogger: Deleted old file " + path);
+  }
+}
+
+void PerfLogger::SetNewestFileHeader(LogStore* store,
+                                     const PerfLogFileHeader& header) {
+  xSemaphoreTake(catalog_mutex_, portMAX_DELAY);
+  PerfLogSegment* segment = store->catalog.newest();
+  segment->version = header.version;
+  segment->boot_id = header.boot_id;
+  segment->start_uptime_ms = header.start_uptime_ms;
+  segment->end_uptime_ms = header.start_uptime_ms;
+  segment->wall_clock_start_ms = header.wall_clock_base_ms;
+  segment->first_seq = header.first_seq;
+  xSemaphoreGive(catalog_mutex_);
+}
+
+std::vector<PerfLogSegment> PerfLogger::CopyCatalog(const LogStore& store,
+                                                    uint64_t* allocated) {
+  std::vector<PerfLogSegment> segments;
+  xSemaphoreTake(catalog_mutex_, portMAX_DELAY);
+  segments.reserve(store.catalog.size());
+  for (size_t i = 0; i < store.catalog.size(); i++) {
+    segments.push_back(store.catalog.at(i));
+  }
+  *allocated = store.catalog.allocated_bytes();
+  xSemaphoreGive(catalog_mutex_);
+  return segments;
+}
+
+void PerfLogger::GrowNewestFile(LogStore* store, uint32_t bytes,
+                                uint64_t end_uptime_ms) {
+  xSemaphoreTake(catalog_mutex_, portMAX_DELAY);
+  store->catalog.GrowNewest(bytes, end_uptime_ms);
+  xSemaphoreGive(catalog_mutex_);
+}
+
+void PerfLogger::AddBlockToNewestFile(LogStore* store, uint32_t bytes,
+                                      uint32_t records,
+                                      uint32_t first_offset_ms,
+                                      uint64_t end_uptime_ms) {
+  xSemaphoreTake(catalog_mutex_, portMAX_DELAY);
+  store->catalog.AddBlockToNewest(bytes, records, first_offset_ms,
+                                  end_uptime_ms);
+  xSemaphoreGive(catalog_mutex_);
+}
+
+PerfLogger::StoreFiles::~StoreFiles() {
+  if (file_) file_.close();
+}
+
+size_t PerfLogger::StoreFiles::Read(int index, uint32_t offset, uint8_t* out,
+                                    size_t size) {
+  if (index != index_) {
+    if (file_) file_.close();
+    file_ = LittleFS.open(GetFileName(store_, index), "r");
+    index_ = index;
+  }
+  if (!file_ || !file_.seek(offset)) return 0;
+  int n = file_.read(out, size);
+  return n > 0 ? n : 0;
+}
+
+void PerfLogger::ServeRange(HttpResponse* response, const char* target) {
+  // Unix seconds, or uptime seconds of one boot if "boot" is given
+  std::string from = HttpQueryParam(target, "from");
+  std::string to = HttpQueryParam(target, "to");
+  std::string boot = HttpQueryParam(target, "boot");
+  std::string channels = HttpQueryParam(target, "channels");
+
+  PerfLogRangeQuery query;
+  query.wall_clock = boot.empty();
+  query.boot_id = query.wall_clock ? 0 : (uint32_t)atoll(boot.c_str());
+  query.from_ms = !from.empty() ? atoll(from.c_str()) * 1000 : 0;
+  query.to_ms = !to.empty() ? atoll(to.c_str()) * 1000 : INT64_MAX;
+
+  uint32_t channel_mask = kPerfLogAllChannels;
+  if (!channels.empty() &&
+      !ParsePerfLogChannelList(channels.c_str(), &channel_mask)) {
+    response->Begin("400 Bad Request", "Content-Type: text/plain\r\n");
+    response->Print(("Unknown channel in: " + channels + "\n").c_str());
+    return;
+  }
+
+  std::string columns = "Boot_Id,Uptime_ms,Unix_ms";
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (channel_mask & (1u << c)) {
+      columns += std::string(",") + kPerfLogChannels[c].name;
     }
-    file = root.openNextFile();
   }
+  columns += "\n";
 
-  // If we have too many files, delete the oldest ones
-  // We want to keep MAX_FILES - 1 (since we are about to create a new one)
-  // Actually, if we are just appending to current, we might not need to delete
-  // yet. But if we are starting a NEW file (which calls this), we should ensure
-  // space.
+  uint64_t allocated;
+  response->Begin("200 OK", "Content-Type: text/csv\r\n");
+  response->Stream(
+      std::unique_ptr<HttpBodySource>(new RangeBodySource(
+          CopyCatalog(raw_store_, &allocated),
+          std::unique_ptr<PerfLogStorage>(new StoreFiles(raw_store_)), query,
+          columns, channel_mask)),
+      -1);
+}
 
-  if (file_indices.size() >= MAX_FILES) {
-    std::sort(file_indices.begin(), file_indices.end());
+void PerfLogger::ServeSince(HttpResponse* response, const char* target) {
+  // The cursor from the previous scrape; 0 (or none) for everything
+  std::string seq = HttpQueryParam(target, "seq");
+  std::string channels = HttpQueryParam(target, "channels");
+  uint64_t after_seq = strtoull(seq.c_str(), nullptr, 10);
 
-    // Delete oldest until we have space
-    int to_delete = file_indices.size() - (MAX_FILES - 1);
-    for (int i = 0; i < to_delete; i++) {
-      String path = "/perf_logger_" + String(file_indices[i]) + ".dat";
-      LittleFS.remove(path);
-      Logger::println("PerfLogger: Deleted old file " + path);
+  uint32_t channel_mask = kPerfLogAllChannels;
+  if (!channels.empty() &&
+      !ParsePerfLogChannelList(channels.c_str(), &channel_mask)) {
+    response->Begin("400 Bad Request", "Content-Type: text/plain\r\n");
+    response->Print(("Unknown channel in: " + channels + "\n").c_str());
+    return;
+  }
+
+  // The body ends at the newest record in this copy of the catalog, so the
+  // cursor is known before streaming
+  uint64_t allocated;
+  std::vector<PerfLogSegment> segments = CopyCatalog(raw_store_, &allocated);
+  char cursor[80];
+  snprintf(cursor, sizeof(cursor),
+           "Content-Type: text/csv\r\nX-Perf-Log-Cursor: %llu\r\n",
+           (unsigned long long)PerfLogLastSeq(segments));
+  std::string columns = "Seq,Boot_Id,Uptime_ms,Unix_ms";
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (channel_mask & (1u << c)) {
+      columns += std::string(",") + kPerfLogChannels[c].name;
     }
   }
+  columns += "\n";
+
+  response->Begin("200 OK", cursor);
+  response->Stream(
+      std::unique_ptr<HttpBodySource>(new SinceBodySource(
+          std::move(segments),
+          std::unique_ptr<PerfLogStorage>(new StoreFiles(raw_store_)),
+          after_seq, columns, channel_mask)),
+      -1);
+}
+
+int PerfLogger::ParseFileIndex(const String& name, const char* prefix) {
+  // Note: LittleFS file names might include leading slash
+  int start = name.startsWith("/") ? 1 : 0;
+  int prefix_len = strlen(prefix);
+  if (name.substring(start, start + prefix_len) != prefix ||
+      !name.endsWith(".dat")) {
+    return -1;
+  }
+  return name.substring(start + prefix_len, name.length() - 4).toInt();
 }
 
-String PerfLogger::GetCurrentFileName() {
-  return "/perf_logger_" + String(current_file_index_) + ".dat";
+String PerfLogger::GetFileName(const LogStore& store, int index) {
+  return "/" + String(store.prefix) + String(index) + ".dat";
 }
 
 uint8_t PerfLogger::EncodeTemperature(float temp_c) {
@@ -138,181 +636,561 @@ void PerfLogger::LoggingTask(void* parameter) {
   for (;;) {
     vTaskDelayUntil(&xLastWakeTime, xFrequency);
 
+    unsigned long start_us = micros();
+    uint64_t uptime_ms = esp_timer_get_time() / 1000;
     PerfLogRecord record;
-    record.timestamp = (uint16_t)(millis() / 1000);
-
-    // Fans
-    for (int i = 0; i < 4; i++) {
-      // We need to access private members or add getters for target duty cycle
-      // if not available. Assuming GetDutyCycle returns current. The
-      // requirement asks for Target and Current. PWMFan class has
-      // GetDutyCycle() which returns current. It doesn't seem to expose
-      // TargetDutyCycle directly in the public interface provided in context. I
-      // will assume GetDutyCycle is the current one. For target, I might need
-      // to modify PWMFan or just use current for both if target isn't
-      // available. However, looking at PWMFan header: "SetDutyCycle(float
-      // percent)". I should probably add GetTargetDutyCycle to PWMFan. For now,
-      // I'll use GetDutyCycle for both or 0 for target if I can't get it. Let's
-      // check PWMFan header again. It has `GetDutyCycle()`. I will modify
-      // PWMFan to add `GetTargetDutyCycle()` later. For now I will use
-      // GetDutyCycle for both.
-
-      StatusOr<float> duty = logger->fans_[i]->GetDutyCycle();
-      float d = duty.ok() ? duty.value() : 0.0f;
-
-      StatusOr<float> target = logger->fans_[i]->GetTargetDutyCycle();
-      float t = target.ok() ? target.value() : 0.0f;
-
-      uint8_t encoded_duty = logger->EncodeDutyCycle(d);
-      uint8_t encoded_target = logger->EncodeDutyCycle(t);
-
-      if (i == 0) {
-        record.fan1_target_duty = encoded_target;
-        record.fan1_current_duty = encoded_duty;
-        StatusOr<int> rpm = logger->fans_[i]->GetRpm();
-        record.fan1_rpm = rpm.ok() ? (uint16_t)rpm.value() : 0;
-      } else if (i == 1) {
-        record.fan2_target_duty = encoded_target;
-        record.fan2_current_duty = encoded_duty;
-        StatusOr<int> rpm = logger->fans_[i]->GetRpm();
-        record.fan2_rpm = rpm.ok() ? (uint16_t)rpm.value() : 0;
-      } else if (i == 2) {
-        record.fan3_target_duty = encoded_target;
-        record.fan3_current_duty = encoded_duty;
-        StatusOr<int> rpm = logger->fans_[i]->GetRpm();
-        record.fan3_rpm = rpm.ok() ? (uint16_t)rpm.value() : 0;
-      } else if (i == 3) {
-        record.fan4_target_duty = encoded_target;
-        record.fan4_current_duty = encoded_duty;
-        StatusOr<int> rpm = logger->fans_[i]->GetRpm();
-        record.fan4_rpm = rpm.ok() ? (uint16_t)rpm.value() : 0;
+    record.delta_ms = 0;  // Filled in on flush
+
+    // Fans (one consistent copy of the whole bank)
+    FanBankSnapshot bank;
+    FanBank::Instance().Snapshot(&bank);
+    uint8_t targets[kLoggedFans];
+    uint8_t duties[kLoggedFans];
+    uint16_t rpms[kLoggedFans];
+    for (int i = 0; i < kLoggedFans; i++) {
+      PWMFan* fan = logger->fans_[i];
+      float d = 0.0f;
+      float t = 0.0f;
+      int r = 0;
+      if (fan != nullptr) {
+        uint8_t ch = fan->GetChannel();
+        d = bank.duty[ch];
+        t = bank.target[ch];
+        r = bank.rpm[ch];
       }
+      targets[i] = logger->EncodeDutyCycle(t);
+      duties[i] = logger->EncodeDutyCycle(d);
+      rpms[i] = (uint16_t)r;
     }
 
     // Thermistors
-    StatusOr<float> t0 = logger->thermistors_[0]->GetSampledTemperature();
-    record.temp_ambient =
-        logger->EncodeTemperature(t0.ok() ? t0.value() : 0.0f);
-
-    StatusOr<float> t1 = logger->thermistors_[1]->GetSampledTemperature();
-    record.temp_coolant_in =
-        logger->EncodeTemperature(t1.ok() ? t1.value() : 0.0f);
-
-    StatusOr<float> t2 = logger->thermistors_[2]->GetSampledTemperature();
-    record.temp_coolant_out =
-        logger->EncodeTemperature(t2.ok() ? t2.value() : 0.0f);
-
-    // Write to file
-    File f = LittleFS.open(logger->GetCurrentFileName(), "a");
-    if (f) {
-      f.write((uint8_t*)&record, sizeof(PerfLogRecord));
-      f.close();
-      logger->current_record_count_++;
-
-      if (logger->current_record_count_ >= RECORDS_PER_FILE) {
-        logger->current_file_index_++;
-        logger->current_record_count_ = 0;
-        logger->RotateFiles();
+    uint8_t temps[kLoggedThermistors];
+    for (int i = 0; i < kLoggedThermistors; i++) {
+      float temp = 0.0f;
+      if (logger->thermistors_[i] != nullptr) {
+        StatusOr<float> t = logger->thermistors_[i]->GetSampledTemperature();
+        if (t.ok()) temp = t.value();
       }
+      temps[i] = logger->EncodeTemperature(temp);
+    }
+
+    // Lay the values out as the schema says
+    int32_t channels[kPerfLogChannelCount];
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      const PerfLogChannelInfo& channel = kPerfLogChannels[c];
+      switch (channel.kind) {
+        case kPerfLogFanTarget:
+          channels[c] = targets[channel.instance];
+          break;
+        case kPerfLogFanDuty:
+          channels[c] = duties[channel.instance];
+          break;
+        case kPerfLogFanRpm:
+          channels[c] = rpms[channel.instance];
+          break;
+        case kPerfLogTemperature:
+          channels[c] = temps[channel.instance];
+          break;
+      }
+    }
+    PerfLogChannelsToRecord(channels, &record);
+
+    xSemaphoreTake(logger->history_mutex_, portMAX_DELAY);
+    logger->history_.Add((uint32_t)uptime_ms, record);
+    xSemaphoreGive(logger->history_mutex_);
+
+    // Append to the RAM buffer; flash writes happen in FlushTask
+    if (logger->buffers_[logger->active_buffer_].count >= kBufferRecords) {
+      logger->SwapBuffers();
+    }
+    WriteBuffer& buffer = logger->buffers_[logger->active_buffer_];
+    buffer.wall_clock_offset_ms = WallClockOffsetMs(uptime_ms);
+    bool stored = buffer.count < kBufferRecords;
+    if (stored) {
+      buffer.records[buffer.count] = record;
+      buffer.uptime_ms[buffer.count] = uptime_ms;
+      buffer.count++;
+    }
+
+    // Rollups see every sample, even ones the raw log had to drop
+    uint32_t rollups_dropped = 0;
+    for (int i = 0; i < kRollupTierCount; i++) {
+      PendingRollup pending;
+      if (!logger->rollups_[i].Add(uptime_ms, record, &pending.record,
+                                   &pending.start_ms)) {
+        continue;
+      }
+      if (buffer.rollup_count < kBufferRollups) {
+        pending.tier = (RollupTier)i;
+        buffer.rollups[buffer.rollup_count++] = pending;
+      } else {
+        rollups_dropped++;
+      }
+    }
+
+    // Flush at least every FLUSH_INTERVAL_MS to bound the data-loss window
+    if (millis() - logger->last_swap_ms_ >= FLUSH_INTERVAL_MS) {
+      logger->SwapBuffers();
+    }
+
+    uint32_t elapsed_us = micros() - start_us;
+    portENTER_CRITICAL(&logger->stats_lock_);
+    if (stored) {
+      logger->stats_.records_logged++;
     } else {
-      Logger::println("PerfLogger: Failed to open file for writing");
+      logger->stats_.records_dropped++;
+    }
+    logger->stats_.rollups_dropped += rollups_dropped;
+    logger->stats_.record_time_us_total += elapsed_us;
+    if (elapsed_us > logger->stats_.record_time_us_max) {
+      logger->stats_.record_time_us_max = elapsed_us;
     }
+    portEXIT_CRITICAL(&logger->stats_lock_);
   }
 }
 
-void PerfLogger::ServerTask(void* parameter) {
-  PerfLogger* logger = (PerfLogger*)parameter;
-  WiFiServer server(SERVER_PORT);
-  server.begin();
+bool PerfLogger::SwapBuffers() {
+  if (flush_pending_ || (buffers_[active_buffer_].count == 0 &&
+                         buffers_[active_buffer_].rollup_count == 0)) {
+    return false;
+  }
 
-  Logger::printf("PerfLogger Server started on port %d", SERVER_PORT);
+  active_buffer_ = 1 - active_buffer_;
+  buffers_[active_buffer_].count = 0;
+  buffers_[active_buffer_].rollup_count = 0;
+  last_swap_ms_ = millis();
+  flush_pending_ = true;
+  xTaskNotifyGive(flush_task_handle_);
+  return true;
+}
+
+void PerfLogger::FlushTask(void* parameter) {
+  PerfLogger* logger = (PerfLogger*)parameter;
 
   for (;;) {
-    WiFiClient client = server.available();
-    if (client) {
-      Logger::printf("New client connected from %s",
-                     client.remoteIP().toString().c_str());
-      String currentLine = "";
-      String requestLine = "";
-      while (client.connected()) {
-        if (client.available()) {
-          char c = client.read();
-          if (c == '\n') {
-            if (currentLine.length() == 0) {
-              // End of headers
-              // Parse request
-              if (requestLine.startsWith("GET /perf_logger_")) {
-                int start = 5;  // "GET /"
-                int end = requestLine.indexOf(" HTTP");
-                String path = requestLine.substring(start, end);
-
-                if (LittleFS.exists("/" + path)) {
-                  File f = LittleFS.open("/" + path, "r");
-                  client.println("HTTP/1.1 200 OK");
-                  client.println("Content-Type: application/octet-stream");
-                  client.println(
-                      "Content-Disposition: attachment; filename=\"" + path +
-                      "\"");
-                  client.println("Connection: close");
-                  client.println();
-
-                  while (f.available()) {
-                    uint8_t buf[64];
-                    int n = f.read(buf, sizeof(buf));
-                    client.write(buf, n);
-                  }
-                  f.close();
-                } else {
-                  client.println("HTTP/1.1 404 Not Found");
-                  client.println("Connection: close");
-                  client.println();
-                }
-              } else if (requestLine.startsWith("GET / ")) {
-                // List files
-                client.println("HTTP/1.1 200 OK");
-                client.println("Content-Type: text/html");
-                client.println("Connection: close");
-                client.println();
-                client.println("<html><body><h1>Perf Logs</h1><ul>");
-
-                File root = LittleFS.open("/");
-                File file = root.openNextFile();
-                while (file) {
-                  String name = file.name();
-                  if (name.startsWith("perf_logger_") ||
-                      name.startsWith("/perf_logger_")) {
-                    // Handle potential leading slash
-                    String cleanName =
-                        name.startsWith("/") ? name.substring(1) : name;
-                    client.println("<li><a href=\"/" + cleanName + "\">" +
-                                   cleanName + "</a> (" + String(file.size()) +
-                                   " bytes)</li>");
-                  }
-                  file = root.openNextFile();
-                }
-                client.println("</ul></body></html>");
-              } else {
-                client.println("HTTP/1.1 404 Not Found");
-                client.println("Connection: close");
-                client.println();
-              }
-              break;
-            } else {
-              if (requestLine.length() == 0) {
-                requestLine = currentLine;
-                Logger::printf("Request: %s", requestLine.c_str());
-              }
-              currentLine = "";
-            }
-          } else if (c != '\r') {
-            currentLine += c;
-          }
-        } else {
-          vTaskDelay(pdMS_TO_TICKS(10));
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!logger->flush_pending_) continue;
+
+    // The inactive buffer is ours until flush_pending_ is cleared
+    unsigned long start_us = micros();
+    WriteBuffer& buffer = logger->buffers_[1 - logger->active_buffer_];
+    logger->WriteBufferToFlash(buffer);
+    logger->WriteRollupsToFlash(buffer);
+    uint32_t elapsed_us = micros() - start_us;
+
+    portENTER_CRITICAL(&logger->stats_lock_);
+    logger->stats_.flushes++;
+    logger->stats_.flush_time_us_last = elapsed_us;
+    logger->stats_.flush_time_us_total += elapsed_us;
+    if (elapsed_us > logger->stats_.flush_time_us_max) {
+      logger->stats_.flush_time_us_max = elapsed_us;
+    }
+    portEXIT_CRITICAL(&logger->stats_lock_);
+
+    logger->flush_pending_ = false;
+  }
+}
+
+void PerfLogger::WriteBufferToFlash(WriteBuffer& buffer) {
+  LogStore* store = &raw_store_;
+  int written = 0;
+  while (written < buffer.count) {
+    // Start a new file if the gap since the last record overflows delta_ms
+    if (store->catalog.newest()->bytes > 0 &&
+        buffer.uptime_ms[written] - store->last_uptime_ms > UINT16_MAX) {
+      StartNextFile(store);
+    }
+    PerfLogSegment* segment = store->catalog.newest();
+    bool new_file = segment->bytes == 0;
+    uint64_t file_start_ms =
+        new_file ? buffer.uptime_ms[written] : segment->start_uptime_ms;
+
+    // Set deltas for the run of records whose gaps fit in delta_ms
+    uint64_t previous =
+        new_file ? buffer.uptime_ms[written] : store->last_uptime_ms;
+    int n = 0;
+    while (written + n < buffer.count) {
+      uint64_t delta = buffer.uptime_ms[written + n] - previous;
+      if (delta > UINT16_MAX) break;
+      buffer.records[written + n].delta_ms = (uint16_t)delta;
+      previous = buffer.uptime_ms[written + n];
+      n++;
+    }
+
+    unsigned long encode_start_us = micros();
+    uint32_t first_offset_ms = buffer.uptime_ms[written] - file_start_ms;
+    size_t block_size = EncodePerfLogBlock(&buffer.records[written], n,
+                                           first_offset_ms, encode_buffer_,
+                                           sizeof(encode_buffer_));
+    uint32_t encode_us = micros() - encode_start_us;
+
+    // Blocks never span files; the first delta is re-based in a new file
+    size_t needed = block_size + (new_file ? kPerfLogEncodedHeaderSize : 0);
+    if (!new_file && segment->bytes + needed > MAX_FILE_BYTES) {
+      StartNextFile(store);
+      continue;
+    }
+
+    File f = LittleFS.open(GetFileName(*store, segment->index), "a");
+    if (!f) {
+      Logger::println("PerfLogger: Failed to open file for writing");
+      portENTER_CRITICAL(&stats_lock_);
+      stats_.records_dropped += buffer.count - written;
+      portEXIT_CRITICAL(&stats_lock_);
+      return;
+    }
+    size_t header_bytes = 0;
+    if (new_file) {
+      PerfLogFileHeader header;
+      InitPerfLogHeader(&header, boot_id_, LOG_INTERVAL_MS, file_start_ms,
+                        WallClockAt(buffer, file_start_ms));
+      header.first_seq = next_seq_;
+      // Once per file, reserving every number the file can use, so after a
+      // reboot numbering resumes past it even if the file is lost or its
+      // tail unreadable (a collector then sees a gap, not reused numbers)
+      Preferences prefs;
+      prefs.begin("perf_logger", false);
+      prefs.putULong64("next_seq", next_seq_ + kMaxFileRecords);
+      prefs.end();
+      uint8_t header_data[kPerfLogEncodedHeaderSize];
+      header_bytes = f.write(header_data,
+                             EncodePerfLogHeader(&header, header_data));
+      SetNewestFileHeader(store, header);
+      GrowNewestFile(store, header_bytes, file_start_ms);
+    }
+    size_t bytes = header_bytes + f.write(encode_buffer_, block_size);
+    f.close();
+
+    portENTER_CRITICAL(&stats_lock_);
+    stats_.file_writes++;
+    stats_.bytes_written += bytes;
+    stats_.records_flushed += n;
+    stats_.encode_time_us_total += encode_us;
+    portEXIT_CRITICAL(&stats_lock_);
+
+    written += n;
+    next_seq_ += n;
+    AddBlockToNewestFile(store, bytes - header_bytes, n, first_offset_ms,
+                         previous);
+    store->last_uptime_ms = previous;
+    if (segment->bytes >= MAX_FILE_BYTES) StartNextFile(store);
+  }
+}
+
+void PerfLogger::WriteRollupsToFlash(WriteBuffer& buffer) {
+  for (int i = 0; i < buffer.rollup_count; i++) {
+    PendingRollup& pending = buffer.rollups[i];
+    LogStore* store = &rollup_stores_[pending.tier];
+
+    if (store->catalog.newest()->bytes + sizeof(PerfLogRollupRecord) >
+        MAX_FILE_BYTES) {
+      StartNextFile(store);
+    }
+    PerfLogSegment* segment = store->catalog.newest();
+    bool new_file = segment->bytes == 0;
+    uint64_t file_start_ms =
+        new_file ? pending.start_ms : segment->start_uptime_ms;
+    pending.record.start_s = (pending.start_ms - file_start_ms) / 1000;
+
+    File f = LittleFS.open(GetFileName(*store, segment->index), "a");
+    if (!f) {
+      Logger::println("PerfLogger: Failed to open rollup file for writing");
+      portENTER_CRITICAL(&stats_lock_);
+      stats_.rollups_dropped += buffer.rollup_count - i;
+      portEXIT_CRITICAL(&stats_lock_);
+      return;
+    }
+    size_t bytes = 0;
+    if (new_file) {
+      PerfLogFileHeader header;
+      InitPerfLogHeader(&header, boot_id_,
+                        rollups_[pending.tier].period_ms(), file_start_ms,
+                        WallClockAt(buffer, file_start_ms));
+      header.schema_id = kPerfLogSchemaRollup;
+      header.record_size = sizeof(PerfLogRollupRecord);
+      uint8_t header_data[kPerfLogEncodedHeaderSize];
+      bytes += f.write(header_data, EncodePerfLogHeader(&header, header_data));
+      SetNewestFileHeader(store, header);
+    }
+    bytes += f.write((const uint8_t*)&pending.record, sizeof(pending.record));
+    f.close();
+
+    portENTER_CRITICAL(&stats_lock_);
+    stats_.file_writes++;
+    stats_.bytes_written += bytes;
+    stats_.rollups_written++;
+    portEXIT_CRITICAL(&stats_lock_);
+
+    GrowNewestFile(store, bytes, pending.start_ms);
+    store->last_uptime_ms = pending.start_ms;
+  }
+}
+
+int64_t PerfLogger::WallClockAt(const WriteBuffer& buffer,
+                                uint64_t uptime_ms) {
+  return buffer.wall_clock_offset_ms != 0
+             ? buffer.wall_clock_offset_ms + (int64_t)uptime_ms
+             : 0;
+}
+
+int64_t PerfLogger::WallClockOffsetMs(uint64_t uptime_ms) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < MIN_VALID_UNIX_TIME) return 0;
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - (int64_t)uptime_ms;
+}
+
+void PerfLogger::AddRoutes(HttpRouter* router) {
+  // Under kRoutePrefix; the legacy port serves them at its root
+  router->Add(
+      "GET", "/logs/",
+      [](const HttpRequest&, HttpResponse* response, void* logger) {
+        ((PerfLogger*)logger)->ServeIndex(response);
+      },
+      this);
+  router->Add(
+      "GET", "/logs/perf_*",
+      [](const HttpRequest& request, HttpResponse* response, void* logger) {
+        std::string path(request.target() + strlen(kRoutePrefix),
+                         HttpPathLength(request.target()) -
+                             strlen(kRoutePrefix));
+        ((PerfLogger*)logger)
+            ->ServeFile(response, path.c_str(), request.Header("Range"));
+      },
+      this);
+  router->Add(
+      "GET", "/logs/all",
+      [](const HttpRequest& request, HttpResponse* response, void* logger) {
+        ((PerfLogger*)logger)
+            ->ServeAll(response, request.target(), request.Header("Range"));
+      },
+      this);
+  router->Add(
+      "GET", "/logs/range",
+      [](const HttpRequest& request, HttpResponse* response, void* logger) {
+        ((PerfLogger*)logger)->ServeRange(response, request.target());
+      },
+      this);
+  router->Add(
+      "GET", "/logs/since",
+      [](const HttpRequest& request, HttpResponse* response, void* logger) {
+        ((PerfLogger*)logger)->ServeSince(response, request.target());
+      },
+      this);
+  router->Add(
+      "POST", "/logs/capture",
+      [](const HttpRequest&, HttpResponse* response, void*) {
+        if (FlightRecorder::Running() == nullptr) {
+          response->Begin("503 Service Unavailable",
+                          "Content-Type: text/plain\r\n");
+          response->Print("Flight recorder not running\n");
+          return;
         }
-      }
-      client.stop();
+        FlightRecorder::Trigger(kFlightTriggerManual, 0);
+        response->Begin("202 Accepted", "Content-Type: text/plain\r\n");
+        response->Print("Capture requested\n");
+      },
+      this);
+}
+
+void PerfLogger::StreamSegments(HttpResponse* response, const String& headers,
+                                const std::vector<PerfLogSegment>& segments,
+                                const char* range,
+                                std::unique_ptr<PerfLogStorage> storage) {
+  uint64_t size = PerfLogSegmentsSize(segments);
+  uint64_t first = 0;
+  uint64_t last = size > 0 ? size - 1 : 0;
+  HttpRangeResult ranged = ParseHttpRange(range, size, &first, &last);
+  if (ranged == kHttpRangeUnsatisfiable) {
+    response->Begin(
+        "416 Range Not Satisfiable",
+        ("Content-Range: bytes */" + String((uint32_t)size) + "\r\n").c_str());
+    return;
+  }
+
+  uint64_t length = size > 0 ? last - first + 1 : 0;
+  String head = "Content-Type: application/octet-stream\r\n" + headers +
+                "Accept-Ranges: bytes\r\n";
+  if (ranged == kHttpRangeSatisfiable) {
+    head += "Content-Range: bytes " + String((uint32_t)first) + "-" +
+            String((uint32_t)last) + "/" + String((uint32_t)size) + "\r\n";
+  }
+  response->Begin(
+      ranged == kHttpRangeSatisfiable ? "206 Partial Content" : "200 OK",
+      head.c_str());
+  if (length == 0) return;
+
+  // Read from flash as the socket drains
+  response->Stream(std::unique_ptr<HttpBodySource>(new PartsBodySource(
+                       SlicePerfLogSegments(segments, first, last),
+                       std::move(storage), length)),
+                   length);
+}
+
+bool PerfLogger::IsLogFile(const char* path) {
+  // The path comes from the request: no subdirectories or "..", and only
+  // names the catalogs know
+  if (strchr(path + 1, '/') != nullptr) return false;
+  String name(path);
+  bool found = false;
+  const LogStore* stores[] = {&raw_store_, &rollup_stores_[kMinuteTier],
+                              &rollup_stores_[kHourTier]};
+  xSemaphoreTake(catalog_mutex_, portMAX_DELAY);
+  for (const LogStore* store : stores) {
+    int index = ParseFileIndex(name, store->prefix);
+    if (index < 0 || GetFileName(*store, index) != name) continue;
+    for (size_t i = 0; i < store->catalog.size() && !found; i++) {
+      found = store->catalog.at(i).index == index;
+    }
+  }
+  xSemaphoreGive(catalog_mutex_);
+  if (found) return true;
+
+  FlightRecorder* recorder = FlightRecorder::Running();
+  if (recorder == nullptr) return false;
+  for (const FlightCaptureInfo& capture : recorder->GetCaptures()) {
+    if (name == FlightRecorder::GetFileName(capture.index)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerfLogger::ServeFile(HttpResponse* response, const char* path,
+                           const char* range) {
+  File f;
+  if (IsLogFile(path)) f = LittleFS.open(path, "r");
+  if (!f || f.isDirectory()) {
+    response->Begin("404 Not Found", "Content-Type: text/plain\r\n");
+    response->Print("Not Found\n");
+    return;
+  }
+  PerfLogSegment segment = {};
+  segment.bytes = f.size();
+  StreamSegments(
+      response,
+      "Content-Disposition: attachment; filename=\"" + String(path + 1) +
+          "\"\r\n",
+      std::vector<PerfLogSegment>(1, segment), range,
+      std::unique_ptr<PerfLogStorage>(new OpenFile(f)));
+}
+
+void PerfLogger::ServeAll(HttpResponse* response, const char* target,
+                          const char* range) {
+  std::string name = HttpQueryParam(target, "store");
+  const LogStore* store = &raw_store_;
+  if (name == "minute") {
+    store = &rollup_stores_[kMinuteTier];
+  } else if (name == "hour") {
+    store = &rollup_stores_[kHourTier];
+  } else if (!name.empty() && name != "raw") {
+    response->Begin("400 Bad Request", "Content-Type: text/plain\r\n");
+    response->Print("Unknown store\n");
+    return;
+  }
+
+  // The files as of now; a file rotated away while streaming cuts the
+  // response short, and the client resumes with a Range
+  uint64_t allocated;
+  std::vector<PerfLogSegment> segments = CopyCatalog(*store, &allocated);
+  String list;
+  for (const PerfLogSegment& segment : segments) {
+    if (list.length() > 0) list += ",";
+    list += GetFileName(*store, segment.index).substring(1) + ":" +
+            String(segment.bytes);
+  }
+  StreamSegments(response,
+                 "Content-Disposition: attachment; filename=\"" +
+                     String(store->prefix) + "all.dat\"\r\n" +
+                     "X-Perf-Log-Segments: " + list + "\r\n",
+                 segments, range,
+                 std::unique_ptr<PerfLogStorage>(new StoreFiles(*store)));
+}
+
+void PerfLogger::ServeIndex(HttpResponse* response) {
+  // Links are relative: this is /logs/ on the web server, and / on the
+  // legacy port
+  String html = "<html><body><h1>Perf Logs</h1>\n";
+
+  // From the catalogs; no directory scan needed
+  const LogStore* stores[] = {&raw_store_, &rollup_stores_[kMinuteTier],
+                              &rollup_stores_[kHourTier]};
+  const char* store_names[] = {"raw", "minute", "hour"};
+  for (int i = 0; i < kRollupTierCount + 1; i++) {
+    const LogStore* store = stores[i];
+    uint64_t allocated;
+    std::vector<PerfLogSegment> segments = CopyCatalog(*store, &allocated);
+    html += "<h2>" + String(store->prefix) + "</h2><p>" +
+            String((uint32_t)allocated) + " of " +
+            String((uint32_t)store->budget_bytes) +
+            " bytes (<a href=\"all?store=" + store_names[i] +
+            "\">all in one file</a>)</p><ul>\n";
+    for (const PerfLogSegment& segment : segments) {
+      String name = GetFileName(*store, segment.index).substring(1);
+      html += "<li><a href=\"" + name + "\">" + name + "</a> (" +
+              String(segment.bytes) + " bytes, boot " +
+              String(segment.boot_id) + ", uptime " +
+              String((uint32_t)(segment.start_uptime_ms / 1000)) + "-" +
+              String((uint32_t)(segment.end_uptime_ms / 1000)) + " s)</li>\n";
+    }
+    html += "</ul>\n";
+  }
+
+  PerfLogStats stats = GetStats();
+  uint32_t avg_us = stats.records_logged + stats.records_dropped > 0
+                        ? stats.record_time_us_total /
+                              (stats.records_logged + stats.records_dropped)
+                        : 0;
+  html +=
+      "<p>Records: " + String(stats.records_logged) + " (dropped " +
+      String(stats.records_dropped) +
+      "), rollups: " + String(stats.rollups_written) + " (dropped " +
+      String(stats.rollups_dropped) + ")" +
+      ", flushes: " + String(stats.flushes) +
+      ", file writes: " + String(stats.file_writes) +
+      ", bytes: " + String(stats.bytes_written) + " (" +
+      String(stats.records_flushed > 0
+                 ? (float)stats.bytes_written / stats.records_flushed
+                 : 0.0f) +
+      " per record, encode " +
+      String(stats.records_flushed > 0
+                 ? (float)stats.encode_time_us_total / stats.records_flushed
+                 : 0.0f) +
+      " us per record)" + ", record time avg/max: " + String(avg_us) + "/" +
+      String(stats.record_time_us_max) + " us, flush time last/max: " +
+      String(stats.flush_time_us_last) + "/" +
+      String(stats.flush_time_us_max) + " us</p>\n";
+
+  FlightRecorder* recorder = FlightRecorder::Running();
+  if (recorder != nullptr) {
+    html +=
+        "<h2>Flight recorder captures</h2><form method=\"post\" "
+        "action=\"capture\"><button>Capture now</button></form><ul>\n";
+    for (const FlightCaptureInfo& capture : recorder->GetCaptures()) {
+      String name = "perf_capture_" + String(capture.index) + ".dat";
+      html +=
+          "<li><a href=\"" + name + "\">" + name + "</a> (" +
+          String(capture.bytes) + " bytes, " +
+          FlightTriggerName((FlightTriggerReason)capture.reason) + " " +
+          String(capture.reason_index) + ", boot " + String(capture.boot_id) +
+          ", uptime " + String((uint32_t)(capture.trigger_uptime_ms / 1000)) +
+          " s)</li>\n";
     }
-    vTaskDelay(pdMS_TO_TICKS(100));
+    FlightRecorderStats fr = recorder->GetStats();
+    uint32_t taken = fr.samples + fr.samples_dropped;
+    html +=
+        "</ul><p>Samples: " + String(fr.samples) + " (dropped " +
+        String(fr.samples_dropped) + "), " +
+        String((uint32_t)recorder->sample_size()) + " bytes each, " +
+        String(recorder->ring_samples()) + " in RAM, sample time avg/max: " +
+        String(taken > 0 ? fr.sample_time_us_total / taken : 0) + "/" +
+        String(fr.sample_time_us_max) + " us, triggers: " +
+        String(fr.triggers) + " (ignored " + String(fr.triggers_ignored) +
+        "), captures: " + String(fr.captures_written) +
+        ", write time last/max: " + String(fr.write_time_us_last) + "/" +
+        String(fr.write_time_us_max) + " us</p>\n";
   }
+  html += "</body></html>\n";
+  response->Begin("200 OK", "Content-Type: text/html\r\n");
+  response->Write(html.c_str(), html.length());
 }
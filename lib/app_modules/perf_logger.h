@@ -2,64 +2,267 @@
 #define PERF_LOGGER_H
 
 #include <Arduino.h>
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "flight_recorder.h"
+#include "http_request.h"
+#include "http_router.h"
+#include "perf_log_catalog.h"
+#include "perf_log_format.h"
+#include "perf_log_query.h"
+#include "perf_log_rollup.h"
+#include "perf_log_stream.h"
 #include "pwm_fan.h"
+#include "status_history.h"
 #include "thermistor.h"
 
-// Structure for a single performance log record
-// Packed to ensure consistent size on disk
-// Note: Total size is 21 bytes (2 timestamp + 16 fans + 3 thermistors)
-// The requirement mentioned 20 bytes but listed fields summing to 21 (or 25
-// depending on interpretation). We follow the field list which results in 21
-// bytes.
-struct __attribute__((packed)) PerfLogRecord {
-  uint16_t timestamp;  // Seconds since boot
-
-  // Fan 1
-  uint8_t fan1_target_duty;
-  uint8_t fan1_current_duty;
-  uint16_t fan1_rpm;
-
-  // Fan 2
-  uint8_t fan2_target_duty;
-  uint8_t fan2_current_duty;
-  uint16_t fan2_rpm;
-
-  // Fan 3
-  uint8_t fan3_target_duty;
-  uint8_t fan3_current_duty;
-  uint16_t fan3_rpm;
-
-  // Fan 4 (Pump)
-  uint8_t fan4_target_duty;
-  uint8_t fan4_current_duty;
-  uint16_t fan4_rpm;
-
-  // Thermistors
-  uint8_t temp_ambient;
-  uint8_t temp_coolant_in;
-  uint8_t temp_coolant_out;
+// Write statistics, for measuring the cost of logging
+struct PerfLogStats {
+  uint32_t records_logged;   // Records accepted into the RAM buffer
+  uint32_t records_dropped;  // Lost to full buffers or a failed file open
+  uint32_t flushes;          // Buffer flushes (each one open/write/close)
+  uint32_t file_writes;      // Open/write/close cycles (one per block)
+  uint32_t bytes_written;    // Including file and block headers
+  uint32_t records_flushed;  // Records written to flash
+  uint32_t rollups_written;  // Minute and hour rollup records written
+  uint32_t rollups_dropped;  // Lost to a full buffer or a failed file open
+  uint32_t encode_time_us_total;  // Block encoding time
+  uint32_t record_time_us_total;  // LoggingTask time spent per record
+  uint32_t record_time_us_max;
+  uint32_t flush_time_us_last;  // Flash time of the last flush
+  uint32_t flush_time_us_max;
+  uint32_t flush_time_us_total;
 };
 
+// PerfLogger - Binary performance log on LittleFS
+//
+// Records the channels listed in PERF_LOG_CHANNELS (perf_log_schema.h) once
+// per second: the first kLoggedFans fans and kLoggedThermistors thermistors of
+// the topology; missing channels are logged as 0.
+//
+// Write-behind buffering: LoggingTask only appends records to one of two RAM
+// buffers and never touches flash. When the active buffer is full or
+// FLUSH_INTERVAL_MS has passed, the buffers are swapped and FlushTask writes
+// the full one as one compressed block (see perf_log_format.h) with a single
+// open/write/close. If the flash is still busy with the previous buffer when
+// the active one fills up, new records are dropped (and counted) rather than
+// blocking the logger.
+//
+// On power loss at most the records buffered since the last flush are lost,
+// i.e. about FLUSH_INTERVAL_MS of data. Blocks are CRC-checked, so a write
+// torn by the power cut is detected at the next boot and cut off the newest
+// file (the only one that can have one); readers skip corrupt blocks
+// anywhere else.
+//
+// Files use the versioned format in perf_log_format.h: each file starts with a
+// header (boot id, start uptime, wall-clock base once NTP has synced) and
+// records carry millisecond deltas, so timelines stay exact across long runs
+// and reboots.
+//
+// Alongside the 1 s raw log, per-minute and per-hour min/max/mean rollups
+// (perf_log_rollup.h) are kept in their own rotating stores with longer
+// retention, so long time ranges can be read without scanning raw data.
+//
+// Retention is by size: the stores share a byte budget (PERF_LOG_BUDGET_BYTES,
+// or PERF_LOG_BUDGET_PERCENT of the space free for logs at boot) and each
+// deletes its oldest files when it outgrows its share. Files are tracked in
+// in-memory catalogs built once at boot, so rotation does not scan the
+// filesystem.
+//
+// The raw catalog also indexes every block with its start time, so
+// "GET /range?from=&to=&channels=" (perf_log_query.h) seeks straight to the
+// blocks of the requested time range and streams them as CSV.
+//
+// The downloads are routes of the web server under kRoutePrefix ("/logs/"),
+// which kLegacyPort also serves at its root. Files are streamed from flash as
+// the socket drains, with Range support (perf_log_stream.h), and "GET /all"
+// sends a whole store as one response; /range and /since decode a block at a
+// time. The index also lists and serves the FlightRecorder's captures
+// ("perf_capture_<n>.dat"), and "POST /capture" requests one.
+//
+// Every record also goes into a RAM ring of the newest STATUS_HISTORY_SECONDS
+// (status_history.h), from which the web UI's /api/history fills its charts
+// on page load.
 class PerfLogger {
  public:
-  PerfLogger(PWMFan* fan1, PWMFan* fan2, PWMFan* fan3, PWMFan* pump,
-             Thermistor* ambient, Thermistor* coolant_in,
-             Thermistor* coolant_out);
+  static constexpr int kLoggedFans =
+      std::max({PerfLogInstanceCount(kPerfLogFanTarget),
+                PerfLogInstanceCount(kPerfLogFanDuty),
+                PerfLogInstanceCount(kPerfLogFanRpm)});
+  static constexpr int kLoggedThermistors =
+      PerfLogInstanceCount(kPerfLogTemperature);
+
+  PerfLogger(const std::vector<PWMFan*>& fans,
+             const std::vector<Thermistor*>& thermistors);
+  // A started logger runs for the life of the firmware; only unstarted ones
+  // (as in tests) may be destroyed
+  ~PerfLogger();
 
   // Initialize file system and start logging task
   void Start();
 
+  // Copy of the write statistics
+  PerfLogStats GetStats() const;
+
+  // Id of this boot, as written to the file headers; 0 before Start()
+  uint32_t GetBootId() const { return boot_id_; }
+
+  // Call `read` with the RAM history, holding off new records until it
+  // returns
+  void ReadHistory(void (*read)(const StatusHistory& history, void* context),
+                   void* context);
+
+  // The started logger, or nullptr
+  static PerfLogger* Running() { return instance_; }
+
+  // Where the download routes are on the web server
+  static constexpr const char* kRoutePrefix = "/logs";
+
+  // The port the downloads had their own server on, kept as an alias of
+  // kRoutePrefix for existing clients
+  static constexpr uint16_t kLegacyPort = 5599;
+
+  // Add the download routes to the web server
+  void AddRoutes(HttpRouter* router);
+
  private:
+  // Records per RAM buffer
+  static constexpr int kBufferRecords = kPerfLogMaxBlockRecords;
+
+  // Rollup records per RAM buffer (a buffer spans about a minute)
+  static constexpr int kBufferRollups = 4;
+
+  enum RollupTier { kMinuteTier, kHourTier, kRollupTierCount };
+
+  struct PendingRollup {
+    RollupTier tier;
+    uint64_t start_ms;  // start_s is set on flush, relative to the file
+    PerfLogRollupRecord record;
+  };
+
+  struct WriteBuffer {
+    PerfLogRecord records[kBufferRecords];
+    // Sample times; delta_ms is set on flush, when file boundaries are known
+    uint64_t uptime_ms[kBufferRecords];
+    int64_t wall_clock_offset_ms;  // Unix time minus uptime, 0 if unknown
+    int count;
+    PendingRollup rollups[kBufferRollups];
+    int rollup_count;
+  };
+
+  // A set of rotating files "/<prefix><index>.dat" sharing a byte budget
+  struct LogStore {
+    const char* prefix;
+    int budget_percent;       // Share of the total perf log budget
+    uint64_t budget_bytes;
+    PerfLogCatalog catalog;   // Newest segment is the file being appended to
+    uint64_t last_uptime_ms;  // Last record written to the newest file
+  };
+
+  // Query access to the files of a store; keeps the last file open
+  class StoreFiles : public PerfLogStorage {
+   public:
+    explicit StoreFiles(const LogStore& store) : store_(store) {}
+    ~StoreFiles() override;
+    size_t Read(int index, uint32_t offset, uint8_t* out,
+                size_t size) override;
+
+   private:
+    const LogStore& store_;
+    File file_;
+    int index_ = -1;
+  };
+
   // Task functions
   static void LoggingTask(void* parameter);
-  static void ServerTask(void* parameter);
+  static void FlushTask(void* parameter);
+
+  // Hand the active buffer to FlushTask. Returns false if the previous flush
+  // is still in progress.
+  bool SwapBuffers();
+
+  // Write a buffer's records to flash as blocks, rotating files as they
+  // fill up
+  void WriteBufferToFlash(WriteBuffer& buffer);
+
+  // Append a buffer's rollups to their tier's store
+  void WriteRollupsToFlash(WriteBuffer& buffer);
+
+  // Unix time minus uptime in ms, or 0 if the clock is not set yet
+  static int64_t WallClockOffsetMs(uint64_t uptime_ms);
 
-  // Helper to manage file rotation
-  void RotateFiles();
+  // Unix time in ms at `uptime_ms` as seen by a buffer, or 0 if unknown
+  static int64_t WallClockAt(const WriteBuffer& buffer, uint64_t uptime_ms);
 
-  // Helper to get next filename
-  String GetCurrentFileName();
+  // Build the catalogs of all stores with one directory scan, recover torn
+  // writes, size the budgets and start a new file in each
+  void OpenStores();
+
+  // Catalog entry of an existing file: header fields, plus the block index
+  // of raw files
+  void ReadSegment(const LogStore& store, int index, File& file,
+                   PerfLogSegment* segment);
+
+  // Cut a torn write off the end of a store's newest file, or remove the
+  // file if no records survive
+  void RecoverNewestFile(LogStore* store);
+
+  // Move on to a new file, deleting the oldest files beyond the budget
+  void StartNextFile(LogStore* store);
+
+  // Record the header just written to the newest file of a store
+  void SetNewestFileHeader(LogStore* store, const PerfLogFileHeader& header);
+
+  // Account for bytes appended to the newest file of a store
+  void GrowNewestFile(LogStore* store, uint32_t bytes, uint64_t end_uptime_ms);
+
+  // Account for a block of `records` records appended to the newest raw
+  // file and index it
+  void AddBlockToNewestFile(LogStore* store, uint32_t bytes, uint32_t records,
+                            uint32_t first_offset_ms, uint64_t end_uptime_ms);
+
+  // Consistent copy of a store's catalog (oldest first) and its size
+  std::vector<PerfLogSegment> CopyCatalog(const LogStore& store,
+                                          uint64_t* allocated);
+
+  // Answer with `segments` concatenated, or the part `range` (a Range
+  // header value or nullptr) selects, as 200, 206 or 416
+  void StreamSegments(HttpResponse* response, const String& headers,
+                      const std::vector<PerfLogSegment>& segments,
+                      const char* range,
+                      std::unique_ptr<PerfLogStorage> storage);
+
+  // Answer "GET /perf_*" with one file
+  void ServeFile(HttpResponse* response, const char* path, const char* range);
+
+  // Whether `path` ("/<name>") is a file of a store or a flight recorder
+  // capture, and so may be served
+  bool IsLogFile(const char* path);
+
+  // Answer "GET /all?store=raw|minute|hour" with every file of a store
+  void ServeAll(HttpResponse* response, const char* target, const char* range);
+
+  // Answer "GET /range?..." from the raw store
+  void ServeRange(HttpResponse* response, const char* target);
+
+  // Answer "GET /since?seq=N" with the raw records numbered after N
+  void ServeSince(HttpResponse* response, const char* target);
+
+  // Answer "GET /" with the file list and statistics
+  void ServeIndex(HttpResponse* response);
+
+  // Index of a store file name (with or without leading slash), or -1
+  static int ParseFileIndex(const String& name, const char* prefix);
+
+  // "/<prefix><index>.dat"
+  static String GetFileName(const LogStore& store, int index);
 
   // Helper to encode temperature
   uint8_t EncodeTemperature(float temp_c);
@@ -67,11 +270,34 @@ class PerfLogger {
   // Helper to encode duty cycle
   uint8_t EncodeDutyCycle(float duty_percent);
 
-  PWMFan* fans_[4];
-  Thermistor* thermistors_[3];
+  PWMFan* fans_[kLoggedFans];
+  Thermistor* thermistors_[kLoggedThermistors];
+
+  LogStore raw_store_;
+  LogStore rollup_stores_[kRollupTierCount];
+  SemaphoreHandle_t catalog_mutex_;  // Guards the store catalogs
+  PerfLogRollup rollups_[kRollupTierCount];  // Used by LoggingTask only
+  uint32_t boot_id_;
+  uint64_t next_seq_;  // Of the next raw record written; FlushTask only
+
+  // Double buffer: LoggingTask fills buffers_[active_buffer_] while FlushTask
+  // writes buffers_[1 - active_buffer_] when flush_pending_ is set. Static
+  // (with encode_buffer_), like the history, to keep about 7 KB off the
+  // stack of the task constructing the logger
+  static WriteBuffer buffers_[2];
+  int active_buffer_;
+  volatile bool flush_pending_;
+  unsigned long last_swap_ms_;
+  TaskHandle_t flush_task_handle_;
+  static uint8_t encode_buffer_[kPerfLogMaxBlockSize];  // FlushTask only
+
+  PerfLogStats stats_;
+  mutable portMUX_TYPE stats_lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+  StatusHistory history_;
+  SemaphoreHandle_t history_mutex_;  // Guards history_
 
-  int current_file_index_;
-  int current_record_count_;
+  static PerfLogger* instance_;
 };
 
 #endif  // PERF_LOGGER_H
@@ -0,0 +1,102 @@
+#include "topology_loader.h"
+
+#include <LittleFS.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.h"
+
+constexpr size_t kMaxTopologyFileSize = 2048;
+
+// Fans and pumps the board can drive: one LEDC channel each, and the
+// ESP32-C3 has 6
+constexpr int kMaxBoardFans = 6;
+
+const char* const kDefaultTopologyPath = "/topology.cfg";
+
+// WARNING: D8 (GPIO 8) and D9 (GPIO 9) are strapping pins on ESP32-C3.
+// D8 is used to select the boot mode (Download Boot if LOW, SPI Boot if HIGH).
+// D9 is used for internal voltage selection and should be pulled up.
+// Ensure your fan circuitry does not pull these pins to an invalid state during
+// boot!
+const char* const kDefaultTopology =
+    "sensor Ambient A0\n"
+    "sensor Coolant_In A1\n"
+    "sensor Coolant_Out A2\n"
+    "fan Fan1 D3 D4 40\n"
+    "fan Fan2 D5 D6 20\n"
+    "fan Fan3 D8 D7 25\n"
+    "pump Pump D10 D9 50\n"
+    "zone Loop max reference=Ambient sensors=Coolant_In,Coolant_Out "
+    "fans=Fan1,Fan2,Fan3,Pump\n";
+
+namespace {
+
+struct PinName {
+  const char* name;
+  uint8_t pin;
+};
+
+const PinName kPinNames[] = {
+    {"D0", D0}, {"D1", D1}, {"D2", D2}, {"D3", D3},   {"D4", D4},
+    {"D5", D5}, {"D6", D6}, {"D7", D7}, {"D8", D8},   {"D9", D9},
+    {"D10", D10}, {"A0", A0}, {"A1", A1}, {"A2", A2},
+};
+
+}  // namespace
+
+int ResolveBoardPin(const char* name) {
+  for (const PinName& pin_name : kPinNames) {
+    if (strcmp(pin_name.name, name) == 0) return pin_name.pin;
+  }
+
+  // Raw GPIO number
+  char* end = nullptr;
+  long gpio = strtol(name, &end, 10);
+  if (end == name || *end != '\0' || gpio < 0 || gpio > 48) return -1;
+  return gpio;
+}
+
+StatusOr<Topology> LoadTopologyFile(const char* path) {
+  if (!LittleFS.begin(true)) {
+    return Status(StatusCode::kInternalError, "LittleFS mount failed");
+  }
+  if (!LittleFS.exists(path)) {
+    return Status(StatusCode::kInternalError, String("No ") + path);
+  }
+
+  File f = LittleFS.open(path, "r");
+  if (!f) {
+    return Status(StatusCode::kInternalError, String("Failed to open ") + path);
+  }
+  if (f.size() > kMaxTopologyFileSize) {
+    f.close();
+    return Status::OutOfRange(String(path) + " too large");
+  }
+  String text = f.readString();
+  f.close();
+
+  Topology topology;
+  char error[64];
+  if (ParseTopology(text.c_str(), ResolveBoardPin, &topology, error,
+                    sizeof(error)) != nullptr) {
+    return Status::InvalidArgument(String(path) + " " + error);
+  }
+  if (topology.fan_count > kMaxBoardFans) {
+    return Status::InvalidArgument(String(path) + " has more than " +
+                                   kMaxBoardFans + " fans and pumps");
+  }
+  return topology;
+}
+
+Topology DefaultTopology() {
+  Topology topology;
+  char error[64];
+  if (ParseTopology(kDefaultTopology, ResolveBoardPin, &topology, error,
+                    sizeof(error)) != nullptr) {
+    // Only reachable if kDefaultTopology itself is broken
+    Logger::println(String("Default topology invalid: ") + error);
+  }
+  return topology;
+}
@@ -0,0 +1,31 @@
+#ifndef TOPOLOGY_LOADER_H
+#define TOPOLOGY_LOADER_H
+
+#include <Arduino.h>
+
+#include "status.h"
+#include "topology.h"
+
+// Topology loading for the Xiao ESP32C3 board
+//
+// The sensor/fan/zone layout is read from a text file on LittleFS (see
+// topology.h for the format), so builds with more radiators and probes only
+// need a different /topology.cfg. Pins are given by their board names (D0-D10,
+// A0-A2) or as raw GPIO numbers.
+//
+// kDefaultTopology describes the original hardware (3 thermistors, 3 case fans
+// and a pump in a single zone) and is used when no file is present.
+
+extern const char* const kDefaultTopologyPath;
+extern const char* const kDefaultTopology;
+
+// Resolve a board pin name to a GPIO number (-1 if unknown)
+int ResolveBoardPin(const char* name);
+
+// Parse the topology stored at `path`
+StatusOr<Topology> LoadTopologyFile(const char* path);
+
+// Parse the built-in topology
+Topology DefaultTopology();
+
+#endif  // TOPOLOGY_LOADER_H
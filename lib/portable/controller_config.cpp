@@ -0,0 +1,119 @@
+#include "controller_config.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+ControllerConfig DefaultControllerConfig() {
+  ControllerConfig config;
+  config.update_interval_ms = 1000;
+  config.min_delta_t = 5.0f;
+  config.max_delta_t = 8.0f;
+  config.base_water_temp = 25.0f;
+  config.max_water_temp = 30.0f;
+  config.delta_t_weight = 0.4f;
+  config.water_temp_weight = 0.6f;
+  for (int i = 0; i < kMaxFanChannels; i++) {
+    config.min_duty_percent[i] = 50.0f;
+  }
+  return config;
+}
+
+const char* ValidateControllerConfig(const ControllerConfig& config,
+                                     const float* min_duty_floor) {
+  if (config.update_interval_ms < 100 || config.update_interval_ms > 60000) {
+    return "update_interval_ms must be between 100 and 60000";
+  }
+  if (!(config.max_delta_t > config.min_delta_t)) {
+    return "max_delta_t must be greater than min_delta_t";
+  }
+  if (!(config.max_water_temp > config.base_water_temp)) {
+    return "max_water_temp must be greater than base_water_temp";
+  }
+  if (!(config.delta_t_weight >= 0.0f && config.delta_t_weight <= 1.0f) ||
+      !(config.water_temp_weight >= 0.0f &&
+        config.water_temp_weight <= 1.0f)) {
+    return "weights must be between 0 and 1";
+  }
+  for (int i = 0; i < kMaxFanChannels; i++) {
+    if (!(config.min_duty_percent[i] >= 0.0f &&
+          config.min_duty_percent[i] <= 100.0f)) {
+      return "min_duty must be between 0 and 100";
+    }
+    if (min_duty_floor != nullptr &&
+        config.min_duty_percent[i] < min_duty_floor[i]) {
+      return "min_duty of a pump must not be below its topology minimum";
+    }
+  }
+  return nullptr;
+}
+
+const char* SetControllerConfigField(ControllerConfig* config,
+                                     const char* name, float value) {
+  if (!std::isfinite(value)) return "value must be a finite number";
+  if (strcmp(name, "update_interval_ms") == 0) {
+    // Range-checked before the cast, which is undefined outside uint32_t
+    if (!(value >= 0.0f && value <= 60000.0f)) {
+      return "update_interval_ms must be between 100 and 60000";
+    }
+    config->update_interval_ms = (uint32_t)value;
+  } else if (strcmp(name, "min_delta_t") == 0) {
+    config->min_delta_t = value;
+  } else if (strcmp(name, "max_delta_t") == 0) {
+    config->max_delta_t = value;
+  } else if (strcmp(name, "base_water_temp") == 0) {
+    config->base_water_temp = value;
+  } else if (strcmp(name, "max_water_temp") == 0) {
+    config->max_water_temp = value;
+  } else if (strcmp(name, "delta_t_weight") == 0) {
+    config->delta_t_weight = value;
+  } else if (strcmp(name, "water_temp_weight") == 0) {
+    config->water_temp_weight = value;
+  } else if (strncmp(name, "min_duty_", 9) == 0) {
+    char* end = nullptr;
+    long channel = strtol(name + 9, &end, 10);
+    if (end == name + 9 || *end != '\0' || channel < 1 ||
+        channel > kMaxFanChannels) {
+      return "unknown field";
+    }
+    config->min_duty_percent[channel - 1] = value;
+  } else {
+    return "unknown field";
+  }
+  return nullptr;
+}
+
+float CalculateFanSpeed(const ControllerConfig& config, float delta_t,
+                        float water_temp) {
+  // Hybrid formula: considers both deltaT and absolute water temperature
+  // This ensures fans ramp up earlier on hot ambient days
+
+  // Factor 1: DeltaT contribution (0.0 to 1.0)
+  if (delta_t < config.min_delta_t) delta_t = config.min_delta_t;
+  float delta_t_factor = (delta_t - config.min_delta_t) /
+                         (config.max_delta_t - config.min_delta_t);
+  if (delta_t_factor > 1.0f) delta_t_factor = 1.0f;
+
+  // Factor 2: Absolute water temperature contribution (0.0 to 1.0)
+  float water_temp_factor = (water_temp - config.base_water_temp) /
+                            (config.max_water_temp - config.base_water_temp);
+  if (water_temp_factor > 1.0f) water_temp_factor = 1.0f;
+  if (water_temp_factor < 0.0f) water_temp_factor = 0.0f;
+
+  // Combine factors with weighting
+  float combined_factor = (config.delta_t_weight * delta_t_factor) +
+                          (config.water_temp_weight * water_temp_factor);
+
+  // Calculate final speed intensity (0-100%)
+  float speed = combined_factor * 100.0f;
+
+  // Clamp to valid range
+  if (speed < 0.0f) {
+    speed = 0.0f;
+  }
+  if (speed > 100.0f) {
+    speed = 100.0f;
+  }
+
+  return speed;
+}
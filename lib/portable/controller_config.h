@@ -0,0 +1,62 @@
+#ifndef CONTROLLER_CONFIG_H
+#define CONTROLLER_CONFIG_H
+
+#include <cstdint>
+
+// ControllerConfig - Runtime-tunable parameters of the fan control curve
+//
+// Plain data so it can be published through an RcuCell, persisted to flash
+// as-is and unit tested on the host. FanController reads one consistent copy
+// per control tick, so changes take effect on the next tick without a reboot.
+//
+// Speed Calculation (see CalculateFanSpeed):
+// - DeltaT factor: 0 at min_delta_t, 1 at max_delta_t and above
+// - Water temp factor: 0 at base_water_temp, 1 at max_water_temp and above
+// - Intensity = 100 * (delta_t_weight * DeltaT + water_temp_weight * Water)
+//
+// Per-channel minimum duty cycles are indexed in the controller's channel
+// order (fans first, then pumps).
+
+// Maximum number of fan/pump channels a config can describe
+constexpr int kMaxFanChannels = 8;
+
+struct ControllerConfig {
+  uint32_t update_interval_ms;  // Control loop period
+  float min_delta_t;        // DeltaT below which delta_t_weight has no effect
+  float max_delta_t;        // DeltaT giving the maximum DeltaT contribution
+  float base_water_temp;    // Reference water temp (comfortable baseline)
+  float max_water_temp;     // Water temp giving the maximum boost
+  float delta_t_weight;     // Weight of the DeltaT factor (0.0 - 1.0)
+  float water_temp_weight;  // Weight of the absolute water temp factor
+  float min_duty_percent[kMaxFanChannels];  // Per-channel minimum duty cycle
+};
+
+// Factory defaults (the values the controller shipped with)
+ControllerConfig DefaultControllerConfig();
+
+// Returns nullptr if the config is usable, otherwise a description of the
+// first problem found. `min_duty_floor` (kMaxFanChannels entries, or nullptr
+// for none) is the lowest min_duty each channel may be given, e.g. a pump's
+// topology minimum.
+const char* ValidateControllerConfig(const ControllerConfig& config,
+                                     const float* min_duty_floor = nullptr);
+
+// Set a single field by its external name (as used by the HTTP API), e.g.
+// "max_delta_t" or "min_duty_2" (1-based channel). Returns nullptr on
+// success, or a description of the problem: an unknown name, a value that is
+// not finite, or one the field cannot hold. The result still needs to be
+// validated.
+const char* SetControllerConfigField(ControllerConfig* config,
+                                     const char* name, float value);
+
+// Calculate target fan speed intensity (0-100%) from DeltaT and the highest
+// water temperature.
+float CalculateFanSpeed(const ControllerConfig& config, float delta_t,
+                        float water_temp);
+
+// Scale an intensity (0-100%) onto the range [min_duty, 100%]
+inline float ScaleToMinimumDuty(float intensity, float min_duty) {
+  return min_duty + (intensity / 100.0f) * (100.0f - min_duty);
+}
+
+#endif  // CONTROLLER_CONFIG_H
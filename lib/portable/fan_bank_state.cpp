@@ -0,0 +1,99 @@
+#include "fan_bank_state.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr float kSmoothingStepFraction = 0.02f;  // 2% of the difference
+constexpr float kSnapThreshold = 0.001f;
+constexpr int kDebounceSamples = 5;
+constexpr int kDebounceMajority = 3;
+
+// Population count of the low 5 bits
+inline int CountHighSamples(uint8_t history) {
+  static const uint8_t kBits[32] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2,
+                                    3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3,
+                                    3, 4, 2, 3, 3, 4, 3, 4, 4, 5};
+  return kBits[history & ((1 << kDebounceSamples) - 1)];
+}
+
+}  // namespace
+
+void InitFanBankState(FanBankState* state) {
+  memset(state, 0, sizeof(*state));
+}
+
+uint32_t StepFanRamps(FanBankState* state, int resolution_bits) {
+  // Ensure minimum step of 1/(2^resolution) to avoid stalling
+  // 100.0f because we are working with percentages
+  float min_step = 100.0f / (1 << resolution_bits);
+  if (min_step < 0.1f) min_step = 0.1f;
+
+  uint32_t changed = 0;
+  for (int ch = 0; ch < kMaxBankChannels; ch++) {
+    if (!(state->active_mask & (1u << ch))) continue;
+
+    float duty = state->duty[ch];
+    float target = state->target[ch];
+    float difference = target - duty;
+    if (fabsf(difference) <= kSnapThreshold) {
+      // If very close to target, snap to target.
+      duty = target;
+    } else {
+      float step = difference * kSmoothingStepFraction;
+      if (fabsf(step) < min_step) {
+        step = (difference > 0) ? min_step : -min_step;
+      }
+      duty += step;
+
+      // Clamp to avoid overshooting
+      if ((difference > 0 && duty > target) ||
+          (difference < 0 && duty < target)) {
+        duty = target;
+      }
+    }
+    state->duty[ch] = duty;
+
+    uint16_t pwm_value = DutyToPwmValue(duty, resolution_bits);
+    if (pwm_value != state->pwm_value[ch]) {
+      state->pwm_value[ch] = pwm_value;
+      changed |= 1u << ch;
+    }
+  }
+  return changed;
+}
+
+void SampleFanTachs(FanBankState* state, uint32_t levels) {
+  uint32_t channels = state->active_mask & state->sampling_mask;
+  for (int ch = 0; ch < kMaxBankChannels; ch++) {
+    uint32_t bit = 1u << ch;
+    if (!(channels & bit)) continue;
+
+    uint8_t history = (uint8_t)((state->tach_history[ch] << 1) |
+                                ((levels & bit) ? 1 : 0));
+    state->tach_history[ch] = history;
+
+    // Determine current state by majority vote, count rising edges
+    bool high = CountHighSamples(history) >= kDebounceMajority;
+    if (high && !(state->tach_level_mask & bit)) {
+      state->pulses[ch]++;
+    }
+    if (high) {
+      state->tach_level_mask |= bit;
+    } else {
+      state->tach_level_mask &= ~bit;
+    }
+  }
+}
+
+void UpdateFanRpms(FanBankState* state, uint32_t elapsed_ms) {
+  if (elapsed_ms == 0) return;
+  for (int ch = 0; ch < kMaxBankChannels; ch++) {
+    if (!(state->active_mask & (1u << ch))) continue;
+    // Standard PC fans emit 2 pulses per revolution
+    state->rpm[ch] = (state->pulses[ch] / 2) * (int32_t)(60000 / elapsed_ms);
+    state->pulse_total[ch] += state->pulses[ch];
+    state->pulses[ch] = 0;
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef FAN_BANK_STATE_H
+#define FAN_BANK_STATE_H
+
+#include <cstdint>
+
+// FanBankState - Struct-of-arrays state and update kernels for a bank of fans
+//
+// Holds duty, target, minimum, RPM and tach state for every channel in
+// parallel arrays so one task can update all ramps and tachometers in a tight
+// loop. Hardware I/O (PWM writes, pin reads, interrupts) is left to the caller
+// (see FanBank), which keeps these kernels testable on the host.
+//
+// Channel sets are bitmasks (bit n = channel n).
+
+constexpr int kMaxBankChannels = 16;
+
+struct FanBankState {
+  uint32_t active_mask;    // Channels in use
+  uint32_t sampling_mask;  // Channels whose tach is debounced by sampling
+  uint32_t override_mask;  // Channels locked by a manual override
+
+  float duty[kMaxBankChannels];      // Current duty cycle (%)
+  float target[kMaxBankChannels];    // Target duty cycle (%)
+  float min_duty[kMaxBankChannels];  // Minimum duty cycle (%)
+  uint16_t pwm_value[kMaxBankChannels];  // Last value written to PWM
+
+  int32_t pulses[kMaxBankChannels];  // Tach pulses since the last RPM update
+  uint32_t pulse_total[kMaxBankChannels];  // Pulses before that (wraps)
+  int32_t rpm[kMaxBankChannels];     // Latest RPM
+
+  // Debounce history: last 5 raw samples per channel (bit 0 = newest)
+  uint8_t tach_history[kMaxBankChannels];
+  uint32_t tach_level_mask;  // Debounced tach level per channel
+};
+
+// Clear all channels
+void InitFanBankState(FanBankState* state);
+
+// Duty cycle (%) to PWM compare value at the given resolution
+inline uint16_t DutyToPwmValue(float duty_percent, int resolution_bits) {
+  return (uint16_t)((1 << resolution_bits) * duty_percent / 100.0f);
+}
+
+// Move every active channel a fraction of the way towards its target (with a
+// minimum step so ramps never stall) and recompute its PWM value. Returns the
+// mask of channels whose PWM value changed and must be written out.
+uint32_t StepFanRamps(FanBankState* state, int resolution_bits);
+
+// Feed one raw tach sample per sampling channel (bit n of `levels` set = pin
+// n high). A channel's level is the majority of its last 5 samples; each
+// debounced rising edge counts one pulse.
+void SampleFanTachs(FanBankState* state, uint32_t levels);
+
+// Convert the pulses counted over `elapsed_ms` into RPM (2 pulses per
+// revolution), move them to pulse_total and reset the counters.
+void UpdateFanRpms(FanBankState* state, uint32_t elapsed_ms);
+
+#endif  // FAN_BANK_STATE_H
@@ -0,0 +1,128 @@
+#include "flight_capture.h"
+
+#include <cmath>
+#include <cstring>
+
+const char* FlightTriggerName(FlightTriggerReason reason) {
+  switch (reason) {
+    case kFlightTriggerNone:
+      return "none";
+    case kFlightTriggerSensorError:
+      return "sensor_error";
+    case kFlightTriggerFanStall:
+      return "fan_stall";
+    case kFlightTriggerTempSlope:
+      return "temp_slope";
+    case kFlightTriggerManual:
+      return "manual";
+  }
+  return "unknown";
+}
+
+FlightRing::FlightRing(uint8_t* storage, size_t capacity_bytes,
+                       size_t sample_size, int pre_samples, int post_samples)
+    : storage_(storage),
+      sample_size_(sample_size),
+      capacity_(sample_size > 0 ? (int)(capacity_bytes / sample_size) : 0),
+      pre_samples_(pre_samples > 0 ? pre_samples : 0),
+      post_samples_(post_samples > 0 ? post_samples : 0) {
+  // Keep the whole window in the ring, giving up pre-trigger samples first
+  int room = capacity_ > 0 ? capacity_ - 1 : 0;
+  if (post_samples_ > room) post_samples_ = room;
+  if (pre_samples_ > room - post_samples_) pre_samples_ = room - post_samples_;
+}
+
+bool FlightRing::Add(const uint8_t* sample) {
+  if (frozen_ || capacity_ == 0) return false;
+  memcpy(storage_ + (total_ % capacity_) * sample_size_, sample, sample_size_);
+  total_++;
+  if (triggered_ && total_ - 1 - trigger_ >= (uint32_t)post_samples_) {
+    frozen_ = true;
+  }
+  return true;
+}
+
+bool FlightRing::Trigger() {
+  if (triggered_ || total_ == 0) return false;
+  triggered_ = true;
+  trigger_ = total_ - 1;
+  if (post_samples_ == 0) frozen_ = true;
+  return true;
+}
+
+uint32_t FlightRing::capture_samples() const {
+  if (!frozen_) return 0;
+  uint32_t pre = trigger_ < (uint32_t)pre_samples_ ? trigger_ : pre_samples_;
+  return pre + 1 + post_samples_;
+}
+
+void FlightRing::GetCapture(const uint8_t** first, size_t* first_bytes,
+                            const uint8_t** second, size_t* second_bytes,
+                            uint32_t* trigger_sample) const {
+  uint32_t count = capture_samples();
+  uint32_t start = total_ - count;
+  uint32_t head = start % capacity_;
+  uint32_t first_count = count;
+  if (head + first_count > (uint32_t)capacity_) first_count = capacity_ - head;
+
+  *first = storage_ + head * sample_size_;
+  *first_bytes = first_count * sample_size_;
+  *second = storage_;
+  *second_bytes = (count - first_count) * sample_size_;
+  *trigger_sample = trigger_ - start;
+}
+
+void FlightRing::Release() {
+  // Samples were dropped while frozen, so start over rather than let the
+  // next window span the gap
+  total_ = 0;
+  triggered_ = false;
+  frozen_ = false;
+}
+
+FlightTriggerDetector::FlightTriggerDetector(float max_slope_c_per_s,
+                                             int window_s)
+    : max_slope_c_per_s_(max_slope_c_per_s), window_s_(window_s) {
+  if (window_s_ < 1) window_s_ = 1;
+  if (window_s_ > kMaxWindowSeconds) window_s_ = kMaxWindowSeconds;
+  memset(history_, 0, sizeof(history_));
+}
+
+FlightTriggerReason FlightTriggerDetector::Check(const int32_t* rpm,
+                                                 int fan_count,
+                                                 const float* temps,
+                                                 const bool* valid,
+                                                 int sensor_count, int* index) {
+  FlightTriggerReason reason = kFlightTriggerNone;
+  auto fire = [&](FlightTriggerReason r, int i) {
+    if (reason != kFlightTriggerNone) return;
+    reason = r;
+    *index = i;
+  };
+
+  if (fan_count > kMaxFans) fan_count = kMaxFans;
+  for (int i = 0; i < fan_count; i++) {
+    if (last_rpm_[i] > 0 && rpm[i] == 0) fire(kFlightTriggerFanStall, i);
+    last_rpm_[i] = rpm[i];
+  }
+
+  // history_[i] is a ring of window_s_ + 1 readings sharing history_pos_
+  int slots = window_s_ + 1;
+  if (sensor_count > kMaxSensors) sensor_count = kMaxSensors;
+  for (int i = 0; i < sensor_count; i++) {
+    if (!valid[i]) {
+      history_count_[i] = 0;
+      continue;
+    }
+    history_[i][history_pos_] = temps[i];
+    if (history_count_[i] < slots) history_count_[i]++;
+    if (history_count_[i] < slots) continue;
+
+    float oldest = history_[i][(history_pos_ + 1) % slots];
+    float slope = fabsf(temps[i] - oldest) / window_s_;
+    if (slope > max_slope_c_per_s_) fire(kFlightTriggerTempSlope, i);
+  }
+  history_pos_ = (history_pos_ + 1) % slots;
+
+  return reason;
+}
@@ -0,0 +1,138 @@
+#ifndef FLIGHT_CAPTURE_H
+#define FLIGHT_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Flight recorder captures
+//
+// A capture file is a FlightCaptureHeader followed by `sample_count`
+// fixed-size samples, oldest first, taken at `sample_rate_hz`:
+//   uint32_t uptime_ms          Low 32 bits of the uptime
+//   uint8_t  duty[fan_count]    Current duty cycle, 0..255 = 0..100 %
+//   uint8_t  pulses[fan_count]  Tach pulses since the previous sample
+//   uint16_t adc_mv[sensor_count]  Raw thermistor divider voltage
+// Sample `trigger_sample` is the newest one taken before the trigger fired.
+//
+// All fields are little-endian (native on both the ESP32 and the host tools).
+
+constexpr uint32_t kFlightCaptureMagic = 0x52464346;  // "FCFR"
+constexpr uint16_t kFlightCaptureVersion = 1;
+
+enum FlightTriggerReason : uint8_t {
+  kFlightTriggerNone = 0,
+  kFlightTriggerSensorError = 1,  // A sensor started failing
+  kFlightTriggerFanStall = 2,     // A spinning fan's RPM dropped to 0
+  kFlightTriggerTempSlope = 3,    // A temperature changed too fast
+  kFlightTriggerManual = 4,       // Requested over HTTP
+};
+
+// Short name of a trigger reason, e.g. "fan_stall"
+const char* FlightTriggerName(FlightTriggerReason reason);
+
+struct __attribute__((packed)) FlightCaptureHeader {
+  uint32_t magic;        // kFlightCaptureMagic
+  uint16_t version;      // kFlightCaptureVersion
+  uint16_t header_size;  // Bytes; readers skip fields they do not know
+  uint8_t fan_count;
+  uint8_t sensor_count;
+  uint16_t sample_size;  // Bytes per sample
+  uint16_t sample_rate_hz;
+  uint8_t reason;        // FlightTriggerReason
+  uint8_t reason_index;  // Fan or sensor that fired the trigger
+  uint32_t boot_id;
+  uint64_t trigger_uptime_ms;
+  int64_t trigger_wall_clock_ms;  // Unix time of the trigger, 0 if unknown
+  uint32_t sample_count;
+  uint32_t trigger_sample;
+};
+
+// Bytes per sample for a fan and sensor count
+constexpr size_t FlightSampleSize(int fan_count, int sensor_count) {
+  return sizeof(uint32_t) + 2 * fan_count + sizeof(uint16_t) * sensor_count;
+}
+
+// FlightRing - Fixed-size ring of samples that can freeze a trigger window
+//
+// Samples are appended continuously, overwriting the oldest. Trigger() marks
+// the newest sample; once `post_samples` more have arrived the ring freezes:
+// Add() drops samples until Release(), so the window (up to `pre_samples`
+// before the trigger, the trigger sample and `post_samples` after it) can be
+// written out without copying.
+//
+// Not thread-safe; callers serialize Add(), Trigger() and Release(). While
+// frozen the capture is immutable and may be read without the lock.
+class FlightRing {
+ public:
+  // `storage` holds capacity_bytes / sample_size samples; pre_samples +
+  // post_samples + 1 are clamped to that
+  FlightRing(uint8_t* storage, size_t capacity_bytes, size_t sample_size,
+             int pre_samples, int post_samples);
+
+  // Append a copy of `sample`. Returns false if it was dropped because the
+  // ring is frozen.
+  bool Add(const uint8_t* sample);
+
+  // Start a capture window at the newest sample. Returns false if a capture
+  // is already pending or frozen.
+  bool Trigger();
+
+  bool triggered() const { return triggered_; }
+  bool frozen() const { return frozen_; }
+  int capacity() const { return capacity_; }
+
+  // The frozen window, oldest first, as up to two contiguous runs of
+  // samples (`second` may be empty). `trigger_sample` is the trigger's index
+  // in the window.
+  void GetCapture(const uint8_t** first, size_t* first_bytes,
+                  const uint8_t** second, size_t* second_bytes,
+                  uint32_t* trigger_sample) const;
+
+  // Samples in the frozen window
+  uint32_t capture_samples() const;
+
+  // Discard the capture and resume recording
+  void Release();
+
+ private:
+  uint8_t* storage_;
+  size_t sample_size_;
+  int capacity_;  // In samples
+  int pre_samples_;
+  int post_samples_;
+
+  uint32_t total_ = 0;  // Samples ever added (not dropped)
+  bool triggered_ = false;
+  bool frozen_ = false;
+  uint32_t trigger_ = 0;  // Sample index (of total_) of the trigger
+};
+
+// FlightTriggerDetector - Once-a-second checks for fan stalls and fast
+// temperature changes
+class FlightTriggerDetector {
+ public:
+  static constexpr int kMaxFans = 16;
+  static constexpr int kMaxSensors = 8;
+  static constexpr int kMaxWindowSeconds = 30;
+
+  // A temperature slope above `max_slope_c_per_s`, averaged over
+  // `window_s` seconds (1..kMaxWindowSeconds), fires a trigger
+  FlightTriggerDetector(float max_slope_c_per_s, int window_s);
+
+  // Feed one observation; call once a second. Sensors with valid[i] false
+  // restart their slope window. Returns the first trigger found, or
+  // kFlightTriggerNone, and sets `index` to the fan or sensor.
+  FlightTriggerReason Check(const int32_t* rpm, int fan_count,
+                            const float* temps, const bool* valid,
+                            int sensor_count, int* index);
+
+ private:
+  float max_slope_c_per_s_;
+  int window_s_;
+  int32_t last_rpm_[kMaxFans] = {};
+  float history_[kMaxSensors][kMaxWindowSeconds + 1];
+  int history_count_[kMaxSensors] = {};  // Valid readings in a row
+  int history_pos_ = 0;                   // Next slot, shared by all sensors
+};
+
+#endif  // FLIGHT_CAPTURE_H
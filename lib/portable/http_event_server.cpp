@@ -0,0 +1,533 @@
+#include "http_event_server.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // lwIP never raises SIGPIPE
+#endif
+
+namespace {
+
+bool WouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+bool SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Close a socket after discarding request bytes that were never read, which
+// would otherwise make the close a reset that can destroy the response
+void Discard(int fd) {
+  char scratch[256];
+  for (int i = 0; i < 16; i++) {
+    if (recv(fd, scratch, sizeof(scratch), MSG_DONTWAIT) <= 0) break;
+  }
+  close(fd);
+}
+
+// Room before a chunk's data for its size line ("800\r\n" for
+// kSendChunkBytes)
+constexpr size_t kChunkHeadBytes = 8;
+
+// Frame `data` as one chunk of a chunked body
+std::string Chunk(const std::string& data) {
+  char head[24];
+  snprintf(head, sizeof(head), "%zx\r\n", data.size());
+  return head + data + "\r\n";
+}
+
+// True once `deadline` is reached, across clock wrap
+bool Expired(uint32_t now, uint32_t deadline) {
+  return (int32_t)(now - deadline) >= 0;
+}
+
+}  // namespace
+
+void HttpResponse::Begin(const char* status, const char* headers) {
+  head_ = std::string("HTTP/1.1 ") + status + "\r\n" + headers;
+  begun_ = true;
+}
+
+void HttpResponse::Write(const void* data, size_t size) {
+  body_.append((const char*)data, size);
+}
+
+void HttpResponse::Stream(std::unique_ptr<HttpBodySource> source,
+                          int64_t length) {
+  source_ = std::move(source);
+  source_length_ = length;
+}
+
+void HttpResponse::Clear() {
+  begun_ = false;
+  subscribe_ = false;
+  head_.clear();
+  body_.clear();
+  source_.reset();
+  source_length_ = -1;
+}
+
+HttpEventServer::HttpEventServer(int max_connections, uint32_t timeout_ms,
+                                 HttpHandler handler, void* context,
+                                 HttpClockMs clock)
+    : connections_(max_connections),
+      timeout_ms_(timeout_ms),
+      handler_(handler),
+      context_(context),
+      clock_(clock) {}
+
+HttpEventServer::~HttpEventServer() { Stop(); }
+
+void HttpEventServer::SetKeepAlive(uint32_t idle_timeout_ms,
+                                   int max_requests) {
+  idle_timeout_ms_ = idle_timeout_ms;
+  max_requests_ = max_requests;
+}
+
+bool HttpEventServer::Listen(uint16_t port, const char* mount) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  socklen_t length = sizeof(addr);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0 ||
+      !SetNonBlocking(fd) ||
+      getsockname(fd, (sockaddr*)&addr, &length) != 0) {
+    close(fd);
+    return false;
+  }
+  listeners_.push_back({fd, ntohs(addr.sin_port), mount});
+  return true;
+}
+
+void HttpEventServer::Stop() {
+  for (Connection& c : connections_) Close(&c);
+  for (const Listener& listener : listeners_) close(listener.fd);
+  listeners_.clear();
+}
+
+int HttpEventServer::active_connections() const {
+  int active = 0;
+  for (const Connection& c : connections_) active += c.fd >= 0;
+  return active;
+}
+
+int HttpEventServer::subscribers() const {
+  int count = 0;
+  for (const Connection& c : connections_) count += c.fd >= 0 && c.subscribe;
+  return count;
+}
+
+int HttpEventServer::Publish(const void* data, size_t size) {
+  if (subscribers() == 0) return 0;
+
+  // One copy, however many subscribers send it
+  Frame frame = std::make_shared<const std::string>((const char*)data, size);
+  uint32_t now = clock_();
+  int count = 0;
+  for (Connection& c : connections_) {
+    if (c.fd < 0 || !c.subscribe) continue;
+    count++;
+    if (c.next != nullptr) stats_.frames_skipped++;
+    c.next = frame;
+    if (c.state != kSubscribed) continue;  // Still sending its response
+    if (c.frame == nullptr) c.deadline_ms = now + timeout_ms_;
+    OnFrameWritable(&c, now);
+  }
+  return count;
+}
+
+HttpEventServer::Connection* HttpEventServer::OldestIdle() {
+  Connection* oldest = nullptr;
+  for (Connection& c : connections_) {
+    if (c.fd < 0 || !c.idle) continue;
+    if (oldest == nullptr || Expired(oldest->deadline_ms, c.deadline_ms)) {
+      oldest = &c;
+    }
+  }
+  return oldest;
+}
+
+bool HttpEventServer::HasDeadline(const Connection& c) {
+  return c.state != kSubscribed || c.frame != nullptr || c.next != nullptr;
+}
+
+void HttpEventServer::Poll(int timeout_ms) {
+  if (listeners_.empty()) return;
+
+  // Connections wait to read until their response starts, then to write.
+  // With every slot busy (but for idle ones), new clients wait in the
+  // listen backlog.
+  fd_set readable;
+  fd_set writable;
+  FD_ZERO(&readable);
+  FD_ZERO(&writable);
+  bool accepting = active_connections() < (int)connections_.size() ||
+                   OldestIdle() != nullptr;
+  int max_fd = -1;
+  for (const Listener& listener : listeners_) {
+    if (accepting) FD_SET(listener.fd, &readable);
+    if (listener.fd > max_fd) max_fd = listener.fd;
+  }
+  // Subscribers are always read, to notice them leave.
+  for (Connection& c : connections_) {
+    if (c.fd < 0) continue;
+    if (c.state == kSubscribed) {
+      FD_SET(c.fd, &readable);
+      if (HasDeadline(c)) FD_SET(c.fd, &writable);
+    } else {
+      FD_SET(c.fd, c.state == kWriting ? &writable : &readable);
+    }
+    if (c.fd > max_fd) max_fd = c.fd;
+  }
+  timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+  int ready = select(max_fd + 1, &readable, &writable, nullptr, &timeout);
+  uint32_t now = clock_();
+
+  if (ready > 0) {
+    for (Connection& c : connections_) {
+      if (c.fd < 0) continue;
+      bool writable_now = FD_ISSET(c.fd, &writable);
+      if (FD_ISSET(c.fd, &readable)) OnReadable(&c, now);
+      if (c.fd >= 0 && writable_now) {
+        OnWritable(&c, now);
+        ConsumePending(&c, now);
+      }
+    }
+    // After the others, so a new connection's fd is not mistaken for the
+    // closed one it may reuse
+    for (size_t i = 0; accepting && i < listeners_.size(); i++) {
+      if (FD_ISSET(listeners_[i].fd, &readable)) Accept(i, now);
+    }
+  }
+
+  for (Connection& c : connections_) {
+    if (c.fd >= 0 && HasDeadline(c) && Expired(now, c.deadline_ms)) {
+      if (!c.idle) stats_.timeouts++;
+      Close(&c);
+    }
+  }
+}
+
+void HttpEventServer::Accept(int listener, uint32_t now) {
+  // A waiting client takes the slot of an idle one
+  Connection* idle = OldestIdle();
+  if (active_connections() == (int)connections_.size() && idle != nullptr) {
+    Close(idle);
+  }
+
+  for (Connection& c : connections_) {
+    if (c.fd >= 0) continue;
+    int fd = accept(listeners_[listener].fd, nullptr, nullptr);
+    if (fd < 0) return;  // Backlog drained (or an aborted client)
+    if (!SetNonBlocking(fd)) {
+      close(fd);
+      continue;
+    }
+
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    c.fd = fd;
+    c.listener = listener;
+    c.state = kReadingHead;
+    c.deadline_ms = now + timeout_ms_;
+    c.requests = 0;
+    c.idle = false;
+    c.keep_alive = false;
+    c.head.Reset();
+    c.body_expected = 0;
+    c.body_length = 0;
+    c.response.Clear();
+    stats_.connections++;
+
+    // The request usually arrived with the connection
+    OnReadable(&c, now);
+  }
+}
+
+void HttpEventServer::OnReadable(Connection* c, uint32_t now) {
+  char in[kReadChunkBytes];
+  ssize_t n = recv(c->fd, in, sizeof(in), 0);
+  if (n < 0 && WouldBlock()) return;
+  if (n <= 0) {
+    // Closed or reset before the request was complete, or a subscriber left
+    Close(c);
+    return;
+  }
+  if (c->state == kSubscribed) return;  // Nothing more is expected
+  Consume(c, in, n, now);
+  ConsumePending(c, now);
+}
+
+void HttpEventServer::Consume(Connection* c, const char* data, size_t size,
+                              uint32_t now) {
+  size_t used = 0;
+  if (c->state == kReadingHead) {
+    if (c->idle) {
+      // The next request on a kept-alive connection has as long as the first
+      c->idle = false;
+      c->deadline_ms = now + timeout_ms_;
+    }
+    used = c->head.Feed(data, size);
+    switch (c->head.state()) {
+      case HttpRequestParser::kIncomplete:
+        return;
+      case HttpRequestParser::kTooLarge:
+        Fail(c, "431 Request Header Fields Too Large", now);
+        return;
+      case HttpRequestParser::kMalformed:
+        Fail(c, "400 Bad Request", now);
+        return;
+      case HttpRequestParser::kComplete:
+        break;
+    }
+    if (c->head.Header("Transfer-Encoding") != nullptr) {
+      Fail(c, "411 Length Required", now);
+      return;
+    }
+    const char* length = c->head.Header("Content-Length");
+    c->body_expected = length != nullptr ? strtoul(length, nullptr, 10) : 0;
+    if (c->body_expected > kMaxBodyBytes) {
+      Fail(c, "413 Content Too Large", now);
+      return;
+    }
+    c->state = kReadingBody;
+  }
+
+  size_t wanted = c->body_expected - c->body_length;
+  size_t take = size - used < wanted ? size - used : wanted;
+  memcpy(c->body + c->body_length, data + used, take);
+  c->body_length += take;
+  if (c->body_length < c->body_expected) return;
+
+  // Anything past the body is a pipelined request, taken once this one is
+  // answered (the socket is not read meanwhile)
+  c->pending.append(data + used + take, size - used - take);
+  Dispatch(c, now);
+}
+
+void HttpEventServer::ConsumePending(Connection* c, uint32_t now) {
+  // A loop rather than a call from FinishResponse(), so a burst of
+  // pipelined requests does not nest calls on the stack
+  while (c->fd >= 0 && c->state == kReadingHead && !c->pending.empty()) {
+    std::string data;
+    data.swap(c->pending);
+    Consume(c, data.data(), data.size(), now);
+  }
+}
+
+void HttpEventServer::Fail(Connection* c, const char* status, uint32_t now) {
+  stats_.bad_requests++;
+  c->response.Clear();
+  c->response.Begin(status, "Content-Type: text/plain\r\n");
+  c->response.Print(status);
+  c->response.Print("\n");
+  // What follows a request that was not understood cannot be trusted
+  StartResponse(c, false, false, now);
+}
+
+void HttpEventServer::Dispatch(Connection* c, uint32_t now) {
+  c->body[c->body_length] = '\0';
+  const std::string& mount = listeners_[c->listener].mount;
+  std::string target;
+  if (!mount.empty()) target = mount + c->head.target();
+  HttpRequest request(c->head,
+                      mount.empty() ? c->head.target() : target.c_str(),
+                      c->body, c->body_length);
+  c->response.Clear();
+  handler_(request, &c->response, context_);
+  stats_.requests++;
+  if (++c->requests > 1) stats_.reused++;
+  if (!c->response.begun()) {
+    c->response.Clear();
+    c->response.Begin("500 Internal Server Error");
+  } else if (c->response.subscribe_ &&
+             subscribers() >= (int)connections_.size() - 1) {
+    c->response.Clear();
+    c->response.Begin("503 Service Unavailable",
+                      "Content-Type: text/plain\r\n");
+    c->response.Print("Too many subscribers\n");
+  }
+  bool keep_alive =
+      c->requests < max_requests_ &&
+      HttpKeepsAlive(c->head.version(), c->head.Header("Connection"));
+  StartResponse(c, strcmp(c->head.method(), "HEAD") == 0, keep_alive, now);
+}
+
+void HttpEventServer::StartResponse(Connection* c, bool head_only,
+                                    bool keep_alive, uint32_t now) {
+  HttpResponse& response = c->response;
+  c->subscribe = response.subscribe_ && !head_only;
+  c->out = std::move(response.head_);
+  // 204 and 304 have no body, and no Content-Length to describe one
+  bool bodyless = c->out.compare(9, 3, "204") == 0 ||
+                  c->out.compare(9, 3, "304") == 0;
+  bool sized = response.source_ == nullptr || response.source_length_ >= 0;
+  c->chunked = false;
+  if (bodyless || c->subscribe) {
+    // Subscribers' bodies end when they leave
+    keep_alive = keep_alive && !c->subscribe;
+  } else if (sized) {
+    char length[48];
+    snprintf(length, sizeof(length), "Content-Length: %llu\r\n",
+             (unsigned long long)(response.body_.size() +
+                                  (response.source_ != nullptr
+                                       ? response.source_length_
+                                       : 0)));
+    c->out += length;
+  } else if (strcmp(c->head.version(), "HTTP/1.0") != 0) {
+    c->out += "Transfer-Encoding: chunked\r\n";
+    c->chunked = !head_only;
+  } else {
+    // HTTP/1.0 has no chunks: the body ends with the connection
+    keep_alive = false;
+  }
+  c->keep_alive = keep_alive && idle_timeout_ms_ > 0;
+  if (c->keep_alive) {
+    char header[64];
+    snprintf(header, sizeof(header),
+             "Connection: keep-alive\r\nKeep-Alive: timeout=%u\r\n\r\n",
+             (unsigned)(idle_timeout_ms_ / 1000));
+    c->out += header;
+  } else {
+    c->out += "Connection: close\r\n\r\n";
+  }
+  if (head_only || bodyless) {
+    response.source_.reset();
+  } else if (c->chunked && !response.body_.empty()) {
+    c->out += Chunk(response.body_);
+  } else {
+    c->out += response.body_;
+  }
+  response.body_.clear();
+  c->out_sent = 0;
+  c->state = kWriting;
+  c->deadline_ms = now + timeout_ms_;
+
+  // Most responses fit the socket buffer and are gone right away
+  OnWritable(c, now);
+}
+
+void HttpEventServer::OnWritable(Connection* c, uint32_t now) {
+  if (c->state == kSubscribed) {
+    OnFrameWritable(c, now);
+    return;
+  }
+  for (;;) {
+    if (c->out_sent == c->out.size()) {
+      HttpBodySource* source = c->response.source_.get();
+      size_t n = 0;
+      size_t start = c->chunked ? kChunkHeadBytes : 0;
+      if (source != nullptr) {
+        c->out.resize(start + kSendChunkBytes);
+        n = source->Read((uint8_t*)&c->out[start], kSendChunkBytes);
+      }
+      if (n == 0 && c->chunked) {
+        c->out = "0\r\n\r\n";  // The last chunk
+        c->out_sent = 0;
+        c->chunked = false;
+        c->response.source_.reset();
+        continue;
+      }
+      if (n == 0 && c->subscribe) {
+        c->state = kSubscribed;
+        std::string().swap(c->out);
+        c->out_sent = 0;
+        c->response.Clear();
+        OnFrameWritable(c, now);
+        return;
+      }
+      if (n == 0) {
+        FinishResponse(c, now);
+        return;
+      }
+      c->out.resize(start + n);
+      c->out_sent = 0;
+      if (c->chunked) {
+        // The size line goes right before the data; what precedes it in the
+        // reserved room counts as sent
+        char head[kChunkHeadBytes + 1];
+        int length = snprintf(head, sizeof(head), "%zx\r\n", n);
+        c->out_sent = kChunkHeadBytes - length;
+        memcpy(&c->out[c->out_sent], head, length);
+        c->out += "\r\n";
+      }
+    }
+
+    ssize_t n = send(c->fd, c->out.data() + c->out_sent,
+                     c->out.size() - c->out_sent, MSG_NOSIGNAL);
+    if (n < 0 && WouldBlock()) return;
+    if (n <= 0) {
+      Close(c);
+      return;
+    }
+    c->out_sent += n;
+    c->deadline_ms = now + timeout_ms_;
+  }
+}
+
+void HttpEventServer::FinishResponse(Connection* c, uint32_t now) {
+  if (!c->keep_alive) {
+    Close(c);
+    return;
+  }
+  c->state = kReadingHead;
+  c->idle = true;
+  c->deadline_ms = now + idle_timeout_ms_;
+  c->head.Reset();
+  c->body_expected = 0;
+  c->body_length = 0;
+  c->response.Clear();
+  std::string().swap(c->out);  // Released until the next response
+  c->out_sent = 0;
+}
+
+void HttpEventServer::OnFrameWritable(Connection* c, uint32_t now) {
+  for (;;) {
+    if (c->frame == nullptr) {
+      if (c->next == nullptr) return;  // Up to date
+      c->frame = std::move(c->next);
+      c->next = nullptr;
+      c->out_sent = 0;
+    }
+    ssize_t n = send(c->fd, c->frame->data() + c->out_sent,
+                     c->frame->size() - c->out_sent, MSG_NOSIGNAL);
+    if (n < 0 && WouldBlock()) return;
+    if (n <= 0) {
+      Close(c);
+      return;
+    }
+    c->out_sent += n;
+    c->deadline_ms = now + timeout_ms_;
+    if (c->out_sent == c->frame->size()) c->frame = nullptr;
+  }
+}
+
+void HttpEventServer::Close(Connection* c) {
+  if (c->fd < 0) return;
+  Discard(c->fd);
+  c->fd = -1;
+  c->state = kIdle;
+  c->response.Clear();
+  std::string().swap(c->out);  // Release the buffer while idle
+  std::string().swap(c->pending);
+  c->out_sent = 0;
+  c->idle = false;
+  c->subscribe = false;
+  c->frame = nullptr;
+  c->next = nullptr;
+}
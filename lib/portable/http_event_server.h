@@ -0,0 +1,251 @@
+#ifndef HTTP_EVENT_SERVER_H
+#define HTTP_EVENT_SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http_request.h"
+
+// Event-driven HTTP/1.x server
+//
+// One task serves many connections: Poll() waits on all sockets at once with
+// select() and moves each connection through its states as far as it can
+// without blocking:
+//
+//   accept -> read head (fixed HttpRequestParser buffer)
+//          -> read body (Content-Length, fixed buffer)
+//          -> handler -> write response (as the socket takes it) -> close
+//                                  or, kept alive, back to read head
+//
+// Every connection has a deadline: the request must arrive within the
+// timeout of the accept, and a response must make progress at least once per
+// timeout. A slow or stalled client only holds its own slot, never the other
+// connections or the task calling Poll().
+//
+// With SetKeepAlive(), a connection stays open after its response for the
+// client's next request, up to an idle timeout and a number of requests.
+// Every response is then framed: Content-Length when the length is known,
+// else chunked (HTTP/1.0 clients get close-delimited bodies instead).
+// Requests pipelined behind one another are answered in order, each once
+// the previous response is sent. An idle connection gives up its slot when
+// a new client is waiting for one.
+//
+// A handler may instead Subscribe() the connection: after its response it
+// stays open and receives every frame given to Publish() (e.g. Server-Sent
+// Events). A frame is stored once and shared by all subscribers, each
+// sending it from its own offset; a subscriber still sending one frame when
+// the next is published skips to the newest, so a slow client costs neither
+// memory nor time of the others. At most max_connections - 1 connections
+// subscribe, so one slot always remains for plain requests.
+//
+// The server may listen on several ports, all served from the same
+// connection slots. A port can be given a mount path: its requests are
+// handled as if their target began with it, so an extra port can serve one
+// branch of the routes (e.g. a legacy port kept for old clients).
+//
+// Uses BSD sockets, which lwIP provides on the ESP32, so the same code runs
+// in host tests against local sockets.
+
+// A response body produced piece by piece as the socket drains, e.g. a file
+class HttpBodySource {
+ public:
+  virtual ~HttpBodySource() = default;
+
+  // Write up to `size` bytes of the body to `out`. Returns the count; 0 ends
+  // the body.
+  virtual size_t Read(uint8_t* out, size_t size) = 0;
+};
+
+// What a handler answers; sent once the handler returns
+class HttpResponse {
+ public:
+  // Status line ("404 Not Found") and headers, each ending in "\r\n".
+  // Content-Length or chunked Transfer-Encoding (but for 204 and 304) and
+  // Connection are added.
+  void Begin(const char* status, const char* headers = "");
+
+  // Append to the body
+  void Write(const void* data, size_t size);
+  void Print(const char* text) { Write(text, strlen(text)); }
+
+  // Continue the body from `source` after what was written. `length` is the
+  // source's size if known (for Content-Length), else -1 (sent chunked).
+  void Stream(std::unique_ptr<HttpBodySource> source, int64_t length);
+
+  // Keep the connection open after the body for Publish()ed frames. No
+  // Content-Length is sent, and no further requests are read. Answered 503
+  // instead when subscribers are full.
+  void Subscribe() { subscribe_ = true; }
+
+  bool begun() const { return begun_; }
+
+ private:
+  friend class HttpEventServer;
+
+  void Clear();
+
+  bool begun_ = false;
+  bool subscribe_ = false;
+  std::string head_;  // Status line and handler headers
+  std::string body_;
+  std::unique_ptr<HttpBodySource> source_;
+  int64_t source_length_ = -1;
+};
+
+// A complete request, valid during the handler call
+class HttpRequest {
+ public:
+  HttpRequest(const HttpRequestParser& head, const char* target,
+              const char* body, size_t body_size)
+      : head_(head), target_(target), body_(body), body_size_(body_size) {}
+
+  const char* method() const { return head_.method(); }
+  // Path and query, behind the mount path of the port it arrived on
+  const char* target() const { return target_; }
+  const char* Header(const char* name) const { return head_.Header(name); }
+
+  // Body bytes, NUL-terminated (form posts can be used as strings)
+  const char* body() const { return body_; }
+  size_t body_size() const { return body_size_; }
+
+ private:
+  const HttpRequestParser& head_;
+  const char* target_;
+  const char* body_;
+  size_t body_size_;
+};
+
+typedef void (*HttpHandler)(const HttpRequest& request,
+                            HttpResponse* response, void* context);
+
+// Milliseconds from a monotonic clock (wrapping is fine)
+typedef uint32_t (*HttpClockMs)();
+
+struct HttpServerStats {
+  uint32_t connections;     // Accepted
+  uint32_t requests;        // Passed to the handler
+  uint32_t bad_requests;    // Malformed, head or body too large
+  uint32_t timeouts;        // Closed at their deadline
+  uint32_t frames_skipped;  // Published frames a slow subscriber never got
+  uint32_t reused;          // Requests on a kept-alive connection
+};
+
+class HttpEventServer {
+ public:
+  static constexpr size_t kMaxBodyBytes = 1024;
+  static constexpr size_t kReadChunkBytes = 512;
+  static constexpr size_t kSendChunkBytes = 2048;  // Per source Read()
+
+  // At most `max_connections` are served at once; further clients wait in
+  // the listen backlog until a slot is free
+  HttpEventServer(int max_connections, uint32_t timeout_ms,
+                  HttpHandler handler, void* context, HttpClockMs clock);
+  ~HttpEventServer();
+
+  // Listen on `port` (0: any free port, see port()), handling its requests
+  // as if their target began with `mount`. Call once per port. Returns
+  // false on error.
+  bool Listen(uint16_t port, const char* mount = "");
+
+  // Keep connections open for up to `max_requests` requests, at most
+  // `idle_timeout_ms` apart. Off by default: every response closes its
+  // connection.
+  void SetKeepAlive(uint32_t idle_timeout_ms, int max_requests);
+
+  // Wait up to `timeout_ms` for socket events (0: only check) and handle
+  // them, then close connections past their deadline
+  void Poll(int timeout_ms);
+
+  // Send `size` bytes to every subscriber. Returns how many there are.
+  int Publish(const void* data, size_t size);
+
+  // Close the listening sockets and every connection
+  void Stop();
+
+  // Port of the `listener`th Listen() call
+  uint16_t port(int listener = 0) const { return listeners_[listener].port; }
+  int active_connections() const;
+  int subscribers() const;
+  HttpServerStats stats() const { return stats_; }
+
+ private:
+  enum State { kIdle, kReadingHead, kReadingBody, kWriting, kSubscribed };
+
+  typedef std::shared_ptr<const std::string> Frame;
+
+  struct Listener {
+    int fd;
+    uint16_t port;
+    std::string mount;
+  };
+
+  struct Connection {
+    int fd = -1;
+    int listener = 0;  // Accepted from listeners_[listener]
+    State state = kIdle;
+    uint32_t deadline_ms = 0;
+    int requests = 0;         // Dispatched on this connection
+    bool idle = false;        // Kept alive, no byte of a next request yet
+    bool keep_alive = false;  // Read the next request once `out` is sent
+    bool chunked = false;     // Source Read()s are sent as chunks
+    std::string pending;      // Read past the request: the next ones
+    HttpRequestParser head;
+    char body[kMaxBodyBytes + 1];
+    size_t body_expected = 0;
+    size_t body_length = 0;
+    HttpResponse response;
+    std::string out;  // Bytes to send; out_sent of them are gone
+    size_t out_sent = 0;
+    bool subscribe = false;  // Become kSubscribed once `out` is sent
+    Frame frame;             // Frame being sent; out_sent of it are gone
+    Frame next;              // Newest frame, once `frame` is done
+  };
+
+  void Accept(int listener, uint32_t now);
+  void OnReadable(Connection* c, uint32_t now);
+  void OnWritable(Connection* c, uint32_t now);
+  void OnFrameWritable(Connection* c, uint32_t now);
+
+  // The kept-alive connection idle for longest, or nullptr
+  Connection* OldestIdle();
+
+  // Whether the connection waits on its own deadline (a subscriber waiting
+  // for the next frame does not)
+  static bool HasDeadline(const Connection& c);
+
+  // Take `size` request bytes; dispatches once the request is complete
+  void Consume(Connection* c, const char* data, size_t size, uint32_t now);
+
+  // Take the pipelined bytes read with earlier requests, while responses
+  // are done at once
+  void ConsumePending(Connection* c, uint32_t now);
+
+  // Answer a request that cannot be handled with `status`
+  void Fail(Connection* c, const char* status, uint32_t now);
+
+  // Call the handler and start sending its response
+  void Dispatch(Connection* c, uint32_t now);
+  void StartResponse(Connection* c, bool head_only, bool keep_alive,
+                     uint32_t now);
+
+  // After the last byte of a response: close, or wait for the next request
+  void FinishResponse(Connection* c, uint32_t now);
+
+  void Close(Connection* c);
+
+  std::vector<Listener> listeners_;
+  std::vector<Connection> connections_;
+  uint32_t timeout_ms_;
+  uint32_t idle_timeout_ms_ = 0;
+  int max_requests_ = 1;
+  HttpHandler handler_;
+  void* context_;
+  HttpClockMs clock_;
+  HttpServerStats stats_ = {};
+};
+
+#endif  // HTTP_EVENT_SERVER_H
@@ -0,0 +1,227 @@
+#include "http_request.h"
+
+#include <strings.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Call `element(begin, end)` for each comma-separated element of a header
+// value, trimmed, until it returns true. Returns whether one did.
+template <typename Element>
+bool AnyListElement(const char* value, Element element) {
+  while (value != nullptr && *value != '\0') {
+    const char* comma = strchr(value, ',');
+    const char* end = comma != nullptr ? comma : value + strlen(value);
+    const char* begin = value;
+    while (begin < end && (*begin == ' ' || *begin == '\t')) begin++;
+    const char* last = end;
+    while (last > begin && (last[-1] == ' ' || last[-1] == '\t')) last--;
+    if (begin < last && element(begin, last)) return true;
+    value = comma != nullptr ? comma + 1 : nullptr;
+  }
+  return false;
+}
+
+}  // namespace
+
+size_t HttpRequestParser::Feed(const char* data, size_t size) {
+  if (state_ != kIncomplete) return 0;
+
+  size_t start = length_;
+  size_t room = kMaxHeadBytes - length_;
+  size_t copied = size < room ? size : room;
+  memcpy(buffer_ + length_, data, copied);
+  length_ += copied;
+
+  // The head ends at an empty line, "\r\n\r\n" (or a bare "\n\n"); it may
+  // straddle the previous feed
+  for (size_t i = start >= 3 ? start - 3 : 0; i < length_; i++) {
+    if (buffer_[i] != '\n') continue;
+    size_t end = 0;
+    if (i + 1 < length_ && buffer_[i + 1] == '\n') {
+      end = i + 2;
+    } else if (i + 2 < length_ && buffer_[i + 1] == '\r' &&
+               buffer_[i + 2] == '\n') {
+      end = i + 3;
+    }
+    if (end == 0) continue;
+
+    size_t used = end - start;
+    length_ = end;
+    Parse();
+    return used;
+  }
+
+  if (length_ == kMaxHeadBytes) state_ = kTooLarge;
+  return copied;
+}
+
+void HttpRequestParser::Parse() {
+  buffer_[length_] = '\0';
+  for (size_t i = 0; i < length_; i++) {
+    if (buffer_[i] == '\r' || buffer_[i] == '\n') buffer_[i] = '\0';
+  }
+
+  // Request line: METHOD SP target SP HTTP/x.y
+  char* line = buffer_;
+  char* space = strchr(line, ' ');
+  char* target = space != nullptr ? space + 1 : nullptr;
+  char* version = target != nullptr ? strchr(target, ' ') : nullptr;
+  if (version == nullptr || space == line || version == target ||
+      strncmp(version + 1, "HTTP/", 5) != 0) {
+    state_ = kMalformed;
+    return;
+  }
+  *space = '\0';
+  *version = '\0';
+  method_ = line;
+  target_ = target;
+  version_ = version + 1;
+
+  // Header lines follow, one per NUL-terminated run
+  char* end = buffer_ + length_;
+  line = version + 1 + strlen(version + 1);
+  while (line < end && header_count_ < kMaxHeaders) {
+    if (*line == '\0') {
+      line++;
+      continue;
+    }
+    size_t line_length = strlen(line);
+    char* colon = strchr(line, ':');
+    if (colon != nullptr) {
+      *colon = '\0';
+      char* value = colon + 1;
+      while (*value == ' ' || *value == '\t') value++;
+      char* value_end = value + strlen(value);
+      while (value_end > value &&
+             (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        *--value_end = '\0';
+      }
+      header_names_[header_count_] = line;
+      header_values_[header_count_] = value;
+      header_count_++;
+    }
+    line += line_length + 1;
+  }
+  state_ = kComplete;
+}
+
+const char* HttpRequestParser::Header(const char* name) const {
+  for (int i = 0; i < header_count_; i++) {
+    if (strcasecmp(header_names_[i], name) == 0) return header_values_[i];
+  }
+  return nullptr;
+}
+
+void HttpRequestParser::Reset() {
+  length_ = 0;
+  state_ = kIncomplete;
+  method_ = "";
+  target_ = "";
+  version_ = "";
+  header_count_ = 0;
+}
+
+HttpRangeResult ParseHttpRange(const char* value, uint64_t size,
+                               uint64_t* first, uint64_t* last) {
+  if (value == nullptr || strncasecmp(value, "bytes=", 6) != 0) {
+    return kHttpRangeNone;
+  }
+  const char* spec = value + 6;
+  if (strchr(spec, ',') != nullptr) return kHttpRangeNone;
+
+  // Digits only; strtoull alone would accept signs and spaces
+  auto parse = [](const char* s, const char* end, uint64_t* out) {
+    if (s == end) return false;
+    for (const char* p = s; p < end; p++) {
+      if (*p < '0' || *p > '9') return false;
+    }
+    *out = strtoull(s, nullptr, 10);
+    return true;
+  };
+
+  const char* dash = strchr(spec, '-');
+  if (dash == nullptr) return kHttpRangeNone;
+  const char* end = spec + strlen(spec);
+  uint64_t a = 0;
+  uint64_t b = 0;
+  bool has_first = parse(spec, dash, &a);
+  bool has_last = parse(dash + 1, end, &b);
+  if ((!has_first && spec != dash) || (!has_last && dash + 1 != end)) {
+    return kHttpRangeNone;
+  }
+
+  if (!has_first) {
+    // Suffix: the last b bytes
+    if (!has_last) return kHttpRangeNone;
+    if (b == 0 || size == 0) return kHttpRangeUnsatisfiable;
+    *first = b < size ? size - b : 0;
+    *last = size - 1;
+    return kHttpRangeSatisfiable;
+  }
+  if (has_last && b < a) return kHttpRangeNone;
+  if (a >= size) return kHttpRangeUnsatisfiable;
+  *first = a;
+  *last = has_last && b < size - 1 ? b : size - 1;
+  return kHttpRangeSatisfiable;
+}
+
+bool HttpEtagMatches(const char* if_none_match, const char* etag) {
+  size_t length = strlen(etag);
+  return AnyListElement(if_none_match, [&](const char* begin,
+                                           const char* end) {
+    if (end - begin == 1 && *begin == '*') return true;
+    if (end - begin > 2 && strncmp(begin, "W/", 2) == 0) begin += 2;
+    return (size_t)(end - begin) == length &&
+           strncmp(begin, etag, length) == 0;
+  });
+}
+
+bool HttpKeepsAlive(const char* version, const char* connection) {
+  // HTTP/1.0 connections close unless asked not to, later ones the opposite
+  bool http10 = strcmp(version, "HTTP/1.0") == 0;
+  const char* token = http10 ? "keep-alive" : "close";
+  size_t length = strlen(token);
+  bool named = AnyListElement(connection, [&](const char* begin,
+                                             const char* end) {
+    return (size_t)(end - begin) == length &&
+           strncasecmp(begin, token, length) == 0;
+  });
+  return http10 ? named : !named;
+}
+
+bool HttpAcceptsEncoding(const char* accept_encoding, const char* coding) {
+  // An explicit entry for the coding overrides "*"
+  size_t length = strlen(coding);
+  int named = -1;
+  int any = -1;
+  AnyListElement(accept_encoding, [&](const char* begin, const char* end) {
+    // coding [ ";" "q=" qvalue ]
+    const char* name_end = begin;
+    while (name_end < end && *name_end != ';' && *name_end != ' ') name_end++;
+    size_t name_length = name_end - begin;
+    int* result = nullptr;
+    if (name_length == length && strncasecmp(begin, coding, length) == 0) {
+      result = &named;
+    } else if (name_length == 1 && *begin == '*') {
+      result = &any;
+    } else {
+      return false;
+    }
+
+    // q=0, q=0.0, q=0.000 refuse it
+    *result = 1;
+    const char* q = name_end;
+    while (q < end && (*q == ';' || *q == ' ')) q++;
+    if (end - q >= 2 && strncasecmp(q, "q=", 2) == 0) {
+      *result = 0;
+      for (q += 2; q < end; q++) {
+        if (*q != '0' && *q != '.') *result = 1;
+      }
+    }
+    return false;
+  });
+  return named >= 0 ? named == 1 : any == 1;
+}
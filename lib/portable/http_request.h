@@ -0,0 +1,86 @@
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+#include <cstddef>
+#include <cstdint>
+
+// HttpRequestParser - Collects an HTTP/1.x request head in a fixed buffer
+//
+// Bytes are fed as they arrive from the socket, in any split. Once the blank
+// line ending the head is seen, the request line and headers are parsed in
+// place; the method, target and header values then point into the buffer and
+// stay valid until Reset(). Bytes after the head (a request body) are not
+// consumed. No heap allocation, so one parser per connection is cheap.
+class HttpRequestParser {
+ public:
+  enum State {
+    kIncomplete,  // Feed more bytes
+    kComplete,    // Head parsed
+    kTooLarge,    // Head does not fit kMaxHeadBytes
+    kMalformed,   // Not an HTTP request line
+  };
+
+  static constexpr size_t kMaxHeadBytes = 1024;
+  static constexpr int kMaxHeaders = 16;  // Further headers are ignored
+
+  HttpRequestParser() { Reset(); }
+
+  // Consume bytes up to the end of the head. Returns how many were used.
+  size_t Feed(const char* data, size_t size);
+
+  State state() const { return state_; }
+
+  // Request line parts, valid once complete
+  const char* method() const { return method_; }
+  const char* target() const { return target_; }  // Path and query
+  const char* version() const { return version_; }  // "HTTP/1.1"
+
+  // Value of a header (name case-insensitive, value trimmed), or nullptr
+  const char* Header(const char* name) const;
+
+  // Start over for the next request
+  void Reset();
+
+ private:
+  // Split the head into request line and headers
+  void Parse();
+
+  char buffer_[kMaxHeadBytes + 1];  // Head plus a terminator
+  size_t length_;
+  State state_;
+  const char* method_;
+  const char* target_;
+  const char* version_;
+  const char* header_names_[kMaxHeaders];
+  const char* header_values_[kMaxHeaders];
+  int header_count_;
+};
+
+enum HttpRangeResult {
+  kHttpRangeNone,           // No usable Range: send the whole entity
+  kHttpRangeSatisfiable,    // Send bytes [first, last]
+  kHttpRangeUnsatisfiable,  // Answer 416
+};
+
+// Parse a Range header value against an entity of `size` bytes. Supports a
+// single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range; other
+// forms (including multiple ranges) are ignored, as RFC 9110 allows.
+HttpRangeResult ParseHttpRange(const char* value, uint64_t size,
+                               uint64_t* first, uint64_t* last);
+
+// True if an If-None-Match header value lists `etag` (quoted, as sent in
+// ETag) or is "*". Weak tags ("W/...") match by their opaque part, as
+// RFC 9110 asks for If-None-Match.
+bool HttpEtagMatches(const char* if_none_match, const char* etag);
+
+// True if the client of a request of `version` ("HTTP/1.1") with a
+// Connection header value of `connection` (nullptr if absent) takes further
+// requests on the connection: HTTP/1.1 unless it asks to "close", HTTP/1.0
+// only when it asks to "keep-alive"
+bool HttpKeepsAlive(const char* version, const char* connection);
+
+// True if an Accept-Encoding header value allows `coding` ("gzip"), named or
+// through "*", with a non-zero q
+bool HttpAcceptsEncoding(const char* accept_encoding, const char* coding);
+
+#endif  // HTTP_REQUEST_H
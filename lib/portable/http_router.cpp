@@ -0,0 +1,68 @@
+#include "http_router.h"
+
+#include <cstring>
+
+size_t HttpPathLength(const char* target) { return strcspn(target, "?"); }
+
+std::string HttpQueryParam(const char* target, const char* name) {
+  const char* param = strchr(target, '?');
+  size_t name_length = strlen(name);
+  while (param != nullptr) {
+    param++;
+    size_t length = strcspn(param, "&");
+    if (length > name_length && param[name_length] == '=' &&
+        strncmp(param, name, name_length) == 0) {
+      return std::string(param + name_length + 1, length - name_length - 1);
+    }
+    param = param[length] == '&' ? param + length : nullptr;
+  }
+  return "";
+}
+
+void HttpRouter::Add(const char* method, const char* path, HttpHandler handler,
+                     void* context) {
+  routes_.push_back({method, path, handler, context});
+}
+
+bool HttpRouter::PathMatches(const char* pattern, const char* path,
+                             size_t length) {
+  size_t pattern_length = strlen(pattern);
+  if (pattern_length > 0 && pattern[pattern_length - 1] == '*') {
+    return length >= pattern_length - 1 &&
+           strncmp(pattern, path, pattern_length - 1) == 0;
+  }
+  return length == pattern_length && strncmp(pattern, path, length) == 0;
+}
+
+bool HttpRouter::MethodMatches(const char* route_method, const char* method) {
+  return route_method == nullptr || strcmp(route_method, method) == 0 ||
+         (strcmp(route_method, "GET") == 0 && strcmp(method, "HEAD") == 0);
+}
+
+void HttpRouter::Handle(const HttpRequest& request, HttpResponse* response,
+                        void* router) {
+  const std::vector<Route>& routes = ((HttpRouter*)router)->routes_;
+  const char* target = request.target();
+  size_t length = HttpPathLength(target);
+
+  std::string allow;
+  for (const Route& route : routes) {
+    if (!PathMatches(route.path, target, length)) continue;
+    if (MethodMatches(route.method, request.method())) {
+      route.handler(request, response, route.context);
+      return;
+    }
+    if (!allow.empty()) allow += ", ";
+    allow += route.method;
+    if (strcmp(route.method, "GET") == 0) allow += ", HEAD";
+  }
+
+  if (allow.empty()) {
+    response->Begin("404 Not Found", "Content-Type: text/plain\r\n");
+    response->Print("Not Found\n");
+    return;
+  }
+  allow = "Allow: " + allow + "\r\nContent-Type: text/plain\r\n";
+  response->Begin("405 Method Not Allowed", allow.c_str());
+  response->Print("Method Not Allowed\n");
+}
@@ -0,0 +1,59 @@
+#ifndef HTTP_ROUTER_H
+#define HTTP_ROUTER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "http_event_server.h"
+
+// HttpRouter - Route table for an HttpEventServer
+//
+// Modules add their endpoints by method and path, and the router is the
+// server's handler: it calls the first route whose path matches the request
+// path (its target up to the query) and method, and answers 404, or 405 with
+// an Allow header, when none does. A path ending in '*' matches every path
+// it is a prefix of. GET routes also answer HEAD; the server drops the body.
+//
+// Usage:
+//   HttpRouter router;
+//   HttpEventServer server(4, 5000, HttpRouter::Handle, &router, clock);
+//   router.Add("GET", "/api/status", ServeStatus, nullptr);
+//   router.Add("GET", "/logs/perf_*", ServeLogFile, logger);
+class HttpRouter {
+ public:
+  // Route `method` (nullptr: any) requests for `path` to `handler`. The
+  // strings and `context` must outlive the router.
+  void Add(const char* method, const char* path, HttpHandler handler,
+           void* context);
+
+  // Answer `request` from the route table; an HttpHandler whose context is
+  // the router
+  static void Handle(const HttpRequest& request, HttpResponse* response,
+                     void* router);
+
+  int size() const { return routes_.size(); }
+
+ private:
+  struct Route {
+    const char* method;
+    const char* path;
+    HttpHandler handler;
+    void* context;
+  };
+
+  static bool PathMatches(const char* pattern, const char* path,
+                          size_t length);
+  static bool MethodMatches(const char* route_method, const char* method);
+
+  std::vector<Route> routes_;
+};
+
+// Length of the path of a request target, i.e. up to the query
+size_t HttpPathLength(const char* target);
+
+// Value of a query parameter of a request target (as sent, not decoded), or
+// "" if absent
+std::string HttpQueryParam(const char* target, const char* name);
+
+#endif  // HTTP_ROUTER_H
@@ -0,0 +1,153 @@
+#include "json_writer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+JsonWriter::JsonWriter(char* buffer, size_t size, JsonSink sink,
+                       void* context)
+    : buffer_(buffer), capacity_(size), sink_(sink), context_(context) {}
+
+void JsonWriter::BeginObject() { Open('{'); }
+void JsonWriter::EndObject() { Close('}'); }
+void JsonWriter::BeginArray() { Open('['); }
+void JsonWriter::EndArray() { Close(']'); }
+
+void JsonWriter::Key(const char* name) {
+  String(name);
+  Put(':');
+  after_key_ = true;
+}
+
+void JsonWriter::String(const char* value) { String(value, strlen(value)); }
+
+void JsonWriter::String(const char* value, size_t size) {
+  BeginString();
+  PutEscaped(value, size);
+  Put('"');
+}
+
+void JsonWriter::BeginString() {
+  Separate();
+  Put('"');
+}
+
+void JsonWriter::StringPart(const char* value, size_t size) {
+  PutEscaped(value, size);
+}
+
+void JsonWriter::EndString() { Put('"'); }
+
+void JsonWriter::Int(int64_t value) {
+  Separate();
+  char text[24];
+  int n = snprintf(text, sizeof(text), "%lld", (long long)value);
+  Put(text, n);
+}
+
+void JsonWriter::Bool(bool value) {
+  Separate();
+  if (value) {
+    Put("true", 4);
+  } else {
+    Put("false", 5);
+  }
+}
+
+void JsonWriter::Null() {
+  Separate();
+  Put("null", 4);
+}
+
+void JsonWriter::Float(double value, int decimals) {
+  if (!std::isfinite(value)) {
+    Null();
+    return;
+  }
+  Separate();
+  char text[48];
+  int n = snprintf(text, sizeof(text), "%.*f", decimals, value);
+  Put(text, n < (int)sizeof(text) ? n : sizeof(text) - 1);
+}
+
+bool JsonWriter::Flush() {
+  if (used_ > 0 && ok_) ok_ = sink_(buffer_, used_, context_);
+  used_ = 0;
+  return ok_;
+}
+
+void JsonWriter::Separate() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (depth_ == 0) return;
+  uint32_t bit = 1u << (depth_ - 1);
+  if (has_values_ & bit) Put(',');
+  has_values_ |= bit;
+}
+
+void JsonWriter::Open(char bracket) {
+  Separate();
+  Put(bracket);
+  if (depth_ < kMaxDepth) depth_++;
+  has_values_ &= ~(1u << (depth_ - 1));
+}
+
+void JsonWriter::Close(char bracket) {
+  if (depth_ > 0) depth_--;
+  Put(bracket);
+}
+
+void JsonWriter::Put(char c) {
+  if (used_ == capacity_) Flush();
+  buffer_[used_++] = c;
+  size_++;
+}
+
+void JsonWriter::Put(const char* data, size_t size) {
+  while (size > 0) {
+    if (used_ == capacity_) Flush();
+    size_t n = capacity_ - used_ < size ? capacity_ - used_ : size;
+    memcpy(buffer_ + used_, data, n);
+    used_ += n;
+    size_ += n;
+    data += n;
+    size -= n;
+  }
+}
+
+void JsonWriter::PutEscaped(const char* value, size_t size) {
+  // Runs of plain characters are copied at once
+  size_t start = 0;
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = value[i];
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    Put(value + start, i - start);
+    start = i + 1;
+
+    char escape[8];
+    switch (c) {
+      case '"':
+        Put("\\\"", 2);
+        break;
+      case '\\':
+        Put("\\\\", 2);
+        break;
+      case '\n':
+        Put("\\n", 2);
+        break;
+      case '\r':
+        Put("\\r", 2);
+        break;
+      case '\t':
+        Put("\\t", 2);
+        break;
+      default:
+        snprintf(escape, sizeof(escape), "\\u%04x", c);
+        Put(escape, 6);
+        break;
+    }
+  }
+  Put(value + start, size - start);
+}
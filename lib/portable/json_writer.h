@@ -0,0 +1,90 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// JsonWriter - Streams a JSON document through a fixed buffer
+//
+// Values are escaped and separated as they are written into a caller-owned
+// buffer, which is handed to the sink whenever it fills and on Flush(), so a
+// document of any size is built without a heap allocation or an intermediate
+// copy. Commas are placed automatically; the caller only has to nest
+// Begin/End calls correctly (up to kMaxDepth levels) and put a Key() before
+// each value inside an object.
+//
+// Usage:
+//   char buffer[256];
+//   JsonWriter json(buffer, sizeof(buffer), SocketSink, &fd);
+//   json.BeginObject();
+//   json.Key("rpm");
+//   json.Int(1180);
+//   json.EndObject();
+//   json.Flush();
+
+// Take `size` bytes of output; return false to stop the writer
+typedef bool (*JsonSink)(const char* data, size_t size, void* context);
+
+class JsonWriter {
+ public:
+  static constexpr int kMaxDepth = 32;
+
+  JsonWriter(char* buffer, size_t size, JsonSink sink, void* context);
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+
+  // Object member name; the next call writes its value
+  void Key(const char* name);
+
+  void String(const char* value);
+  void String(const char* value, size_t size);
+
+  // A string value written in pieces, e.g. from several buffers
+  void BeginString();
+  void StringPart(const char* value, size_t size);
+  void EndString();
+
+  void Int(int64_t value);
+  void Bool(bool value);
+  void Null();
+
+  // Fixed-point with `decimals` digits, like printf's %.*f; null if not
+  // finite
+  void Float(double value, int decimals);
+
+  // Hand the buffered output to the sink. Returns false if the sink refused
+  // any output (everything after that is dropped).
+  bool Flush();
+
+  bool ok() const { return ok_; }
+
+  // Bytes produced so far, buffered or not
+  size_t size() const { return size_; }
+
+ private:
+  // Comma before a value, unless it follows a key or opens a container
+  void Separate();
+  void Open(char bracket);
+  void Close(char bracket);
+
+  void Put(char c);
+  void Put(const char* data, size_t size);
+  void PutEscaped(const char* value, size_t size);
+
+  char* buffer_;
+  size_t capacity_;
+  size_t used_ = 0;
+  JsonSink sink_;
+  void* context_;
+  bool ok_ = true;
+  size_t size_ = 0;
+
+  int depth_ = 0;
+  uint32_t has_values_ = 0;  // Bit n: level n already holds a value
+  bool after_key_ = false;
+};
+
+#endif  // JSON_WRITER_H
@@ -0,0 +1,118 @@
+#include "metrics_writer.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+MetricsWriter::MetricsWriter(char* buffer, size_t size)
+    : buffer_(buffer), capacity_(size) {}
+
+void MetricsWriter::Family(const char* name, const char* type,
+                           const char* help) {
+  Put("# HELP ");
+  Put(name);
+  Put(" ");
+  Put(help);
+  EndLine();
+  Put("# TYPE ");
+  Put(name);
+  Put(" ");
+  Put(type);
+  EndLine();
+}
+
+void MetricsWriter::Sample(const char* name, double value) {
+  Sample(name, nullptr, nullptr, value);
+}
+
+void MetricsWriter::Sample(const char* name, const char* label,
+                           const char* label_value, double value) {
+  SampleName(name, label, label_value);
+  if (std::isnan(value)) {
+    Put("NaN");
+  } else if (std::isinf(value)) {
+    Put(value > 0 ? "+Inf" : "-Inf");
+  } else {
+    // Floats carry about 7 digits; more would print their binary noise
+    char text[32];
+    int n = snprintf(text, sizeof(text), "%.7g", value);
+    Put(text, n);
+  }
+  EndLine();
+}
+
+void MetricsWriter::Sample(const char* name, int64_t value) {
+  Sample(name, nullptr, nullptr, value);
+}
+
+void MetricsWriter::Sample(const char* name, const char* label,
+                           const char* label_value, int64_t value) {
+  SampleName(name, label, label_value);
+  char text[24];
+  int n = snprintf(text, sizeof(text), "%" PRId64, value);
+  Put(text, n);
+  EndLine();
+}
+
+void MetricsWriter::SampleName(const char* name, const char* label,
+                               const char* label_value) {
+  Put(name);
+  if (label != nullptr) {
+    Put("{");
+    Put(label);
+    Put("=\"");
+    // Label values escape backslash, double quote and line feed
+    const char* start = label_value;
+    for (const char* p = label_value; *p != '\0'; p++) {
+      const char* escape = *p == '\\'  ? "\\\\"
+                           : *p == '"' ? "\\\""
+                           : *p == '\n' ? "\\n"
+                                        : nullptr;
+      if (escape == nullptr) continue;
+      Put(start, p - start);
+      Put(escape);
+      start = p + 1;
+    }
+    Put(start);
+    Put("\"}");
+  }
+  Put(" ");
+}
+
+void MetricsWriter::Put(const char* text) { Put(text, strlen(text)); }
+
+void MetricsWriter::Put(const char* text, size_t size) {
+  if (!ok_) return;
+  if (size > capacity_ - used_) {
+    // Cut off at the last complete line; nothing more is written
+    ok_ = false;
+    used_ = line_start_;
+    return;
+  }
+  memcpy(buffer_ + used_, text, size);
+  used_ += size;
+}
+
+void MetricsWriter::EndLine() {
+  Put("\n", 1);
+  if (ok_) line_start_ = used_;
+}
+
+MetricsCache::MetricsCache(char* buffer, size_t size)
+    : buffer_(buffer), capacity_(size) {}
+
+const char* MetricsCache::Get(uint32_t tick, MetricsRenderer render,
+                              void* context, size_t* size) {
+  if (!valid_ || tick != tick_) {
+    MetricsWriter metrics(buffer_, capacity_);
+    render(&metrics, context);
+    size_ = metrics.size();
+    ok_ = metrics.ok();
+    valid_ = true;
+    tick_ = tick;
+    renders_++;
+  }
+  *size = size_;
+  return ok_ ? buffer_ : nullptr;
+}
@@ -0,0 +1,88 @@
+#ifndef METRICS_WRITER_H
+#define METRICS_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// MetricsWriter - Prometheus text exposition format into a fixed buffer
+//
+// Writes metric families ("# HELP" and "# TYPE" lines) and their samples,
+// with label values escaped. Output that does not fit is cut off at the
+// last complete line and ok() turns false, so a short buffer never yields a
+// half-written sample.
+//
+// Usage:
+//   char buffer[1024];
+//   MetricsWriter metrics(buffer, sizeof(buffer));
+//   metrics.Family("fan_rpm", "gauge", "Tachometer speed");
+//   metrics.Sample("fan_rpm", "fan", "Fan1", 1180);
+class MetricsWriter {
+ public:
+  MetricsWriter(char* buffer, size_t size);
+
+  // Start a family; `type` is "gauge" or "counter" (whose name should end
+  // in _total)
+  void Family(const char* name, const char* type, const char* help);
+
+  // A sample without labels, or with one label
+  void Sample(const char* name, double value);
+  void Sample(const char* name, const char* label, const char* label_value,
+              double value);
+
+  // Integers are written exactly (a double would round counters above 2^53
+  // and print large ones in exponent form)
+  void Sample(const char* name, int64_t value);
+  void Sample(const char* name, const char* label, const char* label_value,
+              int64_t value);
+
+  const char* data() const { return buffer_; }
+  size_t size() const { return used_; }
+
+  // False if something did not fit
+  bool ok() const { return ok_; }
+
+ private:
+  void SampleName(const char* name, const char* label,
+                  const char* label_value);
+  void Put(const char* text);
+  void Put(const char* text, size_t size);
+  void EndLine();
+
+  char* buffer_;
+  size_t capacity_;
+  size_t used_ = 0;
+  size_t line_start_ = 0;
+  bool ok_ = true;
+};
+
+typedef void (*MetricsRenderer)(MetricsWriter* metrics, void* context);
+
+// MetricsCache - The rendered /metrics body, rebuilt at most once per tick
+//
+// Scrapes within one control tick share one rendering in a caller-owned
+// buffer, however many scrapers there are. Not thread-safe.
+class MetricsCache {
+ public:
+  MetricsCache(char* buffer, size_t size);
+
+  // The body for `tick`, rendered by `render` unless the cached one is of
+  // the same tick. Returns nullptr if the body did not fit the buffer.
+  const char* Get(uint32_t tick, MetricsRenderer render, void* context,
+                  size_t* size);
+
+  // Drop the cached body, e.g. when there is no tick to key it on
+  void Invalidate() { valid_ = false; }
+
+  uint32_t renders() const { return renders_; }
+
+ private:
+  char* buffer_;
+  size_t capacity_;
+  size_t size_ = 0;
+  bool valid_ = false;
+  bool ok_ = false;
+  uint32_t tick_ = 0;
+  uint32_t renders_ = 0;
+};
+
+#endif  // METRICS_WRITER_H
@@ -0,0 +1,65 @@
+#include "perf_log_catalog.h"
+
+#include <algorithm>
+
+PerfLogCatalog::PerfLogCatalog(uint32_t block_size)
+    : block_size_(block_size) {}
+
+void PerfLogCatalog::Add(const PerfLogSegment& segment) {
+  segments_.push_back(segment);
+  allocated_bytes_ += Allocated(segment.bytes);
+}
+
+void PerfLogCatalog::Sort() {
+  std::sort(segments_.begin(), segments_.end(),
+            [](const PerfLogSegment& a, const PerfLogSegment& b) {
+              return a.index < b.index;
+            });
+}
+
+PerfLogSegment* PerfLogCatalog::AppendNext() {
+  PerfLogSegment segment = {};
+  segment.index = segments_.empty() ? 0 : segments_.back().index + 1;
+  segments_.push_back(segment);
+  return &segments_.back();
+}
+
+void PerfLogCatalog::GrowNewest(uint32_t bytes, uint64_t end_uptime_ms) {
+  if (segments_.empty()) return;
+  PerfLogSegment& segment = segments_.back();
+  allocated_bytes_ -= Allocated(segment.bytes);
+  segment.bytes += bytes;
+  segment.end_uptime_ms = end_uptime_ms;
+  allocated_bytes_ += Allocated(segment.bytes);
+}
+
+void PerfLogCatalog::AddBlockToNewest(uint32_t bytes, uint32_t records,
+                                      uint32_t first_offset_ms,
+                                      uint64_t end_uptime_ms) {
+  if (segments_.empty()) return;
+  PerfLogSegment& segment = segments_.back();
+  segment.blocks.push_back({(uint16_t)segment.bytes, first_offset_ms});
+  segment.records += records;
+  GrowNewest(bytes, end_uptime_ms);
+}
+
+void PerfLogCatalog::PopNewest() {
+  if (segments_.empty()) return;
+  allocated_bytes_ -= Allocated(segments_.back().bytes);
+  segments_.pop_back();
+}
+
+bool PerfLogCatalog::PopOldestOver(uint64_t budget, uint32_t reserve,
+                                   PerfLogSegment* evicted) {
+  if (segments_.size() <= 1 || allocated_bytes_ + reserve <= budget) {
+    return false;
+  }
+  *evicted = segments_.front();
+  allocated_bytes_ -= Allocated(evicted->bytes);
+  segments_.pop_front();
+  return true;
+}
+
+uint64_t PerfLogCatalog::Allocated(uint32_t bytes) const {
+  return ((uint64_t)bytes + block_size_ - 1) / block_size_ * block_size_;
+}
@@ -0,0 +1,95 @@
+#ifndef PERF_LOG_CATALOG_H
+#define PERF_LOG_CATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Sparse index entry: where a block starts and when its first record was
+// taken. With up to 64 records per block this is 6 bytes per minute of raw
+// log.
+struct __attribute__((packed)) PerfLogBlockRef {
+  uint16_t offset;           // Byte offset of the block in the file
+  uint32_t first_offset_ms;  // First record, ms after start_uptime_ms
+};
+
+// One log file ("segment") of a rotating store
+struct PerfLogSegment {
+  int index;                    // File index
+  uint32_t bytes;               // File size
+  uint16_t version;             // From the file header, 0 if unknown
+  uint32_t boot_id;             // From the file header, 0 if unknown
+  uint64_t start_uptime_ms;     // From the file header
+  uint64_t end_uptime_ms;       // Last record; start_uptime_ms if unknown
+  int64_t wall_clock_start_ms;  // Unix time of start_uptime_ms, 0 if unknown
+  uint64_t first_seq;           // Of the first record, 0 if unnumbered
+  uint32_t records;             // Records with known sequence numbers
+
+  // Blocks of a version 4+ file in file order; empty for other files
+  std::vector<PerfLogBlockRef> blocks;
+};
+
+// PerfLogCatalog - In-memory list of the segments of one store
+//
+// Built once at boot from a directory scan and then updated as files are
+// written, so rotation never has to list or sort the filesystem again.
+// Segments are ordered oldest (lowest index) first; the newest one is the
+// file being appended to.
+//
+// Retention is by size: PopOldestOver() evicts the oldest segments until the
+// store fits its byte budget. Sizes are counted in whole filesystem blocks,
+// since that is what a file really occupies on LittleFS.
+//
+// Not thread-safe; the owner serializes access.
+class PerfLogCatalog {
+ public:
+  explicit PerfLogCatalog(uint32_t block_size = 4096);
+
+  // Add an existing segment (any order during the boot scan; call Sort()
+  // afterwards)
+  void Add(const PerfLogSegment& segment);
+  void Sort();
+
+  // Start a new, empty newest segment after the current newest one and
+  // return it
+  PerfLogSegment* AppendNext();
+
+  // Account for bytes appended to the newest segment
+  void GrowNewest(uint32_t bytes, uint64_t end_uptime_ms);
+
+  // Account for a block of `records` records appended to the newest
+  // segment: indexes it at the current end of the file (which must be below
+  // 64 KiB), then grows the segment by `bytes`
+  void AddBlockToNewest(uint32_t bytes, uint32_t records,
+                        uint32_t first_offset_ms, uint64_t end_uptime_ms);
+
+  // Drop the newest segment (e.g. a file removed by crash recovery)
+  void PopNewest();
+
+  // If the store plus `reserve` bytes exceeds `budget` and there is more than
+  // one segment, remove the oldest segment, copy it to `evicted` and return
+  // true. Call repeatedly to enforce the budget.
+  bool PopOldestOver(uint64_t budget, uint32_t reserve,
+                     PerfLogSegment* evicted);
+
+  // Newest segment, or nullptr if empty
+  PerfLogSegment* newest() {
+    return segments_.empty() ? nullptr : &segments_.back();
+  }
+
+  size_t size() const { return segments_.size(); }
+  const PerfLogSegment& at(size_t i) const { return segments_[i]; }
+
+  // Bytes on the filesystem, rounded up to whole blocks
+  uint64_t allocated_bytes() const { return allocated_bytes_; }
+
+ private:
+  uint64_t Allocated(uint32_t bytes) const;
+
+  uint32_t block_size_;
+  uint64_t allocated_bytes_ = 0;
+  std::deque<PerfLogSegment> segments_;
+};
+
+#endif  // PERF_LOG_CATALOG_H
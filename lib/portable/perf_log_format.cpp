@@ -0,0 +1,450 @@
+#include "perf_log_format.h"
+
+#include <cstring>
+
+// Schema kPerfLogSchemaFourFansThreeTemps; a different PERF_LOG_CHANNELS list
+// needs a new schema id
+static_assert(sizeof(PerfLogRecord) == 21, "PerfLogRecord layout changed");
+static_assert(sizeof(PerfLogFileHeader) == 46,
+              "PerfLogFileHeader layout changed");
+static_assert(sizeof(PerfLogBlockHeader) == 18,
+              "PerfLogBlockHeader layout changed");
+
+namespace {
+
+uint32_t ZigZag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t UnZigZag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Append a varint; the caller guarantees 5 bytes of room
+uint8_t* PutVarint(uint8_t* out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+// Read a varint of at most 5 bytes. Returns false on overrun.
+bool GetVarint(const uint8_t** p, const uint8_t* end, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35 && *p < end; shift += 7) {
+    uint8_t byte = *(*p)++;
+    result |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Schema description of PerfLogRecord (see perf_log_format.h). Returns the
+// bytes written, kPerfLogSchemaSize.
+size_t EncodeRecordSchema(uint8_t* out) {
+  uint8_t* p = out;
+  *p++ = kPerfLogChannelCount;
+  for (const PerfLogChannelInfo& channel : kPerfLogChannels) {
+    *p++ = channel.size | channel.kind << 4;
+    size_t length = strlen(channel.name) + 1;
+    memcpy(p, channel.name, length);
+    p += length;
+  }
+  return p - out;
+}
+
+// Check that a header describes PerfLogRecord data this reader can decode
+const char* CheckRecordSchema(const PerfLogFileHeader& header) {
+  if (header.schema_id != kPerfLogSchemaFourFansThreeTemps) {
+    return "unknown schema";
+  }
+  if (header.record_size < sizeof(PerfLogRecord)) {
+    return "record size too small for schema";
+  }
+  if (header.version >= kPerfLogUntimedBlockVersion &&
+      header.record_size != sizeof(PerfLogRecord)) {
+    return "record size does not match schema";
+  }
+  return nullptr;
+}
+
+// Check a file's schema description, if it has one, against PerfLogRecord
+const char* CheckSchemaDescription(const uint8_t* data,
+                                   const PerfLogFileHeader& header) {
+  if (header.schema_size == 0) return nullptr;
+  uint8_t expected[kPerfLogSchemaSize];
+  EncodeRecordSchema(expected);
+  if (header.schema_size != sizeof(expected) ||
+      memcmp(data + header.header_size - header.schema_size, expected,
+             sizeof(expected)) != 0) {
+    return "schema description does not match";
+  }
+  return nullptr;
+}
+
+// Header, size and CRC of the block at the start of `data`, without decoding
+// the payload
+const char* CheckBlock(const uint8_t* data, size_t size, uint16_t version,
+                       PerfLogBlockHeader* header, size_t* block_size) {
+  const char* error = ParsePerfLogBlockHeader(data, size, version, header);
+  if (error != nullptr) return error;
+  size_t header_size = PerfLogBlockHeaderSize(version);
+  if (size - header_size < header->payload_size) return "truncated block";
+  if (PerfLogCrc32(data + header_size, header->payload_size) !=
+      header->payload_crc) {
+    return "block CRC mismatch";
+  }
+  *block_size = header_size + header->payload_size;
+  return nullptr;
+}
+
+}  // namespace
+
+uint32_t PerfLogCrc32(const uint8_t* data, size_t size, uint32_t crc) {
+  // Nibble-wise table: small enough for flash, fast enough for a few KB/min
+  static const uint32_t kTable[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+      0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = kTable[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = kTable[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+size_t EncodePerfLogBlock(const PerfLogRecord* records, int count,
+                          uint32_t first_offset_ms, uint8_t* out,
+                          size_t capacity) {
+  if (count < 1 || count > kPerfLogMaxBlockRecords) return 0;
+  size_t needed = sizeof(PerfLogBlockHeader) + sizeof(PerfLogRecord) +
+                  (count - 1) * kPerfLogMaxEncodedRecordSize;
+  if (capacity < needed) return 0;
+
+  uint8_t* payload = out + sizeof(PerfLogBlockHeader);
+  uint8_t* p = payload;
+
+  // Keyframe
+  memcpy(p, &records[0], sizeof(PerfLogRecord));
+  p += sizeof(PerfLogRecord);
+
+  int32_t previous[kPerfLogChannelCount];
+  PerfLogRecordToChannels(records[0], previous);
+  int32_t previous_delta_ms = records[0].delta_ms;
+  uint32_t last_offset_ms = first_offset_ms;
+
+  for (int i = 1; i < count; i++) {
+    int32_t current[kPerfLogChannelCount];
+    PerfLogRecordToChannels(records[i], current);
+    last_offset_ms += records[i].delta_ms;
+
+    p = PutVarint(p, ZigZag((int32_t)records[i].delta_ms - previous_delta_ms));
+    previous_delta_ms = records[i].delta_ms;
+
+    uint32_t mask = 0;
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (current[c] != previous[c]) mask |= 1u << c;
+    }
+    p = PutVarint(p, mask);
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (mask & (1u << c)) {
+        p = PutVarint(p, ZigZag(current[c] - previous[c]));
+        previous[c] = current[c];
+      }
+    }
+  }
+
+  PerfLogBlockHeader header;
+  header.magic = kPerfLogBlockMagic;
+  header.record_count = count;
+  header.payload_size = p - payload;
+  header.payload_crc = PerfLogCrc32(payload, header.payload_size);
+  header.first_offset_ms = first_offset_ms;
+  header.last_offset_ms = last_offset_ms;
+  memcpy(out, &header, sizeof(header));
+  return p - out;
+}
+
+const char* ParsePerfLogBlockHeader(const uint8_t* data, size_t size,
+                                    uint16_t version,
+                                    PerfLogBlockHeader* header) {
+  size_t header_size = PerfLogBlockHeaderSize(version);
+  if (size < header_size) return "truncated block";
+  memset(header, 0, sizeof(*header));
+  memcpy(header, data, header_size);
+  if (header->magic != kPerfLogBlockMagic) return "bad block magic";
+  if (header->record_count < 1 ||
+      header->record_count > kPerfLogMaxBlockRecords) {
+    return "bad block record count";
+  }
+  if (header->payload_size > kPerfLogMaxBlockSize) return "bad block size";
+  return nullptr;
+}
+
+const char* DecodePerfLogBlock(const uint8_t* data, size_t size,
+                               uint16_t version, PerfLogRecord* records,
+                               int* count, size_t* block_size) {
+  PerfLogBlockHeader header;
+  size_t size_checked;
+  const char* error = CheckBlock(data, size, version, &header, &size_checked);
+  if (error != nullptr) return error;
+
+  const uint8_t* payload = data + PerfLogBlockHeaderSize(version);
+  const uint8_t* p = payload;
+  const uint8_t* end = payload + header.payload_size;
+  if (header.payload_size < sizeof(PerfLogRecord)) return "bad block payload";
+  memcpy(&records[0], p, sizeof(PerfLogRecord));
+  p += sizeof(PerfLogRecord);
+
+  int32_t values[kPerfLogChannelCount];
+  PerfLogRecordToChannels(records[0], values);
+  int32_t delta_ms = records[0].delta_ms;
+
+  for (int i = 1; i < header.record_count; i++) {
+    uint32_t raw;
+    if (!GetVarint(&p, end, &raw)) return "bad block payload";
+    delta_ms += UnZigZag(raw);
+
+    uint32_t mask;
+    if (!GetVarint(&p, end, &mask)) return "bad block payload";
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (mask & (1u << c)) {
+        if (!GetVarint(&p, end, &raw)) return "bad block payload";
+        values[c] += UnZigZag(raw);
+      }
+    }
+
+    records[i].delta_ms = delta_ms;
+    PerfLogChannelsToRecord(values, &records[i]);
+  }
+  if (p != end) return "bad block payload";
+
+  *count = header.record_count;
+  *block_size = size_checked;
+  return nullptr;
+}
+
+size_t FindPerfLogBlock(const uint8_t* data, size_t size, size_t offset,
+                        uint16_t version) {
+  const uint8_t kMagic[2] = {kPerfLogBlockMagic & 0xFF,
+                             kPerfLogBlockMagic >> 8};
+  for (; offset + 1 < size; offset++) {
+    if (data[offset] != kMagic[0] || data[offset + 1] != kMagic[1]) continue;
+    PerfLogBlockHeader header;
+    size_t block_size;
+    if (CheckBlock(data + offset, size - offset, version, &header,
+                   &block_size) == nullptr) {
+      return offset;
+    }
+  }
+  return size;
+}
+
+size_t PerfLogValidLength(const uint8_t* data, size_t size) {
+  uint32_t magic = 0;
+  if (size >= sizeof(magic)) memcpy(&magic, data, sizeof(magic));
+  if (magic != kPerfLogMagic) {
+    // Headerless version 1 file
+    return size - size % sizeof(PerfLogRecord);
+  }
+
+  PerfLogFileHeader header;
+  if (ParsePerfLogHeader(data, size, &header) != nullptr) return 0;
+  size_t offset = header.header_size;
+  if (header.version < kPerfLogUntimedBlockVersion ||
+      header.schema_id != kPerfLogSchemaFourFansThreeTemps) {
+    // Fixed-size records
+    if (header.record_size == 0) return offset;
+    return offset + (size - offset) / header.record_size * header.record_size;
+  }
+
+  size_t valid = offset;
+  while (offset < size) {
+    PerfLogBlockHeader block;
+    size_t block_size;
+    if (CheckBlock(data + offset, size - offset, header.version, &block,
+                   &block_size) == nullptr) {
+      offset += block_size;
+      valid = offset;
+    } else {
+      offset = FindPerfLogBlock(data, size, offset + 1, header.version);
+    }
+  }
+  return valid;
+}
+
+void InitPerfLogHeader(PerfLogFileHeader* header, uint32_t boot_id,
+                       uint32_t sample_interval_ms, uint64_t start_uptime_ms,
+                       int64_t wall_clock_base_ms) {
+  memset(header, 0, sizeof(*header));
+  header->magic = kPerfLogMagic;
+  header->version = kPerfLogVersion;
+  header->header_size = sizeof(PerfLogFileHeader);
+  header->schema_id = kPerfLogSchemaFourFansThreeTemps;
+  header->record_size = sizeof(PerfLogRecord);
+  header->boot_id = boot_id;
+  header->sample_interval_ms = sample_interval_ms;
+  header->start_uptime_ms = start_uptime_ms;
+  header->wall_clock_base_ms = wall_clock_base_ms;
+}
+
+size_t EncodePerfLogHeader(PerfLogFileHeader* header, uint8_t* out) {
+  header->header_size = kPerfLogEncodedHeaderSize;
+  header->schema_size = kPerfLogSchemaSize;
+  memcpy(out, header, sizeof(*header));
+  return sizeof(*header) + EncodeRecordSchema(out + sizeof(*header));
+}
+
+const char* ParsePerfLogHeader(const uint8_t* data, size_t size,
+                               PerfLogFileHeader* header) {
+  // Fields up to record_size are needed to find the records at all
+  const size_t kMinHeaderSize = offsetof(PerfLogFileHeader, boot_id);
+  if (size < kMinHeaderSize) return "truncated header";
+
+  memset(header, 0, sizeof(*header));
+  memcpy(header, data, kMinHeaderSize);
+  if (header->magic != kPerfLogMagic) return "bad magic";
+  if (header->version < kPerfLogRawVersion ||
+      header->version > kPerfLogVersion) {
+    return "unsupported version";
+  }
+  if (header->header_size < kMinHeaderSize) return "invalid header size";
+  if (header->header_size > size) return "truncated header";
+
+  // Newer writers may append header fields; older ones may omit ours. The
+  // fields end where the schema description starts.
+  const size_t kSchemaSizeEnd = offsetof(PerfLogFileHeader, first_seq);
+  size_t fields = header->header_size;
+  if (fields >= kSchemaSizeEnd) {
+    memcpy(header, data, kSchemaSizeEnd);
+    if (header->schema_size > fields - kSchemaSizeEnd) {
+      return "invalid schema size";
+    }
+    fields -= header->schema_size;
+  }
+  size_t known = fields < sizeof(*header) ? fields : sizeof(*header);
+  memset(header, 0, sizeof(*header));
+  memcpy(header, data, known);
+  return nullptr;
+}
+
+const char* PerfLogReader::Open(const uint8_t* data, size_t size) {
+  data_ = data;
+  size_ = size;
+  uptime_ms_ = 0;
+  last_legacy_seconds_ = 0;
+  legacy_wraps_ = 0;
+  first_ = true;
+  truncated_ = false;
+  error_ = nullptr;
+  skipped_bytes_ = 0;
+  block_count_ = 0;
+  block_pos_ = 0;
+
+  uint32_t magic = 0;
+  if (size >= sizeof(magic)) memcpy(&magic, data, sizeof(magic));
+
+  if (magic != kPerfLogMagic) {
+    // Headerless version 1 file
+    memset(&header_, 0, sizeof(header_));
+    header_.version = kPerfLogLegacyVersion;
+    header_.schema_id = kPerfLogSchemaFourFansThreeTemps;
+    header_.record_size = sizeof(PerfLogRecord);
+    header_.sample_interval_ms = 1000;
+    offset_ = 0;
+    return nullptr;
+  }
+
+  const char* error = ParsePerfLogHeader(data, size, &header_);
+  if (error == nullptr) error = CheckRecordSchema(header_);
+  if (error == nullptr) error = CheckSchemaDescription(data, header_);
+  if (error != nullptr) {
+    data_ = nullptr;
+    return error;
+  }
+
+  uptime_ms_ = header_.start_uptime_ms;
+  offset_ = header_.header_size;
+  return nullptr;
+}
+
+bool PerfLogReader::Next(PerfLogSample* sample) {
+  if (data_ == nullptr) return false;
+
+  bool rebased = false;
+  if (header_.version >= kPerfLogUntimedBlockVersion) {
+    size_t block_offset = 0;
+    bool block_start = false;
+    while (block_pos_ >= block_count_) {
+      if (offset_ >= size_) return false;
+      size_t block_size;
+      const char* error = DecodePerfLogBlock(data_ + offset_, size_ - offset_,
+                                             header_.version, block_,
+                                             &block_count_, &block_size);
+      if (error == nullptr) {
+        block_start = true;
+        block_offset = offset_;
+        offset_ += block_size;
+        block_pos_ = 0;
+      } else if (strcmp(error, "truncated block") == 0 &&
+                 FindPerfLogBlock(data_, size_, offset_ + 1,
+                                  header_.version) == size_) {
+        block_count_ = 0;
+        truncated_ = true;
+        return false;
+      } else {
+        // Corrupt block: resync at the next intact one
+        block_count_ = 0;
+        error_ = error;
+        size_t next = FindPerfLogBlock(data_, size_, offset_ + 1,
+                                       header_.version);
+        skipped_bytes_ += next - offset_;
+        offset_ = next;
+      }
+    }
+
+    // Version 4 blocks carry their start time, so time stays exact after a
+    // skipped block
+    PerfLogBlockHeader block;
+    if (block_start && header_.version >= kPerfLogVersion &&
+        ParsePerfLogBlockHeader(data_ + block_offset, size_ - block_offset,
+                                header_.version, &block) == nullptr) {
+      uptime_ms_ = header_.start_uptime_ms + block.first_offset_ms;
+      rebased = true;
+    }
+    sample->record = block_[block_pos_++];
+  } else {
+    if (offset_ >= size_) return false;
+    if (size_ - offset_ < header_.record_size) {
+      truncated_ = true;
+      return false;
+    }
+    memcpy(&sample->record, data_ + offset_, sizeof(PerfLogRecord));
+    offset_ += header_.record_size;
+  }
+
+  if (header_.version == kPerfLogLegacyVersion) {
+    // Seconds counter; a backwards step is taken to be a 16-bit wrap
+    uint16_t seconds = sample->record.delta_ms;
+    if (!first_ && seconds < last_legacy_seconds_) legacy_wraps_++;
+    last_legacy_seconds_ = seconds;
+    uptime_ms_ = ((legacy_wraps_ << 16) + seconds) * 1000;
+  } else if (!first_ && !rebased) {
+    uptime_ms_ += sample->record.delta_ms;
+  }
+  first_ = false;
+
+  sample->uptime_ms = uptime_ms_;
+  sample->wall_clock_ms =
+      header_.wall_clock_base_ms != 0
+          ? header_.wall_clock_base_ms +
+                (int64_t)(uptime_ms_ - header_.start_uptime_ms)
+          : 0;
+  return true;
+}
@@ -0,0 +1,312 @@
+#ifndef PERF_LOG_FORMAT_H
+#define PERF_LOG_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "perf_log_schema.h"
+
+// Perf log file format
+//
+// Version 2 files start with a PerfLogFileHeader followed by fixed-size
+// records. Each record stores the milliseconds elapsed since the previous
+// record of the same file (the first record has delta 0 and is taken at
+// header.start_uptime_ms), so absolute time is exact no matter how long the
+// controller runs. A writer starts a new file whenever a delta would not fit.
+//
+// Version 3 files have the same header, followed by CRC-protected blocks
+// instead of raw records (see "Block encoding" below). Records keep the same
+// meaning, including delta_ms. Version 4 block headers also carry the time
+// range of the block, so readers can seek to a time without decoding.
+//
+// The record layout comes from the channel list in perf_log_schema.h. Headers
+// may end with a description of it (see "Schema description" below).
+//
+// Raw records are numbered with a sequence number that keeps counting across
+// files and boots. It is not stored per record: the header holds the number
+// of the first record and the rest follow in file order, block by block.
+//
+// Version 1 files (no header) are plain 21-byte records whose timestamp is a
+// uint16_t seconds-since-boot counter that wraps after ~18 hours. The reader
+// still accepts them and unwraps the counter on a best-effort basis.
+//
+// All fields are little-endian (native on both the ESP32 and the host tools).
+
+constexpr uint32_t kPerfLogMagic = 0x4C504346;  // "FCPL"
+constexpr uint16_t kPerfLogVersion = 4;
+constexpr uint16_t kPerfLogUntimedBlockVersion = 3;
+constexpr uint16_t kPerfLogRawVersion = 2;
+constexpr uint16_t kPerfLogLegacyVersion = 1;
+
+// Record layouts. Bump when PerfLogRecord changes so old files stay readable.
+constexpr uint16_t kPerfLogSchemaFourFansThreeTemps = 1;
+constexpr uint16_t kPerfLogSchemaRollup = 2;  // See perf_log_rollup.h
+
+// Structure for a single performance log record, generated from
+// PERF_LOG_CHANNELS (perf_log_schema.h)
+// Packed to ensure consistent size on disk
+// Note: Total size is 21 bytes (2 timestamp + 16 fans + 3 thermistors)
+struct __attribute__((packed)) PerfLogRecord {
+  // Version 2+: ms since the previous record. Version 1: seconds since boot.
+  uint16_t delta_ms;
+
+#define PERF_LOG_RECORD_FIELD(field, type, kind, instance, name) type field;
+  PERF_LOG_CHANNELS(PERF_LOG_RECORD_FIELD)
+#undef PERF_LOG_RECORD_FIELD
+};
+
+// Channels: the record fields after delta_ms, in PERF_LOG_CHANNELS order
+#define PERF_LOG_COUNT_CHANNEL(field, type, kind, instance, name) +1
+constexpr int kPerfLogChannelCount = 0 PERF_LOG_CHANNELS(PERF_LOG_COUNT_CHANNEL);
+#undef PERF_LOG_COUNT_CHANNEL
+static_assert(kPerfLogChannelCount <= 32, "channel masks are 32 bits");
+
+struct PerfLogChannelInfo {
+  const char* name;  // Column name, as in /range
+  PerfLogChannelKind kind;
+  uint8_t instance;  // Fan or thermistor, 0-based
+  uint8_t size;      // Bytes in the record (unsigned)
+};
+
+constexpr PerfLogChannelInfo kPerfLogChannels[kPerfLogChannelCount] = {
+#define PERF_LOG_CHANNEL_INFO(field, type, kind, instance, name) \
+  {name, kind, instance, sizeof(type)},
+    PERF_LOG_CHANNELS(PERF_LOG_CHANNEL_INFO)
+#undef PERF_LOG_CHANNEL_INFO
+};
+
+// Number of logged fans or thermistors: highest instance of `kind` plus one
+constexpr int PerfLogInstanceCount(PerfLogChannelKind kind) {
+  int count = 0;
+  for (const PerfLogChannelInfo& channel : kPerfLogChannels) {
+    if (channel.kind == kind && channel.instance >= count) {
+      count = channel.instance + 1;
+    }
+  }
+  return count;
+}
+
+// Record fields after delta_ms as an array of kPerfLogChannelCount values
+inline void PerfLogRecordToChannels(const PerfLogRecord& record,
+                                    int32_t* channels) {
+  int32_t* out = channels;
+#define PERF_LOG_GET_CHANNEL(field, type, kind, instance, name) \
+  *out++ = record.field;
+  PERF_LOG_CHANNELS(PERF_LOG_GET_CHANNEL)
+#undef PERF_LOG_GET_CHANNEL
+}
+
+inline void PerfLogChannelsToRecord(const int32_t* channels,
+                                    PerfLogRecord* record) {
+  const int32_t* in = channels;
+#define PERF_LOG_SET_CHANNEL(field, type, kind, instance, name) \
+  record->field = (type)*in++;
+  PERF_LOG_CHANNELS(PERF_LOG_SET_CHANNEL)
+#undef PERF_LOG_SET_CHANNEL
+}
+
+struct __attribute__((packed)) PerfLogFileHeader {
+  uint32_t magic;        // kPerfLogMagic
+  uint16_t version;      // kPerfLogVersion
+  uint16_t header_size;  // Bytes; readers skip fields they do not know
+  uint16_t schema_id;    // Record layout
+  uint16_t record_size;  // Bytes per record; readers skip unknown tail bytes
+  uint32_t boot_id;      // Incremented on every boot
+  uint32_t sample_interval_ms;
+  uint64_t start_uptime_ms;     // Uptime of the first record in the file
+  int64_t wall_clock_base_ms;   // Unix time at start_uptime_ms, 0 if unknown
+  uint16_t schema_size;  // Bytes of schema description ending the header
+  uint64_t first_seq;    // Sequence number of the first record, 0 if none
+};
+
+// Schema description
+//
+// Raw and rollup files written by EncodePerfLogHeader() end their header with
+// a description of the record channels, so tools can decode a file without
+// knowing its schema id:
+//   uint8_t  channel count
+//   per channel, in record order after delta_ms:
+//     uint8_t  size in bytes (low nibble) | PerfLogChannelKind << 4
+//     char[]   name, NUL-terminated
+#define PERF_LOG_SCHEMA_ENTRY_SIZE(field, type, kind, instance, name) \
+  +1 + sizeof(name)
+constexpr size_t kPerfLogSchemaSize =
+    1 PERF_LOG_CHANNELS(PERF_LOG_SCHEMA_ENTRY_SIZE);
+#undef PERF_LOG_SCHEMA_ENTRY_SIZE
+
+// Header bytes written by EncodePerfLogHeader()
+constexpr size_t kPerfLogEncodedHeaderSize =
+    sizeof(PerfLogFileHeader) + kPerfLogSchemaSize;
+
+// Fill a header for the current version and schema
+void InitPerfLogHeader(PerfLogFileHeader* header, uint32_t boot_id,
+                       uint32_t sample_interval_ms, uint64_t start_uptime_ms,
+                       int64_t wall_clock_base_ms);
+
+// Serialize `header` followed by the schema description into `out` (room for
+// kPerfLogEncodedHeaderSize bytes), setting header_size and schema_size.
+// Returns the bytes written.
+size_t EncodePerfLogHeader(PerfLogFileHeader* header, uint8_t* out);
+
+// Parse a version 2+ header without checking the schema. Fields the writer
+// did not know are zeroed. Returns nullptr on success or an error message.
+const char* ParsePerfLogHeader(const uint8_t* data, size_t size,
+                               PerfLogFileHeader* header);
+
+// Block encoding
+//
+// Temperatures, duties and RPMs barely change from one second to the next, so
+// version 3+ stores records in blocks: a PerfLogBlockHeader, then the first
+// record verbatim (the keyframe), then for every following record
+//   varint  zigzag(delta_ms - previous delta_ms)
+//   varint  bitmask of changed channels (bit n = channel n, see below)
+//   varint  zigzag(value - previous value), for each changed channel
+// An unchanged record at the usual interval is 2 bytes instead of 21.
+//
+// Channels are in mask order, i.e. PERF_LOG_CHANNELS order.
+
+constexpr uint16_t kPerfLogBlockMagic = 0xB10C;
+constexpr int kPerfLogMaxBlockRecords = 64;
+
+struct __attribute__((packed)) PerfLogBlockHeader {
+  uint16_t magic;         // kPerfLogBlockMagic
+  uint16_t record_count;  // 1..kPerfLogMaxBlockRecords
+  uint16_t payload_size;  // Bytes following this header
+  uint32_t payload_crc;   // CRC-32 (zlib) of the payload
+
+  // Version 4+: first and last record, ms after header.start_uptime_ms
+  uint32_t first_offset_ms;
+  uint32_t last_offset_ms;
+};
+
+// Bytes of PerfLogBlockHeader present in files of a version
+inline size_t PerfLogBlockHeaderSize(uint16_t version) {
+  return version >= kPerfLogVersion ? sizeof(PerfLogBlockHeader)
+                                    : offsetof(PerfLogBlockHeader,
+                                               first_offset_ms);
+}
+
+// Bytes of a varint holding up to `bits` bits
+constexpr size_t PerfLogVarintSize(int bits) { return (bits + 6) / 7; }
+
+// Worst-case record size: varints for the timestamp, the mask and every
+// channel; a zig-zag delta needs one bit more than its field
+#define PERF_LOG_MAX_DELTA_SIZE(field, type, kind, instance, name) \
+  +PerfLogVarintSize(8 * sizeof(type) + 1)
+constexpr size_t kPerfLogMaxEncodedRecordSize =
+    PerfLogVarintSize(17) + PerfLogVarintSize(kPerfLogChannelCount)
+        PERF_LOG_CHANNELS(PERF_LOG_MAX_DELTA_SIZE);
+#undef PERF_LOG_MAX_DELTA_SIZE
+
+// Best-case record size: an unchanged record is its timestamp and mask
+constexpr size_t kPerfLogMinEncodedRecordSize = 2;
+constexpr size_t kPerfLogMaxBlockSize =
+    sizeof(PerfLogBlockHeader) + sizeof(PerfLogRecord) +
+    (kPerfLogMaxBlockRecords - 1) * kPerfLogMaxEncodedRecordSize;
+
+// CRC-32 as in zlib; pass the previous result to continue a running CRC
+uint32_t PerfLogCrc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+// Encode `count` (1..kPerfLogMaxBlockRecords) records as one current-version
+// block whose first record is `first_offset_ms` after the file start. Returns
+// the block size, or 0 if `count` is out of range or `capacity` is too small
+// (kPerfLogMaxBlockSize is always enough).
+size_t EncodePerfLogBlock(const PerfLogRecord* records, int count,
+                          uint32_t first_offset_ms, uint8_t* out,
+                          size_t capacity);
+
+// Parse and sanity-check the block header at the start of `data` for a file
+// of `version`. Older versions leave the time offsets 0. Returns nullptr on
+// success, "truncated block" if `data` is too short, or another error.
+const char* ParsePerfLogBlockHeader(const uint8_t* data, size_t size,
+                                    uint16_t version,
+                                    PerfLogBlockHeader* header);
+
+// Decode one block from the start of `data`. On success returns nullptr and
+// sets `records`/`count` (room for kPerfLogMaxBlockRecords is needed) and
+// `block_size`. Returns "truncated block" if `data` ends mid-block, or another
+// error message if the block is corrupt.
+const char* DecodePerfLogBlock(const uint8_t* data, size_t size,
+                               uint16_t version, PerfLogRecord* records,
+                               int* count, size_t* block_size);
+
+// Resync after a corrupt block: offset of the first intact block (header and
+// CRC valid) at or after `offset` in `data`, or `size` if there is none. A
+// block cut off by the end of `data` does not count.
+size_t FindPerfLogBlock(const uint8_t* data, size_t size, size_t offset,
+                        uint16_t version);
+
+// Crash recovery: length of a file up to the end of its last intact record or
+// block, looking past corrupt blocks. Anything after it is the torn tail of
+// an interrupted write. Returns 0 if the header is unreadable.
+size_t PerfLogValidLength(const uint8_t* data, size_t size);
+
+// Decoders matching PerfLogger's 1-byte encodings
+inline float DecodePerfLogTemperature(uint8_t encoded) {
+  return 10.0f + encoded * 40.0f / 255.0f;
+}
+
+inline float DecodePerfLogDutyCycle(uint8_t encoded) {
+  return encoded * 100.0f / 255.0f;
+}
+
+// One decoded record with absolute timestamps
+struct PerfLogSample {
+  uint64_t uptime_ms;
+  int64_t wall_clock_ms;  // 0 if the file has no wall-clock base
+  PerfLogRecord record;
+};
+
+// PerfLogReader - Iterates the records of one in-memory perf log file
+//
+// Usage:
+//   PerfLogReader reader;
+//   const char* error = reader.Open(data, size);
+//   PerfLogSample sample;
+//   while (error == nullptr && reader.Next(&sample)) { ... }
+class PerfLogReader {
+ public:
+  // Parse the header (or detect a legacy file). Returns nullptr on success or
+  // an error message. `data` must outlive the reader.
+  const char* Open(const uint8_t* data, size_t size);
+
+  // Decode the next record. Returns false at the end of the file; a trailing
+  // partial record or block (e.g. from a power cut mid-write) is ignored.
+  // Corrupt blocks are skipped by resyncing at the next intact block (see
+  // error() and skipped_bytes()). Version 4 timestamps stay exact across a
+  // skipped block; older versions lose the skipped deltas.
+  bool Next(PerfLogSample* sample);
+
+  // Header of the open file. Legacy files get a synthesized header with
+  // version kPerfLogLegacyVersion.
+  const PerfLogFileHeader& header() const { return header_; }
+
+  // True if a trailing partial record or block was found
+  bool truncated() const { return truncated_; }
+
+  // The last corruption skipped, or nullptr
+  const char* error() const { return error_; }
+
+  // Bytes skipped over corrupt blocks
+  size_t skipped_bytes() const { return skipped_bytes_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  size_t offset_ = 0;
+  PerfLogFileHeader header_ = {};
+  uint64_t uptime_ms_ = 0;
+  uint16_t last_legacy_seconds_ = 0;
+  uint64_t legacy_wraps_ = 0;
+  bool first_ = true;
+  bool truncated_ = false;
+  const char* error_ = nullptr;
+  size_t skipped_bytes_ = 0;
+
+  // Decoded records of the current block (version 3+)
+  PerfLogRecord block_[kPerfLogMaxBlockRecords];
+  int block_count_ = 0;
+  int block_pos_ = 0;
+};
+
+#endif  // PERF_LOG_FORMAT_H
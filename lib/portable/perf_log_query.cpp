@@ -0,0 +1,419 @@
+#include "perf_log_query.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Case-insensitive match of `name` against the `length` chars at `text`
+bool MatchesName(const char* name, const char* text, size_t length) {
+  if (strlen(name) != length) return false;
+  for (size_t i = 0; i < length; i++) {
+    if (tolower((unsigned char)name[i]) != tolower((unsigned char)text[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Time of a segment's records in query units, as an offset from uptime.
+// Returns false if the segment cannot match the query at all.
+bool SegmentTimeShift(const PerfLogSegment& segment,
+                      const PerfLogRangeQuery& query, int64_t* shift) {
+  if (query.wall_clock) {
+    if (segment.wall_clock_start_ms == 0) return false;
+    *shift = segment.wall_clock_start_ms - (int64_t)segment.start_uptime_ms;
+  } else {
+    if (segment.boot_id != query.boot_id) return false;
+    *shift = 0;
+  }
+  return true;
+}
+
+bool InRange(int64_t time_ms, const PerfLogRangeQuery& query) {
+  return time_ms >= query.from_ms && time_ms < query.to_ms;
+}
+
+// Indexed (version 4+) segment: the last block starting at or before the
+// range start, from which the blocks overlapping the range follow
+size_t FirstRangeBlock(const PerfLogSegment& segment, int64_t shift,
+                       const PerfLogRangeQuery& query) {
+  const std::vector<PerfLogBlockRef>& blocks = segment.blocks;
+  int64_t from_offset_ms =
+      query.from_ms - ((int64_t)segment.start_uptime_ms + shift);
+  if (from_offset_ms <= 0) return 0;
+  auto after = std::upper_bound(
+      blocks.begin(), blocks.end(), from_offset_ms,
+      [](int64_t offset_ms, const PerfLogBlockRef& block) {
+        return offset_ms < (int64_t)block.first_offset_ms;
+      });
+  return after != blocks.begin() ? after - blocks.begin() - 1 : 0;
+}
+
+// Whether block `i` of an indexed segment starts before the range ends
+bool RangeBlockNeeded(const PerfLogSegment& segment, size_t i, int64_t shift,
+                      const PerfLogRangeQuery& query) {
+  return i < segment.blocks.size() &&
+         (int64_t)segment.start_uptime_ms + shift +
+                 segment.blocks[i].first_offset_ms <
+             query.to_ms;
+}
+
+// Read block `i` of an indexed segment and pass its records in the range
+void QueryRangeBlock(const PerfLogSegment& segment, size_t i, int64_t shift,
+                     PerfLogStorage* storage, const PerfLogRangeQuery& query,
+                     PerfLogRangeSink sink, void* context,
+                     std::vector<uint8_t>* scratch, PerfLogRangeStats* stats,
+                     const char** last_error) {
+  const std::vector<PerfLogBlockRef>& blocks = segment.blocks;
+  uint32_t end = i + 1 < blocks.size() ? blocks[i + 1].offset : segment.bytes;
+  uint32_t size = end - blocks[i].offset;
+  if (size > scratch->size()) scratch->resize(size);
+  size_t n = storage->Read(segment.index, blocks[i].offset, scratch->data(),
+                           size);
+  stats->blocks_read++;
+  stats->bytes_read += n;
+
+  PerfLogRecord records[kPerfLogMaxBlockRecords];
+  int count;
+  size_t block_size;
+  const char* error = DecodePerfLogBlock(scratch->data(), n, segment.version,
+                                         records, &count, &block_size);
+  if (error != nullptr) {
+    // Skip it, as PerfLogReader does; a torn tail is not an error
+    if (strcmp(error, "truncated block") != 0) {
+      stats->corrupt_blocks++;
+      *last_error = error;
+    }
+    return;
+  }
+  stats->records_decoded += count;
+
+  int64_t time_ms =
+      (int64_t)segment.start_uptime_ms + shift + blocks[i].first_offset_ms;
+  for (int r = 0; r < count; r++) {
+    if (r > 0) time_ms += records[r].delta_ms;
+    if (!InRange(time_ms, query)) continue;
+    PerfLogSample sample;
+    sample.uptime_ms = time_ms - shift;
+    sample.wall_clock_ms =
+        segment.wall_clock_start_ms != 0
+            ? segment.wall_clock_start_ms +
+                  (int64_t)(sample.uptime_ms - segment.start_uptime_ms)
+            : 0;
+    sample.record = records[r];
+    stats->records_matched++;
+    sink(segment.boot_id, sample, context);
+  }
+}
+
+// Older segment without a block index: decode the whole file
+void QueryWholeSegment(const PerfLogSegment& segment,
+                       PerfLogStorage* storage,
+                       const PerfLogRangeQuery& query, PerfLogRangeSink sink,
+                       void* context, PerfLogRangeStats* stats,
+                       const char** last_error) {
+  std::vector<uint8_t> data(segment.bytes);
+  size_t n = storage->Read(segment.index, 0, data.data(), data.size());
+  stats->segments_read++;
+  stats->bytes_read += n;
+
+  PerfLogReader reader;
+  const char* error = reader.Open(data.data(), n);
+  if (error != nullptr) {
+    *last_error = error;
+    return;
+  }
+  PerfLogSample sample;
+  while (reader.Next(&sample)) {
+    stats->records_decoded++;
+    int64_t time_ms =
+        query.wall_clock ? sample.wall_clock_ms : (int64_t)sample.uptime_ms;
+    if (query.wall_clock && sample.wall_clock_ms == 0) continue;
+    if (!InRange(time_ms, query)) continue;
+    stats->records_matched++;
+    sink(reader.header().boot_id, sample, context);
+  }
+  if (reader.error() != nullptr) {
+    stats->corrupt_blocks++;
+    *last_error = reader.error();
+  }
+}
+
+enum SeqBlockResult {
+  kSeqBlockSkipped,  // Only its header was read: all before the cursor
+  kSeqBlockRead,     // Its records (or a gap for them) were passed on
+  kSeqBlockEnd,      // Its header is unreadable; the segment ends here
+};
+
+// Block `i` of a numbered segment, whose first record is numbered `*seq`.
+// Passes the records numbered from `*next` on and advances both numbers
+// past the block.
+SeqBlockResult QuerySeqBlock(const PerfLogSegment& segment, size_t i,
+                             PerfLogStorage* storage, uint64_t* seq,
+                             uint64_t* next, PerfLogSeqSink sink,
+                             PerfLogGapSink gap, void* context,
+                             std::vector<uint8_t>* scratch,
+                             PerfLogRangeStats* stats,
+                             const char** last_error) {
+  const std::vector<PerfLogBlockRef>& blocks = segment.blocks;
+
+  // Blocks before the cursor only need their record count
+  uint8_t data[sizeof(PerfLogBlockHeader)];
+  size_t n = storage->Read(segment.index, blocks[i].offset, data,
+                           PerfLogBlockHeaderSize(segment.version));
+  stats->bytes_read += n;
+  PerfLogBlockHeader header;
+  const char* error =
+      ParsePerfLogBlockHeader(data, n, segment.version, &header);
+  if (error != nullptr) {
+    // Rotated away since the catalog was copied, or rewritten
+    if (n > 0) *last_error = error;
+    return kSeqBlockEnd;
+  }
+  uint64_t block_end = *seq + header.record_count;
+  if (block_end <= *next) {
+    *seq = block_end;
+    return kSeqBlockSkipped;
+  }
+
+  uint32_t end = i + 1 < blocks.size() ? blocks[i + 1].offset : segment.bytes;
+  uint32_t size = end - blocks[i].offset;
+  if (size > scratch->size()) scratch->resize(size);
+  n = storage->Read(segment.index, blocks[i].offset, scratch->data(), size);
+  stats->blocks_read++;
+  stats->bytes_read += n;
+
+  PerfLogRecord records[kPerfLogMaxBlockRecords];
+  int count;
+  size_t block_size;
+  error = DecodePerfLogBlock(scratch->data(), n, segment.version, records,
+                             &count, &block_size);
+  if (error != nullptr) {
+    // The header still says how many numbers the block used
+    stats->corrupt_blocks++;
+    *last_error = error;
+    gap(*next, block_end - 1, context);
+    *seq = *next = block_end;
+    return kSeqBlockRead;
+  }
+  stats->records_decoded += count;
+
+  uint64_t time_ms = segment.start_uptime_ms + blocks[i].first_offset_ms;
+  for (int r = 0; r < count; r++) {
+    if (r > 0) time_ms += records[r].delta_ms;
+    if (*seq + r < *next) continue;
+    PerfLogSample sample;
+    sample.uptime_ms = time_ms;
+    sample.wall_clock_ms =
+        segment.wall_clock_start_ms != 0
+            ? segment.wall_clock_start_ms +
+                  (int64_t)(time_ms - segment.start_uptime_ms)
+            : 0;
+    sample.record = records[r];
+    stats->records_matched++;
+    sink(*seq + r, segment.boot_id, sample, context);
+  }
+  *seq = *next = block_end;
+  return kSeqBlockRead;
+}
+
+}  // namespace
+
+bool ParsePerfLogChannelList(const char* list, uint32_t* mask) {
+  *mask = 0;
+  const char* start = list;
+  for (;;) {
+    const char* end = strchr(start, ',');
+    size_t length = end != nullptr ? end - start : strlen(start);
+    int channel = -1;
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (MatchesName(kPerfLogChannels[c].name, start, length)) channel = c;
+    }
+    if (channel < 0) return false;
+    *mask |= 1u << channel;
+    if (end == nullptr) return true;
+    start = end + 1;
+  }
+}
+
+int FormatPerfLogChannel(int channel, int32_t value, char* out, size_t size) {
+  switch (kPerfLogChannels[channel].kind) {
+    case kPerfLogFanTarget:
+    case kPerfLogFanDuty:
+      return snprintf(out, size, "%.1f", DecodePerfLogDutyCycle(value));
+    case kPerfLogTemperature:
+      return snprintf(out, size, "%.1f", DecodePerfLogTemperature(value));
+    default:
+      return snprintf(out, size, "%d", (int)value);
+  }
+}
+
+PerfLogRangeCursor::PerfLogRangeCursor(
+    const std::vector<PerfLogSegment>& segments, PerfLogStorage* storage,
+    const PerfLogRangeQuery& query, PerfLogRangeSink sink, void* context)
+    : segments_(segments),
+      storage_(storage),
+      query_(query),
+      sink_(sink),
+      context_(context) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bool PerfLogRangeCursor::Next() {
+  while (segment_ < segments_.size()) {
+    const PerfLogSegment& segment = segments_[segment_];
+    if (!in_segment_) {
+      if (segment.bytes == 0 || !SegmentTimeShift(segment, query_, &shift_) ||
+          (int64_t)segment.start_uptime_ms + shift_ >= query_.to_ms) {
+        segment_++;
+        continue;
+      }
+      if (segment.version < kPerfLogVersion) {
+        QueryWholeSegment(segment, storage_, query_, sink_, context_, &stats_,
+                          &error_);
+        segment_++;
+        return true;
+      }
+      // The end time is exact for indexed segments
+      if ((int64_t)segment.end_uptime_ms + shift_ < query_.from_ms) {
+        segment_++;
+        continue;
+      }
+      stats_.segments_read++;
+      block_ = FirstRangeBlock(segment, shift_, query_);
+      in_segment_ = true;
+    }
+    if (!RangeBlockNeeded(segment, block_, shift_, query_)) {
+      in_segment_ = false;
+      segment_++;
+      continue;
+    }
+    QueryRangeBlock(segment, block_++, shift_, storage_, query_, sink_,
+                    context_, &scratch_, &stats_, &error_);
+    return true;
+  }
+  return false;
+}
+
+const char* QueryPerfLogRange(const std::vector<PerfLogSegment>& segments,
+                              PerfLogStorage* storage,
+                              const PerfLogRangeQuery& query,
+                              PerfLogRangeSink sink, void* context,
+                              PerfLogRangeStats* stats) {
+  PerfLogRangeCursor cursor(segments, storage, query, sink, context);
+  while (cursor.Next()) {
+  }
+  if (stats != nullptr) *stats = cursor.stats();
+  return cursor.error();
+}
+
+uint32_t IndexPerfLogBlocks(PerfLogStorage* storage, int index,
+                            uint16_t version, uint32_t offset, uint32_t size,
+                            std::vector<PerfLogBlockRef>* blocks,
+                            uint32_t* end_offset_ms, uint32_t* records) {
+  size_t header_size = PerfLogBlockHeaderSize(version);
+  *end_offset_ms = 0;
+  *records = 0;
+  bool resynced = false;
+  uint32_t indexed = offset;
+  while (offset < size && offset <= UINT16_MAX) {
+    uint8_t data[sizeof(PerfLogBlockHeader)];
+    size_t n = storage->Read(index, offset, data, header_size);
+    PerfLogBlockHeader header;
+    if (ParsePerfLogBlockHeader(data, n, version, &header) == nullptr &&
+        size - offset >= header_size + header.payload_size) {
+      blocks->push_back({(uint16_t)offset, header.first_offset_ms});
+      *end_offset_ms = header.last_offset_ms;
+      if (!resynced) *records += header.record_count;
+      offset += header_size + header.payload_size;
+      indexed = offset;
+      continue;
+    }
+
+    // Corrupt header or torn tail: resync on the rest of the file
+    std::vector<uint8_t> rest(size - offset);
+    n = storage->Read(index, offset, rest.data(), rest.size());
+    size_t next = FindPerfLogBlock(rest.data(), n, 1, version);
+    if (next >= n) break;
+    offset += next;
+    resynced = true;
+  }
+  return indexed;
+}
+
+uint64_t PerfLogLastSeq(const std::vector<PerfLogSegment>& segments) {
+  for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+    if (it->first_seq != 0 && it->records > 0) {
+      return it->first_seq + it->records - 1;
+    }
+  }
+  return 0;
+}
+
+PerfLogSinceCursor::PerfLogSinceCursor(
+    const std::vector<PerfLogSegment>& segments, PerfLogStorage* storage,
+    uint64_t after_seq, PerfLogSeqSink sink, PerfLogGapSink gap,
+    void* context)
+    : segments_(segments),
+      storage_(storage),
+      sink_(sink),
+      gap_(gap),
+      context_(context),
+      last_seq_(PerfLogLastSeq(segments)),
+      next_(after_seq + 1) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bool PerfLogSinceCursor::Next() {
+  while (segment_ < segments_.size() && next_ <= last_seq_) {
+    const PerfLogSegment& segment = segments_[segment_];
+    uint64_t end_seq = segment.first_seq + segment.records;
+    if (!in_segment_) {
+      if (segment.first_seq == 0 || segment.version < kPerfLogVersion ||
+          end_seq <= next_) {
+        segment_++;
+        continue;
+      }
+      // Rotated out, or lost behind a corrupt block header
+      if (segment.first_seq > next_) {
+        gap_(next_, segment.first_seq - 1, context_);
+        next_ = segment.first_seq;
+      }
+      stats_.segments_read++;
+      seq_ = segment.first_seq;
+      block_ = 0;
+      in_segment_ = true;
+    }
+    SeqBlockResult result = kSeqBlockEnd;
+    if (block_ < segment.blocks.size() && seq_ < end_seq) {
+      result = QuerySeqBlock(segment, block_++, storage_, &seq_, &next_,
+                             sink_, gap_, context_, &scratch_, &stats_,
+                             &error_);
+    }
+    if (result == kSeqBlockEnd) {
+      in_segment_ = false;
+      segment_++;
+    }
+    if (result == kSeqBlockRead) return true;
+  }
+  if (next_ <= last_seq_) {
+    gap_(next_, last_seq_, context_);
+    next_ = last_seq_ + 1;
+    return true;
+  }
+  return false;
+}
+
+const char* QueryPerfLogSince(const std::vector<PerfLogSegment>& segments,
+                              PerfLogStorage* storage, uint64_t after_seq,
+                              PerfLogSeqSink sink, PerfLogGapSink gap,
+                              void* context, PerfLogRangeStats* stats) {
+  PerfLogSinceCursor cursor(segments, storage, after_seq, sink, gap, context);
+  while (cursor.Next()) {
+  }
+  if (stats != nullptr) *stats = cursor.stats();
+  return cursor.error();
+}
@@ -0,0 +1,187 @@
+#ifndef PERF_LOG_QUERY_H
+#define PERF_LOG_QUERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "perf_log_catalog.h"
+#include "perf_log_format.h"
+
+// Time-range queries over a raw perf log store
+//
+// Version 4 block headers carry the time of their first and last record, and
+// the catalog keeps a sparse index of each file's blocks (one PerfLogBlockRef
+// per block). A query picks the files overlapping the range from the catalog,
+// binary-searches their block index and reads and decodes only the blocks
+// that can contain matching records. Older files have no index and are read
+// whole.
+
+// Bit n selects channel n
+constexpr uint32_t kPerfLogAllChannels = (1u << kPerfLogChannelCount) - 1;
+
+// Parse a comma-separated list of kPerfLogChannels names (case-insensitive)
+// into a channel mask. Returns false on an unknown name.
+bool ParsePerfLogChannelList(const char* list, uint32_t* mask);
+
+// Format one channel value the way the CSV tools do: duty cycles in percent
+// and temperatures in degrees C with one decimal, RPMs as integers. Returns
+// the length written (snprintf semantics).
+int FormatPerfLogChannel(int channel, int32_t value, char* out, size_t size);
+
+// Read access to the files of a store
+class PerfLogStorage {
+ public:
+  virtual ~PerfLogStorage() = default;
+
+  // Read up to `size` bytes at `offset` of the file with catalog index
+  // `index`. Returns the number of bytes read.
+  virtual size_t Read(int index, uint32_t offset, uint8_t* out,
+                      size_t size) = 0;
+};
+
+struct PerfLogRangeQuery {
+  // Half-open range [from_ms, to_ms)
+  int64_t from_ms;
+  int64_t to_ms;
+  // Times are Unix ms if true (files without a wall-clock base are skipped),
+  // else uptime ms of boot `boot_id`
+  bool wall_clock;
+  uint32_t boot_id;
+};
+
+// Work done by a query, to compare against a full scan
+struct PerfLogRangeStats {
+  uint32_t segments_read;
+  uint32_t blocks_read;
+  uint32_t bytes_read;
+  uint32_t records_decoded;
+  uint32_t records_matched;
+  uint32_t corrupt_blocks;  // Skipped blocks (or files) that failed to decode
+};
+
+// Called for each matching record, in file order
+typedef void (*PerfLogRangeSink)(uint32_t boot_id,
+                                 const PerfLogSample& sample, void* context);
+
+// Run `query` over `segments` (oldest first, as from PerfLogCatalog) and pass
+// the matching records to `sink`. Corrupt blocks are skipped. Returns nullptr,
+// or the last decoding error if anything was skipped. `stats` may be null.
+const char* QueryPerfLogRange(const std::vector<PerfLogSegment>& segments,
+                              PerfLogStorage* storage,
+                              const PerfLogRangeQuery& query,
+                              PerfLogRangeSink sink, void* context,
+                              PerfLogRangeStats* stats);
+
+// Build the block index of a version 4+ file by walking its block headers
+// from `offset` (just after the file header). Reads only the headers, unless
+// one is corrupt: then the rest of the file is read to resync at the next
+// intact block. Stops at a torn tail or at 64 KiB. Sets `end_offset_ms` to
+// the last record of the last indexed block, relative to the file start, and
+// `records` to the records before the first resync (after it, record
+// numbers within the file are unknown). Returns the end offset of the last
+// indexed block.
+uint32_t IndexPerfLogBlocks(PerfLogStorage* storage, int index,
+                            uint16_t version, uint32_t offset, uint32_t size,
+                            std::vector<PerfLogBlockRef>* blocks,
+                            uint32_t* end_offset_ms, uint32_t* records);
+
+// Sequence queries
+//
+// Raw records are numbered from the first_seq of their file (see
+// perf_log_format.h), so "everything after record N" needs no clock at all:
+// segments numbered entirely at or below N are skipped from the catalog
+// alone, block headers tell how many records each block holds, and only
+// blocks with newer records are decoded. Numbers after N whose records are
+// gone (rotated out, or in a corrupt block) are reported as gaps, so a
+// collector can tell lost records from ones it has not fetched yet.
+
+// Sequence number of the newest record in `segments`, 0 if none is numbered
+uint64_t PerfLogLastSeq(const std::vector<PerfLogSegment>& segments);
+
+// Called for each record after the cursor, in sequence order
+typedef void (*PerfLogSeqSink)(uint64_t seq, uint32_t boot_id,
+                               const PerfLogSample& sample, void* context);
+
+// Called for each run [first, last] of sequence numbers after the cursor
+// whose records cannot be delivered, in order with the records
+typedef void (*PerfLogGapSink)(uint64_t first, uint64_t last, void* context);
+
+// Pass the records of `segments` numbered after `after_seq`, up to
+// PerfLogLastSeq(segments), to `sink` and the missing numbers in between to
+// `gap`. Unnumbered segments are skipped. Returns nullptr, or the last
+// decoding error. `stats` may be null; records_matched counts records sent.
+const char* QueryPerfLogSince(const std::vector<PerfLogSegment>& segments,
+                              PerfLogStorage* storage, uint64_t after_seq,
+                              PerfLogSeqSink sink, PerfLogGapSink gap,
+                              void* context, PerfLogRangeStats* stats);
+
+// Resumable queries
+//
+// The cursors run the queries above a step at a time: each Next() reads and
+// decodes at most one block (or one unindexed file) and passes its records
+// on, so a server can produce the response as the socket drains rather than
+// all at once. `segments` and `storage` must outlive the cursor.
+
+class PerfLogRangeCursor {
+ public:
+  PerfLogRangeCursor(const std::vector<PerfLogSegment>& segments,
+                     PerfLogStorage* storage, const PerfLogRangeQuery& query,
+                     PerfLogRangeSink sink, void* context);
+
+  // Run the next step. Returns false once the query is done.
+  bool Next();
+
+  // nullptr, or the last decoding error so far
+  const char* error() const { return error_; }
+  const PerfLogRangeStats& stats() const { return stats_; }
+
+ private:
+  const std::vector<PerfLogSegment>& segments_;
+  PerfLogStorage* storage_;
+  PerfLogRangeQuery query_;
+  PerfLogRangeSink sink_;
+  void* context_;
+  std::vector<uint8_t> scratch_;
+  PerfLogRangeStats stats_;
+  const char* error_ = nullptr;
+  size_t segment_ = 0;       // Segment being read
+  bool in_segment_ = false;  // Whether block_ and shift_ are set for it
+  size_t block_ = 0;         // Next block of the segment
+  int64_t shift_ = 0;
+};
+
+class PerfLogSinceCursor {
+ public:
+  PerfLogSinceCursor(const std::vector<PerfLogSegment>& segments,
+                     PerfLogStorage* storage, uint64_t after_seq,
+                     PerfLogSeqSink sink, PerfLogGapSink gap, void* context);
+
+  // Run the next step. Returns false once the query is done.
+  bool Next();
+
+  // nullptr, or the last decoding error so far
+  const char* error() const { return error_; }
+  const PerfLogRangeStats& stats() const { return stats_; }
+
+  // PerfLogLastSeq() of the segments: the cursor for the next query
+  uint64_t last_seq() const { return last_seq_; }
+
+ private:
+  const std::vector<PerfLogSegment>& segments_;
+  PerfLogStorage* storage_;
+  PerfLogSeqSink sink_;
+  PerfLogGapSink gap_;
+  void* context_;
+  std::vector<uint8_t> scratch_;
+  PerfLogRangeStats stats_;
+  const char* error_ = nullptr;
+  uint64_t last_seq_;
+  uint64_t next_;            // First number not yet sent or reported
+  size_t segment_ = 0;       // Segment being read
+  bool in_segment_ = false;  // Whether block_ and seq_ are set for it
+  size_t block_ = 0;         // Next block of the segment
+  uint64_t seq_ = 0;         // Number of that block's first record
+};
+
+#endif  // PERF_LOG_QUERY_H
@@ -0,0 +1,53 @@
+#include "perf_log_rollup.h"
+
+#include <cstring>
+
+static_assert(sizeof(PerfLogRollupRecord) == 69,
+              "PerfLogRollupRecord layout changed");
+
+PerfLogRollup::PerfLogRollup(uint32_t period_ms) : period_ms_(period_ms) {}
+
+bool PerfLogRollup::Add(uint64_t uptime_ms, const PerfLogRecord& record,
+                        PerfLogRollupRecord* finished,
+                        uint64_t* finished_start_ms) {
+  uint64_t period_start = uptime_ms - uptime_ms % period_ms_;
+
+  bool emitted = false;
+  if (count_ > 0 && period_start != period_start_ms_) {
+    Finish(finished);
+    *finished_start_ms = period_start_ms_;
+    count_ = 0;
+    emitted = true;
+  }
+
+  int32_t values[kPerfLogChannelCount];
+  PerfLogRecordToChannels(record, values);
+  if (count_ == 0) {
+    period_start_ms_ = period_start;
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      min_[c] = max_[c] = values[c];
+      sum_[c] = values[c];
+    }
+  } else {
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (values[c] < min_[c]) min_[c] = values[c];
+      if (values[c] > max_[c]) max_[c] = values[c];
+      sum_[c] += values[c];
+    }
+  }
+  count_++;
+  return emitted;
+}
+
+void PerfLogRollup::Finish(PerfLogRollupRecord* finished) const {
+  memset(finished, 0, sizeof(*finished));
+  finished->sample_count = count_ > UINT16_MAX ? UINT16_MAX : count_;
+
+  int32_t mean[kPerfLogChannelCount];
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    mean[c] = (sum_[c] + count_ / 2) / count_;
+  }
+  PerfLogChannelsToRecord(min_, &finished->min);
+  PerfLogChannelsToRecord(max_, &finished->max);
+  PerfLogChannelsToRecord(mean, &finished->mean);
+}
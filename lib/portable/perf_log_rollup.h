@@ -0,0 +1,53 @@
+#ifndef PERF_LOG_ROLLUP_H
+#define PERF_LOG_ROLLUP_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "perf_log_format.h"
+
+// Downsampled perf log tiers
+//
+// A rollup file has the usual PerfLogFileHeader with schema_id
+// kPerfLogSchemaRollup, record_size sizeof(PerfLogRollupRecord) and
+// sample_interval_ms set to the rollup period, followed by fixed-size
+// PerfLogRollupRecords (never block encoded).
+//
+// Periods are aligned to multiples of the period in uptime, so a minute
+// rollup covers uptime [k * 60 s, (k + 1) * 60 s).
+
+struct __attribute__((packed)) PerfLogRollupRecord {
+  uint32_t start_s;       // Period start, seconds after header.start_uptime_ms
+  uint16_t sample_count;  // Samples that went into the period
+  PerfLogRecord min;      // Per-channel minimum (delta_ms unused)
+  PerfLogRecord max;      // Per-channel maximum (delta_ms unused)
+  PerfLogRecord mean;     // Per-channel mean, rounded (delta_ms unused)
+};
+
+// PerfLogRollup - Incremental min/max/mean of every channel over one period
+//
+// Add() is O(1) per sample: it only updates running min, max and sum.
+class PerfLogRollup {
+ public:
+  explicit PerfLogRollup(uint32_t period_ms);
+
+  // Add a sample. If the sample falls into a later period than the samples
+  // before it, the finished period is stored in `finished` (start_s left 0)
+  // and its start in `finished_start_ms`, and true is returned.
+  bool Add(uint64_t uptime_ms, const PerfLogRecord& record,
+           PerfLogRollupRecord* finished, uint64_t* finished_start_ms);
+
+  uint32_t period_ms() const { return period_ms_; }
+
+ private:
+  void Finish(PerfLogRollupRecord* finished) const;
+
+  uint32_t period_ms_;
+  uint64_t period_start_ms_ = 0;
+  uint32_t count_ = 0;
+  int32_t min_[kPerfLogChannelCount];
+  int32_t max_[kPerfLogChannelCount];
+  uint32_t sum_[kPerfLogChannelCount];
+};
+
+#endif  // PERF_LOG_ROLLUP_H
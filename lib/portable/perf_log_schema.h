@@ -0,0 +1,46 @@
+#ifndef PERF_LOG_SCHEMA_H
+#define PERF_LOG_SCHEMA_H
+
+#include <cstdint>
+
+// Perf log record schema
+//
+// PERF_LOG_CHANNELS is the one list of logged channels. Each entry
+//   X(field, type, kind, instance, name)
+// becomes a PerfLogRecord member `field` of unsigned `type`, a slot in the
+// channel arrays used by the block codec and the rollups (list order), a
+// kPerfLogChannels descriptor, and an entry in the schema description that
+// raw and rollup files carry in their header (see EncodePerfLogHeader()).
+// `kind` says what is measured and how it is encoded; `instance` is the
+// 0-based fan or thermistor in topology order. `name` is the column name
+// used by /range and the tools.
+//
+// Adding a fan or sensor means adding entries here. That changes the record
+// layout, so also give the new layout its own schema id (perf_log_format.h);
+// files written with the old one stay readable by the tools, which decode
+// them from their schema description.
+
+enum PerfLogChannelKind : uint8_t {
+  kPerfLogFanTarget = 1,    // Target duty cycle, 0..255 = 0..100 %
+  kPerfLogFanDuty = 2,      // Current duty cycle, same encoding
+  kPerfLogFanRpm = 3,       // Tachometer RPM
+  kPerfLogTemperature = 4,  // Thermistor, 0..255 = 10..50 degrees C
+};
+
+#define PERF_LOG_FAN_CHANNELS(X, n, instance)                              \
+  X(fan##n##_target_duty, uint8_t, kPerfLogFanTarget, instance,            \
+    "Fan" #n "_Target")                                                    \
+  X(fan##n##_current_duty, uint8_t, kPerfLogFanDuty, instance,             \
+    "Fan" #n "_Current")                                                   \
+  X(fan##n##_rpm, uint16_t, kPerfLogFanRpm, instance, "Fan" #n "_RPM")
+
+#define PERF_LOG_CHANNELS(X)                                               \
+  PERF_LOG_FAN_CHANNELS(X, 1, 0)                                           \
+  PERF_LOG_FAN_CHANNELS(X, 2, 1)                                           \
+  PERF_LOG_FAN_CHANNELS(X, 3, 2)                                           \
+  PERF_LOG_FAN_CHANNELS(X, 4, 3) /* Pump */                                \
+  X(temp_ambient, uint8_t, kPerfLogTemperature, 0, "Temp_Ambient")         \
+  X(temp_coolant_in, uint8_t, kPerfLogTemperature, 1, "Temp_Coolant_In")   \
+  X(temp_coolant_out, uint8_t, kPerfLogTemperature, 2, "Temp_Coolant_Out")
+
+#endif  // PERF_LOG_SCHEMA_H
@@ -0,0 +1,64 @@
+#include "perf_log_stream.h"
+
+uint64_t PerfLogSegmentsSize(const std::vector<PerfLogSegment>& segments) {
+  uint64_t total = 0;
+  for (const PerfLogSegment& segment : segments) total += segment.bytes;
+  return total;
+}
+
+std::vector<PerfLogFilePart> SlicePerfLogSegments(
+    const std::vector<PerfLogSegment>& segments, uint64_t first,
+    uint64_t last) {
+  std::vector<PerfLogFilePart> parts;
+  uint64_t start = 0;  // Of the current segment in the concatenation
+  for (const PerfLogSegment& segment : segments) {
+    uint64_t end = start + segment.bytes;  // Exclusive
+    if (first < end && last >= start && segment.bytes > 0) {
+      uint64_t from = first > start ? first : start;
+      uint64_t to = last + 1 < end ? last + 1 : end;
+      parts.push_back({segment.index, (uint32_t)(from - start),
+                       (uint32_t)(to - from)});
+    }
+    start = end;
+    if (start > last) break;
+  }
+  return parts;
+}
+
+uint64_t StreamPerfLogParts(const std::vector<PerfLogFilePart>& parts,
+                            PerfLogStorage* storage, uint8_t* buffer,
+                            size_t buffer_size, PerfLogByteSink sink,
+                            void* context) {
+  PerfLogPartsReader reader(parts, storage);
+  uint64_t sent = 0;
+  size_t n;
+  while ((n = reader.Read(buffer, buffer_size)) > 0) {
+    if (!sink(buffer, n, context)) break;
+    sent += n;
+  }
+  return sent;
+}
+
+PerfLogPartsReader::PerfLogPartsReader(
+    const std::vector<PerfLogFilePart>& parts, PerfLogStorage* storage)
+    : parts_(parts), storage_(storage) {}
+
+size_t PerfLogPartsReader::Read(uint8_t* out, size_t size) {
+  size_t total = 0;
+  while (!ended_ && total < size && part_ < parts_.size()) {
+    const PerfLogFilePart& part = parts_[part_];
+    size_t want = part.length - done_;
+    if (want > size - total) want = size - total;
+    size_t n = storage_->Read(part.index, part.offset + done_, out + total,
+                              want);
+    total += n;
+    done_ += n;
+    if (n < want) ended_ = true;  // File shrank or vanished
+    if (done_ == part.length) {
+      part_++;
+      done_ = 0;
+    }
+  }
+  read_ += total;
+  return total;
+}
@@ -0,0 +1,69 @@
+#ifndef PERF_LOG_STREAM_H
+#define PERF_LOG_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "perf_log_catalog.h"
+#include "perf_log_query.h"
+
+// Streaming downloads of perf log files
+//
+// A download is one file or all segments of a store concatenated in catalog
+// order, optionally cut to an HTTP byte range. It is planned as a list of
+// file parts and copied from storage to the socket through one large buffer,
+// so each flash read and socket write moves up to a TCP window of data.
+
+// Bytes [offset, offset + length) of the file with catalog index `index`
+struct PerfLogFilePart {
+  int index;
+  uint32_t offset;
+  uint32_t length;
+};
+
+// Total size of `segments` concatenated
+uint64_t PerfLogSegmentsSize(const std::vector<PerfLogSegment>& segments);
+
+// Parts covering bytes [first, last] of `segments` concatenated (oldest
+// first); empty if the range is outside them
+std::vector<PerfLogFilePart> SlicePerfLogSegments(
+    const std::vector<PerfLogSegment>& segments, uint64_t first,
+    uint64_t last);
+
+// Called with each chunk to send; returns false to abort (client gone)
+typedef bool (*PerfLogByteSink)(const uint8_t* data, size_t size,
+                                void* context);
+
+// Copy `parts` from `storage` to `sink` through `buffer`. A part whose file
+// turns out shorter than planned (e.g. rotated away) ends the stream early.
+// Returns the number of bytes sent.
+uint64_t StreamPerfLogParts(const std::vector<PerfLogFilePart>& parts,
+                            PerfLogStorage* storage, uint8_t* buffer,
+                            size_t buffer_size, PerfLogByteSink sink,
+                            void* context);
+
+// Pull form of StreamPerfLogParts(), for a server that sends as the socket
+// drains: each Read() continues where the last one stopped
+class PerfLogPartsReader {
+ public:
+  PerfLogPartsReader(const std::vector<PerfLogFilePart>& parts,
+                     PerfLogStorage* storage);
+
+  // Copy up to `size` next bytes to `out`. Returns the count; 0 at the end,
+  // or after a file turned out shorter than planned.
+  size_t Read(uint8_t* out, size_t size);
+
+  // Bytes read so far
+  uint64_t read() const { return read_; }
+
+ private:
+  std::vector<PerfLogFilePart> parts_;
+  PerfLogStorage* storage_;
+  size_t part_ = 0;    // Part being read
+  uint32_t done_ = 0;  // Of that part
+  bool ended_ = false;
+  uint64_t read_ = 0;
+};
+
+#endif  // PERF_LOG_STREAM_H
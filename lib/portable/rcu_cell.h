@@ -0,0 +1,109 @@
+#ifndef RCU_CELL_H
+#define RCU_CELL_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// RcuCell - Lock-free published value with read-copy-update semantics
+//
+// Holds a value of type T that readers access without taking a lock while
+// writers publish replacements. A writer copies the new value into a spare
+// slot and publishes it by atomically swapping the current slot index, so a
+// reader always sees either the complete old value or the complete new one,
+// never a mix.
+//
+// Storage is a fixed pool of kSlots slots (no heap). A slot is only reused
+// once no reader holds it, which is the RCU grace period. With kSlots = 3 a
+// single long-lived reader (e.g. the control task) can never block a writer.
+// If every spare slot stays pinned, Publish() gives up and returns false.
+//
+// Writers are serialized by a mutex; readers never touch it.
+//
+// Usage:
+//   RcuCell<Config> cell(initial);
+//   {
+//     RcuCell<Config>::ReadGuard config(cell);
+//     Use(config->threshold);  // Consistent for the guard's lifetime
+//   }
+//   cell.Publish(updated);
+//
+template <typename T, int kSlots = 3>
+class RcuCell {
+ public:
+  // Pins the current value for the lifetime of the guard
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const RcuCell& cell)
+        : cell_(cell), index_(cell.Acquire()) {}
+    ~ReadGuard() { cell_.Release(index_); }
+
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+
+    const T& operator*() const { return cell_.slots_[index_]; }
+    const T* operator->() const { return &cell_.slots_[index_]; }
+
+   private:
+    const RcuCell& cell_;
+    int index_;
+  };
+
+  explicit RcuCell(const T& initial) : current_(0) {
+    for (int i = 0; i < kSlots; i++) {
+      slots_[i] = initial;
+      readers_[i].store(0);
+    }
+  }
+
+  RcuCell(const RcuCell&) = delete;
+  RcuCell& operator=(const RcuCell&) = delete;
+
+  // Publish a new value. Returns false if no slot left its grace period.
+  bool Publish(const T& value) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    int current = current_.load(std::memory_order_relaxed);
+    for (int attempt = 0; attempt < kMaxPublishAttempts; attempt++) {
+      for (int i = 0; i < kSlots; i++) {
+        if (i == current || readers_[i].load() != 0) continue;
+        slots_[i] = value;
+        current_.store(i);
+        return true;
+      }
+      std::this_thread::yield();
+    }
+    return false;
+  }
+
+  // Copy of the current value
+  T Snapshot() const {
+    ReadGuard guard(*this);
+    return *guard;
+  }
+
+ private:
+  static constexpr int kMaxPublishAttempts = 100;
+
+  // A reader announces itself on a slot, then re-checks that the slot is still
+  // current. A writer only reuses a slot that is not current and has no
+  // readers, so a validated reader can never observe a partial write.
+  int Acquire() const {
+    while (true) {
+      int index = current_.load();
+      readers_[index].fetch_add(1);
+      if (current_.load() == index) return index;
+      readers_[index].fetch_sub(1);
+    }
+  }
+
+  void Release(int index) const {
+    readers_[index].fetch_sub(1, std::memory_order_release);
+  }
+
+  T slots_[kSlots];
+  mutable std::atomic<int> readers_[kSlots];
+  std::atomic<int> current_;
+  std::mutex writer_mutex_;
+};
+
+#endif  // RCU_CELL_H
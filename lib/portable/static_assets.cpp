@@ -0,0 +1,87 @@
+#include "static_assets.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "http_request.h"
+
+uint32_t StaticAssetHash(const void* data, size_t size, uint32_t hash) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void FormatStaticAssetEtag(const StaticAsset& asset, bool gzip,
+                           char out[kStaticAssetEtagSize]) {
+  snprintf(out, kStaticAssetEtagSize, "\"%08lx%s\"", (unsigned long)asset.hash,
+           gzip ? "-gz" : "");
+}
+
+StaticAssetResponse PrepareStaticAssetResponse(const StaticAsset& asset,
+                                               const char* accept_encoding,
+                                               const char* if_none_match,
+                                               const char* cache_control) {
+  StaticAssetResponse response;
+  response.gzip = asset.gzip_size > 0 &&
+                  HttpAcceptsEncoding(accept_encoding, "gzip");
+  char etag[kStaticAssetEtagSize];
+  FormatStaticAssetEtag(asset, response.gzip, etag);
+  int n = snprintf(response.headers, sizeof(response.headers),
+                   "ETag: %s\r\nCache-Control: %s\r\n"
+                   "Vary: Accept-Encoding\r\n",
+                   etag, cache_control);
+  response.not_modified = HttpEtagMatches(if_none_match, etag);
+  if (response.not_modified) {
+    response.status = "304 Not Modified";
+    return response;
+  }
+  response.status = "200 OK";
+  if (n >= 0 && (size_t)n < sizeof(response.headers)) {
+    snprintf(response.headers + n, sizeof(response.headers) - n,
+             "Content-Type: %s\r\n%s", asset.content_type,
+             response.gzip ? "Content-Encoding: gzip\r\n" : "");
+  }
+  return response;
+}
+
+bool StaticAssetTable::Add(const char* path, const char* content_type,
+                           uint32_t hash, uint32_t size, uint32_t gzip_size) {
+  if (strlen(path) > StaticAsset::kMaxPathLength) return false;
+  int slot = Probe(path);
+  if (slot < 0) return false;
+
+  StaticAsset& asset = slots_[slot];
+  if (asset.path[0] == '\0') count_++;
+  strcpy(asset.path, path);
+  asset.content_type = content_type;
+  asset.hash = hash;
+  asset.size = size;
+  asset.gzip_size = gzip_size;
+  return true;
+}
+
+const StaticAsset* StaticAssetTable::Find(const char* path) const {
+  int slot = Probe(path);
+  if (slot < 0 || slots_[slot].path[0] == '\0') return nullptr;
+  return &slots_[slot];
+}
+
+void StaticAssetTable::Clear() {
+  memset(slots_, 0, sizeof(slots_));
+  count_ = 0;
+}
+
+int StaticAssetTable::Probe(const char* path) const {
+  // Assets are never removed, so the first free slot ends the probe
+  uint32_t start = StaticAssetHash(path, strlen(path)) % kCapacity;
+  for (int i = 0; i < kCapacity; i++) {
+    int slot = (start + i) % kCapacity;
+    if (slots_[slot].path[0] == '\0' || strcmp(slots_[slot].path, path) == 0) {
+      return slot;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,87 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// StaticAssetTable - The web UI files and their validators, held in RAM
+//
+// The files only change with a filesystem upload, so each one is hashed once
+// at boot. A request is looked up by path in a small open-addressed hash
+// table (FNV-1a, linear probing); when it carries the asset's ETag in
+// If-None-Match it is answered 304 Not Modified without opening the file.
+//
+// An asset may have a pre-compressed "<path>.gz" next to it, made at build
+// time (tools/gzip_assets.py). Clients accepting gzip get that file with
+// Content-Encoding: gzip; its ETag carries a "-gz" suffix, as the two
+// representations differ byte for byte.
+struct StaticAsset {
+  static constexpr size_t kMaxPathLength = 31;
+
+  char path[kMaxPathLength + 1];  // Empty: free slot
+  const char* content_type;       // Static string
+  uint32_t hash;                  // Of the uncompressed file
+  uint32_t size;                  // Uncompressed bytes
+  uint32_t gzip_size;             // Bytes of <path>.gz, 0 if there is none
+};
+
+// Quotes, 8 hex digits, "-gz" and a terminator
+constexpr size_t kStaticAssetEtagSize = 14;
+
+// FNV-1a; pass the previous result to continue over more bytes
+constexpr uint32_t kStaticAssetHashSeed = 2166136261u;
+uint32_t StaticAssetHash(const void* data, size_t size,
+                         uint32_t hash = kStaticAssetHashSeed);
+
+// Format the strong ETag of an asset's plain or gzip representation
+void FormatStaticAssetEtag(const StaticAsset& asset, bool gzip,
+                           char out[kStaticAssetEtagSize]);
+
+// How to answer a GET of an asset: 304 with the validators, or 200 with
+// them and the content headers, the body being "<path>.gz" if `gzip`
+struct StaticAssetResponse {
+  const char* status;  // "200 OK" or "304 Not Modified"
+  bool not_modified;   // 304: no body
+  bool gzip;
+  char headers[224];  // Response headers, each ending in CRLF
+};
+
+// Decide the response from the request's Accept-Encoding and If-None-Match
+// values (nullptr if absent). Usage:
+//
+//   StaticAssetResponse answer = PrepareStaticAssetResponse(
+//       *asset, request.Header("Accept-Encoding"),
+//       request.Header("If-None-Match"), "no-cache");
+//   response->Begin(answer.status, answer.headers);
+//   if (!answer.not_modified) { ... stream the file ... }
+StaticAssetResponse PrepareStaticAssetResponse(const StaticAsset& asset,
+                                               const char* accept_encoding,
+                                               const char* if_none_match,
+                                               const char* cache_control);
+
+class StaticAssetTable {
+ public:
+  static constexpr int kCapacity = 16;  // Slots; a few assets keep probes short
+
+  StaticAssetTable() { Clear(); }
+
+  // Add (or replace) an asset. Returns false if the path is too long or the
+  // table is full.
+  bool Add(const char* path, const char* content_type, uint32_t hash,
+           uint32_t size, uint32_t gzip_size);
+
+  // The asset at `path` (no query), or nullptr
+  const StaticAsset* Find(const char* path) const;
+
+  int size() const { return count_; }
+  void Clear();
+
+ private:
+  // Slot holding `path`, or the free slot it would go in, or -1 if full
+  int Probe(const char* path) const;
+
+  StaticAsset slots_[kCapacity];
+  int count_;
+};
+
+#endif  // STATIC_ASSETS_H
@@ -0,0 +1,212 @@
+#include "status_binary.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Fixed-point 0.01 units, saturating (kStatusBinaryNoReading is never made)
+int16_t ToSignedCenti(float value) {
+  if (!std::isfinite(value)) return 0;
+  float centi = roundf(value * 100.0f);
+  if (centi > INT16_MAX) return INT16_MAX;
+  if (centi < -INT16_MAX) return -INT16_MAX;
+  return (int16_t)centi;
+}
+
+uint16_t ToUnsignedCenti(float value) {
+  if (!std::isfinite(value)) return 0;
+  float centi = roundf(value * 100.0f);
+  if (centi > UINT16_MAX) return UINT16_MAX;
+  if (centi < 0.0f) return 0;
+  return (uint16_t)centi;
+}
+
+// Appends to a fixed buffer; remembers running out of room
+struct Output {
+  uint8_t* data;
+  size_t size;
+  size_t used;
+  bool ok;
+
+  void Put(const void* bytes, size_t n) {
+    if (!ok || n > size - used) {
+      ok = false;
+      return;
+    }
+    memcpy(data + used, bytes, n);
+    used += n;
+  }
+};
+
+void PutId(Output* out, const char* id) {
+  if (id == nullptr) id = "";
+  out->Put(id, strlen(id) + 1);
+}
+
+// The next NUL-terminated id of the names block, or nullptr if it is cut off
+const char* NextId(const uint8_t* end, const uint8_t** next) {
+  const uint8_t* start = *next;
+  const uint8_t* nul =
+      (const uint8_t*)memchr(start, '\0', end > start ? end - start : 0);
+  if (nul == nullptr) return nullptr;
+  *next = nul + 1;
+  return (const char*)start;
+}
+
+}  // namespace
+
+size_t EncodeStatusBinary(const StatusBinaryState& state, uint8_t* out,
+                          size_t size) {
+  if (state.sensor_count < 0 || state.sensor_count > kMaxSensors ||
+      state.fan_count < 0 || state.fan_count > kMaxFanChannels ||
+      state.zone_count < 0 || state.zone_count > kMaxZones) {
+    return 0;
+  }
+
+  size_t names_size = 0;
+  for (int i = 0; i < state.sensor_count; i++) {
+    names_size += strlen(state.sensors[i].id ? state.sensors[i].id : "") + 1;
+  }
+  for (int i = 0; i < state.fan_count; i++) {
+    names_size += strlen(state.fans[i].id ? state.fans[i].id : "") + 1;
+  }
+  for (int i = 0; i < state.zone_count; i++) {
+    names_size += strlen(state.zones[i].id ? state.zones[i].id : "") + 1;
+  }
+  if (names_size > UINT16_MAX) return 0;
+
+  StatusBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  header.version = kStatusBinaryVersion;
+  header.header_size = sizeof(StatusBinaryHeader);
+  header.flags = state.override_enabled ? kStatusBinaryOverrideEnabled : 0;
+  header.sensor_count = state.sensor_count;
+  header.sensor_size = sizeof(StatusBinarySensor);
+  header.fan_count = state.fan_count;
+  header.fan_size = sizeof(StatusBinaryFan);
+  header.zone_count = state.zone_count;
+  header.zone_size = sizeof(StatusBinaryZone);
+  header.names_size = names_size;
+  header.uptime_ms = state.uptime_ms;
+  header.tick_count = state.tick_count;
+  header.log_seq = state.log_seq;
+  header.delta_t_centi = ToSignedCenti(state.delta_t);
+  header.target_intensity_centi = ToUnsignedCenti(state.target_intensity);
+
+  Output output = {out, size, 0, true};
+  output.Put(&header, sizeof(header));
+  for (int i = 0; i < state.sensor_count; i++) {
+    const StatusBinarySensorState& sensor = state.sensors[i];
+    StatusBinarySensor record;
+    record.temp_centi =
+        sensor.ok ? ToSignedCenti(sensor.temp) : kStatusBinaryNoReading;
+    output.Put(&record, sizeof(record));
+  }
+  for (int i = 0; i < state.fan_count; i++) {
+    const StatusBinaryFanState& fan = state.fans[i];
+    StatusBinaryFan record;
+    record.duty_centi = ToUnsignedCenti(fan.duty);
+    record.target_centi = ToUnsignedCenti(fan.target);
+    record.rpm = fan.rpm < 0 ? 0 : fan.rpm > UINT16_MAX ? UINT16_MAX : fan.rpm;
+    record.zone_mask = fan.zone_mask;
+    record.flags = (fan.overridden ? kStatusBinaryFanOverridden : 0) |
+                   (fan.pump ? kStatusBinaryFanPump : 0);
+    output.Put(&record, sizeof(record));
+  }
+  for (int i = 0; i < state.zone_count; i++) {
+    const StatusBinaryZoneState& zone = state.zones[i];
+    StatusBinaryZone record;
+    record.delta_t_centi = ToSignedCenti(zone.delta_t);
+    record.target_intensity_centi = ToUnsignedCenti(zone.target_intensity);
+    output.Put(&record, sizeof(record));
+  }
+  for (int i = 0; i < state.sensor_count; i++) {
+    PutId(&output, state.sensors[i].id);
+  }
+  for (int i = 0; i < state.fan_count; i++) PutId(&output, state.fans[i].id);
+  for (int i = 0; i < state.zone_count; i++) PutId(&output, state.zones[i].id);
+  return output.ok ? output.used : 0;
+}
+
+const char* DecodeStatusBinary(const uint8_t* data, size_t size,
+                               StatusBinaryState* state) {
+  if (size < 1) return "Empty status";
+  if (data[0] != kStatusBinaryVersion) return "Unsupported status version";
+  if (size < 2 || data[1] < sizeof(StatusBinaryHeader) || size < data[1]) {
+    return "Truncated status header";
+  }
+
+  StatusBinaryHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.sensor_size < sizeof(StatusBinarySensor) ||
+      header.fan_size < sizeof(StatusBinaryFan) ||
+      header.zone_size < sizeof(StatusBinaryZone)) {
+    return "Status records too small";
+  }
+  if (header.sensor_count > kMaxSensors ||
+      header.fan_count > kMaxFanChannels || header.zone_count > kMaxZones) {
+    return "Too many status records";
+  }
+  size_t records_size = (size_t)header.sensor_count * header.sensor_size +
+                        (size_t)header.fan_count * header.fan_size +
+                        (size_t)header.zone_count * header.zone_size;
+  if (size < header.header_size + records_size + header.names_size) {
+    return "Truncated status";
+  }
+
+  *state = StatusBinaryState();
+  state->uptime_ms = header.uptime_ms;
+  state->tick_count = header.tick_count;
+  state->log_seq = header.log_seq;
+  state->override_enabled = header.flags & kStatusBinaryOverrideEnabled;
+  state->delta_t = header.delta_t_centi / 100.0f;
+  state->target_intensity = header.target_intensity_centi / 100.0f;
+  state->sensor_count = header.sensor_count;
+  state->fan_count = header.fan_count;
+  state->zone_count = header.zone_count;
+
+  const uint8_t* next = data + header.header_size;
+  for (int i = 0; i < state->sensor_count; i++, next += header.sensor_size) {
+    StatusBinarySensor record;
+    memcpy(&record, next, sizeof(record));
+    StatusBinarySensorState& sensor = state->sensors[i];
+    sensor.ok = record.temp_centi != kStatusBinaryNoReading;
+    sensor.temp = sensor.ok ? record.temp_centi / 100.0f : 0.0f;
+  }
+  for (int i = 0; i < state->fan_count; i++, next += header.fan_size) {
+    StatusBinaryFan record;
+    memcpy(&record, next, sizeof(record));
+    StatusBinaryFanState& fan = state->fans[i];
+    fan.duty = record.duty_centi / 100.0f;
+    fan.target = record.target_centi / 100.0f;
+    fan.rpm = record.rpm;
+    fan.zone_mask = record.zone_mask;
+    fan.overridden = record.flags & kStatusBinaryFanOverridden;
+    fan.pump = record.flags & kStatusBinaryFanPump;
+  }
+  for (int i = 0; i < state->zone_count; i++, next += header.zone_size) {
+    StatusBinaryZone record;
+    memcpy(&record, next, sizeof(record));
+    state->zones[i].delta_t = record.delta_t_centi / 100.0f;
+    state->zones[i].target_intensity = record.target_intensity_centi / 100.0f;
+  }
+
+  const uint8_t* end = next + header.names_size;
+  for (int i = 0; i < state->sensor_count; i++) {
+    if ((state->sensors[i].id = NextId(end, &next)) == nullptr) {
+      return "Truncated status ids";
+    }
+  }
+  for (int i = 0; i < state->fan_count; i++) {
+    if ((state->fans[i].id = NextId(end, &next)) == nullptr) {
+      return "Truncated status ids";
+    }
+  }
+  for (int i = 0; i < state->zone_count; i++) {
+    if ((state->zones[i].id = NextId(end, &next)) == nullptr) {
+      return "Truncated status ids";
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,133 @@
+#ifndef STATUS_BINARY_H
+#define STATUS_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "controller_config.h"
+#include "topology.h"
+
+// Binary status (GET /api/status.bin)
+//
+// The /api/status content for machine scrapers, plus the controller state
+// the JSON leaves out, as fixed-point integers instead of decimal strings:
+//
+//   StatusBinaryHeader
+//   StatusBinarySensor[sensor_count]  Topology order
+//   StatusBinaryFan[fan_count]        Topology order (fans, then pumps)
+//   StatusBinaryZone[zone_count]      Topology order
+//   ids                               names_size bytes: the sensor, fan and
+//                                     zone ids, in that order, each
+//                                     NUL-terminated
+//
+// All fields are little-endian (native on both the ESP32 and the host
+// tools). Temperatures are in 0.01 C and duty cycles and intensities in
+// 0.01 %. Later versions only append fields to the header or to a record
+// and grow header_size or the record size, so a reader of this version
+// decodes them by skipping what it does not know; a different `version`
+// byte means an incompatible layout.
+
+constexpr uint8_t kStatusBinaryVersion = 1;
+
+// temp_centi of a sensor without a valid reading
+constexpr int16_t kStatusBinaryNoReading = INT16_MIN;
+
+// StatusBinaryHeader::flags
+constexpr uint8_t kStatusBinaryOverrideEnabled = 1 << 0;  // Manual control
+
+// StatusBinaryFan::flags
+constexpr uint8_t kStatusBinaryFanOverridden = 1 << 0;  // Locked by override
+constexpr uint8_t kStatusBinaryFanPump = 1 << 1;
+
+struct __attribute__((packed)) StatusBinaryHeader {
+  uint8_t version;      // kStatusBinaryVersion
+  uint8_t header_size;  // Bytes; readers skip fields they do not know
+  uint8_t flags;
+  uint8_t sensor_count;
+  uint8_t sensor_size;  // Bytes per sensor record
+  uint8_t fan_count;
+  uint8_t fan_size;
+  uint8_t zone_count;
+  uint8_t zone_size;
+  uint8_t reserved;
+  uint16_t names_size;
+  uint32_t uptime_ms;   // Low 32 bits
+  uint32_t tick_count;  // FanController ticks since boot
+  uint32_t log_seq;     // Newest log line, as in /api/logs
+  int16_t delta_t_centi;          // Highest DeltaT across zones
+  uint16_t target_intensity_centi;  // Highest zone intensity
+};
+
+struct __attribute__((packed)) StatusBinarySensor {
+  int16_t temp_centi;  // kStatusBinaryNoReading if failed
+};
+
+struct __attribute__((packed)) StatusBinaryFan {
+  uint16_t duty_centi;    // Current duty cycle
+  uint16_t target_centi;  // Duty cycle the fan ramps towards
+  uint16_t rpm;
+  uint8_t zone_mask;  // Bit z: driven by zone z
+  uint8_t flags;
+};
+
+struct __attribute__((packed)) StatusBinaryZone {
+  int16_t delta_t_centi;
+  uint16_t target_intensity_centi;
+};
+
+// The status in natural units, encoded from and decoded to
+struct StatusBinarySensorState {
+  const char* id;
+  bool ok;
+  float temp;  // C, valid if ok
+};
+
+struct StatusBinaryFanState {
+  const char* id;
+  float duty;    // %
+  float target;  // %
+  int32_t rpm;
+  uint8_t zone_mask;
+  bool overridden;
+  bool pump;
+};
+
+struct StatusBinaryZoneState {
+  const char* id;
+  float delta_t;           // C
+  float target_intensity;  // %
+};
+
+struct StatusBinaryState {
+  uint32_t uptime_ms;
+  uint32_t tick_count;
+  uint32_t log_seq;
+  bool override_enabled;
+  float delta_t;           // Highest across zones
+  float target_intensity;  // Highest across zones
+  int sensor_count;
+  StatusBinarySensorState sensors[kMaxSensors];
+  int fan_count;
+  StatusBinaryFanState fans[kMaxFanChannels];
+  int zone_count;
+  StatusBinaryZoneState zones[kMaxZones];
+};
+
+// Largest encoding of a state (every list full, every id at its longest)
+constexpr size_t kStatusBinaryMaxSize =
+    sizeof(StatusBinaryHeader) + kMaxSensors * sizeof(StatusBinarySensor) +
+    kMaxFanChannels * sizeof(StatusBinaryFan) +
+    kMaxZones * sizeof(StatusBinaryZone) +
+    (kMaxSensors + kMaxFanChannels + kMaxZones) * kMaxTopologyIdLength;
+
+// Encode `state` into `out`. Returns the size, or 0 if it needs more than
+// `size` bytes (never with kStatusBinaryMaxSize and ids from a Topology).
+size_t EncodeStatusBinary(const StatusBinaryState& state, uint8_t* out,
+                          size_t size);
+
+// Decode a status of this or a later compatible version. Returns nullptr on
+// success, else an error message. Ids point into `data`.
+const char* DecodeStatusBinary(const uint8_t* data, size_t size,
+                               StatusBinaryState* state);
+
+#endif  // STATUS_BINARY_H
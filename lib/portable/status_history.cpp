@@ -0,0 +1,248 @@
+#include "status_history.h"
+
+#include <cmath>
+
+namespace {
+
+constexpr int kHistoryThermistors = PerfLogInstanceCount(kPerfLogTemperature);
+constexpr int kHistoryFans = PerfLogInstanceCount(kPerfLogFanDuty) >
+                                     PerfLogInstanceCount(kPerfLogFanRpm)
+                                 ? PerfLogInstanceCount(kPerfLogFanDuty)
+                                 : PerfLogInstanceCount(kPerfLogFanRpm);
+
+// Maps channel values onto 0..1 of their range in a history
+struct ChannelRanges {
+  int32_t min[kPerfLogChannelCount];
+  float scale[kPerfLogChannelCount];  // 0 for a constant channel
+};
+
+void FindChannelRanges(const StatusHistory& history, ChannelRanges* ranges) {
+  int32_t max[kPerfLogChannelCount];
+  int32_t channels[kPerfLogChannelCount];
+  for (int i = 0; i < history.size(); i++) {
+    PerfLogRecordToChannels(history.at(i), channels);
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (i == 0 || channels[c] < ranges->min[c]) ranges->min[c] = channels[c];
+      if (i == 0 || channels[c] > max[c]) max[c] = channels[c];
+    }
+  }
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    int32_t range = max[c] - ranges->min[c];
+    ranges->scale[c] = range > 0 ? 1.0f / range : 0.0f;
+  }
+}
+
+void ScaleChannels(const PerfLogRecord& record, const ChannelRanges& ranges,
+                   float* out) {
+  int32_t channels[kPerfLogChannelCount];
+  PerfLogRecordToChannels(record, channels);
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    out[c] = (channels[c] - ranges.min[c]) * ranges.scale[c];
+  }
+}
+
+// First record of LTTB bucket `bucket`; the buckets split the records
+// between the oldest and the newest
+int BucketStart(int bucket, int count, int buckets) {
+  return 1 + (int)((int64_t)bucket * (count - 2) / buckets);
+}
+
+// Channel index of a fan or thermistor value, or -1 if it is not logged
+int FindChannel(PerfLogChannelKind kind, int instance) {
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (kPerfLogChannels[c].kind == kind &&
+        kPerfLogChannels[c].instance == instance) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+struct HistoryPoints {
+  JsonWriter* json;
+  uint32_t span_ms;
+  int temps[kHistoryThermistors];
+  int thermistor_count;
+  int duties[kHistoryFans];
+  int rpms[kHistoryFans];
+  int fan_count;
+};
+
+void WriteHistoryPoint(const PerfLogRecord& record, uint32_t offset_ms,
+                       void* context) {
+  HistoryPoints* points = (HistoryPoints*)context;
+  JsonWriter* json = points->json;
+  int32_t channels[kPerfLogChannelCount];
+  PerfLogRecordToChannels(record, channels);
+
+  json->BeginArray();
+  json->Int(points->span_ms - offset_ms);
+  for (int i = 0; i < points->thermistor_count; i++) {
+    int c = points->temps[i];
+    if (c < 0 || channels[c] == 0) {
+      json->Null();
+    } else {
+      json->Float(DecodePerfLogTemperature(channels[c]), 1);
+    }
+  }
+  for (int i = 0; i < points->fan_count; i++) {
+    int duty = points->duties[i];
+    int rpm = points->rpms[i];
+    if (duty < 0) {
+      json->Null();
+    } else {
+      json->Float(DecodePerfLogDutyCycle(channels[duty]), 1);
+    }
+    if (rpm < 0) {
+      json->Null();
+    } else {
+      json->Int(channels[rpm]);
+    }
+  }
+  json->EndArray();
+}
+
+}  // namespace
+
+StatusHistory::StatusHistory(PerfLogRecord* storage, int capacity)
+    : storage_(storage), capacity_(capacity) {}
+
+void StatusHistory::Add(uint32_t uptime_ms, const PerfLogRecord& record) {
+  if (capacity_ <= 0) return;
+  uint32_t delta_ms = count_ > 0 ? uptime_ms - last_uptime_ms_ : 0;
+  if (delta_ms > 0xFFFF) delta_ms = 0xFFFF;
+
+  if (count_ == capacity_) {
+    // Drop the oldest; the time to the next one no longer counts
+    first_ = first_ + 1 < capacity_ ? first_ + 1 : 0;
+    count_--;
+    span_ms_ -= at(0).delta_ms;
+  }
+  int slot = first_ + count_;
+  PerfLogRecord& stored = storage_[slot < capacity_ ? slot : slot - capacity_];
+  stored = record;
+  stored.delta_ms = delta_ms;
+  count_++;
+  span_ms_ += delta_ms;
+  last_uptime_ms_ = uptime_ms;
+}
+
+void StatusHistory::Clear() {
+  first_ = 0;
+  count_ = 0;
+  span_ms_ = 0;
+}
+
+void ReduceStatusHistory(const StatusHistory& history, int max_points,
+                         StatusHistoryVisitor visit, void* context) {
+  int count = history.size();
+  if (max_points < 2) max_points = 2;
+  if (count <= max_points) {
+    uint32_t offset = 0;
+    for (int i = 0; i < count; i++) {
+      if (i > 0) offset += history.at(i).delta_ms;
+      visit(history.at(i), offset, context);
+    }
+    return;
+  }
+
+  ChannelRanges ranges;
+  FindChannelRanges(history, &ranges);
+  float y[kPerfLogChannelCount];
+
+  // The previous pick, the first corner of the triangles
+  float a_x = 0.0f;
+  float a_y[kPerfLogChannelCount];
+  ScaleChannels(history.at(0), ranges, a_y);
+  visit(history.at(0), 0, context);
+
+  int buckets = max_points - 2;
+  int start = 1;
+  uint32_t start_offset = history.at(1).delta_ms;
+  for (int b = 0; b < buckets; b++) {
+    int end = BucketStart(b + 1, count, buckets);
+    uint32_t end_offset = start_offset;
+    for (int i = start + 1; i <= end; i++) end_offset += history.at(i).delta_ms;
+
+    // The third corner: the next bucket's average (the newest record after
+    // the last bucket)
+    int next_end = b + 1 < buckets ? BucketStart(b + 2, count, buckets) : count;
+    float c_x = 0.0f;
+    float c_y[kPerfLogChannelCount] = {};
+    uint32_t offset = end_offset;
+    for (int i = end; i < next_end; i++) {
+      if (i > end) offset += history.at(i).delta_ms;
+      ScaleChannels(history.at(i), ranges, y);
+      c_x += offset;
+      for (int c = 0; c < kPerfLogChannelCount; c++) c_y[c] += y[c];
+    }
+    int next_count = next_end - end;
+    c_x /= next_count;
+    for (int c = 0; c < kPerfLogChannelCount; c++) c_y[c] /= next_count;
+
+    // Keep the record of this bucket spanning the largest triangle
+    int best = start;
+    uint32_t best_offset = start_offset;
+    float best_area = -1.0f;
+    float best_y[kPerfLogChannelCount];
+    offset = start_offset;
+    for (int i = start; i < end; i++) {
+      if (i > start) offset += history.at(i).delta_ms;
+      ScaleChannels(history.at(i), ranges, y);
+      float x = offset;
+      float area = 0.0f;
+      for (int c = 0; c < kPerfLogChannelCount; c++) {
+        area += fabsf((a_x - c_x) * (y[c] - a_y[c]) -
+                      (a_x - x) * (c_y[c] - a_y[c]));
+      }
+      if (area > best_area) {
+        best = i;
+        best_offset = offset;
+        best_area = area;
+        for (int c = 0; c < kPerfLogChannelCount; c++) best_y[c] = y[c];
+      }
+    }
+    visit(history.at(best), best_offset, context);
+    a_x = best_offset;
+    for (int c = 0; c < kPerfLogChannelCount; c++) a_y[c] = best_y[c];
+
+    start = end;
+    start_offset = end_offset;
+  }
+  visit(history.at(count - 1), history.span_ms(), context);
+}
+
+void WriteStatusHistoryJson(const StatusHistory& history, int max_points,
+                            const char* const* thermistor_ids,
+                            int thermistor_count, int fan_count,
+                            JsonWriter* json) {
+  HistoryPoints points;
+  points.json = json;
+  points.span_ms = history.span_ms();
+  points.thermistor_count =
+      thermistor_count < kHistoryThermistors ? thermistor_count
+                                             : kHistoryThermistors;
+  for (int i = 0; i < points.thermistor_count; i++) {
+    points.temps[i] = FindChannel(kPerfLogTemperature, i);
+  }
+  points.fan_count = fan_count < kHistoryFans ? fan_count : kHistoryFans;
+  for (int i = 0; i < points.fan_count; i++) {
+    points.duties[i] = FindChannel(kPerfLogFanDuty, i);
+    points.rpms[i] = FindChannel(kPerfLogFanRpm, i);
+  }
+
+  json->BeginObject();
+  json->Key("thermistors");
+  json->BeginArray();
+  for (int i = 0; i < points.thermistor_count; i++) {
+    json->String(thermistor_ids[i]);
+  }
+  json->EndArray();
+  json->Key("fans");
+  json->Int(points.fan_count);
+  json->Key("points");
+  json->BeginArray();
+  ReduceStatusHistory(history, max_points, WriteHistoryPoint, &points);
+  json->EndArray();
+  json->EndObject();
+}
@@ -0,0 +1,83 @@
+#ifndef STATUS_HISTORY_H
+#define STATUS_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "json_writer.h"
+#include "perf_log_format.h"
+
+// StatusHistory - RAM ring of the newest perf log records, for the web UI
+//
+// Keeps the last `capacity` records in caller-owned storage, overwriting the
+// oldest. Each record's delta_ms is set to the time since the record before
+// it (as in perf log blocks, saturating at 65535 ms), so a sample costs
+// sizeof(PerfLogRecord) bytes and no separate timestamp.
+//
+// Not thread-safe; callers serialize Add() and Clear() with reads.
+//
+// Usage:
+//   static PerfLogRecord storage[900];
+//   StatusHistory history(storage, 900);
+//   history.Add(millis(), record);  // Once per sample
+class StatusHistory {
+ public:
+  StatusHistory(PerfLogRecord* storage, int capacity);
+
+  // Append a record sampled at `uptime_ms` (low 32 bits; wrapping is fine)
+  void Add(uint32_t uptime_ms, const PerfLogRecord& record);
+
+  void Clear();
+
+  int size() const { return count_; }
+  int capacity() const { return capacity_; }
+
+  // The i-th oldest record (0 <= i < size())
+  const PerfLogRecord& at(int i) const {
+    int slot = first_ + i;
+    return storage_[slot < capacity_ ? slot : slot - capacity_];
+  }
+
+  // Ms from the oldest record to the newest
+  uint32_t span_ms() const { return span_ms_; }
+
+ private:
+  PerfLogRecord* storage_;
+  int capacity_;
+  int first_ = 0;
+  int count_ = 0;
+  uint32_t last_uptime_ms_ = 0;
+  uint32_t span_ms_ = 0;
+};
+
+// Called with each point of a reduced history, oldest first. `offset_ms` is
+// the time since the oldest record of the history.
+typedef void (*StatusHistoryVisitor)(const PerfLogRecord& record,
+                                     uint32_t offset_ms, void* context);
+
+// Visit at most `max_points` (>= 2) records of the history, oldest first:
+// all of them if there are not more, else a Largest-Triangle-Three-Buckets
+// selection. The oldest and newest records are always kept, and one record
+// is picked from each equal-count bucket in between: the one spanning the
+// largest triangle with the previous pick and the next bucket's average.
+// Channels are scaled to their range in the history, so one selection fits
+// all of them (an RPM swing does not drown a temperature spike).
+void ReduceStatusHistory(const StatusHistory& history, int max_points,
+                         StatusHistoryVisitor visit, void* context);
+
+// The /api/history document: the history reduced to at most `max_points`
+//
+//   {"thermistors":["ambient","coolant_in","coolant_out"],"fans":4,
+//    "points":[[899012,24.5,31.3,null,40.0,1180,...],...,[0,...]]}
+//
+// Each point is [age, temperatures..., then duty and RPM per fan] for the
+// `thermistor_count` thermistors named and the first `fan_count` fans (both
+// limited to the logged ones). The age is in ms before the newest point.
+// Values are numbers in the units of /api/status; a temperature logged as 0
+// (a failed sensor, or below the 10 C the log encodes) is null.
+void WriteStatusHistoryJson(const StatusHistory& history, int max_points,
+                            const char* const* thermistor_ids,
+                            int thermistor_count, int fan_count,
+                            JsonWriter* json);
+
+#endif  // STATUS_HISTORY_H
@@ -0,0 +1,80 @@
+#include "status_json.h"
+
+#include <cstdio>
+
+void WriteStatusJson(const StatusDocument& status, JsonWriter* json) {
+  char text[24];
+  json->BeginObject();
+
+  json->Key("thermistors");
+  json->BeginArray();
+  for (int i = 0; i < status.sensor_count; i++) {
+    const StatusSensorReading& sensor = status.sensors[i];
+    json->BeginObject();
+    json->Key("id");
+    json->String(sensor.id);
+    json->Key("temp");
+    if (sensor.ok) {
+      snprintf(text, sizeof(text), "%.1f", sensor.temp);
+      json->String(text);
+    } else {
+      json->String("ERR");
+    }
+    json->EndObject();
+  }
+  json->EndArray();
+
+  json->Key("fans");
+  json->BeginArray();
+  for (int i = 0; i < status.fan_count; i++) {
+    json->BeginObject();
+    json->Key("duty");
+    snprintf(text, sizeof(text), "%.1f", status.fans[i].duty);
+    json->String(text);
+    json->Key("rpm");
+    snprintf(text, sizeof(text), "%ld", (long)status.fans[i].rpm);
+    json->String(text);
+    json->EndObject();
+  }
+  json->EndArray();
+
+  json->Key("logSeq");
+  json->Int(status.log_seq);
+  json->Key("bootId");
+  json->Int(status.boot_id);
+
+  json->Key("overrideEnabled");
+  json->Bool(status.override_enabled);
+  json->EndObject();
+}
+
+void BeginLogLinesJson(LogLinesJson* lines, JsonWriter* json, uint32_t after,
+                       uint32_t boot_id) {
+  lines->json = json;
+  lines->first = after + 1;
+  lines->seq = after;
+  lines->boot_id = boot_id;
+  lines->count = 0;
+  json->BeginObject();
+  json->Key("lines");
+  json->BeginArray();
+}
+
+void AddLogLineJson(uint32_t seq, const char* line, size_t size, void* lines) {
+  LogLinesJson* log = (LogLinesJson*)lines;
+  if (log->count++ == 0) log->first = seq;
+  log->seq = seq;
+  log->json->String(line, size);
+}
+
+void EndLogLinesJson(LogLinesJson* lines) {
+  JsonWriter* json = lines->json;
+  json->EndArray();
+  json->Key("first");
+  json->Int(lines->first);
+  json->Key("seq");
+  json->Int(lines->seq);
+  json->Key("bootId");
+  json->Int(lines->boot_id);
+  json->EndObject();
+}
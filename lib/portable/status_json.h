@@ -0,0 +1,69 @@
+#ifndef STATUS_JSON_H
+#define STATUS_JSON_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "json_writer.h"
+
+// The /api/status document
+//
+//   {"thermistors":[{"id":"ambient","temp":"24.5"},...],
+//    "fans":[{"duty":"40.0","rpm":"1180"},...],
+//    "logSeq":1234,"bootId":17,"overrideEnabled":false}
+//
+// Readings are strings ("ERR" for a failed sensor), as the web UI expects.
+// The log itself is not included: logSeq is the sequence number of the
+// newest log line, and clients fetch the lines they lack from
+// /api/logs?after=N. Log numbering restarts on every boot; bootId (the perf
+// log's boot counter, 0 without it) tells a client its cursor is stale.
+
+struct StatusSensorReading {
+  const char* id;
+  bool ok;
+  float temp;  // °C, valid if ok
+};
+
+struct StatusFanReading {
+  float duty;  // %
+  int32_t rpm;
+};
+
+struct StatusDocument {
+  const StatusSensorReading* sensors;
+  int sensor_count;
+  const StatusFanReading* fans;
+  int fan_count;
+  uint32_t log_seq;
+  uint32_t boot_id;
+  bool override_enabled;
+};
+
+// Write the document (not flushed)
+void WriteStatusJson(const StatusDocument& status, JsonWriter* json);
+
+// The /api/logs?after=N document: the buffered log lines numbered above N
+//
+//   {"lines":["...","..."],"first":1201,"seq":1250,"bootId":17}
+//
+// first is the number of lines[0]; above N + 1 when older lines have left
+// the buffer. seq is the number of the last line, the `after` of the next
+// request (N if there was nothing new). bootId is as in the status: if it
+// changed, N was a cursor into the previous boot's log.
+struct LogLinesJson {
+  JsonWriter* json;
+  uint32_t first;
+  uint32_t seq;
+  uint32_t boot_id;
+  int count;
+};
+
+void BeginLogLinesJson(LogLinesJson* lines, JsonWriter* json, uint32_t after,
+                       uint32_t boot_id);
+
+// Add a line; `lines` is the LogLinesJson, as a Logger::forEachAfter visitor
+void AddLogLineJson(uint32_t seq, const char* line, size_t size, void* lines);
+
+void EndLogLinesJson(LogLinesJson* lines);
+
+#endif  // STATUS_JSON_H
@@ -0,0 +1,284 @@
+#include "topology.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr int kMaxLineLength = 160;
+constexpr int kMaxTokens = 8;
+
+// Split `line` in place on whitespace. Returns the number of tokens, or -1 if
+// there are more than `max_tokens`.
+int Tokenize(char* line, char** tokens, int max_tokens) {
+  int count = 0;
+  char* p = line;
+  while (*p != '\0') {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    if (*p == '\0') break;
+    if (count == max_tokens) return -1;
+    tokens[count++] = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    if (*p != '\0') *p++ = '\0';
+  }
+  return count;
+}
+
+bool CopyId(char* dest, const char* src) {
+  if (strlen(src) >= kMaxTopologyIdLength) return false;
+  strcpy(dest, src);
+  return true;
+}
+
+int FindSensor(const Topology& topology, const char* id) {
+  for (int i = 0; i < topology.sensor_count; i++) {
+    if (strcmp(topology.sensors[i].id, id) == 0) return i;
+  }
+  return -1;
+}
+
+int FindZone(const Topology& topology, const char* id) {
+  for (int i = 0; i < topology.zone_count; i++) {
+    if (strcmp(topology.zones[i].id, id) == 0) return i;
+  }
+  return -1;
+}
+
+int FindFan(const Topology& topology, const char* id) {
+  for (int i = 0; i < topology.fan_count; i++) {
+    if (strcmp(topology.fans[i].id, id) == 0) return i;
+  }
+  return -1;
+}
+
+bool ParseFloat(const char* text, float* value) {
+  char* end = nullptr;
+  *value = strtof(text, &end);
+  return end != text && *end == '\0';
+}
+
+// Parse "a,b,c" (optionally "a:0.5,b:0.5" when weights is non-null) into
+// sensor indices. Returns the count, or -1 on error.
+int ParseSensorList(const Topology& topology, char* list, uint8_t* indices,
+                    float* weights) {
+  int count = 0;
+  char* item = list;
+  while (item != nullptr && *item != '\0') {
+    char* next = strchr(item, ',');
+    if (next != nullptr) *next++ = '\0';
+
+    float weight = 1.0f;
+    char* colon = strchr(item, ':');
+    if (colon != nullptr) {
+      if (weights == nullptr || !ParseFloat(colon + 1, &weight) ||
+          weight < 0.0f) {
+        return -1;
+      }
+      *colon = '\0';
+    }
+
+    int index = FindSensor(topology, item);
+    if (index < 0 || count >= kMaxSensors) return -1;
+    indices[count] = index;
+    if (weights != nullptr) weights[count] = weight;
+    count++;
+    item = next;
+  }
+  return count;
+}
+
+int ParseFanList(const Topology& topology, char* list, uint8_t* indices) {
+  int count = 0;
+  char* item = list;
+  while (item != nullptr && *item != '\0') {
+    char* next = strchr(item, ',');
+    if (next != nullptr) *next++ = '\0';
+    int index = FindFan(topology, item);
+    if (index < 0 || count >= kMaxFanChannels) return -1;
+    indices[count++] = index;
+    item = next;
+  }
+  return count;
+}
+
+const char* ParseLine(char** tokens, int count, PinResolver resolve_pin,
+                      Topology* topology) {
+  const char* kind = tokens[0];
+
+  if (strcmp(kind, "sensor") == 0) {
+    if (count != 3) return "expected: sensor <id> <pin>";
+    if (topology->sensor_count >= kMaxSensors) return "too many sensors";
+    if (FindSensor(*topology, tokens[1]) >= 0) return "duplicate sensor id";
+    SensorSpec& sensor = topology->sensors[topology->sensor_count];
+    if (!CopyId(sensor.id, tokens[1])) return "sensor id too long";
+    int pin = resolve_pin(tokens[2]);
+    if (pin < 0) return "unknown pin";
+    sensor.pin = pin;
+    topology->sensor_count++;
+    return nullptr;
+  }
+
+  if (strcmp(kind, "fan") == 0 || strcmp(kind, "pump") == 0) {
+    if (count != 5) return "expected: fan <id> <pwm_pin> <tach_pin> <min_duty>";
+    if (topology->fan_count >= kMaxFanChannels) return "too many fans";
+    if (FindFan(*topology, tokens[1]) >= 0) return "duplicate fan id";
+    FanSpec& fan = topology->fans[topology->fan_count];
+    if (!CopyId(fan.id, tokens[1])) return "fan id too long";
+    int pwm_pin = resolve_pin(tokens[2]);
+    int tach_pin = resolve_pin(tokens[3]);
+    if (pwm_pin < 0 || tach_pin < 0) return "unknown pin";
+    fan.pwm_pin = pwm_pin;
+    fan.tach_pin = tach_pin;
+    if (!ParseFloat(tokens[4], &fan.min_duty_percent) ||
+        fan.min_duty_percent < 0.0f || fan.min_duty_percent > 100.0f) {
+      return "min_duty must be a number between 0 and 100";
+    }
+    fan.is_pump = strcmp(kind, "pump") == 0;
+    topology->fan_count++;
+    return nullptr;
+  }
+
+  if (strcmp(kind, "zone") == 0) {
+    if (count < 4) return "expected: zone <id> <aggregation> key=value...";
+    if (topology->zone_count >= kMaxZones) return "too many zones";
+    if (FindZone(*topology, tokens[1]) >= 0) return "duplicate zone id";
+    ZoneSpec& zone = topology->zones[topology->zone_count];
+    memset(&zone, 0, sizeof(zone));
+    if (!CopyId(zone.id, tokens[1])) return "zone id too long";
+
+    if (strcmp(tokens[2], "max") == 0) {
+      zone.aggregation = kAggregationMax;
+    } else if (strcmp(tokens[2], "mean") == 0) {
+      zone.aggregation = kAggregationMean;
+    } else if (strcmp(tokens[2], "weighted") == 0) {
+      zone.aggregation = kAggregationWeighted;
+    } else {
+      return "aggregation must be max, mean or weighted";
+    }
+
+    for (int i = 3; i < count; i++) {
+      char* eq = strchr(tokens[i], '=');
+      if (eq == nullptr) return "expected key=value";
+      *eq = '\0';
+      char* value = eq + 1;
+      if (strcmp(tokens[i], "reference") == 0) {
+        zone.reference_count =
+            ParseSensorList(*topology, value, zone.references, nullptr);
+        if (zone.reference_count < 0) return "bad reference sensor list";
+      } else if (strcmp(tokens[i], "sensors") == 0) {
+        zone.sensor_count =
+            ParseSensorList(*topology, value, zone.sensors, zone.weights);
+        if (zone.sensor_count < 0) return "bad sensor list";
+      } else if (strcmp(tokens[i], "fans") == 0) {
+        zone.fan_count = ParseFanList(*topology, value, zone.fans);
+        if (zone.fan_count < 0) return "bad fan list";
+      } else {
+        return "unknown zone key";
+      }
+    }
+
+    if (zone.sensor_count == 0) return "zone needs at least one sensor";
+    if (zone.fan_count == 0) return "zone needs at least one fan";
+    topology->zone_count++;
+    return nullptr;
+  }
+
+  return "unknown entry type";
+}
+
+}  // namespace
+
+const char* ParseTopology(const char* text, PinResolver resolve_pin,
+                          Topology* topology, char* error, int error_size) {
+  memset(topology, 0, sizeof(*topology));
+
+  int line_number = 0;
+  const char* line_start = text;
+  while (*line_start != '\0') {
+    line_number++;
+    const char* line_end = strchr(line_start, '\n');
+    size_t length =
+        line_end ? (size_t)(line_end - line_start) : strlen(line_start);
+
+    char line[kMaxLineLength];
+    const char* message = nullptr;
+    if (length >= sizeof(line)) {
+      message = "line too long";
+    } else {
+      memcpy(line, line_start, length);
+      line[length] = '\0';
+      char* tokens[kMaxTokens];
+      int count = Tokenize(line, tokens, kMaxTokens);
+      if (count < 0) {
+        message = "too many tokens";
+      } else if (count > 0 && tokens[0][0] != '#') {
+        message = ParseLine(tokens, count, resolve_pin, topology);
+      }
+    }
+
+    if (message != nullptr) {
+      snprintf(error, error_size, "line %d: %s", line_number, message);
+      return error;
+    }
+
+    if (line_end == nullptr) break;
+    line_start = line_end + 1;
+  }
+
+  if (topology->zone_count == 0) {
+    snprintf(error, error_size, "no zones defined");
+    return error;
+  }
+  return nullptr;
+}
+
+uint32_t TopologyChannelHash(const Topology& topology) {
+  // FNV-1a over the fields, with the ids' terminators as separators
+  uint32_t hash = 2166136261u;
+  auto add = [&hash](const void* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      hash ^= ((const uint8_t*)data)[i];
+      hash *= 16777619u;
+    }
+  };
+  add(&topology.fan_count, sizeof(topology.fan_count));
+  for (int i = 0; i < topology.fan_count; i++) {
+    const FanSpec& fan = topology.fans[i];
+    add(fan.id, strlen(fan.id) + 1);
+    uint8_t pump = fan.is_pump ? 1 : 0;
+    add(&pump, 1);
+    add(&fan.min_duty_percent, sizeof(fan.min_duty_percent));
+  }
+  return hash;
+}
+
+bool AggregateReadings(AggregationType aggregation, const float* values,
+                       const bool* valid, const float* weights, int count,
+                       float* result) {
+  float sum = 0.0f;
+  float weight_sum = 0.0f;
+  float maximum = 0.0f;
+  int valid_count = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (!valid[i]) continue;
+    float weight = (aggregation == kAggregationWeighted) ? weights[i] : 1.0f;
+    if (valid_count == 0 || values[i] > maximum) maximum = values[i];
+    sum += values[i] * weight;
+    weight_sum += weight;
+    valid_count++;
+  }
+
+  if (valid_count == 0) return false;
+
+  if (aggregation == kAggregationMax) {
+    *result = maximum;
+  } else if (weight_sum > 0.0f) {
+    *result = sum / weight_sum;
+  } else {
+    // All remaining weights are zero; fall back to the plain maximum
+    *result = maximum;
+  }
+  return true;
+}
@@ -0,0 +1,99 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstdint>
+
+#include "controller_config.h"
+
+// Topology - Which sensors and fans exist and how they are grouped into zones
+//
+// A zone aggregates a set of coolant sensors (max, mean or weighted mean) and
+// compares the result to its reference (ambient) sensors to produce a DeltaT.
+// The zone's intensity drives every fan in its fan group. A fan that belongs
+// to several zones follows the most demanding one.
+//
+// Topologies are parsed from a small line-based text file so larger builds
+// (more radiators and probes) need no code changes:
+//
+//   # sensor <id> <pin>
+//   sensor Ambient A0
+//   sensor Coolant_In A1
+//   # fan|pump <id> <pwm_pin> <tach_pin> <min_duty_percent>
+//   fan Fan1 D3 D4 40
+//   pump Pump D10 D9 50
+//   # zone <id> <max|mean|weighted> [reference=<sensor>,...]
+//   #      sensors=<sensor>[:<weight>],... fans=<fan>,...
+//   zone Loop max reference=Ambient sensors=Coolant_In fans=Fan1,Pump
+//
+// Blank lines and lines starting with '#' are ignored. Pin names are resolved
+// by a caller supplied function, since they are board specific.
+
+constexpr int kMaxSensors = 8;
+constexpr int kMaxZones = 4;
+constexpr int kMaxTopologyIdLength = 16;  // Including terminator
+
+enum AggregationType {
+  kAggregationMax = 0,
+  kAggregationMean = 1,
+  kAggregationWeighted = 2
+};
+
+struct SensorSpec {
+  char id[kMaxTopologyIdLength];
+  uint8_t pin;
+};
+
+struct FanSpec {
+  char id[kMaxTopologyIdLength];
+  uint8_t pwm_pin;
+  uint8_t tach_pin;
+  float min_duty_percent;
+  bool is_pump;
+};
+
+struct ZoneSpec {
+  char id[kMaxTopologyIdLength];
+  AggregationType aggregation;
+  // Reference (ambient) sensors, averaged
+  int reference_count;
+  uint8_t references[kMaxSensors];
+  // Coolant sensors, combined with `aggregation`
+  int sensor_count;
+  uint8_t sensors[kMaxSensors];
+  float weights[kMaxSensors];
+  // Fan group driven by this zone (indices into Topology::fans)
+  int fan_count;
+  uint8_t fans[kMaxFanChannels];
+};
+
+struct Topology {
+  int sensor_count;
+  SensorSpec sensors[kMaxSensors];
+  int fan_count;
+  FanSpec fans[kMaxFanChannels];
+  int zone_count;
+  ZoneSpec zones[kMaxZones];
+};
+
+// Resolves a board pin name (e.g. "D3", "A0" or "5") to a GPIO number, or
+// returns -1 if the name is unknown.
+typedef int (*PinResolver)(const char* name);
+
+// Parse a topology description. Returns nullptr on success, otherwise writes a
+// description of the first error (with its line number) to `error` and
+// returns it.
+const char* ParseTopology(const char* text, PinResolver resolve_pin,
+                          Topology* topology, char* error, int error_size);
+
+// Hash of the channel layout: each fan's id, kind and min_duty, in order.
+// Settings stored per channel index are only valid for the same hash.
+uint32_t TopologyChannelHash(const Topology& topology);
+
+// Combine the valid entries of `values` (valid[i] set). `weights` is only
+// used by kAggregationWeighted and is renormalized over the valid entries.
+// Returns false if no entry is valid.
+bool AggregateReadings(AggregationType aggregation, const float* values,
+                       const bool* valid, const float* weights, int count,
+                       float* result);
+
+#endif  // TOPOLOGY_H
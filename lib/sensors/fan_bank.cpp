@@ -0,0 +1,283 @@
+#include "fan_bank.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "logger.h"
+
+#define kDefaultPwmFrequency 25000  // 25kHz
+// Start at 50% duty cycle to ensure fan spins up
+#define kPwmDefaultDutyCyclePercent 50
+#define kTachSampleIntervalMs 1000
+#define kSmoothingPeriodMs 200  // Update duty cycle smoothing every 200ms
+
+FanBank& FanBank::Instance() {
+  static FanBank bank;
+  return bank;
+}
+
+FanBank::FanBank() : task_handle_(nullptr) {
+  InitFanBankState(&state_);
+  for (int i = 0; i < kMaxBankChannels; i++) {
+    pwm_pin_[i] = 0;
+    tach_pin_[i] = 0;
+    last_tach_time_[i] = 0;
+  }
+}
+
+Status FanBank::Attach(uint8_t channel, uint8_t pwm_pin, uint8_t tach_pin,
+                       RpmCalculationMethod method,
+                       float minimum_duty_cycle_percent) {
+  if (channel >= kMaxBankChannels) {
+    return Status::InvalidArgument("Fan channel out of range");
+  }
+  uint32_t bit = 1u << channel;
+  if (state_.active_mask & bit) {
+    return Status::InvalidArgument("Fan channel already in use");
+  }
+
+  // Fails (returns 0) for channels the chip does not have, e.g. 6 and up on
+  // the ESP32-C3
+  if (ledcSetup(channel, kDefaultPwmFrequency, kPwmResolution) == 0) {
+    return Status(StatusCode::kInternalError, "PWM channel setup failed");
+  }
+
+  pwm_pin_[channel] = pwm_pin;
+  tach_pin_[channel] = tach_pin;
+  last_tach_time_[channel] = 0;
+
+  // Set pin modes
+  pinMode(pwm_pin, OUTPUT);
+  pinMode(tach_pin, INPUT_PULLUP);
+
+  // Attach PWM and set default duty cycle (50%)
+  ledcAttachPin(pwm_pin, channel);
+  uint16_t pwm_value =
+      DutyToPwmValue(kPwmDefaultDutyCyclePercent, kPwmResolution);
+  ledcWrite(channel, pwm_value);
+
+  portENTER_CRITICAL(&spinlock_);
+  state_.duty[channel] = kPwmDefaultDutyCyclePercent;
+  state_.target[channel] = kPwmDefaultDutyCyclePercent;
+  state_.min_duty[channel] = minimum_duty_cycle_percent;
+  state_.pwm_value[channel] = pwm_value;
+  state_.pulses[channel] = 0;
+  state_.rpm[channel] = 0;
+  state_.tach_history[channel] = 0;
+  state_.tach_level_mask &= ~bit;
+  state_.override_mask &= ~bit;
+  if (method == kRpmCalculationSampling) {
+    state_.sampling_mask |= bit;
+  } else {
+    state_.sampling_mask &= ~bit;
+  }
+  state_.active_mask |= bit;
+  portEXIT_CRITICAL(&spinlock_);
+
+  if (method == kRpmCalculationDefault) {
+    // Attach interrupt for tachometer on rising edge
+    attachInterruptArg(digitalPinToInterrupt(tach_pin), TachISR,
+                       reinterpret_cast<void*>((intptr_t)channel), RISING);
+  }
+
+  if (task_handle_ == nullptr) {
+    xTaskCreate(BankTask,       // Task function
+                "Fan_Bank_Task",  // Task name
+                2048,           // Stack size
+                this,           // Parameter (this FanBank instance)
+                2,              // Priority (tach sampling needs 1ms cadence)
+                &task_handle_   // Task handle
+    );
+  }
+
+  return OkStatus();
+}
+
+void FanBank::Detach(uint8_t channel) {
+  if (!ValidChannel(channel)) return;
+  uint32_t bit = 1u << channel;
+
+  if (!(state_.sampling_mask & bit)) {
+    detachInterrupt(digitalPinToInterrupt(tach_pin_[channel]));
+  }
+
+  portENTER_CRITICAL(&spinlock_);
+  state_.active_mask &= ~bit;
+  portEXIT_CRITICAL(&spinlock_);
+}
+
+void IRAM_ATTR FanBank::TachISR(void* arg) {
+  FanBank& bank = Instance();
+  int channel = reinterpret_cast<intptr_t>(arg);
+  unsigned long current_time = millis();
+
+  // Debounce: ignore if less than 1ms since last pulse
+  // 1ms = 1000 Hz. For 2 pulses/rev, max 30000 RPM.
+  if (current_time - bank.last_tach_time_[channel] >= 1) {
+    portENTER_CRITICAL_ISR(&bank.spinlock_);
+    bank.state_.pulses[channel]++;
+    portEXIT_CRITICAL_ISR(&bank.spinlock_);
+    bank.last_tach_time_[channel] = current_time;
+  }
+}
+
+void FanBank::BankTask(void* arg) {
+  FanBank* bank = static_cast<FanBank*>(arg);
+  unsigned long last_smooth_time = millis();
+  unsigned long last_rpm_time = millis();
+
+  while (true) {
+    // Sample every tach input once (sampling channels only)
+    uint32_t sampling = bank->state_.active_mask & bank->state_.sampling_mask;
+    uint32_t levels = 0;
+    for (int ch = 0; ch < kMaxBankChannels; ch++) {
+      if ((sampling & (1u << ch)) && digitalRead(bank->tach_pin_[ch])) {
+        levels |= 1u << ch;
+      }
+    }
+    SampleFanTachs(&bank->state_, levels);
+
+    unsigned long current_time = millis();
+
+    // Smoothing: step all ramps every kSmoothingPeriodMs, then write out only
+    // the channels whose PWM value changed
+    if (current_time - last_smooth_time >= kSmoothingPeriodMs) {
+      last_smooth_time = current_time;
+      uint16_t pwm_values[kMaxBankChannels];
+      portENTER_CRITICAL(&bank->spinlock_);
+      uint32_t changed = StepFanRamps(&bank->state_, kPwmResolution);
+      for (int ch = 0; ch < kMaxBankChannels; ch++) {
+        pwm_values[ch] = bank->state_.pwm_value[ch];
+      }
+      portEXIT_CRITICAL(&bank->spinlock_);
+
+      for (int ch = 0; changed != 0; ch++, changed >>= 1) {
+        if (changed & 1) ledcWrite(ch, pwm_values[ch]);
+      }
+    }
+
+    // RPM for all channels once per kTachSampleIntervalMs
+    if (current_time - last_rpm_time >= kTachSampleIntervalMs) {
+      last_rpm_time += kTachSampleIntervalMs;
+      portENTER_CRITICAL(&bank->spinlock_);
+      UpdateFanRpms(&bank->state_, kTachSampleIntervalMs);
+      portEXIT_CRITICAL(&bank->spinlock_);
+    }
+
+    // Wait 1ms before next sample
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+}
+
+Status FanBank::SetTargetDutyCycle(uint8_t channel, float percent) {
+  if (!ValidChannel(channel)) {
+    return Status::InvalidArgument("Fan channel not attached");
+  }
+
+  portENTER_CRITICAL(&spinlock_);
+  if (!(state_.override_mask & (1u << channel))) {
+    if (percent > 100.0f) percent = 100.0f;
+    if (percent < state_.min_duty[channel]) percent = state_.min_duty[channel];
+    // Set target duty cycle - smoothing will gradually approach this value
+    state_.target[channel] = percent;
+  }
+  portEXIT_CRITICAL(&spinlock_);
+  return OkStatus();
+}
+
+Status FanBank::SetDutyCycle(uint8_t channel, float percent, bool override) {
+  if (!ValidChannel(channel)) {
+    return Status::InvalidArgument("Fan channel not attached");
+  }
+
+  portENTER_CRITICAL(&spinlock_);
+  if ((state_.override_mask & (1u << channel)) && !override) {
+    portEXIT_CRITICAL(&spinlock_);
+    return Status(StatusCode::kInternalError, "Fan is locked in override mode");
+  }
+  if (percent > 100.0f) percent = 100.0f;
+  if (percent < state_.min_duty[channel]) percent = state_.min_duty[channel];
+  state_.target[channel] = percent;
+  state_.duty[channel] = percent;
+  uint16_t pwm_value = DutyToPwmValue(percent, kPwmResolution);
+  state_.pwm_value[channel] = pwm_value;
+  portEXIT_CRITICAL(&spinlock_);
+
+  // Apply the new duty cycle to PWM hardware immediately
+  ledcWrite(channel, pwm_value);
+  return OkStatus();
+}
+
+Status FanBank::SetMinDutyCycle(uint8_t channel, float percent) {
+  if (!ValidChannel(channel)) {
+    return Status::InvalidArgument("Fan channel not attached");
+  }
+  if (percent < 0.0f || percent > 100.0f) {
+    return Status::InvalidArgument("Minimum duty cycle out of range");
+  }
+
+  portENTER_CRITICAL(&spinlock_);
+  state_.min_duty[channel] = percent;
+  if (!(state_.override_mask & (1u << channel)) &&
+      state_.target[channel] < percent) {
+    state_.target[channel] = percent;
+  }
+  portEXIT_CRITICAL(&spinlock_);
+  return OkStatus();
+}
+
+void FanBank::SetOverride(uint8_t channel, bool active) {
+  if (channel >= kMaxBankChannels) return;
+  portENTER_CRITICAL(&spinlock_);
+  if (active) {
+    state_.override_mask |= 1u << channel;
+  } else {
+    state_.override_mask &= ~(1u << channel);
+  }
+  portEXIT_CRITICAL(&spinlock_);
+}
+
+bool FanBank::IsOverridden(uint8_t channel) const {
+  return channel < kMaxBankChannels &&
+         (state_.override_mask & (1u << channel));
+}
+
+float FanBank::GetDutyCycle(uint8_t channel) const {
+  return channel < kMaxBankChannels ? state_.duty[channel] : 0.0f;
+}
+
+float FanBank::GetTargetDutyCycle(uint8_t channel) const {
+  return channel < kMaxBankChannels ? state_.target[channel] : 0.0f;
+}
+
+float FanBank::GetMinDutyCycle(uint8_t channel) const {
+  return channel < kMaxBankChannels ? state_.min_duty[channel] : 0.0f;
+}
+
+int FanBank::GetRpm(uint8_t channel) const {
+  return channel < kMaxBankChannels ? state_.rpm[channel] : 0;
+}
+
+bool FanBank::IsActive(uint8_t channel) const { return ValidChannel(channel); }
+
+void FanBank::Snapshot(FanBankSnapshot* snapshot) const {
+  portENTER_CRITICAL(&spinlock_);
+  snapshot->active_mask = state_.active_mask;
+  for (int ch = 0; ch < kMaxBankChannels; ch++) {
+    snapshot->duty[ch] = state_.duty[ch];
+    snapshot->target[ch] = state_.target[ch];
+    snapshot->min_duty[ch] = state_.min_duty[ch];
+    snapshot->rpm[ch] = state_.rpm[ch];
+  }
+  portEXIT_CRITICAL(&spinlock_);
+}
+
+void FanBank::SampleCounters(float* duty, uint32_t* pulses) const {
+  portENTER_CRITICAL(&spinlock_);
+  for (int ch = 0; ch < kMaxBankChannels; ch++) {
+    duty[ch] = state_.duty[ch];
+    pulses[ch] = state_.pulse_total[ch] + (uint32_t)state_.pulses[ch];
+  }
+  portEXIT_CRITICAL(&spinlock_);
+}
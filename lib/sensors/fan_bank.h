@@ -0,0 +1,107 @@
+#ifndef FAN_BANK_H
+#define FAN_BANK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cstdint>
+
+#include "fan_bank_state.h"
+#include "status.h"
+
+enum RpmCalculationMethod {
+  kRpmCalculationDefault = 0,  // Simple ISR counting pullups
+  kRpmCalculationSampling = 1  // Circular buffer sampling with debouncing
+};
+
+// Consistent copy of every channel's readings (indexed by channel number)
+struct FanBankSnapshot {
+  uint32_t active_mask;
+  float duty[kMaxBankChannels];
+  float target[kMaxBankChannels];
+  float min_duty[kMaxBankChannels];
+  int32_t rpm[kMaxBankChannels];
+};
+
+// FanBank - Drives all PWM fan channels from a single FreeRTOS task
+//
+// Keeps duty, target, minimum, RPM and tach state for up to kMaxBankChannels
+// channels in parallel arrays (FanBankState). One task samples every tach
+// input each millisecond, steps every duty cycle ramp every 200ms and updates
+// every RPM once per second, instead of two tasks and a spinlock per fan.
+//
+// PWMFan objects are thin views onto one channel of the shared bank
+// (FanBank::Instance()); readers that need several channels at once should
+// take a Snapshot() instead of querying fan by fan.
+//
+// Locking: the ramp/RPM state is guarded by one spinlock, held only for the
+// array updates themselves. PWM writes and pin reads happen outside it.
+//
+class FanBank {
+ public:
+  // The bank shared by all PWMFan views
+  static FanBank& Instance();
+
+  // Claim a channel (LEDC channel number) and configure its pins. Starts the
+  // bank task on first use.
+  Status Attach(uint8_t channel, uint8_t pwm_pin, uint8_t tach_pin,
+                RpmCalculationMethod method, float minimum_duty_cycle_percent);
+
+  // Release a channel
+  void Detach(uint8_t channel);
+
+  // Set target duty cycle as percentage (0.0 - 100.0) - smoothed
+  Status SetTargetDutyCycle(uint8_t channel, float percent);
+
+  // Set duty cycle as percentage (0.0 - 100.0) - immediate
+  Status SetDutyCycle(uint8_t channel, float percent, bool override);
+
+  // Set minimum duty cycle percentage; raises the target if needed
+  Status SetMinDutyCycle(uint8_t channel, float percent);
+
+  // Override lock
+  void SetOverride(uint8_t channel, bool active);
+  bool IsOverridden(uint8_t channel) const;
+
+  // Per channel getters
+  float GetDutyCycle(uint8_t channel) const;
+  float GetTargetDutyCycle(uint8_t channel) const;
+  float GetMinDutyCycle(uint8_t channel) const;
+  int GetRpm(uint8_t channel) const;
+  bool IsActive(uint8_t channel) const;
+
+  // Copy all channels at once
+  void Snapshot(FanBankSnapshot* snapshot) const;
+
+  // Duty cycle and running tach pulse count (wraps) of every channel, for
+  // sampling faster than the 1 s RPM updates
+  void SampleCounters(float* duty, uint32_t* pulses) const;
+
+  static constexpr int kPwmResolution = 10;  // 1024 gives ~0.1% granularity
+
+ private:
+  FanBank();
+
+  FanBankState state_;
+  uint8_t pwm_pin_[kMaxBankChannels];
+  uint8_t tach_pin_[kMaxBankChannels];
+  volatile unsigned long last_tach_time_[kMaxBankChannels];  // ISR debounce
+
+  mutable portMUX_TYPE spinlock_ = portMUX_INITIALIZER_UNLOCKED;
+  TaskHandle_t task_handle_;
+
+  // Static ISR handler for tachometer (used with DEFAULT method). The
+  // argument is the channel number.
+  static void TachISR(void* arg);
+
+  // Static task function: tach sampling, ramps and RPM for all channels
+  static void BankTask(void* arg);
+
+  bool ValidChannel(uint8_t channel) const {
+    return channel < kMaxBankChannels &&
+           (state_.active_mask & (1u << channel));
+  }
+};
+
+#endif  // FAN_BANK_H
@@ -2,23 +2,17 @@
 #define PWM_FAN_H
 
 #include <Arduino.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
 
 #include <cstdint>
 
+#include "fan_bank.h"
 #include "status.h"
 
-enum RpmCalculationMethod {
-  kRpmCalculationDefault = 0,  // Simple ISR counting pullups
-  kRpmCalculationSampling = 1  // Circular buffer sampling with debouncing
-};
-
 // PWMFan - Controls a 4-pin PWM computer fan with RPM monitoring
 //
-// This class manages a single PWM-controlled fan, providing duty cycle control
-// and RPM measurement. It uses 25kHz PWM frequency with 8-bit resolution (256
-// levels).
+// This class is a thin view onto one channel of the shared FanBank, providing
+// duty cycle control and RPM measurement. It uses 25kHz PWM frequency with
+// 10-bit resolution (1024 levels).
 //
 // Features:
 // - Duty cycle control (0-100%) with configurable minimum speed enforcement
@@ -26,8 +20,9 @@ enum RpmCalculationMethod {
 //   * kRpmCalculationDefault: ISR-based pulse counting (fast, may be noisy)
 //   * kRpmCalculationSampling: Debounced sampling with 5-sample circular buffer
 //   (recommended)
-// - Smooth duty cycle transitions (configurable rate, default 10% per 200ms)
-// - FreeRTOS task-based operation for non-blocking execution
+// - Smooth duty cycle transitions (2% of the difference per 200ms)
+// - All channels are updated by the single FanBank task; a PWMFan owns no
+//   tasks or locks of its own
 //
 // Configuration:
 // - minimum_duty_cycle_percent: Enforces a floor on fan speed (e.g., 35% for
@@ -37,6 +32,7 @@ enum RpmCalculationMethod {
 //
 class PWMFan {
  public:
+  // Claims channel_number in FanBank::Instance(); released by the destructor
   PWMFan(uint8_t pwm_pin, uint8_t tach_pin, uint8_t channel_number,
          RpmCalculationMethod method = kRpmCalculationSampling,
          float minimum_duty_cycle_percent = 50.0f);
@@ -70,43 +66,16 @@ class PWMFan {
   // Get minimum duty cycle percentage
   StatusOr<float> GetMinDutyCycle() const;
 
+  // Set minimum duty cycle percentage (0.0 - 100.0). A target below the new
+  // minimum is raised to it.
+  Status SetMinDutyCycle(float percent);
+
+  // FanBank channel backing this fan
+  uint8_t GetChannel() const { return channel_number_; }
+
  private:
-  uint8_t pwm_pin_;
-  uint8_t tach_pin_;
+  FanBank* bank_;
   uint8_t channel_number_;
-  RpmCalculationMethod calculation_method_;
-  volatile int tach_pulses_;
-  volatile int latest_rpm_;
-  volatile unsigned long last_tach_time_;
-  float current_duty_cycle_;
-  float target_duty_cycle_;
-  float minimum_duty_cycle_;
-  bool override_active_;
-  volatile unsigned long last_smooth_time_;
-
-  // Circular buffer for debouncing (used with SAMPLING method)
-  static const int kBufferSize = 5;
-  volatile bool sample_buffer_[kBufferSize];
-  volatile int buffer_index_;
-  volatile bool last_state_;
-
-  // FreeRTOS task handles
-  TaskHandle_t rpm_task_handle_;
-  TaskHandle_t sampling_task_handle_;
-
-  // Static ISR handler for tachometer (used with DEFAULT method)
-  static void tachISR(void* arg);
-
-  portMUX_TYPE spinlock_ = portMUX_INITIALIZER_UNLOCKED;
-
-  // Static task function for sampling tachometer (used with SAMPLING method)
-  static void samplingTask(void* arg);
-
-  // Static task function for RPM calculation
-  static void rpmCalculationTask(void* arg);
-
-  // Helper function for duty cycle smoothing
-  void UpdateDutyCycleSmoothing();
 };
 
 #endif  // PWM_FAN_H
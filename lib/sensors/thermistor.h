@@ -49,6 +49,9 @@ class Thermistor {
   // Get temperature in Celsius (sampled and averaged)
   StatusOr<float> GetSampledTemperature();
 
+  // Raw divider voltage in millivolts (immediate read, no validation)
+  uint32_t ReadMilliVolts() const { return analogReadMilliVolts(analog_pin_); }
+
   // Get the detected thermistor type
   ThermistorType GetType() const { return type_; }
 
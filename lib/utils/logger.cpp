@@ -9,6 +9,7 @@ static String buffer[LOG_CAPACITY];
 static int head = 0;   // index of oldest entry
 static int tail = 0;   // index to write next
 static int count = 0;  // number of stored entries
+static volatile uint32_t lines = 0;  // lines logged since boot (newest seq)
 static SemaphoreHandle_t logMutex = NULL;
 
 // internal push
@@ -27,6 +28,7 @@ static void pushLine(const String& line) {
       // buffer full, advance head to overwrite oldest
       head = tail;
     }
+    lines = lines + 1;
     xSemaphoreGive(logMutex);
   }
 }
@@ -72,6 +74,29 @@ String get() {
   return out;
 }
 
+void forEachAfter(uint32_t after,
+                  void (*visit)(uint32_t seq, const char* line, size_t size,
+                                void* context),
+                  void* context) {
+  if (logMutex == NULL) {
+    return;
+  }
+
+  if (xSemaphoreTake(logMutex, portMAX_DELAY) == pdTRUE) {
+    // The buffer holds lines (lines - count, lines]
+    uint32_t first = lines - count + 1;
+    int skip = 0;
+    if (after >= first) {
+      skip = after - first + 1 < (uint32_t)count ? after - first + 1 : count;
+    }
+    for (int i = skip; i < count; ++i) {
+      const String& line = buffer[(head + i) % LOG_CAPACITY];
+      visit(first + i, line.c_str(), line.length(), context);
+    }
+    xSemaphoreGive(logMutex);
+  }
+}
+
 void clear() {
   if (logMutex == NULL) {
     return;
@@ -88,4 +113,6 @@ void clear() {
   }
 }
 
+uint32_t sequence() { return lines; }
+
 }  // namespace Logger
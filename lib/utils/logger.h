@@ -19,6 +19,7 @@
 //   Logger::println("System started");
 //   Logger::println(WiFi.localIP());
 //   String logs = Logger::get();  // Retrieve all buffered logs for web display
+//   Logger::forEachAfter(seq, visit, context);  // Only the lines after seq
 //
 namespace Logger {
 void println();
@@ -30,7 +31,19 @@ void printf(const char* format, ...);
 // linker issues on Arduino builds; use the supplied overloads instead.
 
 String get();
+
+// Every line gets a sequence number, counting from 1 at boot. Call `visit`
+// for each buffered line numbered above `after`, oldest first, without
+// copying them. Runs under the log lock: `visit` must not log.
+void forEachAfter(uint32_t after,
+                  void (*visit)(uint32_t seq, const char* line, size_t size,
+                                void* context),
+                  void* context);
+
 void clear();
+
+// Sequence number of the newest line (0 before the first)
+uint32_t sequence();
 }  // namespace Logger
 
 #endif  // LOGGER_H
@@ -8,37 +8,17 @@
 #include <vector>
 
 #include "fan_controller.h"
+#include "flight_recorder.h"
 #include "http_server.h"
 #include "logger.h"
 #include "perf_logger.h"
 #include "pwm_fan.h"
 #include "thermistor.h"
+#include "topology_loader.h"
 
-// Define fan pins (pairs starting from D3 to D10)
-#define FAN_1_PWM_PIN D3
-#define FAN_1_TAC_PIN D4
-#define FAN_2_PWM_PIN D5
-#define FAN_2_TAC_PIN D6
-// WARNING: D8 (GPIO 8) and D9 (GPIO 9) are strapping pins on ESP32-C3.
-// D8 is used to select the boot mode (Download Boot if LOW, SPI Boot if HIGH).
-// D9 is used for internal voltage selection and should be pulled up.
-// Ensure your fan circuitry does not pull these pins to an invalid state during
-// boot!
-#define FAN_3_PWM_PIN D8
-#define FAN_3_TAC_PIN D7
-#define FAN_4_PWM_PIN D10
-#define FAN_4_TAC_PIN D9
-
-// Global fan objects
-PWMFan* fan1 = nullptr;
-PWMFan* fan2 = nullptr;
-PWMFan* fan3 = nullptr;
-PWMFan* pump = nullptr;
-
-// Global thermistor objects
-Thermistor* ambientTemp = nullptr;
-Thermistor* coolantInTemp = nullptr;
-Thermistor* coolantOutTemp = nullptr;
+// Global sensor and fan objects, in topology order
+std::vector<Thermistor*> thermistors;
+std::vector<PWMFan*> fans;
 
 // Global fan controller
 FanController* fanController = nullptr;
@@ -46,42 +26,51 @@ FanController* fanController = nullptr;
 // Global perf logger
 PerfLogger* perfLogger = nullptr;
 
+// Global flight recorder
+FlightRecorder* flightRecorder = nullptr;
+
 void setup() {
   // 1. Initialize Logger (Serial connection)
   Serial.begin(115200);
   delay(1000);  // Wait for serial to initialize
   Logger::println("Fan Controller Starting...");
 
-  // 2. Initialize Thermistors (A0=ambient, A1=coolant in, A2=coolant out)
+  // 2. Load the sensor/fan/zone topology
+  Logger::println("Loading topology...");
+  Topology topology;
+  StatusOr<Topology> topology_res = LoadTopologyFile(kDefaultTopologyPath);
+  if (topology_res.ok()) {
+    topology = topology_res.value();
+  } else {
+    Logger::println("Using built-in topology (" +
+                    topology_res.status().message() + ")");
+    topology = DefaultTopology();
+  }
+
+  // 3. Initialize Thermistors
   Logger::println("Initializing thermistors...");
-  ambientTemp = new Thermistor(A0, "Ambient");
-  coolantInTemp = new Thermistor(A1, "Coolant_In");
-  coolantOutTemp = new Thermistor(A2, "Coolant_Out");
+  for (int i = 0; i < topology.sensor_count; i++) {
+    const SensorSpec& sensor = topology.sensors[i];
+    thermistors.push_back(new Thermistor(sensor.pin, sensor.id));
+  }
   Logger::println("All thermistors initialized");
 
-  // 3. Initialize PWMFan objects (4 fans with pins D3-D10)
-  // Fans 1-3: 35% minimum, Fan 4 (pump): 50% minimum
+  // 4. Initialize PWMFan objects (one PWM channel per topology fan)
   Logger::println("Initializing fans...");
-  fan1 = new PWMFan(FAN_1_PWM_PIN, FAN_1_TAC_PIN, 0, kRpmCalculationSampling,
-                    40.0f);
-  fan2 = new PWMFan(FAN_2_PWM_PIN, FAN_2_TAC_PIN, 1, kRpmCalculationSampling,
-                    20.0f);
-  fan3 = new PWMFan(FAN_3_PWM_PIN, FAN_3_TAC_PIN, 2, kRpmCalculationSampling,
-                    25.0f);
-  pump = new PWMFan(FAN_4_PWM_PIN, FAN_4_TAC_PIN, 3, kRpmCalculationSampling,
-                    50.0f);  // Pump
+  for (int i = 0; i < topology.fan_count; i++) {
+    const FanSpec& fan = topology.fans[i];
+    fans.push_back(new PWMFan(fan.pwm_pin, fan.tach_pin, i,
+                              kRpmCalculationSampling, fan.min_duty_percent));
+  }
   Logger::println("All fans initialized");
 
-  // 4. Initialize FanController
+  // 5. Initialize FanController
   Logger::println("Initializing fan controller...");
-  std::vector<PWMFan*> fans = {fan1, fan2, fan3};
-  std::vector<PWMFan*> pumps = {pump};
-  fanController = new FanController(fans, pumps, ambientTemp, coolantInTemp,
-                                    coolantOutTemp);
+  fanController = new FanController(topology, fans, thermistors);
   fanController->Start();
   Logger::println("Fan controller initialized");
 
-  // 5. Initialize WiFi
+  // 6. Initialize WiFi
   Logger::println("Initializing WiFi...");
   setup_wifi();
 
@@ -124,16 +113,21 @@ void setup() {
   ArduinoOTA.begin();
 #endif
 
-  // 6. Initialize HTTPServer
+  // 7. Initialize HTTPServer
   Logger::println("Initializing HTTP Server...");
-  setup_http_server(fan1, fan2, fan3, pump, ambientTemp, coolantInTemp,
-                    coolantOutTemp);
+  setup_http_server(fans, thermistors, fanController);
 
-  // 7. Initialize PerfLogger
+  // 8. Initialize PerfLogger
   Logger::println("Initializing PerfLogger...");
-  perfLogger = new PerfLogger(fan1, fan2, fan3, pump, ambientTemp,
-                              coolantInTemp, coolantOutTemp);
+  perfLogger = new PerfLogger(fans, thermistors);
   perfLogger->Start();
+  perfLogger->AddRoutes(http_routes());
+
+  // 9. Initialize FlightRecorder (captures go next to the perf logs)
+  Logger::println("Initializing FlightRecorder...");
+  flightRecorder =
+      new FlightRecorder(fans, thermistors, perfLogger->GetBootId());
+  flightRecorder->Start();
 
   Logger::println("Setup complete!");
 }
@@ -144,9 +138,7 @@ void loop() {
   ArduinoOTA.handle();
 #endif
 
-  // Handle HTTP requests
+  // Handle HTTP requests; waits up to 10 ms for socket events, which paces
+  // the loop
   handle_http_request();
-
-  // Sleep using FreeRTOS
-  vTaskDelay(pdMS_TO_TICKS(10));
 }
@@ -5,6 +5,7 @@
 #include "fan_controller.h"
 #include "pwm_fan.h"
 #include "thermistor.h"
+#include "topology_loader.h"
 
 void test_fan_controller_target_speed(void) {
   PWMFan f1(D3, D4, 0);
@@ -16,11 +17,21 @@ void test_fan_controller_target_speed(void) {
   Thermistor t2(A1, "T2");
   Thermistor t3(A2, "T3");
 
-  std::vector<PWMFan*> fans = {&f1, &f2, &f3};
-  std::vector<PWMFan*> pumps = {&pump};
+  std::vector<PWMFan*> fans = {&f1, &f2, &f3, &pump};
+  std::vector<Thermistor*> sensors = {&t1, &t2, &t3};
 
-  FanController testController(fans, pumps, &t1, &t2, &t3);
+  FanController testController(DefaultTopology(), fans, sensors);
 
   float speed = testController.GetTargetFanSpeed();
   TEST_ASSERT_TRUE(speed >= 0.0f && speed <= 100.0f);
 }
+
+void test_fan_controller_default_topology(void) {
+  Topology topology = DefaultTopology();
+  TEST_ASSERT_EQUAL_INT(3, topology.sensor_count);
+  TEST_ASSERT_EQUAL_INT(4, topology.fan_count);
+  TEST_ASSERT_EQUAL_INT(1, topology.zone_count);
+  TEST_ASSERT_EQUAL_INT(D3, topology.fans[0].pwm_pin);
+  TEST_ASSERT_TRUE(topology.fans[3].is_pump);
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, topology.fans[3].min_duty_percent);
+}
@@ -6,13 +6,16 @@ void test_pwm_fan_initial_state(void);
 void test_pwm_fan_set_duty_cycle(void);
 void test_pwm_fan_min_clamping(void);
 void test_pwm_fan_max_clamping(void);
+void test_pwm_fan_bank_channel(void);
 
 void test_thermistor_initialization(void);
 void test_thermistor_reading(void);
 
 void test_fan_controller_target_speed(void);
+void test_fan_controller_default_topology(void);
 
 void test_perf_logger_init(void);
+void test_perf_logger_initial_stats(void);
 
 void test_logger_logic(void);
 
@@ -33,6 +36,7 @@ void setup() {
   RUN_TEST(test_pwm_fan_set_duty_cycle);
   RUN_TEST(test_pwm_fan_min_clamping);
   RUN_TEST(test_pwm_fan_max_clamping);
+  RUN_TEST(test_pwm_fan_bank_channel);
 
   // Thermistor Tests
   RUN_TEST(test_thermistor_initialization);
@@ -40,9 +44,11 @@ void setup() {
 
   // Fan Controller Tests
   RUN_TEST(test_fan_controller_target_speed);
+  RUN_TEST(test_fan_controller_default_topology);
 
   // Perf Logger Tests
   RUN_TEST(test_perf_logger_init);
+  RUN_TEST(test_perf_logger_initial_stats);
 
   // Logger Tests
   RUN_TEST(test_logger_logic);
@@ -16,7 +16,17 @@ void test_perf_logger_init(void) {
   Thermistor t2(A1, "T2");
   Thermistor t3(A2, "T3");
 
-  PerfLogger testPerfLogger(&f1, &f2, &f3, &pump, &t1, &t2, &t3);
+  PerfLogger testPerfLogger({&f1, &f2, &f3, &pump}, {&t1, &t2, &t3});
   // Just checking it constructs without crashing
   TEST_ASSERT_TRUE(true);
 }
+
+void test_perf_logger_initial_stats(void) {
+  PerfLogger testPerfLogger({}, {});
+  PerfLogStats stats = testPerfLogger.GetStats();
+  TEST_ASSERT_EQUAL_UINT32(0, stats.records_logged);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.records_dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.rollups_dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.flushes);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.bytes_written);
+}
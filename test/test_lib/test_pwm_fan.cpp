@@ -39,3 +39,15 @@ void test_pwm_fan_max_clamping(void) {
   TEST_ASSERT_TRUE(duty.ok());
   TEST_ASSERT_EQUAL_FLOAT(100.0f, duty.value());
 }
+
+void test_pwm_fan_bank_channel(void) {
+  {
+    PWMFan testFan(TEST_PWM_PIN, TEST_TACH_PIN, TEST_CHANNEL);
+    TEST_ASSERT_TRUE(FanBank::Instance().IsActive(TEST_CHANNEL));
+    testFan.SetTargetDutyCycle(75.0f);
+    FanBankSnapshot snapshot;
+    FanBank::Instance().Snapshot(&snapshot);
+    TEST_ASSERT_EQUAL_FLOAT(75.0f, snapshot.target[TEST_CHANNEL]);
+  }
+  TEST_ASSERT_FALSE(FanBank::Instance().IsActive(TEST_CHANNEL));
+}
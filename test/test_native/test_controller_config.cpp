@@ -0,0 +1,141 @@
+#include <unity.h>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "controller_config.h"
+#include "rcu_cell.h"
+
+void test_controller_config_defaults_valid(void) {
+  ControllerConfig config = DefaultControllerConfig();
+  TEST_ASSERT_NULL(ValidateControllerConfig(config));
+  TEST_ASSERT_EQUAL_FLOAT(5.0f, config.min_delta_t);
+  TEST_ASSERT_EQUAL_FLOAT(8.0f, config.max_delta_t);
+}
+
+void test_controller_config_validation(void) {
+  ControllerConfig config = DefaultControllerConfig();
+  config.max_delta_t = config.min_delta_t;
+  TEST_ASSERT_NOT_NULL(ValidateControllerConfig(config));
+
+  config = DefaultControllerConfig();
+  config.delta_t_weight = 1.5f;
+  TEST_ASSERT_NOT_NULL(ValidateControllerConfig(config));
+
+  config = DefaultControllerConfig();
+  config.min_duty_percent[3] = -1.0f;
+  TEST_ASSERT_NOT_NULL(ValidateControllerConfig(config));
+
+  // A pump (channel 4) may not go below its floor; fans may go to 0
+  float floors[kMaxFanChannels] = {0.0f, 0.0f, 0.0f, 50.0f};
+  config = DefaultControllerConfig();
+  config.min_duty_percent[0] = 0.0f;
+  TEST_ASSERT_NULL(ValidateControllerConfig(config, floors));
+  config.min_duty_percent[3] = 49.0f;
+  TEST_ASSERT_NOT_NULL(ValidateControllerConfig(config, floors));
+  TEST_ASSERT_NULL(ValidateControllerConfig(config));
+}
+
+void test_controller_config_set_field(void) {
+  ControllerConfig config = DefaultControllerConfig();
+  TEST_ASSERT_NULL(SetControllerConfigField(&config, "max_delta_t", 9.5f));
+  TEST_ASSERT_EQUAL_FLOAT(9.5f, config.max_delta_t);
+  TEST_ASSERT_NULL(SetControllerConfigField(&config, "min_duty_4", 55.0f));
+  TEST_ASSERT_EQUAL_FLOAT(55.0f, config.min_duty_percent[3]);
+  TEST_ASSERT_NULL(
+      SetControllerConfigField(&config, "update_interval_ms", 2500.0f));
+  TEST_ASSERT_EQUAL_UINT32(2500, config.update_interval_ms);
+  TEST_ASSERT_EQUAL_STRING(
+      "unknown field", SetControllerConfigField(&config, "min_duty_0", 1.0f));
+  TEST_ASSERT_NOT_NULL(SetControllerConfigField(&config, "min_duty_x", 1.0f));
+  TEST_ASSERT_NOT_NULL(SetControllerConfigField(&config, "bogus", 1.0f));
+
+  // Values the cast to uint32_t cannot take are rejected, not converted
+  TEST_ASSERT_NOT_NULL(
+      SetControllerConfigField(&config, "update_interval_ms", NAN));
+  TEST_ASSERT_NOT_NULL(
+      SetControllerConfigField(&config, "update_interval_ms", 5e9f));
+  TEST_ASSERT_NOT_NULL(
+      SetControllerConfigField(&config, "update_interval_ms", -1.0f));
+  TEST_ASSERT_NOT_NULL(
+      SetControllerConfigField(&config, "max_delta_t", INFINITY));
+  TEST_ASSERT_EQUAL_UINT32(2500, config.update_interval_ms);
+}
+
+void test_controller_config_fan_speed(void) {
+  ControllerConfig config = DefaultControllerConfig();
+  // Cool water and small DeltaT: minimum intensity
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, CalculateFanSpeed(config, 2.0f, 22.0f));
+  // Hot water and large DeltaT: full intensity
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, CalculateFanSpeed(config, 12.0f, 35.0f));
+  // Halfway on both factors
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 50.0f,
+                           CalculateFanSpeed(config, 6.5f, 27.5f));
+  TEST_ASSERT_EQUAL_FLOAT(70.0f, ScaleToMinimumDuty(50.0f, 40.0f));
+}
+
+// Writers publish configs whose fields all derive from one generation number
+// while a control loop reads them lock-free. A torn read would mix fields from
+// two generations.
+void test_controller_config_concurrent_updates(void) {
+  auto make_config = [](int generation) {
+    ControllerConfig config = DefaultControllerConfig();
+    float g = static_cast<float>(generation);
+    config.update_interval_ms = 100 + generation;
+    config.min_delta_t = g;
+    config.max_delta_t = g + 3.0f;
+    config.base_water_temp = g + 20.0f;
+    config.max_water_temp = g + 25.0f;
+    for (int i = 0; i < kMaxFanChannels; i++) {
+      config.min_duty_percent[i] = g;
+    }
+    return config;
+  };
+
+  RcuCell<ControllerConfig> cell(make_config(0));
+  std::atomic<bool> stop(false);
+  std::atomic<int> published(0);
+  std::atomic<int> failed_publishes(0);
+
+  std::vector<std::thread> writers;
+  for (int w = 0; w < 3; w++) {
+    writers.emplace_back([&, w]() {
+      for (int i = 1; !stop.load(); i++) {
+        if (cell.Publish(make_config((i * 3 + w) % 50))) {
+          published++;
+        } else {
+          failed_publishes++;
+        }
+      }
+    });
+  }
+
+  int torn = 0;
+  const int kTicks = 200000;
+  for (int tick = 0; tick < kTicks; tick++) {
+    RcuCell<ControllerConfig>::ReadGuard config(cell);
+    float g = config->min_delta_t;
+    if (config->update_interval_ms != 100 + static_cast<uint32_t>(g) ||
+        config->max_delta_t != g + 3.0f ||
+        config->base_water_temp != g + 20.0f ||
+        config->max_water_temp != g + 25.0f ||
+        config->min_duty_percent[kMaxFanChannels - 1] != g) {
+      torn++;
+    }
+    float speed = CalculateFanSpeed(*config, 4.0f + (tick % 8), 27.0f);
+    if (speed < 0.0f || speed > 100.0f) torn++;
+  }
+
+  // On a single core the writers may not have run yet
+  while (published.load() == 0) std::this_thread::yield();
+  stop = true;
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  TEST_ASSERT_EQUAL_INT(0, torn);
+  TEST_ASSERT_EQUAL_INT(0, failed_publishes.load());
+  TEST_ASSERT_TRUE(published.load() > 0);
+}
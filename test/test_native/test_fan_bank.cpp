@@ -0,0 +1,205 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "fan_bank_state.h"
+
+namespace {
+
+constexpr int kResolution = 10;
+
+void AddChannel(FanBankState* state, int ch, float duty, float target,
+                bool sampling) {
+  state->active_mask |= 1u << ch;
+  if (sampling) state->sampling_mask |= 1u << ch;
+  state->duty[ch] = duty;
+  state->target[ch] = target;
+  state->pwm_value[ch] = DutyToPwmValue(duty, kResolution);
+}
+
+// Per-fan object layout the bank replaced: one heap object per fan, walked
+// through a pointer each tick, with its own 5-entry bool sample buffer.
+struct LegacyFan {
+  float current_duty_cycle;
+  float target_duty_cycle;
+  float minimum_duty_cycle;
+  bool override_active;
+  int tach_pulses;
+  int latest_rpm;
+  bool sample_buffer[5];
+  int buffer_index;
+  bool last_state;
+  int spinlock;
+
+  void Sample(bool reading) {
+    sample_buffer[buffer_index] = reading;
+    buffer_index = (buffer_index + 1) % 5;
+    int high_count = 0;
+    for (int i = 0; i < 5; i++) {
+      if (sample_buffer[i]) high_count++;
+    }
+    bool current_state = high_count >= 3;
+    if (current_state && !last_state) {
+      spinlock++;
+      tach_pulses++;
+      spinlock--;
+    }
+    last_state = current_state;
+  }
+
+  void Smooth() {
+    float difference = target_duty_cycle - current_duty_cycle;
+    if (fabsf(difference) <= 0.001f) {
+      current_duty_cycle = target_duty_cycle;
+    } else {
+      float step = difference * 0.02f;
+      float min_step = 0.1f;
+      if (fabsf(step) < min_step) step = (difference > 0) ? min_step : -min_step;
+      current_duty_cycle += step;
+      if ((difference > 0 && current_duty_cycle > target_duty_cycle) ||
+          (difference < 0 && current_duty_cycle < target_duty_cycle)) {
+        current_duty_cycle = target_duty_cycle;
+      }
+    }
+  }
+};
+
+// Tach waveform: channel ch toggles every (3 + ch % 4) samples
+uint32_t TachLevels(int tick, int channels) {
+  uint32_t levels = 0;
+  for (int ch = 0; ch < channels; ch++) {
+    if ((tick / (3 + ch % 4)) % 2) levels |= 1u << ch;
+  }
+  return levels;
+}
+
+}  // namespace
+
+void test_fan_bank_ramp_converges(void) {
+  FanBankState state;
+  InitFanBankState(&state);
+  AddChannel(&state, 0, 50.0f, 80.0f, true);
+  AddChannel(&state, 3, 50.0f, 20.0f, true);
+
+  uint32_t changed = StepFanRamps(&state, kResolution);
+  TEST_ASSERT_EQUAL_UINT32(0x9, changed);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 50.6f, state.duty[0]);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 49.4f, state.duty[3]);
+
+  for (int i = 0; i < 1000; i++) {
+    StepFanRamps(&state, kResolution);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(80.0f, state.duty[0]);
+  TEST_ASSERT_EQUAL_FLOAT(20.0f, state.duty[3]);
+
+  // Settled channels need no PWM writes
+  TEST_ASSERT_EQUAL_UINT32(0, StepFanRamps(&state, kResolution));
+}
+
+void test_fan_bank_tach_debounce(void) {
+  FanBankState state;
+  InitFanBankState(&state);
+  AddChannel(&state, 1, 50.0f, 50.0f, true);
+  AddChannel(&state, 2, 50.0f, 50.0f, false);  // ISR counted, not sampled
+
+  // Clean square wave: 10 low, 10 high, repeated 6 times
+  for (int cycle = 0; cycle < 6; cycle++) {
+    for (int i = 0; i < 20; i++) {
+      SampleFanTachs(&state, i < 10 ? 0 : 0x6);
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(6, state.pulses[1]);
+  TEST_ASSERT_EQUAL_INT(0, state.pulses[2]);
+
+  // Single-sample glitches are rejected by the majority vote
+  for (int i = 0; i < 50; i++) {
+    SampleFanTachs(&state, (i % 7 == 0) ? 0x2 : 0);
+  }
+  TEST_ASSERT_EQUAL_INT(6, state.pulses[1]);
+
+  UpdateFanRpms(&state, 1000);
+  TEST_ASSERT_EQUAL_INT(180, state.rpm[1]);
+  TEST_ASSERT_EQUAL_INT(0, state.pulses[1]);
+  TEST_ASSERT_EQUAL_UINT32(6, state.pulse_total[1]);
+}
+
+void test_fan_bank_matches_legacy(void) {
+  const int kChannels = 8;
+  FanBankState state;
+  InitFanBankState(&state);
+  std::vector<std::unique_ptr<LegacyFan>> legacy;
+  for (int ch = 0; ch < kChannels; ch++) {
+    float target = 20.0f + 10.0f * ch;
+    AddChannel(&state, ch, 50.0f, target, true);
+    legacy.emplace_back(new LegacyFan{50.0f, target, 0.0f, false, 0, 0,
+                                      {false}, 0, false, 0});
+  }
+
+  for (int tick = 0; tick < 5000; tick++) {
+    uint32_t levels = TachLevels(tick, kChannels);
+    SampleFanTachs(&state, levels);
+    for (int ch = 0; ch < kChannels; ch++) {
+      legacy[ch]->Sample(levels & (1u << ch));
+    }
+    if (tick % 200 == 0) {
+      StepFanRamps(&state, kResolution);
+      for (auto& fan : legacy) fan->Smooth();
+    }
+  }
+
+  for (int ch = 0; ch < kChannels; ch++) {
+    TEST_ASSERT_EQUAL_FLOAT(legacy[ch]->current_duty_cycle, state.duty[ch]);
+    TEST_ASSERT_EQUAL_INT(legacy[ch]->tach_pulses, state.pulses[ch]);
+  }
+}
+
+// Per-tick cost (one tach sample for every channel plus a ramp step every
+// 200th tick, matching the 1ms / 200ms firmware cadence) at 4, 8 and 16
+// channels, bank versus per-fan objects.
+void test_fan_bank_benchmark(void) {
+  const int kTicks = 200000;
+  for (int channels : {4, 8, 16}) {
+    FanBankState state;
+    InitFanBankState(&state);
+    std::vector<std::unique_ptr<LegacyFan>> legacy;
+    for (int ch = 0; ch < channels; ch++) {
+      AddChannel(&state, ch, 50.0f, 100.0f, true);
+      legacy.emplace_back(new LegacyFan{50.0f, 100.0f, 0.0f, false, 0, 0,
+                                        {false}, 0, false, 0});
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < kTicks; tick++) {
+      SampleFanTachs(&state, TachLevels(tick, channels));
+      if (tick % 200 == 0) StepFanRamps(&state, kResolution);
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < kTicks; tick++) {
+      uint32_t levels = TachLevels(tick, channels);
+      for (int ch = 0; ch < channels; ch++) {
+        legacy[ch]->Sample(levels & (1u << ch));
+      }
+      if (tick % 200 == 0) {
+        for (auto& fan : legacy) fan->Smooth();
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double bank_ns =
+        std::chrono::duration<double, std::nano>(mid - start).count() / kTicks;
+    double legacy_ns =
+        std::chrono::duration<double, std::nano>(end - mid).count() / kTicks;
+    char message[128];
+    snprintf(message, sizeof(message),
+             "%2d channels: bank %.1f ns/tick, per-fan %.1f ns/tick",
+             channels, bank_ns, legacy_ns);
+    TEST_MESSAGE(message);
+
+    // Keep the work observable so it is not optimized away
+    TEST_ASSERT_EQUAL_INT(legacy[0]->tach_pulses, state.pulses[0]);
+  }
+}
@@ -0,0 +1,140 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include "flight_capture.h"
+
+namespace {
+
+// One-byte samples so the window contents are easy to check
+uint8_t Sample(int i) { return (uint8_t)i; }
+
+// Concatenate the frozen window
+int ReadCapture(const FlightRing& ring, uint8_t* out, uint32_t* trigger) {
+  const uint8_t* first;
+  const uint8_t* second;
+  size_t first_bytes, second_bytes;
+  ring.GetCapture(&first, &first_bytes, &second, &second_bytes, trigger);
+  memcpy(out, first, first_bytes);
+  memcpy(out + first_bytes, second, second_bytes);
+  return first_bytes + second_bytes;
+}
+
+}  // namespace
+
+void test_flight_ring_window(void) {
+  uint8_t storage[16];
+  FlightRing ring(storage, sizeof(storage), 1, 5, 3);
+
+  // Nothing to capture yet
+  TEST_ASSERT_FALSE(ring.Trigger());
+
+  for (int i = 0; i < 40; i++) {
+    uint8_t s = Sample(i);
+    TEST_ASSERT_TRUE(ring.Add(&s));
+  }
+  TEST_ASSERT_TRUE(ring.Trigger());  // At sample 39
+  TEST_ASSERT_FALSE(ring.Trigger());
+  TEST_ASSERT_FALSE(ring.frozen());
+
+  for (int i = 40; i < 43; i++) {
+    uint8_t s = Sample(i);
+    TEST_ASSERT_TRUE(ring.Add(&s));
+  }
+  TEST_ASSERT_TRUE(ring.frozen());
+
+  // Dropped while frozen; the window is unchanged
+  uint8_t s = Sample(99);
+  TEST_ASSERT_FALSE(ring.Add(&s));
+
+  uint8_t out[16];
+  uint32_t trigger = 0;
+  TEST_ASSERT_EQUAL_INT(9, ReadCapture(ring, out, &trigger));
+  TEST_ASSERT_EQUAL_UINT32(9, ring.capture_samples());
+  TEST_ASSERT_EQUAL_UINT32(5, trigger);
+  for (int i = 0; i < 9; i++) TEST_ASSERT_EQUAL_UINT8(34 + i, out[i]);
+
+  // Recording resumes without the samples from before the gap
+  ring.Release();
+  TEST_ASSERT_FALSE(ring.frozen());
+  s = Sample(50);
+  TEST_ASSERT_TRUE(ring.Add(&s));
+  TEST_ASSERT_TRUE(ring.Trigger());
+  for (int i = 51; i < 54; i++) {
+    s = Sample(i);
+    ring.Add(&s);
+  }
+  TEST_ASSERT_TRUE(ring.frozen());
+  TEST_ASSERT_EQUAL_INT(4, ReadCapture(ring, out, &trigger));
+  TEST_ASSERT_EQUAL_UINT32(0, trigger);
+  TEST_ASSERT_EQUAL_UINT8(50, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(53, out[3]);
+}
+
+void test_flight_ring_bounded(void) {
+  // Wider samples; the window asks for more than fits
+  constexpr size_t kSampleSize = 10;
+  uint8_t storage[8 * kSampleSize + 3];
+  FlightRing ring(storage, sizeof(storage), kSampleSize, 100, 2);
+  TEST_ASSERT_EQUAL_INT(8, ring.capacity());
+
+  uint8_t sample[kSampleSize];
+  for (int i = 0; i < 20; i++) {
+    memset(sample, i, sizeof(sample));
+    ring.Add(sample);
+  }
+  ring.Trigger();
+  for (int i = 20; i < 22; i++) {
+    memset(sample, i, sizeof(sample));
+    ring.Add(sample);
+  }
+  TEST_ASSERT_TRUE(ring.frozen());
+
+  // The post-trigger samples are kept; the pre-trigger window shrinks
+  uint8_t out[sizeof(storage)];
+  uint32_t trigger = 0;
+  TEST_ASSERT_EQUAL_INT(8 * kSampleSize, ReadCapture(ring, out, &trigger));
+  TEST_ASSERT_EQUAL_UINT32(5, trigger);
+  TEST_ASSERT_EQUAL_UINT8(14, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(19, out[trigger * kSampleSize]);
+  TEST_ASSERT_EQUAL_UINT8(21, out[7 * kSampleSize + kSampleSize - 1]);
+}
+
+void test_flight_trigger_detector(void) {
+  FlightTriggerDetector detector(0.5f, 4);
+  int32_t rpm[2] = {0, 1200};
+  float temps[2] = {30.0f, 25.0f};
+  bool valid[2] = {true, true};
+  int index = -1;
+
+  // A fan that never spun is not a stall
+  TEST_ASSERT_EQUAL_INT(kFlightTriggerNone,
+                        detector.Check(rpm, 2, temps, valid, 2, &index));
+  rpm[1] = 0;
+  TEST_ASSERT_EQUAL_INT(kFlightTriggerFanStall,
+                        detector.Check(rpm, 2, temps, valid, 2, &index));
+  TEST_ASSERT_EQUAL_INT(1, index);
+  TEST_ASSERT_EQUAL_INT(kFlightTriggerNone,
+                        detector.Check(rpm, 2, temps, valid, 2, &index));
+
+  // 1.5 degrees over 4 s is under the threshold, 2.5 is over
+  for (int i = 0; i < 4; i++) {
+    temps[0] += 0.375f;
+    TEST_ASSERT_EQUAL_INT(kFlightTriggerNone,
+                          detector.Check(rpm, 2, temps, valid, 2, &index));
+  }
+  temps[0] += 1.0f;
+  TEST_ASSERT_EQUAL_INT(kFlightTriggerTempSlope,
+                        detector.Check(rpm, 2, temps, valid, 2, &index));
+  TEST_ASSERT_EQUAL_INT(0, index);
+
+  // An invalid reading restarts the window, so a jump across it is ignored
+  valid[1] = false;
+  detector.Check(rpm, 2, temps, valid, 2, &index);
+  valid[1] = true;
+  temps[1] = 40.0f;
+  for (int i = 0; i < 6; i++) {
+    TEST_ASSERT_EQUAL_INT(kFlightTriggerNone,
+                          detector.Check(rpm, 2, temps, valid, 2, &index));
+  }
+}
@@ -0,0 +1,692 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_event_server.h"
+#include "http_request.h"
+#include "test_support.h"
+
+namespace {
+
+// A /api/status-sized JSON answer; POSTs echo their body
+const std::string kStatusJson =
+    "{\"thermistors\":[{\"id\":\"ambient\",\"temp\":\"24.5\"},{\"id\":"
+    "\"coolant_in\",\"temp\":\"31.2\"},{\"id\":\"coolant_out\",\"temp\":"
+    "\"29.8\"}],\"fans\":[{\"duty\":\"40.0\",\"rpm\":\"1180\"},{\"duty\":"
+    "\"40.0\",\"rpm\":\"1175\"},{\"duty\":\"55.0\",\"rpm\":\"2410\"},{\"duty\":"
+    "\"55.0\",\"rpm\":\"2390\"}],\"overrideEnabled\":false}";
+
+// Streams `remaining` bytes of 'x'
+class FillSource : public HttpBodySource {
+ public:
+  explicit FillSource(size_t size) : remaining_(size) {}
+  size_t Read(uint8_t* out, size_t size) override {
+    size_t n = std::min(size, remaining_);
+    memset(out, 'x', n);
+    remaining_ -= n;
+    return n;
+  }
+
+ private:
+  size_t remaining_;
+};
+
+void Handle(const HttpRequest& request, HttpResponse* response,
+            void* context) {
+  (void)context;
+  if (strcmp(request.method(), "POST") == 0) {
+    response->Begin("200 OK", "Content-Type: text/plain\r\n");
+    response->Write(request.body(), request.body_size());
+  } else if (strcmp(request.target(), "/big") == 0) {
+    response->Begin("200 OK", "Content-Type: text/plain\r\n");
+    response->Print("start:");
+    response->Stream(std::unique_ptr<HttpBodySource>(new FillSource(100000)),
+                     100000);
+  } else if (strcmp(request.target(), "/stream") == 0) {
+    // A query result, whose length is not known up front
+    response->Begin("200 OK", "Content-Type: text/csv\r\n");
+    response->Print("start:");
+    response->Stream(std::unique_ptr<HttpBodySource>(new FillSource(5000)),
+                     -1);
+  } else if (strcmp(request.target(), "/perf_raw_0.bin") == 0) {
+    response->Begin("200 OK", "Content-Type: application/octet-stream\r\n");
+    response->Stream(std::unique_ptr<HttpBodySource>(new FillSource(4096)),
+                     4096);
+  } else if (strcmp(request.target(), "/api/status") == 0) {
+    response->Begin("200 OK", "Content-Type: application/json\r\n");
+    response->Print(kStatusJson.c_str());
+  } else if (strcmp(request.target(), "/api/events") == 0) {
+    response->Begin("200 OK", "Content-Type: text/event-stream\r\n");
+    response->Print(("data: " + kStatusJson + "\n\n").c_str());
+    response->Subscribe();
+  } else if (strcmp(request.target(), "/none") != 0) {
+    response->Begin("404 Not Found");
+  }
+}
+
+// Read one response from a kept-alive connection, its body framed by
+// Content-Length or chunks (else ending with the connection). `buffer` keeps
+// bytes read past it, i.e. of the next pipelined response. Returns the head,
+// or "" if the connection closed first; without `body`, only the head is
+// read (a response to HEAD).
+std::string ReadResponse(int fd, std::string* buffer, std::string* body) {
+  char chunk[8192];
+  auto fill = [&](size_t size) {
+    while (buffer->size() < size) {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) return false;
+      buffer->append(chunk, n);
+    }
+    return true;
+  };
+  size_t end;
+  while ((end = buffer->find("\r\n\r\n")) == std::string::npos) {
+    if (!fill(buffer->size() + 1)) return "";
+  }
+  std::string head = buffer->substr(0, end + 4);
+  buffer->erase(0, end + 4);
+  if (body == nullptr) return head;
+  body->clear();
+
+  size_t length_at = head.find("Content-Length: ");
+  if (length_at != std::string::npos) {
+    size_t length = strtoul(head.c_str() + length_at + 16, nullptr, 10);
+    if (!fill(length)) return "";
+    body->assign(*buffer, 0, length);
+    buffer->erase(0, length);
+  } else if (head.find("Transfer-Encoding: chunked\r\n") !=
+             std::string::npos) {
+    for (;;) {
+      size_t line;
+      while ((line = buffer->find("\r\n")) == std::string::npos) {
+        if (!fill(buffer->size() + 1)) return "";
+      }
+      size_t size = strtoul(buffer->c_str(), nullptr, 16);
+      if (!fill(line + 2 + size + 2)) return "";
+      body->append(*buffer, line + 2, size);
+      buffer->erase(0, line + 2 + size + 2);
+      if (size == 0) break;
+    }
+  } else {
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+      buffer->append(chunk, n);
+    }
+    body->swap(*buffer);
+    buffer->clear();
+  }
+  return head;
+}
+
+bool Contains(const std::string& text, const std::string& part) {
+  return text.find(part) != std::string::npos;
+}
+
+// True if the peer closed the connection (within 1 s, or already)
+bool Closed(int fd, bool wait = true) {
+  timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char c;
+  return recv(fd, &c, 1, wait ? 0 : MSG_DONTWAIT) == 0;
+}
+
+// Read from a subscription until `events` more events ("\n\n") arrived
+// (1 s at most); returns what was read
+std::string ReadEvents(int fd, int events) {
+  timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  std::string data;
+  char buffer[8192];
+  size_t scanned = 0;
+  int seen = 0;
+  while (seen < events) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) break;
+    data.append(buffer, n);
+    for (size_t at = data.find("\n\n", scanned); at != std::string::npos;
+         at = data.find("\n\n", at + 2)) {
+      seen++;
+      scanned = at + 2;
+    }
+    if (data.size() > scanned + 1) scanned = data.size() - 1;
+  }
+  return data;
+}
+
+int Subscribe(uint16_t port) {
+  int fd = Connect(port);
+  SendAll(fd, "GET /api/events HTTP/1.1\r\n\r\n");
+  return fd;
+}
+
+double ThreadCpuMs() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+// The server this change replaced: one client at a time from the loop task
+// (10 ms between checks when idle), reading the head a byte at a time until
+// the blank line, however long the client takes
+void LegacyServer(int listen_fd, std::atomic<bool>* stop) {
+  while (!*stop) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    std::string line;
+    for (;;) {
+      char c;
+      if (recv(fd, &c, 1, 0) <= 0) break;
+      if (c != '\n') {
+        if (c != '\r') line += c;
+        continue;
+      }
+      if (line.empty()) break;
+      line.clear();
+    }
+    std::string response =
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+        "Connection: close\r\n\r\n" +
+        kStatusJson;
+    SendAll(fd, response);
+    close(fd);
+  }
+}
+
+struct LoadResult {
+  double requests_per_s;
+  double p50_ms;
+  double p99_ms;
+  int ok;
+};
+
+// `clients` threads each fetch /api/status `requests` times back to back
+// while one slow client trickles its request head over `slow_ms`
+LoadResult RunLoad(uint16_t port, int clients, int requests, int slow_ms) {
+  std::vector<std::vector<double>> latencies(clients);
+  std::atomic<int> ok{0};
+  std::thread slow([port, slow_ms] {
+    int fd = Connect(port);
+    std::string request = "GET /api/status HTTP/1.1\r\nHost: x\r\n\r\n";
+    for (char c : request) {
+      send(fd, &c, 1, MSG_NOSIGNAL);
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(slow_ms / (int)request.size()));
+    }
+    ReadAll(fd);
+    close(fd);
+  });
+  // Let the slow client connect first, as a phone on bad WiFi would
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; i++) {
+    threads.emplace_back([&, i] {
+      for (int r = 0; r < requests; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::string response =
+            Fetch(port, "GET /api/status HTTP/1.1\r\nHost: x\r\n\r\n");
+        latencies[i].push_back(std::chrono::duration<double, std::milli>(
+                                   std::chrono::steady_clock::now() - t0)
+                                   .count());
+        if (Body(response) == kStatusJson) ok++;
+      }
+    });
+  }
+  for (std::thread& t : threads) t.join();
+  double elapsed_s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  slow.join();
+
+  std::vector<double> all;
+  for (const std::vector<double>& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::sort(all.begin(), all.end());
+  LoadResult result;
+  result.requests_per_s = all.size() / elapsed_s;
+  result.p50_ms = all[all.size() / 2];
+  result.p99_ms = all[all.size() * 99 / 100];
+  result.ok = ok;
+  return result;
+}
+
+}  // namespace
+
+void test_http_event_server_requests(void) {
+  HttpEventServer server(4, 300, Handle, nullptr, NowMs);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  ServerThread thread(&server);
+  uint16_t port = server.port();
+
+  std::string response =
+      Fetch(port, "GET /api/status HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.1 200 OK\r\n"));
+  TEST_ASSERT_TRUE(response.find("Content-Length: " +
+                                 std::to_string(kStatusJson.size())) !=
+                   std::string::npos);
+  TEST_ASSERT_TRUE(Body(response) == kStatusJson);
+
+  // A form post whose body arrives in pieces, after the head
+  int fd = Connect(port);
+  SendAll(fd, "POST /api/config HTTP/1.1\r\nContent-Length: 27\r\n\r\nmax_delta");
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  SendAll(fd, "_t=9&min_duty_4=55");
+  response = ReadAll(fd);
+  close(fd);
+  TEST_ASSERT_EQUAL_STRING("max_delta_t=9&min_duty_4=55",
+                           Body(response).c_str());
+
+  // Streamed body after the buffered part, with its length known up front
+  response = Fetch(port, "GET /big HTTP/1.1\r\n\r\n");
+  TEST_ASSERT_TRUE(response.find("Content-Length: 100006\r\n") !=
+                   std::string::npos);
+  TEST_ASSERT_EQUAL(100006, (int)Body(response).size());
+  response = Fetch(port, "HEAD /big HTTP/1.1\r\n\r\n");
+  TEST_ASSERT_EQUAL(0, (int)Body(response).size());
+
+  // Errors the handler never sees
+  TEST_ASSERT_EQUAL(0, (int)Fetch(port, "hello\r\n\r\n")
+                           .find("HTTP/1.1 400 Bad Request"));
+  TEST_ASSERT_EQUAL(
+      0, (int)Fetch(port, "POST / HTTP/1.1\r\nContent-Length: 5000\r\n\r\n")
+             .find("HTTP/1.1 413"));
+  TEST_ASSERT_EQUAL(0, (int)Fetch(port, "GET " + std::string(2000, 'a') +
+                                            " HTTP/1.1\r\n\r\n")
+                           .find("HTTP/1.1 431"));
+  TEST_ASSERT_EQUAL(0, (int)Fetch(port, "GET /none HTTP/1.1\r\n\r\n")
+                           .find("HTTP/1.1 500"));
+
+  // Stalled clients hold a slot until their deadline; with every slot held,
+  // the next client waits in the backlog and is served once they time out
+  int stalled[4];
+  for (int& s : stalled) {
+    s = Connect(port);
+    SendAll(s, "GET /api/status HTTP/1.1\r\n");
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TEST_ASSERT_EQUAL(4, server.active_connections());
+  TEST_ASSERT_TRUE(Body(Fetch(port, "GET /api/status HTTP/1.1\r\n\r\n")) ==
+                   kStatusJson);
+  TEST_ASSERT_TRUE(server.stats().timeouts > 0);  // Only a timeout frees a slot
+  for (int s : stalled) {
+    TEST_ASSERT_EQUAL(0, (int)ReadAll(s).size());
+    close(s);
+  }
+
+  HttpServerStats stats = server.stats();
+  TEST_ASSERT_EQUAL_UINT32(4, stats.timeouts);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.bad_requests);
+}
+
+void test_http_event_server_benchmark(void) {
+  const int kClients = 8;
+  const int kRequests = 50;
+  const int kSlowMs = 500;
+
+  // Legacy: one client at a time
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+  listen(listen_fd, 64);
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+  socklen_t length = sizeof(addr);
+  getsockname(listen_fd, (sockaddr*)&addr, &length);
+  std::atomic<bool> stop{false};
+  std::thread legacy(LegacyServer, listen_fd, &stop);
+  LoadResult before = RunLoad(ntohs(addr.sin_port), kClients, kRequests,
+                              kSlowMs);
+  stop = true;
+  legacy.join();
+  close(listen_fd);
+
+  // Event-driven, with the firmware's 4 slots
+  LoadResult after;
+  {
+    HttpEventServer server(4, 5000, Handle, nullptr, NowMs);
+    TEST_ASSERT_TRUE(server.Listen(0));
+    ServerThread thread(&server);
+    after = RunLoad(server.port(), kClients, kRequests, kSlowMs);
+  }
+
+  TEST_ASSERT_EQUAL(kClients * kRequests, before.ok);
+  TEST_ASSERT_EQUAL(kClients * kRequests, after.ok);
+
+  char message[240];
+  snprintf(message, sizeof(message),
+           "%d clients x %d requests, one client taking %d ms to send its "
+           "request: one at a time %.0f req/s, p50 %.2f ms, p99 %.1f ms; "
+           "event-driven %.0f req/s, p50 %.2f ms, p99 %.2f ms",
+           kClients, kRequests, kSlowMs, before.requests_per_s, before.p50_ms,
+           before.p99_ms, after.requests_per_s, after.p50_ms, after.p99_ms);
+  TEST_MESSAGE(message);
+}
+
+void test_http_event_server_events(void) {
+  HttpEventServer server(4, 300, Handle, nullptr, NowMs);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  ServerThread thread(&server, 1);
+  uint16_t port = server.port();
+  auto publish = [&](const std::string& frame) {
+    int count = 0;
+    thread.Call([&] { count = server.Publish(frame.data(), frame.size()); });
+    return count;
+  };
+  auto subscribers = [&] {
+    int count = 0;
+    thread.Call([&] { count = server.subscribers(); });
+    return count;
+  };
+
+  // The response carries the current status and no length
+  int a = Subscribe(port);
+  std::string response = ReadEvents(a, 1);
+  TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.1 200 OK\r\n"));
+  TEST_ASSERT_TRUE(response.find("Content-Length") == std::string::npos);
+  TEST_ASSERT_TRUE(Body(response) == "data: " + kStatusJson + "\n\n");
+  int b = Subscribe(port);
+  ReadEvents(b, 1);
+  TEST_ASSERT_EQUAL(2, subscribers());
+
+  // One frame reaches both; idle subscribers outlive the timeout
+  TEST_ASSERT_EQUAL(2, publish("data: 1\n\n"));
+  TEST_ASSERT_EQUAL_STRING("data: 1\n\n", ReadEvents(a, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("data: 1\n\n", ReadEvents(b, 1).c_str());
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  TEST_ASSERT_EQUAL(2, publish("data: 2\n\n"));
+  TEST_ASSERT_EQUAL_STRING("data: 2\n\n", ReadEvents(a, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("data: 2\n\n", ReadEvents(b, 1).c_str());
+
+  // A third may subscribe; the last slot is kept for requests
+  int small = 4096;
+  int c = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(c, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  connect(c, (sockaddr*)&addr, sizeof(addr));
+  SendAll(c, "GET /api/events HTTP/1.1\r\n\r\n");
+  ReadEvents(c, 1);
+  TEST_ASSERT_EQUAL(0, (int)Fetch(port, "GET /api/events HTTP/1.1\r\n\r\n")
+                           .find("HTTP/1.1 503"));
+  TEST_ASSERT_TRUE(Body(Fetch(port, "GET /api/status HTTP/1.1\r\n\r\n")) ==
+                   kStatusJson);
+
+  // A subscriber that stops reading (c) skips to the newest frame and is
+  // dropped at its deadline; the others get every frame
+  std::string big = "data: " + std::string(1 << 20, 'x') + "\n\n";
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL(3, publish(big));
+    TEST_ASSERT_EQUAL(big.size(), ReadEvents(a, 1).size());
+    TEST_ASSERT_EQUAL(big.size(), ReadEvents(b, 1).size());
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  TEST_ASSERT_EQUAL(2, subscribers());
+  HttpServerStats stats;
+  thread.Call([&] { stats = server.stats(); });
+  TEST_ASSERT_TRUE(stats.frames_skipped >= 1);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.timeouts);
+  close(c);
+
+  // Leaving frees the slot
+  close(a);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TEST_ASSERT_EQUAL(1, subscribers());
+  close(b);
+}
+
+void test_http_event_server_push_benchmark(void) {
+  const int kClients = 8;
+  const int kTicks = 50;
+  HttpEventServer server(kClients + 1, 5000, Handle, nullptr, NowMs);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  ServerThread thread(&server, 1);
+  uint16_t port = server.port();
+  const std::string request = "GET /api/status HTTP/1.1\r\nHost: x\r\n\r\n";
+  // Work done by the server: CPU time of its thread, read on that thread
+  auto server_cpu_ms = [&] {
+    double ms = 0;
+    thread.Call([&] { ms = ThreadCpuMs(); });
+    return ms;
+  };
+
+  // Polling: every dashboard fetches the status once per tick
+  size_t poll_bytes = 0;
+  int poll_ok = 0;
+  double cpu = server_cpu_ms();
+  for (int t = 0; t < kTicks; t++) {
+    for (int i = 0; i < kClients; i++) {
+      std::string response = Fetch(port, request);
+      poll_bytes += request.size() + response.size();
+      poll_ok += Body(response) == kStatusJson;
+    }
+  }
+  double poll_ms = server_cpu_ms() - cpu;
+  HttpServerStats before;
+  thread.Call([&] { before = server.stats(); });
+
+  // Push: one frame per tick, fanned out to every subscriber
+  std::vector<int> fds;
+  for (int i = 0; i < kClients; i++) {
+    fds.push_back(Subscribe(port));
+    ReadEvents(fds.back(), 1);
+  }
+  std::string frame = "data: " + kStatusJson + "\n\n";
+  size_t push_bytes = 0;
+  int push_ok = 0;
+  cpu = server_cpu_ms();
+  for (int t = 0; t < kTicks; t++) {
+    thread.Call([&] { server.Publish(frame.data(), frame.size()); });
+    for (int fd : fds) {
+      std::string event = ReadEvents(fd, 1);
+      push_bytes += event.size();
+      push_ok += event == frame;
+    }
+  }
+  double push_ms = server_cpu_ms() - cpu;
+  HttpServerStats after;
+  thread.Call([&] { after = server.stats(); });
+  for (int fd : fds) close(fd);
+
+  TEST_ASSERT_EQUAL(kClients * kTicks, poll_ok);
+  TEST_ASSERT_EQUAL(kClients * kTicks, push_ok);
+  // One request per subscriber, instead of one per client and tick
+  TEST_ASSERT_EQUAL_UINT32(kClients, after.requests - before.requests);
+  TEST_ASSERT_TRUE(push_bytes < poll_bytes);
+
+  char message[240];
+  snprintf(message, sizeof(message),
+           "%d dashboards, %d ticks, per tick: polling %.0f us server CPU, "
+           "%u bytes, %d connections; push %.0f us server CPU, %u bytes, "
+           "1 encode",
+           kClients, kTicks, poll_ms * 1000 / kTicks,
+           (unsigned)(poll_bytes / kTicks), kClients,
+           push_ms * 1000 / kTicks, (unsigned)(push_bytes / kTicks));
+  TEST_MESSAGE(message);
+}
+
+void test_http_event_server_keep_alive(void) {
+  HttpEventServer server(2, 300, Handle, nullptr, NowMs);
+  server.SetKeepAlive(200, 3);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  ServerThread thread(&server, 1);
+  uint16_t port = server.port();
+  const std::string status = "GET /api/status HTTP/1.1\r\nHost: x\r\n\r\n";
+
+  // Up to 3 requests on one connection; the last response closes it
+  int fd = Connect(port);
+  std::string buffer;
+  std::string body;
+  for (int i = 0; i < 3; i++) {
+    SendAll(fd, status);
+    std::string head = ReadResponse(fd, &buffer, &body);
+    TEST_ASSERT_EQUAL(0, (int)head.find("HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_TRUE(body == kStatusJson);
+    TEST_ASSERT_TRUE(Contains(head, i < 2 ? "Connection: keep-alive\r\n"
+                                          : "Connection: close\r\n"));
+  }
+  TEST_ASSERT_TRUE(Closed(fd));
+  close(fd);
+
+  // Pipelined: answered in order, a streamed body sent in chunks
+  fd = Connect(port);
+  SendAll(fd,
+          "GET /stream HTTP/1.1\r\n\r\n"
+          "POST /api/config HTTP/1.1\r\nContent-Length: 5\r\n\r\nfan=1"
+          "HEAD /big HTTP/1.1\r\nConnection: close\r\n\r\n");
+  std::string head = ReadResponse(fd, &buffer, &body);
+  TEST_ASSERT_TRUE(Contains(head, "Transfer-Encoding: chunked\r\n"));
+  TEST_ASSERT_FALSE(Contains(head, "Content-Length"));
+  TEST_ASSERT_TRUE(body == "start:" + std::string(5000, 'x'));
+  ReadResponse(fd, &buffer, &body);
+  TEST_ASSERT_EQUAL_STRING("fan=1", body.c_str());
+  head = ReadResponse(fd, &buffer, nullptr);
+  TEST_ASSERT_TRUE(Contains(head, "Content-Length: 100006\r\n"));
+  TEST_ASSERT_TRUE(Contains(head, "Connection: close\r\n"));
+  TEST_ASSERT_TRUE(Closed(fd));
+  TEST_ASSERT_EQUAL(0, (int)buffer.size());
+  close(fd);
+
+  // HTTP/1.0 gets no chunks: the body ends with the connection
+  std::string response = Fetch(port, "GET /stream HTTP/1.0\r\n\r\n");
+  TEST_ASSERT_FALSE(Contains(response, "chunked"));
+  TEST_ASSERT_TRUE(Contains(response, "Connection: close\r\n"));
+  TEST_ASSERT_TRUE(Body(response) == "start:" + std::string(5000, 'x'));
+  response = Fetch(port,
+                   "GET /api/status HTTP/1.0\r\nConnection: keep-alive\r\n"
+                   "\r\n");
+  TEST_ASSERT_TRUE(Contains(response, "Connection: keep-alive\r\n"));
+
+  // Idle connections close after the idle timeout, not counted as timeouts,
+  // and give up their slot to a waiting client before that
+  int a = Connect(port);
+  int b = Connect(port);
+  SendAll(a, status);
+  SendAll(b, status);
+  std::string buffer_b;
+  ReadResponse(a, &buffer, &body);
+  ReadResponse(b, &buffer_b, &body);
+  TEST_ASSERT_TRUE(Body(Fetch(port, "GET /api/status HTTP/1.1\r\n"
+                                    "Connection: close\r\n\r\n")) ==
+                   kStatusJson);
+  // One was evicted for it; the other is still open
+  TEST_ASSERT_TRUE(Closed(a, false) != Closed(b, false));
+  TEST_ASSERT_TRUE(Closed(a) && Closed(b));
+  close(a);
+  close(b);
+
+  HttpServerStats stats;
+  thread.Call([&] { stats = server.stats(); });
+  TEST_ASSERT_EQUAL_UINT32(0, stats.timeouts);
+  TEST_ASSERT_EQUAL_UINT32(4, stats.reused);
+}
+
+void test_http_event_server_keep_alive_benchmark(void) {
+  const int kRequests = 500;
+  const int kFiles = 200;  // 4 KB perf log files
+  HttpEventServer server(4, 5000, Handle, nullptr, NowMs);
+  server.SetKeepAlive(5000, 1000);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  ServerThread thread(&server, 1);
+  uint16_t port = server.port();
+  auto elapsed_ms = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  auto request = [](const char* target, bool close) {
+    return std::string("GET ") + target + " HTTP/1.1\r\nHost: x\r\n" +
+           (close ? "Connection: close\r\n" : "") + "\r\n";
+  };
+
+  // Back to back on a connection each, as before
+  auto run_closing = [&](const char* target, int count, size_t size) {
+    auto start = std::chrono::steady_clock::now();
+    int ok = 0;
+    for (int i = 0; i < count; i++) {
+      ok += Body(Fetch(port, request(target, true))).size() == size;
+    }
+    TEST_ASSERT_EQUAL(count, ok);
+    return elapsed_ms(start);
+  };
+  // ... on one kept-alive connection, waiting for each response
+  auto run_kept = [&](const char* target, int count, size_t size) {
+    auto start = std::chrono::steady_clock::now();
+    int fd = Connect(port);
+    std::string buffer;
+    std::string body;
+    int ok = 0;
+    for (int i = 0; i < count; i++) {
+      SendAll(fd, request(target, false));
+      ReadResponse(fd, &buffer, &body);
+      ok += body.size() == size;
+    }
+    close(fd);
+    TEST_ASSERT_EQUAL(count, ok);
+    return elapsed_ms(start);
+  };
+  // ... and pipelined, all requests sent up front
+  auto run_pipelined = [&](const char* target, int count, size_t size) {
+    auto start = std::chrono::steady_clock::now();
+    int fd = Connect(port);
+    std::string all;
+    for (int i = 0; i < count; i++) all += request(target, false);
+    std::thread sender([&] { SendAll(fd, all); });
+    std::string buffer;
+    std::string body;
+    int ok = 0;
+    for (int i = 0; i < count; i++) {
+      ReadResponse(fd, &buffer, &body);
+      ok += body.size() == size;
+    }
+    sender.join();
+    close(fd);
+    TEST_ASSERT_EQUAL(count, ok);
+    return elapsed_ms(start);
+  };
+
+  double status_closing =
+      run_closing("/api/status", kRequests, kStatusJson.size());
+  double status_kept = run_kept("/api/status", kRequests, kStatusJson.size());
+  double status_pipelined =
+      run_pipelined("/api/status", kRequests, kStatusJson.size());
+  double files_closing = run_closing("/perf_raw_0.bin", kFiles, 4096);
+  double files_kept = run_kept("/perf_raw_0.bin", kFiles, 4096);
+  double files_pipelined = run_pipelined("/perf_raw_0.bin", kFiles, 4096);
+  HttpServerStats stats;
+  thread.Call([&] { stats = server.stats(); });
+  TEST_ASSERT_EQUAL_UINT32(2 * (kRequests - 1) + 2 * (kFiles - 1),
+                           stats.reused);
+
+  char message[320];
+  snprintf(message, sizeof(message),
+           "%d x /api/status: connection each %.1f us/req, kept alive %.1f "
+           "us/req, pipelined %.1f us/req; %d x 4 KB log files: connection "
+           "each %.1f us/file, kept alive %.1f, pipelined %.1f",
+           kRequests, status_closing * 1000 / kRequests,
+           status_kept * 1000 / kRequests, status_pipelined * 1000 / kRequests,
+           kFiles, files_closing * 1000 / kFiles, files_kept * 1000 / kFiles,
+           files_pipelined * 1000 / kFiles);
+  TEST_MESSAGE(message);
+}
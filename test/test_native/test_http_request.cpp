@@ -0,0 +1,120 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include "http_request.h"
+
+void test_http_request_parse(void) {
+  const char kRequest[] =
+      "GET /all?store=minute HTTP/1.1\r\n"
+      "Host: fan-controller:5599\r\n"
+      "range:  bytes=100-  \r\n"
+      "X-Empty:\r\n"
+      "\r\n"
+      "body";
+
+  // Fed one byte at a time, the head ends exactly before the body
+  HttpRequestParser parser;
+  size_t used = 0;
+  for (size_t i = 0; i < strlen(kRequest); i++) {
+    if (parser.state() != HttpRequestParser::kIncomplete) break;
+    used += parser.Feed(kRequest + i, 1);
+  }
+  TEST_ASSERT_EQUAL_INT(HttpRequestParser::kComplete, parser.state());
+  TEST_ASSERT_EQUAL_UINT32(strlen(kRequest) - 4, used);
+  TEST_ASSERT_EQUAL_STRING("GET", parser.method());
+  TEST_ASSERT_EQUAL_STRING("/all?store=minute", parser.target());
+  TEST_ASSERT_EQUAL_STRING("HTTP/1.1", parser.version());
+  TEST_ASSERT_EQUAL_STRING("fan-controller:5599", parser.Header("host"));
+  TEST_ASSERT_EQUAL_STRING("bytes=100-", parser.Header("Range"));
+  TEST_ASSERT_EQUAL_STRING("", parser.Header("X-Empty"));
+  TEST_ASSERT_NULL(parser.Header("Accept"));
+
+  // In one piece, with bare newlines
+  parser.Reset();
+  const char kBare[] = "GET / HTTP/1.0\nAccept: */*\n\n";
+  TEST_ASSERT_EQUAL_UINT32(strlen(kBare), parser.Feed(kBare, strlen(kBare)));
+  TEST_ASSERT_EQUAL_INT(HttpRequestParser::kComplete, parser.state());
+  TEST_ASSERT_EQUAL_STRING("/", parser.target());
+  TEST_ASSERT_EQUAL_STRING("HTTP/1.0", parser.version());
+  TEST_ASSERT_EQUAL_STRING("*/*", parser.Header("accept"));
+
+  parser.Reset();
+  const char kBad[] = "hello\r\n\r\n";
+  parser.Feed(kBad, strlen(kBad));
+  TEST_ASSERT_EQUAL_INT(HttpRequestParser::kMalformed, parser.state());
+
+  // A head that never ends within the buffer
+  parser.Reset();
+  char filler[256];
+  memset(filler, 'a', sizeof(filler));
+  for (int i = 0; i < 8; i++) parser.Feed(filler, sizeof(filler));
+  TEST_ASSERT_EQUAL_INT(HttpRequestParser::kTooLarge, parser.state());
+}
+
+void test_http_request_range(void) {
+  uint64_t first = 0;
+  uint64_t last = 0;
+
+  TEST_ASSERT_EQUAL_INT(kHttpRangeSatisfiable,
+                        ParseHttpRange("bytes=0-99", 1000, &first, &last));
+  TEST_ASSERT_TRUE(first == 0 && last == 99);
+  TEST_ASSERT_EQUAL_INT(kHttpRangeSatisfiable,
+                        ParseHttpRange("bytes=900-", 1000, &first, &last));
+  TEST_ASSERT_TRUE(first == 900 && last == 999);
+  TEST_ASSERT_EQUAL_INT(kHttpRangeSatisfiable,
+                        ParseHttpRange("bytes=990-5000", 1000, &first, &last));
+  TEST_ASSERT_TRUE(first == 990 && last == 999);
+  TEST_ASSERT_EQUAL_INT(kHttpRangeSatisfiable,
+                        ParseHttpRange("bytes=-10", 1000, &first, &last));
+  TEST_ASSERT_TRUE(first == 990 && last == 999);
+  TEST_ASSERT_EQUAL_INT(kHttpRangeSatisfiable,
+                        ParseHttpRange("bytes=-5000", 1000, &first, &last));
+  TEST_ASSERT_TRUE(first == 0 && last == 999);
+
+  // Nothing left to send, e.g. resuming a file that has not grown
+  TEST_ASSERT_EQUAL_INT(kHttpRangeUnsatisfiable,
+                        ParseHttpRange("bytes=1000-", 1000, &first, &last));
+  TEST_ASSERT_EQUAL_INT(kHttpRangeUnsatisfiable,
+                        ParseHttpRange("bytes=-0", 1000, &first, &last));
+
+  // Ignored: whole entity
+  const char* kIgnored[] = {nullptr,        "items=0-1",  "bytes=0-1,5-6",
+                            "bytes=5-1",    "bytes=abc-", "bytes=-",
+                            "bytes=+1-2",   "bytes=1"};
+  for (const char* value : kIgnored) {
+    TEST_ASSERT_EQUAL_INT(kHttpRangeNone,
+                          ParseHttpRange(value, 1000, &first, &last));
+  }
+}
+
+void test_http_request_negotiation(void) {
+  TEST_ASSERT_TRUE(HttpEtagMatches("\"abc\"", "\"abc\""));
+  TEST_ASSERT_TRUE(HttpEtagMatches("\"x\", W/\"abc\"", "\"abc\""));
+  TEST_ASSERT_TRUE(HttpEtagMatches(" * ", "\"abc\""));
+  TEST_ASSERT_FALSE(HttpEtagMatches("\"abc-gz\"", "\"abc\""));
+  TEST_ASSERT_FALSE(HttpEtagMatches("abc", "\"abc\""));
+  TEST_ASSERT_FALSE(HttpEtagMatches("", "\"abc\""));
+  TEST_ASSERT_FALSE(HttpEtagMatches(nullptr, "\"abc\""));
+
+  TEST_ASSERT_TRUE(HttpAcceptsEncoding("gzip, deflate, br", "gzip"));
+  TEST_ASSERT_TRUE(HttpAcceptsEncoding("deflate,GZIP;q=0.5", "gzip"));
+  TEST_ASSERT_TRUE(HttpAcceptsEncoding("*", "gzip"));
+  TEST_ASSERT_FALSE(HttpAcceptsEncoding("gzip;q=0", "gzip"));
+  TEST_ASSERT_FALSE(HttpAcceptsEncoding("gzip; q=0.000, *", "gzip"));
+  TEST_ASSERT_FALSE(HttpAcceptsEncoding("*;q=0", "gzip"));
+  TEST_ASSERT_FALSE(HttpAcceptsEncoding("deflate, x-gzip", "gzip"));
+  TEST_ASSERT_FALSE(HttpAcceptsEncoding(nullptr, "gzip"));
+}
+
+void test_http_request_keep_alive(void) {
+  TEST_ASSERT_TRUE(HttpKeepsAlive("HTTP/1.1", nullptr));
+  TEST_ASSERT_TRUE(HttpKeepsAlive("HTTP/1.1", "keep-alive"));
+  TEST_ASSERT_TRUE(HttpKeepsAlive("HTTP/1.1", "Upgrade, closed"));
+  TEST_ASSERT_FALSE(HttpKeepsAlive("HTTP/1.1", "close"));
+  TEST_ASSERT_FALSE(HttpKeepsAlive("HTTP/1.1", "TE, Close"));
+
+  TEST_ASSERT_FALSE(HttpKeepsAlive("HTTP/1.0", nullptr));
+  TEST_ASSERT_FALSE(HttpKeepsAlive("HTTP/1.0", "close"));
+  TEST_ASSERT_TRUE(HttpKeepsAlive("HTTP/1.0", "Keep-Alive"));
+}
@@ -0,0 +1,216 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_event_server.h"
+#include "http_router.h"
+#include "test_support.h"
+
+namespace {
+
+// Streams `remaining` bytes of 'x'
+class FillSource : public HttpBodySource {
+ public:
+  explicit FillSource(size_t size) : remaining_(size) {}
+  size_t Read(uint8_t* out, size_t size) override {
+    size_t n = std::min(size, remaining_);
+    memset(out, 'x', n);
+    remaining_ -= n;
+    return n;
+  }
+
+ private:
+  size_t remaining_;
+};
+
+// Answers with the route's name, the target it was given and its query
+void Echo(const HttpRequest& request, HttpResponse* response, void* name) {
+  std::string body = std::string((const char*)name) + " " + request.target() +
+                     " n=" + HttpQueryParam(request.target(), "n");
+  response->Begin("200 OK", "Content-Type: text/plain\r\n");
+  response->Print(body.c_str());
+}
+
+// A log file download: 64 KB, streamed as the socket drains
+void Download(const HttpRequest&, HttpResponse* response, void*) {
+  response->Begin("200 OK", "Content-Type: application/octet-stream\r\n");
+  response->Stream(std::unique_ptr<HttpBodySource>(new FillSource(65536)),
+                   65536);
+}
+
+// The firmware's routes, with the perf logger's under /logs
+void AddRoutes(HttpRouter* router) {
+  router->Add("GET", "/", Echo, (void*)"index");
+  router->Add("GET", "/api/status", Echo, (void*)"status");
+  router->Add("GET", "/api/status.bin", Echo, (void*)"status.bin");
+  router->Add("GET", "/api/logs", Echo, (void*)"logs");
+  router->Add("GET", "/api/history", Echo, (void*)"history");
+  router->Add("GET", "/api/config", Echo, (void*)"config");
+  router->Add("POST", "/api/config", Echo, (void*)"set config");
+  router->Add("GET", "/metrics", Echo, (void*)"metrics");
+  router->Add("GET", "/logs/", Echo, (void*)"log index");
+  router->Add("GET", "/logs/perf_*", Download, nullptr);
+  router->Add("GET", "/logs/range", Echo, (void*)"range");
+  router->Add("GET", "/logs/since", Echo, (void*)"since");
+}
+
+std::string Get(uint16_t port, const std::string& target) {
+  return Fetch(port, "GET " + target + " HTTP/1.1\r\nHost: x\r\n\r\n");
+}
+
+bool StartsWith(const std::string& text, const std::string& prefix) {
+  return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+struct Latency {
+  double p50_ms;
+  double p99_ms;
+};
+
+// `requests` fetches of `target`, one after the other
+Latency Measure(uint16_t port, const std::string& target, int requests,
+                const std::string& expected) {
+  std::vector<double> latencies;
+  for (int i = 0; i < requests; i++) {
+    auto start = std::chrono::steady_clock::now();
+    std::string body = Body(Get(port, target));
+    latencies.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), body.c_str());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return {latencies[latencies.size() / 2],
+          latencies[latencies.size() * 99 / 100]};
+}
+
+}  // namespace
+
+void test_http_router_routes(void) {
+  TEST_ASSERT_EQUAL(5, (int)HttpPathLength("/logs?from=1&to=2"));
+  TEST_ASSERT_EQUAL(5, (int)HttpPathLength("/logs"));
+  TEST_ASSERT_EQUAL_STRING(
+      "2", HttpQueryParam("/logs?from=1&to=2", "to").c_str());
+  TEST_ASSERT_EQUAL_STRING("", HttpQueryParam("/logs?tom=1", "to").c_str());
+  TEST_ASSERT_EQUAL_STRING("", HttpQueryParam("/logs?to", "to").c_str());
+  TEST_ASSERT_EQUAL_STRING("", HttpQueryParam("/logs?to=", "to").c_str());
+  TEST_ASSERT_EQUAL_STRING("", HttpQueryParam("/to=1", "to").c_str());
+
+  HttpRouter router;
+  AddRoutes(&router);
+  TEST_ASSERT_EQUAL(12, router.size());
+  HttpEventServer server(4, 1000, HttpRouter::Handle, &router, NowMs);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  ServerThread thread(&server);
+  uint16_t port = server.port();
+
+  // Exact paths, with the query left to the handler
+  TEST_ASSERT_EQUAL_STRING("index / n=", Body(Get(port, "/")).c_str());
+  TEST_ASSERT_EQUAL_STRING("status /api/status?n=3 n=3",
+                           Body(Get(port, "/api/status?n=3")).c_str());
+  TEST_ASSERT_EQUAL_STRING("status.bin /api/status.bin n=",
+                           Body(Get(port, "/api/status.bin")).c_str());
+  TEST_ASSERT_EQUAL_STRING(
+      "set config /api/config n=",
+      Body(Fetch(port, "POST /api/config HTTP/1.1\r\nContent-Length: 3\r\n"
+                       "\r\nn=1"))
+          .c_str());
+
+  // A prefix route, and the exact routes that share its prefix
+  std::string response = Get(port, "/logs/perf_raw_3.bin");
+  TEST_ASSERT_TRUE(StartsWith(response, "HTTP/1.1 200 OK\r\n"));
+  TEST_ASSERT_EQUAL(65536, (int)Body(response).size());
+  TEST_ASSERT_EQUAL_STRING("range /logs/range?n=2 n=2",
+                           Body(Get(port, "/logs/range?n=2")).c_str());
+
+  // GET routes answer HEAD without a body
+  response = Fetch(port, "HEAD /api/status HTTP/1.1\r\n\r\n");
+  TEST_ASSERT_TRUE(StartsWith(response, "HTTP/1.1 200 OK\r\n"));
+  TEST_ASSERT_EQUAL(0, (int)Body(response).size());
+
+  // Unknown paths, and known ones with the wrong method
+  response = Get(port, "/api/statusx");
+  TEST_ASSERT_TRUE(StartsWith(response, "HTTP/1.1 404 Not Found\r\n"));
+  TEST_ASSERT_EQUAL_STRING("Not Found\n", Body(response).c_str());
+  TEST_ASSERT_TRUE(StartsWith(Get(port, "/logs"), "HTTP/1.1 404"));
+  response = Fetch(port, "DELETE /api/config HTTP/1.1\r\n\r\n");
+  TEST_ASSERT_TRUE(
+      StartsWith(response, "HTTP/1.1 405 Method Not Allowed\r\n"));
+  TEST_ASSERT_TRUE(response.find("Allow: GET, HEAD, POST\r\n") !=
+                   std::string::npos);
+  response = Fetch(port, "POST /metrics HTTP/1.1\r\n\r\n");
+  TEST_ASSERT_TRUE(response.find("Allow: GET, HEAD\r\n") != std::string::npos);
+}
+
+void test_http_router_mount(void) {
+  HttpRouter router;
+  AddRoutes(&router);
+  HttpEventServer server(4, 1000, HttpRouter::Handle, &router, NowMs);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  TEST_ASSERT_TRUE(server.Listen(0, "/logs"));
+  ServerThread thread(&server);
+  uint16_t port = server.port(0);
+  uint16_t alias = server.port(1);
+  TEST_ASSERT_TRUE(port != alias);
+
+  // The alias port serves the /logs branch at its root
+  TEST_ASSERT_EQUAL_STRING("log index /logs/ n=",
+                           Body(Get(alias, "/")).c_str());
+  TEST_ASSERT_EQUAL_STRING("since /logs/since?n=9 n=9",
+                           Body(Get(alias, "/since?n=9")).c_str());
+  TEST_ASSERT_EQUAL(65536, (int)Body(Get(alias, "/perf_raw_0.bin")).size());
+  TEST_ASSERT_EQUAL_STRING("log index /logs/ n=",
+                           Body(Get(port, "/logs/")).c_str());
+
+  // ... and nothing outside it
+  TEST_ASSERT_TRUE(StartsWith(Get(alias, "/api/status"), "HTTP/1.1 404"));
+  TEST_ASSERT_EQUAL_STRING("status /api/status n=",
+                           Body(Get(port, "/api/status")).c_str());
+}
+
+void test_http_router_benchmark(void) {
+  const int kRequests = 300;
+  const int kDownloads = 20;
+
+  HttpRouter router;
+  AddRoutes(&router);
+  HttpEventServer server(4, 5000, HttpRouter::Handle, &router, NowMs);
+  TEST_ASSERT_TRUE(server.Listen(0));
+  TEST_ASSERT_TRUE(server.Listen(0, "/logs"));
+  ServerThread thread(&server);
+  uint16_t port = server.port(0);
+  uint16_t alias = server.port(1);
+
+  // Status polls on the main port, alone and while log files download from
+  // the alias port on the same loop
+  Latency idle =
+      Measure(port, "/api/status", kRequests, "status /api/status n=");
+  Latency alias_idle =
+      Measure(alias, "/since", kRequests, "since /logs/since n=");
+  std::atomic<int> downloaded{0};
+  std::thread downloads([&] {
+    for (int i = 0; i < kDownloads; i++) {
+      downloaded += Body(Get(alias, "/perf_raw_0.bin")).size() == 65536;
+    }
+  });
+  Latency busy =
+      Measure(port, "/api/status", kRequests, "status /api/status n=");
+  downloads.join();
+  TEST_ASSERT_EQUAL(kDownloads, downloaded.load());
+
+  char message[300];
+  snprintf(message, sizeof(message),
+           "one loop, two ports: /api/status p50 %.3f ms p99 %.3f ms; alias "
+           "port p50 %.3f ms p99 %.3f ms; /api/status during %d x 64 KB "
+           "downloads p50 %.3f ms p99 %.3f ms",
+           idle.p50_ms, idle.p99_ms, alias_idle.p50_ms, alias_idle.p99_ms,
+           kDownloads, busy.p50_ms, busy.p99_ms);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,392 @@
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "http_event_server.h"
+#include "json_writer.h"
+#include "status_json.h"
+
+// Counts heap allocations for the benchmark
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+  g_allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+bool AppendSink(const char* data, size_t size, void* context) {
+  ((std::string*)context)->append(data, size);
+  return true;
+}
+
+bool AppendToResponse(const char* data, size_t size, void* context) {
+  ((HttpResponse*)context)->Write(data, size);
+  return true;
+}
+
+// A full log buffer (50 lines, sequence numbers 1001-1050) and the default
+// topology's readings
+struct Status {
+  std::vector<std::string> logs;
+  std::vector<StatusSensorReading> sensors;
+  std::vector<StatusFanReading> fans;
+};
+
+const uint32_t kLogSeq = 1050;
+const uint32_t kBootId = 17;
+
+Status MakeStatus() {
+  Status status;
+  for (int i = 0; i < 50; i++) {
+    status.logs.push_back("[" + std::to_string(1000 + i) +
+                          "] Fan 3 duty cycle set to: 55.00% (\"manual\")");
+  }
+  status.logs[7] += "\r";  // Logged with a stray CR
+  status.sensors = {{"ambient", true, 24.46f},
+                    {"coolant_in", true, 31.25f},
+                    {"coolant_out", false, 0.0f}};
+  status.fans = {{40.0f, 1180}, {40.0f, 1175}, {55.5f, 2410}, {0.0f, 0}};
+  return status;
+}
+
+StatusDocument Document(const Status& status) {
+  StatusDocument document = {};
+  document.sensors = status.sensors.data();
+  document.sensor_count = status.sensors.size();
+  document.fans = status.fans.data();
+  document.fan_count = status.fans.size();
+  document.log_seq = status.logs.empty() ? 0 : kLogSeq;
+  document.boot_id = kBootId;
+  return document;
+}
+
+// Stand-in for the Arduino core's String: exact-fit buffers grown with
+// realloc on every append that does not fit, short strings stored inline,
+// and a temporary for each `+`
+class LegacyString {
+ public:
+  LegacyString() {}
+  LegacyString(const char* text) { Append(text, strlen(text)); }
+  LegacyString(const LegacyString& other) {
+    Append(other.data(), other.length_);
+  }
+  LegacyString(float value, int decimals) {
+    char text[24];
+    Append(text, snprintf(text, sizeof(text), "%.*f", decimals, value));
+  }
+  explicit LegacyString(int value) {
+    char text[16];
+    Append(text, snprintf(text, sizeof(text), "%d", value));
+  }
+  ~LegacyString() { free(heap_); }
+  LegacyString& operator=(const LegacyString&) = delete;
+
+  LegacyString& operator+=(const LegacyString& other) {
+    Append(other.data(), other.length_);
+    return *this;
+  }
+  LegacyString& operator+=(const char* text) {
+    Append(text, strlen(text));
+    return *this;
+  }
+  LegacyString& operator+=(char c) {
+    Append(&c, 1);
+    return *this;
+  }
+
+  void reserve(size_t size) {
+    if (size <= capacity_) return;
+    char* grown = (char*)realloc(heap_, size + 1);
+    g_allocations++;
+    if (heap_ == nullptr) memcpy(grown, inline_, length_ + 1);
+    heap_ = grown;
+    capacity_ = size;
+  }
+
+  // As WString::replace: one exact-fit reserve when growing, then in place
+  void replace(const char* find, const char* with) {
+    size_t find_length = strlen(find);
+    size_t with_length = strlen(with);
+    size_t count = 0;
+    for (const char* p = strstr(data(), find); p != nullptr;
+         p = strstr(p + find_length, find)) {
+      count++;
+    }
+    if (count == 0) return;
+    std::string out;  // The core shifts in place; the result is the same
+    const char* p = data();
+    for (const char* hit = strstr(p, find); hit != nullptr;
+         hit = strstr(p, find)) {
+      out.append(p, hit - p).append(with, with_length);
+      p = hit + find_length;
+    }
+    out.append(p);
+    if (out.size() > length_) reserve(out.size());
+    memcpy(buffer(), out.c_str(), out.size() + 1);
+    length_ = out.size();
+  }
+
+  const char* c_str() const { return data(); }
+  size_t length() const { return length_; }
+
+ private:
+  static constexpr size_t kInlineCapacity = 11;
+
+  const char* data() const { return heap_ != nullptr ? heap_ : inline_; }
+  char* buffer() { return heap_ != nullptr ? heap_ : inline_; }
+
+  void Append(const char* text, size_t size) {
+    reserve(length_ + size);
+    memcpy(buffer() + length_, text, size);
+    length_ += size;
+    buffer()[length_] = '\0';
+  }
+
+  char inline_[kInlineCapacity + 1] = {};
+  char* heap_ = nullptr;
+  size_t length_ = 0;
+  size_t capacity_ = kInlineCapacity;
+};
+
+LegacyString operator+(const LegacyString& a, const LegacyString& b) {
+  LegacyString sum(a);
+  sum += b;
+  return sum;
+}
+
+// serveJSONStatus as it was: String concatenation, with a copy of the whole
+// log buffer (Logger::get()) escaped by replace passes, embedded in every
+// response
+std::string LegacyStatusJson(const Status& status) {
+  LegacyString json = "{";
+  json += "\"thermistors\":[";
+  for (size_t i = 0; i < status.sensors.size(); i++) {
+    if (i > 0) json += ",";
+    json += "{";
+    json += "\"id\":\"" + LegacyString(status.sensors[i].id) + "\",";
+    if (status.sensors[i].ok) {
+      json += "\"temp\":\"" + LegacyString(status.sensors[i].temp, 1) + "\"";
+    } else {
+      json += "\"temp\":\"ERR\"";
+    }
+    json += "}";
+  }
+  json += "],";
+
+  json += "\"fans\":[";
+  for (size_t i = 0; i < status.fans.size(); i++) {
+    if (i > 0) json += ",";
+    json += "{";
+    json += "\"duty\":\"" + LegacyString(status.fans[i].duty, 1) + "\",";
+    json += "\"rpm\":\"" + LegacyString((int)status.fans[i].rpm) + "\"";
+    json += "}";
+  }
+  json += "],";
+
+  // Logger::get() copied every line out of the log buffer
+  LegacyString logs;
+  logs.reserve(256);
+  for (size_t i = 0; i < status.logs.size(); i++) {
+    logs += status.logs[i].c_str();
+    if (i + 1 < status.logs.size()) logs += '\n';
+  }
+  logs.replace("\"", "\\\"");
+  logs.replace("\n", "\\n");
+  logs.replace("\r", "");
+  json += "\"logs\":\"" + logs + "\",";
+  json += "\"overrideEnabled\":false";
+  json += "}";
+  return std::string(json.c_str(), json.length());
+}
+
+void LegacyStatus(const Status& status, HttpResponse* response) {
+  std::string json = LegacyStatusJson(status);
+  response->Begin("200 OK", "Content-Type: application/json\r\n");
+  response->Write(json.c_str(), json.length());
+}
+
+// serveJSONStatus now
+void StreamedStatus(const Status& status, HttpResponse* response) {
+  response->Begin("200 OK", "Content-Type: application/json\r\n");
+  char buffer[256];
+  JsonWriter json(buffer, sizeof(buffer), AppendToResponse, response);
+  WriteStatusJson(Document(status), &json);
+  json.Flush();
+}
+
+struct Cost {
+  double us;
+  double allocations;
+};
+
+Cost Measure(void (*serve)(const Status&, HttpResponse*),
+             const Status& status, int iterations) {
+  size_t allocations = g_allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    HttpResponse response;
+    serve(status, &response);
+  }
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  return {us / iterations,
+          (double)(g_allocations - allocations) / iterations};
+}
+
+}  // namespace
+
+void test_json_writer_output(void) {
+  std::string out;
+  char buffer[5];  // Flushed mid-token
+  JsonWriter json(buffer, sizeof(buffer), AppendSink, &out);
+  json.BeginObject();
+  json.Key("a");
+  json.BeginArray();
+  json.Int(-12);
+  json.Bool(true);
+  json.Null();
+  json.BeginObject();
+  json.EndObject();
+  json.BeginArray();
+  json.EndArray();
+  json.Float(2.345, 2);
+  json.Float(1.0 / 0.0, 1);
+  json.EndArray();
+  json.Key("s");
+  json.String("q\"b\\n\n\r\t\x01\x1f end");
+  json.Key("parts");
+  json.BeginString();
+  json.StringPart("ab", 2);
+  json.StringPart("\"", 1);
+  json.EndString();
+  json.EndObject();
+  TEST_ASSERT_TRUE(json.Flush());
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"a\":[-12,true,null,{},[],2.35,null],"
+      "\"s\":\"q\\\"b\\\\n\\n\\r\\t\\u0001\\u001f end\","
+      "\"parts\":\"ab\\\"\"}",
+      out.c_str());
+  TEST_ASSERT_EQUAL_UINT32(out.size(), json.size());
+
+  // A refusing sink stops the writer
+  JsonWriter refused(buffer, sizeof(buffer),
+                     [](const char*, size_t, void*) { return false; },
+                     nullptr);
+  refused.String("more than five bytes");
+  TEST_ASSERT_FALSE(refused.ok());
+  TEST_ASSERT_FALSE(refused.Flush());
+}
+
+void test_json_writer_status_schema(void) {
+  Status status = MakeStatus();
+
+  // Byte for byte what the String version produced, through a buffer
+  // smaller than the document, but for the log: only its newest number
+  std::string expected = LegacyStatusJson(status);
+  size_t logs = expected.find("\"logs\":\"");
+  size_t end = expected.find("\",\"overrideEnabled\"");
+  expected.replace(logs, end + 2 - logs,
+                   "\"logSeq\":" + std::to_string(kLogSeq) +
+                       ",\"bootId\":17,");
+  std::string streamed;
+  char buffer[64];
+  JsonWriter json(buffer, sizeof(buffer), AppendSink, &streamed);
+  WriteStatusJson(Document(status), &json);
+  TEST_ASSERT_TRUE(json.Flush());
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), streamed.c_str());
+
+  // Empty
+  Status empty;
+  streamed.clear();
+  StatusDocument document = Document(empty);
+  document.override_enabled = true;
+  WriteStatusJson(document, &json);
+  json.Flush();
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"thermistors\":[],\"fans\":[],\"logSeq\":0,\"bootId\":17,"
+      "\"overrideEnabled\":true}",
+      streamed.c_str());
+}
+
+void test_json_writer_log_lines(void) {
+  Status status = MakeStatus();
+  char buffer[64];
+  std::string out;
+  JsonWriter json(buffer, sizeof(buffer), AppendSink, &out);
+
+  // As Logger::forEachAfter(1047, ...) visits them
+  LogLinesJson lines;
+  BeginLogLinesJson(&lines, &json, 1047, kBootId);
+  for (uint32_t seq = 1048; seq <= kLogSeq; seq++) {
+    const std::string& line = status.logs[seq - 1001];
+    AddLogLineJson(seq, line.data(), line.size(), &lines);
+  }
+  EndLogLinesJson(&lines);
+  json.Flush();
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"lines\":[\"[1047] Fan 3 duty cycle set to: 55.00% (\\\"manual\\\")\","
+      "\"[1048] Fan 3 duty cycle set to: 55.00% (\\\"manual\\\")\","
+      "\"[1049] Fan 3 duty cycle set to: 55.00% (\\\"manual\\\")\"],"
+      "\"first\":1048,\"seq\":1050,\"bootId\":17}",
+      out.c_str());
+
+  // Nothing new: the cursor stays
+  out.clear();
+  BeginLogLinesJson(&lines, &json, kLogSeq, kBootId);
+  EndLogLinesJson(&lines);
+  json.Flush();
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"lines\":[],\"first\":1051,\"seq\":1050,\"bootId\":17}",
+      out.c_str());
+
+  // A stray CR is escaped, not dropped
+  out.clear();
+  BeginLogLinesJson(&lines, &json, 0, kBootId);
+  AddLogLineJson(1008, status.logs[7].data(), status.logs[7].size(), &lines);
+  EndLogLinesJson(&lines);
+  json.Flush();
+  TEST_ASSERT_TRUE(out.find("(\\\"manual\\\")\\r\"],\"first\":1008,") !=
+                   std::string::npos);
+}
+
+void test_json_writer_benchmark(void) {
+  Status status = MakeStatus();
+  const int kIterations = 2000;
+
+  Measure(LegacyStatus, status, 100);  // Warm up
+  Cost before = Measure(LegacyStatus, status, kIterations);
+  Cost after = Measure(StreamedStatus, status, kIterations);
+
+  TEST_ASSERT_TRUE(after.allocations < before.allocations / 4);
+
+  std::string streamed;
+  char buffer[256];
+  JsonWriter json(buffer, sizeof(buffer), AppendSink, &streamed);
+  WriteStatusJson(Document(status), &json);
+  json.Flush();
+
+  char message[240];
+  snprintf(message, sizeof(message),
+           "/api/status: String concatenation with 50 log lines %u bytes, "
+           "%.1f allocations, %.2f us; JsonWriter with logSeq %u bytes, "
+           "%.1f allocations, %.2f us",
+           (unsigned)LegacyStatusJson(status).size(), before.allocations,
+           before.us, (unsigned)streamed.size(), after.allocations,
+           after.us);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,195 @@
+#include <unity.h>
+
+// Forward declarations of test functions
+void test_controller_config_defaults_valid(void);
+void test_controller_config_validation(void);
+void test_controller_config_set_field(void);
+void test_controller_config_fan_speed(void);
+void test_controller_config_concurrent_updates(void);
+
+void test_topology_parse(void);
+void test_topology_parse_errors(void);
+void test_topology_aggregation(void);
+void test_topology_channel_hash(void);
+
+void test_fan_bank_ramp_converges(void);
+void test_fan_bank_tach_debounce(void);
+void test_fan_bank_matches_legacy(void);
+void test_fan_bank_benchmark(void);
+
+void test_perf_log_format_round_trip(void);
+void test_perf_log_format_forward_compatible(void);
+void test_perf_log_format_schema(void);
+void test_perf_log_format_untimed_blocks(void);
+void test_perf_log_format_recovery(void);
+void test_perf_log_format_legacy(void);
+void test_perf_log_block_round_trip(void);
+void test_perf_log_block_benchmark(void);
+void test_perf_log_write_benchmark(void);
+
+void test_perf_log_rollup_min_max_mean(void);
+void test_perf_log_rollup_gaps(void);
+
+void test_perf_log_catalog_boot_scan(void);
+void test_perf_log_catalog_budget(void);
+
+void test_perf_log_query_range(void);
+void test_perf_log_query_channels_and_legacy(void);
+void test_perf_log_query_since(void);
+void test_perf_log_query_cursors(void);
+
+void test_flight_ring_window(void);
+void test_flight_ring_bounded(void);
+void test_flight_trigger_detector(void);
+
+void test_http_request_parse(void);
+void test_http_request_range(void);
+void test_http_request_negotiation(void);
+void test_http_request_keep_alive(void);
+
+void test_perf_log_stream_slices(void);
+void test_perf_log_stream_benchmark(void);
+
+void test_http_event_server_requests(void);
+void test_http_event_server_benchmark(void);
+void test_http_event_server_events(void);
+void test_http_event_server_push_benchmark(void);
+void test_http_event_server_keep_alive(void);
+void test_http_event_server_keep_alive_benchmark(void);
+void test_http_router_routes(void);
+void test_http_router_mount(void);
+void test_http_router_benchmark(void);
+
+void test_static_assets_table(void);
+void test_static_assets_benchmark(void);
+
+void test_json_writer_output(void);
+void test_json_writer_status_schema(void);
+void test_json_writer_log_lines(void);
+void test_json_writer_benchmark(void);
+void test_status_history_ring(void);
+void test_status_history_reduce(void);
+void test_status_history_json(void);
+void test_status_history_benchmark(void);
+void test_status_binary_round_trip(void);
+void test_status_binary_layout(void);
+void test_status_binary_compatibility(void);
+void test_status_binary_benchmark(void);
+void test_metrics_writer_format(void);
+void test_metrics_writer_truncation(void);
+void test_metrics_writer_cache(void);
+void test_metrics_writer_benchmark(void);
+
+void setUp(void) {
+  // Global setup if needed
+}
+
+void tearDown(void) {
+  // Global teardown if needed
+}
+
+int main() {
+  UNITY_BEGIN();
+
+  // Controller Config Tests
+  RUN_TEST(test_controller_config_defaults_valid);
+  RUN_TEST(test_controller_config_validation);
+  RUN_TEST(test_controller_config_set_field);
+  RUN_TEST(test_controller_config_fan_speed);
+  RUN_TEST(test_controller_config_concurrent_updates);
+
+  // Topology Tests
+  RUN_TEST(test_topology_parse);
+  RUN_TEST(test_topology_parse_errors);
+  RUN_TEST(test_topology_aggregation);
+  RUN_TEST(test_topology_channel_hash);
+
+  // Fan Bank Tests
+  RUN_TEST(test_fan_bank_ramp_converges);
+  RUN_TEST(test_fan_bank_tach_debounce);
+  RUN_TEST(test_fan_bank_matches_legacy);
+  RUN_TEST(test_fan_bank_benchmark);
+
+  // Perf Log Format Tests
+  RUN_TEST(test_perf_log_format_round_trip);
+  RUN_TEST(test_perf_log_format_forward_compatible);
+  RUN_TEST(test_perf_log_format_schema);
+  RUN_TEST(test_perf_log_format_untimed_blocks);
+  RUN_TEST(test_perf_log_format_recovery);
+  RUN_TEST(test_perf_log_format_legacy);
+  RUN_TEST(test_perf_log_block_round_trip);
+  RUN_TEST(test_perf_log_block_benchmark);
+  RUN_TEST(test_perf_log_write_benchmark);
+
+  // Perf Log Rollup Tests
+  RUN_TEST(test_perf_log_rollup_min_max_mean);
+  RUN_TEST(test_perf_log_rollup_gaps);
+
+  // Perf Log Catalog Tests
+  RUN_TEST(test_perf_log_catalog_boot_scan);
+  RUN_TEST(test_perf_log_catalog_budget);
+
+  // Perf Log Query Tests
+  RUN_TEST(test_perf_log_query_range);
+  RUN_TEST(test_perf_log_query_channels_and_legacy);
+  RUN_TEST(test_perf_log_query_since);
+  RUN_TEST(test_perf_log_query_cursors);
+
+  // Flight Recorder Tests
+  RUN_TEST(test_flight_ring_window);
+  RUN_TEST(test_flight_ring_bounded);
+  RUN_TEST(test_flight_trigger_detector);
+
+  // HTTP Request Tests
+  RUN_TEST(test_http_request_parse);
+  RUN_TEST(test_http_request_range);
+  RUN_TEST(test_http_request_negotiation);
+  RUN_TEST(test_http_request_keep_alive);
+
+  // Perf Log Stream Tests
+  RUN_TEST(test_perf_log_stream_slices);
+  RUN_TEST(test_perf_log_stream_benchmark);
+
+  // HTTP Event Server Tests
+  RUN_TEST(test_http_event_server_requests);
+  RUN_TEST(test_http_event_server_benchmark);
+  RUN_TEST(test_http_event_server_events);
+  RUN_TEST(test_http_event_server_push_benchmark);
+  RUN_TEST(test_http_event_server_keep_alive);
+  RUN_TEST(test_http_event_server_keep_alive_benchmark);
+
+  // HTTP Router Tests
+  RUN_TEST(test_http_router_routes);
+  RUN_TEST(test_http_router_mount);
+  RUN_TEST(test_http_router_benchmark);
+
+  // Static Asset Tests
+  RUN_TEST(test_static_assets_table);
+  RUN_TEST(test_static_assets_benchmark);
+
+  // JSON Writer Tests
+  RUN_TEST(test_json_writer_output);
+  RUN_TEST(test_json_writer_status_schema);
+  RUN_TEST(test_json_writer_log_lines);
+  RUN_TEST(test_json_writer_benchmark);
+
+  // Status History Tests
+  RUN_TEST(test_status_history_ring);
+  RUN_TEST(test_status_history_reduce);
+  RUN_TEST(test_status_history_json);
+  RUN_TEST(test_status_history_benchmark);
+
+  // Status Binary Tests
+  RUN_TEST(test_status_binary_round_trip);
+  RUN_TEST(test_status_binary_layout);
+  RUN_TEST(test_status_binary_compatibility);
+  RUN_TEST(test_status_binary_benchmark);
+
+  // Metrics Writer Tests
+  RUN_TEST(test_metrics_writer_format);
+  RUN_TEST(test_metrics_writer_truncation);
+  RUN_TEST(test_metrics_writer_cache);
+  RUN_TEST(test_metrics_writer_benchmark);
+
+  return UNITY_END();
+}
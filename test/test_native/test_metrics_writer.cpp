@@ -0,0 +1,168 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "metrics_writer.h"
+
+namespace {
+
+// A /metrics body the size of the firmware's with the default topology
+void RenderExample(MetricsWriter* metrics, void* context) {
+  int* renders = (int*)context;
+  (*renders)++;
+  const char* fans[] = {"fan1", "fan2", "fan3", "pump"};
+  const char* sensors[] = {"ambient", "coolant_in", "coolant_out"};
+  metrics->Family("fan_controller_fan_duty_percent", "gauge",
+                  "Applied PWM duty cycle");
+  for (int i = 0; i < 4; i++) {
+    metrics->Sample("fan_controller_fan_duty_percent", "fan", fans[i],
+                    40.0 + i * 5.5);
+  }
+  metrics->Family("fan_controller_fan_rpm", "gauge", "Tachometer speed");
+  for (int i = 0; i < 4; i++) {
+    metrics->Sample("fan_controller_fan_rpm", "fan", fans[i],
+                    (int64_t)(1180 + i * 410));
+  }
+  metrics->Family("fan_controller_temperature_celsius", "gauge",
+                  "Sampled sensor temperature");
+  for (int i = 0; i < 3; i++) {
+    metrics->Sample("fan_controller_temperature_celsius", "sensor",
+                    sensors[i], 24.46 + i * 3.4);
+  }
+  metrics->Family("fan_controller_sensor_errors_total", "counter",
+                  "Failed sensor readings");
+  for (int i = 0; i < 3; i++) {
+    metrics->Sample("fan_controller_sensor_errors_total", "sensor",
+                    sensors[i], (int64_t)i);
+  }
+  const char* counters[] = {"ticks", "perf_log_records", "perf_log_flushes",
+                            "perf_log_bytes_written", "http_requests",
+                            "http_connections"};
+  for (const char* counter : counters) {
+    char name[64];
+    snprintf(name, sizeof(name), "fan_controller_%s_total", counter);
+    metrics->Family(name, "counter", "A counter");
+    metrics->Sample(name, (int64_t)86400);
+  }
+}
+
+}  // namespace
+
+void test_metrics_writer_format(void) {
+  char buffer[512];
+  MetricsWriter metrics(buffer, sizeof(buffer));
+  metrics.Family("fan_rpm", "gauge", "Tachometer speed");
+  metrics.Sample("fan_rpm", "fan", "Fan1", (int64_t)1180);
+  metrics.Sample("fan_rpm", "fan", "a\\b\"c\nd", (int64_t)-1);
+  metrics.Sample("temp", 24.46f);
+  metrics.Sample("ratio", 0.1);
+  metrics.Sample("bytes_total", (int64_t)1 << 40);
+  metrics.Sample("missing", NAN);
+  metrics.Sample("limit", -INFINITY);
+  TEST_ASSERT_TRUE(metrics.ok());
+  TEST_ASSERT_EQUAL_STRING(
+      "# HELP fan_rpm Tachometer speed\n"
+      "# TYPE fan_rpm gauge\n"
+      "fan_rpm{fan=\"Fan1\"} 1180\n"
+      "fan_rpm{fan=\"a\\\\b\\\"c\\nd\"} -1\n"
+      "temp 24.46\n"
+      "ratio 0.1\n"
+      "bytes_total 1099511627776\n"
+      "missing NaN\n"
+      "limit -Inf\n",
+      std::string(metrics.data(), metrics.size()).c_str());
+}
+
+void test_metrics_writer_truncation(void) {
+  // Room for the family and one sample, but not a second one
+  char buffer[64];
+  MetricsWriter metrics(buffer, sizeof(buffer));
+  metrics.Family("rpm", "gauge", "Speed");
+  metrics.Sample("rpm", "fan", "fan1", (int64_t)1180);
+  metrics.Sample("rpm", "fan", "fan2", (int64_t)1175);
+  metrics.Sample("x", (int64_t)1);  // Would fit, but comes after a cut
+  TEST_ASSERT_FALSE(metrics.ok());
+  TEST_ASSERT_EQUAL_STRING(
+      "# HELP rpm Speed\n# TYPE rpm gauge\nrpm{fan=\"fan1\"} 1180\n",
+      std::string(metrics.data(), metrics.size()).c_str());
+
+  int renders = 0;
+  MetricsCache cache(buffer, sizeof(buffer));
+  size_t size;
+  TEST_ASSERT_NULL(cache.Get(1, RenderExample, &renders, &size));
+  TEST_ASSERT_NULL(cache.Get(1, RenderExample, &renders, &size));
+  TEST_ASSERT_EQUAL_INT(1, renders);
+}
+
+void test_metrics_writer_cache(void) {
+  char buffer[4096];
+  MetricsCache cache(buffer, sizeof(buffer));
+  int renders = 0;
+  size_t size;
+  const char* body = cache.Get(7, RenderExample, &renders, &size);
+  TEST_ASSERT_NOT_NULL(body);
+  TEST_ASSERT_EQUAL_INT(1, renders);
+  std::string first(body, size);
+
+  // Same tick: the cached body; a new tick or Invalidate(): rendered again
+  TEST_ASSERT_TRUE(body == cache.Get(7, RenderExample, &renders, &size));
+  TEST_ASSERT_EQUAL_INT(1, renders);
+  TEST_ASSERT_EQUAL_UINT(first.size(), size);
+  cache.Get(8, RenderExample, &renders, &size);
+  TEST_ASSERT_EQUAL_INT(2, renders);
+  cache.Invalidate();
+  cache.Get(8, RenderExample, &renders, &size);
+  TEST_ASSERT_EQUAL_INT(3, renders);
+  TEST_ASSERT_EQUAL_UINT32(3, cache.renders());
+  TEST_ASSERT_EQUAL_STRING(first.c_str(), std::string(buffer, size).c_str());
+}
+
+void test_metrics_writer_benchmark(void) {
+  // 4 scrapers, every 2 s for a minute, against a 1 s control tick
+  const int kScrapes = 120;
+  const int kTicks = 60;
+  const int kRounds = 200;
+  char buffer[4096];
+  size_t size = 0;
+
+  int uncached_renders = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < kScrapes; i++) {
+      MetricsWriter metrics(buffer, sizeof(buffer));
+      RenderExample(&metrics, &uncached_renders);
+      size = metrics.size();
+    }
+  }
+  double uncached_us = std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - start)
+                           .count() /
+                       kRounds;
+
+  int cached_renders = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    MetricsCache cache(buffer, sizeof(buffer));
+    for (int i = 0; i < kScrapes; i++) {
+      uint32_t tick = (uint32_t)(i * kTicks / kScrapes);
+      TEST_ASSERT_NOT_NULL(cache.Get(tick, RenderExample, &cached_renders,
+                                     &size));
+    }
+  }
+  double cached_us = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - start)
+                         .count() /
+                     kRounds;
+  TEST_ASSERT_EQUAL_INT(kTicks * kRounds, cached_renders);
+
+  char message[200];
+  snprintf(message, sizeof(message),
+           "metrics: %d scrapes over %d ticks (%u byte body): %d renders "
+           "in %.1f us uncached, %d in %.1f us cached",
+           kScrapes, kTicks, (unsigned)size, uncached_renders / kRounds,
+           uncached_us, cached_renders / kRounds, cached_us);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,82 @@
+#include <unity.h>
+
+#include "perf_log_catalog.h"
+
+namespace {
+
+PerfLogSegment MakeSegment(int index, uint32_t bytes) {
+  PerfLogSegment segment = {};
+  segment.index = index;
+  segment.bytes = bytes;
+  return segment;
+}
+
+}  // namespace
+
+void test_perf_log_catalog_boot_scan(void) {
+  PerfLogCatalog catalog(4096);
+
+  // Directory order is arbitrary
+  catalog.Add(MakeSegment(7, 4000));
+  catalog.Add(MakeSegment(5, 100));
+  catalog.Add(MakeSegment(6, 4097));
+  catalog.Sort();
+
+  TEST_ASSERT_EQUAL(3, (int)catalog.size());
+  TEST_ASSERT_EQUAL(5, catalog.at(0).index);
+  TEST_ASSERT_EQUAL(7, catalog.newest()->index);
+  // Whole blocks: 1 + 2 + 1
+  TEST_ASSERT_TRUE(catalog.allocated_bytes() == 4 * 4096);
+
+  // New files continue after the newest one
+  PerfLogSegment* segment = catalog.AppendNext();
+  TEST_ASSERT_EQUAL(8, segment->index);
+  TEST_ASSERT_EQUAL_UINT32(0, segment->bytes);
+  catalog.GrowNewest(36, 1000);
+  catalog.GrowNewest(200, 5000);
+  TEST_ASSERT_EQUAL_UINT32(236, catalog.newest()->bytes);
+  TEST_ASSERT_TRUE(catalog.newest()->end_uptime_ms == 5000);
+  TEST_ASSERT_TRUE(catalog.allocated_bytes() == 5 * 4096);
+
+  // Blocks are indexed at the end of the file as it was before them
+  catalog.AddBlockToNewest(300, 64, 6000, 70000);
+  TEST_ASSERT_EQUAL(1, (int)catalog.newest()->blocks.size());
+  TEST_ASSERT_EQUAL_UINT32(64, catalog.newest()->records);
+  TEST_ASSERT_EQUAL_UINT32(236, catalog.newest()->blocks[0].offset);
+  TEST_ASSERT_EQUAL_UINT32(6000, catalog.newest()->blocks[0].first_offset_ms);
+  TEST_ASSERT_EQUAL_UINT32(536, catalog.newest()->bytes);
+  TEST_ASSERT_TRUE(catalog.newest()->end_uptime_ms == 70000);
+
+  // Recovery can drop the newest file; its index is reused
+  catalog.PopNewest();
+  TEST_ASSERT_EQUAL(7, catalog.newest()->index);
+  TEST_ASSERT_TRUE(catalog.allocated_bytes() == 4 * 4096);
+  TEST_ASSERT_EQUAL(8, catalog.AppendNext()->index);
+
+  // An empty catalog starts at index 0
+  PerfLogCatalog empty;
+  TEST_ASSERT_NULL(empty.newest());
+  TEST_ASSERT_EQUAL(0, empty.AppendNext()->index);
+}
+
+void test_perf_log_catalog_budget(void) {
+  PerfLogCatalog catalog(4096);
+  for (int i = 0; i < 10; i++) catalog.Add(MakeSegment(i, 4096));
+
+  // Room for the current files plus one more within 6 blocks
+  PerfLogSegment evicted;
+  int evictions = 0;
+  while (catalog.PopOldestOver(6 * 4096, 4096, &evicted)) {
+    TEST_ASSERT_EQUAL(evictions, evicted.index);
+    evictions++;
+  }
+  TEST_ASSERT_EQUAL(5, evictions);
+  TEST_ASSERT_EQUAL(5, (int)catalog.size());
+  TEST_ASSERT_EQUAL(5, catalog.at(0).index);
+
+  // The newest file is never evicted, even over budget
+  while (catalog.PopOldestOver(0, 4096, &evicted)) {
+  }
+  TEST_ASSERT_EQUAL(1, (int)catalog.size());
+  TEST_ASSERT_EQUAL(9, catalog.newest()->index);
+}
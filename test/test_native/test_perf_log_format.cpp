@@ -0,0 +1,505 @@
+#include <unistd.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "perf_log_format.h"
+
+namespace {
+
+void Append(std::vector<uint8_t>* file, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  file->insert(file->end(), bytes, bytes + size);
+}
+
+PerfLogRecord MakeRecord(uint16_t delta_ms, uint16_t rpm) {
+  PerfLogRecord record;
+  memset(&record, 0, sizeof(record));
+  record.delta_ms = delta_ms;
+  record.fan1_rpm = rpm;
+  return record;
+}
+
+// A slowly drifting capture like the controller produces: 1 s samples with
+// occasional jitter, temperatures and duties that creep, and RPMs that are
+// measured in whole tach pulses per second (multiples of 30 RPM)
+std::vector<PerfLogRecord> SyntheticCapture(int count) {
+  std::vector<PerfLogRecord> records;
+  uint32_t seed = 12345;
+  auto noise = [&seed](int range) {
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) % (2 * range + 1)) - range;
+  };
+  for (int i = 0; i < count; i++) {
+    double t = i / 600.0;
+    uint8_t duty = (uint8_t)(150 + 60 * sin(t));
+    PerfLogRecord record = MakeRecord(i == 0 ? 0 : 1000 + noise(1) * 2, 0);
+    record.fan1_target_duty = record.fan2_target_duty = duty;
+    record.fan3_target_duty = duty;
+    record.fan1_current_duty = record.fan2_current_duty = duty;
+    record.fan3_current_duty = duty;
+    record.fan4_target_duty = record.fan4_current_duty = 255;
+    record.fan1_rpm = (900 + duty * 3 + noise(15)) / 30 * 30;
+    record.fan2_rpm = (920 + duty * 3 + noise(15)) / 30 * 30;
+    record.fan3_rpm = (880 + duty * 3 + noise(15)) / 30 * 30;
+    record.fan4_rpm = (2400 + noise(30)) / 30 * 30;
+    record.temp_ambient = 80;
+    record.temp_coolant_in = (uint8_t)(120 + 20 * sin(t) + noise(1) * 0.5);
+    record.temp_coolant_out = (uint8_t)(126 + 20 * sin(t));
+    records.push_back(record);
+  }
+  return records;
+}
+
+// Records of a captured log file (any version), or empty if unreadable
+std::vector<PerfLogRecord> LoadCapture(const char* path) {
+  std::vector<PerfLogRecord> records;
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) return records;
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  fclose(f);
+
+  PerfLogReader reader;
+  if (reader.Open(data.data(), data.size()) != nullptr) return records;
+  PerfLogSample sample;
+  while (reader.Next(&sample)) records.push_back(sample.record);
+  return records;
+}
+
+}  // namespace
+
+void test_perf_log_format_round_trip(void) {
+  // Start past the point where the old uint16_t seconds counter wrapped
+  const uint64_t kStartMs = 20ULL * 3600 * 1000;
+  const int64_t kWallMs = 1700000000000LL;
+
+  std::vector<uint8_t> file;
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 7, 1000, kStartMs, kWallMs);
+  header.version = kPerfLogRawVersion;
+  Append(&file, &header, sizeof(header));
+  const uint16_t kDeltas[] = {0, 1000, 1003, 65535};
+  for (int i = 0; i < 4; i++) {
+    PerfLogRecord record = MakeRecord(kDeltas[i], 1000 + i);
+    Append(&file, &record, sizeof(record));
+  }
+
+  PerfLogReader reader;
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  TEST_ASSERT_EQUAL_UINT16(kPerfLogRawVersion, reader.header().version);
+  TEST_ASSERT_EQUAL_UINT32(7, reader.header().boot_id);
+  TEST_ASSERT_EQUAL_UINT32(1000, reader.header().sample_interval_ms);
+
+  PerfLogSample sample;
+  uint64_t expected_ms = kStartMs;
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(reader.Next(&sample));
+    expected_ms += kDeltas[i];
+    TEST_ASSERT_TRUE(sample.uptime_ms == expected_ms);
+    TEST_ASSERT_TRUE(sample.wall_clock_ms ==
+                     kWallMs + (int64_t)(expected_ms - kStartMs));
+    TEST_ASSERT_EQUAL_UINT16(1000 + i, sample.record.fan1_rpm);
+  }
+  TEST_ASSERT_FALSE(reader.Next(&sample));
+  TEST_ASSERT_FALSE(reader.truncated());
+
+  // A torn final record is ignored and reported
+  file.resize(file.size() - 5);
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  for (int i = 0; i < 3; i++) TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_FALSE(reader.Next(&sample));
+  TEST_ASSERT_TRUE(reader.truncated());
+}
+
+void test_perf_log_format_forward_compatible(void) {
+  // A newer writer with a longer header and longer records
+  std::vector<uint8_t> file;
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 1, 1000, 5000, 0);
+  header.version = kPerfLogRawVersion;
+  header.header_size = sizeof(header) + 4;
+  header.record_size = sizeof(PerfLogRecord) + 2;
+  Append(&file, &header, sizeof(header));
+  const uint8_t kPadding[4] = {0xAA, 0xAA, 0xAA, 0xAA};
+  Append(&file, kPadding, 4);
+  for (int i = 0; i < 2; i++) {
+    PerfLogRecord record = MakeRecord(i == 0 ? 0 : 1000, 42);
+    Append(&file, &record, sizeof(record));
+    Append(&file, kPadding, 2);
+  }
+
+  PerfLogReader reader;
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  PerfLogSample sample;
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_TRUE(sample.uptime_ms == 5000);
+  TEST_ASSERT_TRUE(sample.wall_clock_ms == 0);
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_TRUE(sample.uptime_ms == 6000);
+  TEST_ASSERT_EQUAL_UINT16(42, sample.record.fan1_rpm);
+  TEST_ASSERT_FALSE(reader.Next(&sample));
+
+  // Unknown schemas and truncated headers are rejected
+  PerfLogFileHeader* h = (PerfLogFileHeader*)file.data();
+  h->schema_id = 99;
+  TEST_ASSERT_NOT_NULL(reader.Open(file.data(), file.size()));
+  TEST_ASSERT_NOT_NULL(reader.Open(file.data(), 6));
+}
+
+void test_perf_log_format_schema(void) {
+  // The channel list generates the record layout
+  size_t channel_bytes = 0;
+  for (const PerfLogChannelInfo& channel : kPerfLogChannels) {
+    channel_bytes += channel.size;
+  }
+  TEST_ASSERT_EQUAL(sizeof(PerfLogRecord) - sizeof(uint16_t), channel_bytes);
+  TEST_ASSERT_EQUAL(4, PerfLogInstanceCount(kPerfLogFanRpm));
+  TEST_ASSERT_EQUAL(3, PerfLogInstanceCount(kPerfLogTemperature));
+  PerfLogRecord record = MakeRecord(0, 1234);
+  record.temp_coolant_out = 200;
+  int32_t channels[kPerfLogChannelCount];
+  PerfLogRecordToChannels(record, channels);
+  TEST_ASSERT_EQUAL_STRING("Fan1_RPM", kPerfLogChannels[2].name);
+  TEST_ASSERT_EQUAL(1234, channels[2]);
+  TEST_ASSERT_EQUAL(200, channels[kPerfLogChannelCount - 1]);
+
+  // Files describe their channels after the fixed header
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 1, 1000, 5000, 0);
+  header.first_seq = 42;
+  std::vector<uint8_t> file(kPerfLogEncodedHeaderSize);
+  TEST_ASSERT_EQUAL(kPerfLogEncodedHeaderSize,
+                    EncodePerfLogHeader(&header, file.data()));
+  const uint8_t* schema = file.data() + sizeof(header);
+  TEST_ASSERT_EQUAL(kPerfLogChannelCount, schema[0]);
+  TEST_ASSERT_EQUAL_UINT8(1 | kPerfLogFanTarget << 4, schema[1]);
+  TEST_ASSERT_EQUAL_STRING("Fan1_Target", (const char*)schema + 2);
+  TEST_ASSERT_EQUAL_UINT8(kPerfLogTemperature << 4 | 1,
+                          file[file.size() - sizeof("Temp_Coolant_Out") - 1]);
+
+  PerfLogRecord records[2] = {MakeRecord(0, 900), MakeRecord(1000, 930)};
+  uint8_t block[kPerfLogMaxBlockSize];
+  size_t size = EncodePerfLogBlock(records, 2, 0, block, sizeof(block));
+  Append(&file, block, size);
+  PerfLogReader reader;
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  TEST_ASSERT_TRUE(reader.header().first_seq == 42);
+  PerfLogSample sample;
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_EQUAL_UINT16(930, sample.record.fan1_rpm);
+
+  // Headers from before first_seq end their fields at schema_size; the
+  // description after them is not mistaken for a sequence number
+  std::vector<uint8_t> unnumbered(file.begin(), file.end());
+  unnumbered.erase(unnumbered.begin() + offsetof(PerfLogFileHeader, first_seq),
+                   unnumbered.begin() + sizeof(header));
+  ((PerfLogFileHeader*)unnumbered.data())->header_size -= sizeof(uint64_t);
+  TEST_ASSERT_NULL(reader.Open(unnumbered.data(), unnumbered.size()));
+  TEST_ASSERT_TRUE(reader.header().first_seq == 0);
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_EQUAL_UINT16(900, sample.record.fan1_rpm);
+
+  // A description that does not match this build's record is rejected
+  file[sizeof(header) + 2] = 'X';
+  TEST_ASSERT_NOT_NULL(reader.Open(file.data(), file.size()));
+  PerfLogFileHeader* h = (PerfLogFileHeader*)file.data();
+  // Longer than the header after schema_size
+  h->schema_size =
+      h->header_size - offsetof(PerfLogFileHeader, first_seq) + 1;
+  PerfLogFileHeader parsed;
+  TEST_ASSERT_NOT_NULL(ParsePerfLogHeader(file.data(), file.size(), &parsed));
+
+  // Headers from before the description have no schema_size
+  std::vector<uint8_t> old_file;
+  InitPerfLogHeader(&header, 1, 1000, 5000, 0);
+  header.header_size = offsetof(PerfLogFileHeader, schema_size);
+  Append(&old_file, &header, header.header_size);
+  Append(&old_file, block, size);
+  TEST_ASSERT_NULL(reader.Open(old_file.data(), old_file.size()));
+  TEST_ASSERT_EQUAL_UINT16(0, reader.header().schema_size);
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_EQUAL_UINT16(900, sample.record.fan1_rpm);
+}
+
+void test_perf_log_format_untimed_blocks(void) {
+  // Version 3 blocks have the shorter header without time offsets
+  std::vector<PerfLogRecord> records = SyntheticCapture(10);
+  uint8_t block[kPerfLogMaxBlockSize];
+  size_t size = EncodePerfLogBlock(&records[0], 10, 0, block, sizeof(block));
+  const size_t kTimeBytes = 8;
+
+  std::vector<uint8_t> file;
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 1, 1000, 0, 0);
+  header.version = kPerfLogUntimedBlockVersion;
+  Append(&file, &header, sizeof(header));
+  Append(&file, block, PerfLogBlockHeaderSize(kPerfLogUntimedBlockVersion));
+  Append(&file, block + sizeof(PerfLogBlockHeader),
+         size - sizeof(PerfLogBlockHeader));
+  TEST_ASSERT_EQUAL(size - kTimeBytes, file.size() - sizeof(header));
+
+  PerfLogReader reader;
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  PerfLogSample sample;
+  for (int i = 0; i < 10; i++) {
+    TEST_ASSERT_TRUE(reader.Next(&sample));
+    TEST_ASSERT_EQUAL_MEMORY(&records[i], &sample.record,
+                             sizeof(PerfLogRecord));
+  }
+  TEST_ASSERT_FALSE(reader.Next(&sample));
+  TEST_ASSERT_NULL(reader.error());
+}
+
+// Boot-time recovery finds the end of the intact data after a torn write
+void test_perf_log_format_recovery(void) {
+  std::vector<PerfLogRecord> records = SyntheticCapture(128);
+  std::vector<uint8_t> file;
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 1, 1000, 0, 0);
+  Append(&file, &header, sizeof(header));
+  uint8_t block[kPerfLogMaxBlockSize];
+  size_t first_size =
+      EncodePerfLogBlock(&records[0], 64, 0, block, sizeof(block));
+  Append(&file, block, first_size);
+  size_t second_size =
+      EncodePerfLogBlock(&records[64], 64, 64000, block, sizeof(block));
+  Append(&file, block, second_size);
+  TEST_ASSERT_EQUAL(file.size(), PerfLogValidLength(file.data(), file.size()));
+
+  // Torn second block
+  size_t intact = sizeof(header) + first_size;
+  TEST_ASSERT_EQUAL(intact, PerfLogValidLength(file.data(), file.size() - 5));
+  TEST_ASSERT_EQUAL(intact, PerfLogValidLength(file.data(), intact + 3));
+
+  // A corrupt block in the middle does not hide the intact one after it
+  std::vector<uint8_t> corrupt = file;
+  corrupt[sizeof(header) + 20] ^= 0x10;
+  TEST_ASSERT_EQUAL(file.size(),
+                    PerfLogValidLength(corrupt.data(), corrupt.size()));
+  TEST_ASSERT_EQUAL(intact, FindPerfLogBlock(corrupt.data(), corrupt.size(),
+                                             sizeof(header) + 1,
+                                             kPerfLogVersion));
+  TEST_ASSERT_EQUAL(corrupt.size() - 5,
+                    FindPerfLogBlock(corrupt.data(), corrupt.size() - 5,
+                                     sizeof(header) + 1, kPerfLogVersion));
+
+  // Header only, or fixed-size records with a partial one
+  TEST_ASSERT_EQUAL(sizeof(header),
+                    PerfLogValidLength(file.data(), sizeof(header)));
+  header.version = kPerfLogRawVersion;
+  std::vector<uint8_t> raw;
+  Append(&raw, &header, sizeof(header));
+  Append(&raw, &records[0], sizeof(PerfLogRecord) * 3);
+  TEST_ASSERT_EQUAL(sizeof(header) + 2 * sizeof(PerfLogRecord),
+                    PerfLogValidLength(raw.data(), raw.size() - 1));
+  TEST_ASSERT_EQUAL(0, PerfLogValidLength(file.data(), 10));
+}
+
+void test_perf_log_format_legacy(void) {
+  // Headerless file whose seconds counter wraps
+  std::vector<uint8_t> file;
+  const uint16_t kSeconds[] = {65534, 65535, 0, 1};
+  for (int i = 0; i < 4; i++) {
+    PerfLogRecord record = MakeRecord(kSeconds[i], 0);
+    Append(&file, &record, sizeof(record));
+  }
+
+  PerfLogReader reader;
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  TEST_ASSERT_EQUAL_UINT16(kPerfLogLegacyVersion, reader.header().version);
+  PerfLogSample sample;
+  const uint64_t kExpected[] = {65534000, 65535000, 65536000, 65537000};
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(reader.Next(&sample));
+    TEST_ASSERT_TRUE(sample.uptime_ms == kExpected[i]);
+  }
+  TEST_ASSERT_FALSE(reader.Next(&sample));
+}
+
+void test_perf_log_block_round_trip(void) {
+  std::vector<PerfLogRecord> records = SyntheticCapture(100);
+  records[50].fan4_rpm = 0;  // Large jumps still round-trip
+  records[51].delta_ms = 65535;
+
+  // File with a 64-record block and a 36-record block
+  std::vector<uint8_t> file;
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 1, 1000, 0, 0);
+  Append(&file, &header, sizeof(header));
+  uint8_t block[kPerfLogMaxBlockSize];
+  size_t size = EncodePerfLogBlock(&records[0], 64, 0, block, sizeof(block));
+  TEST_ASSERT_TRUE(size > 0);
+  Append(&file, block, size);
+
+  // Block headers carry the time range of their records
+  PerfLogBlockHeader block_header;
+  TEST_ASSERT_NULL(
+      ParsePerfLogBlockHeader(block, size, kPerfLogVersion, &block_header));
+  uint32_t last_offset_ms = 0;
+  for (int i = 1; i < 64; i++) last_offset_ms += records[i].delta_ms;
+  TEST_ASSERT_EQUAL_UINT32(0, block_header.first_offset_ms);
+  TEST_ASSERT_EQUAL_UINT32(last_offset_ms, block_header.last_offset_ms);
+
+  uint32_t first_offset_ms = last_offset_ms + records[64].delta_ms;
+  size = EncodePerfLogBlock(&records[64], 36, first_offset_ms, block,
+                            sizeof(block));
+  TEST_ASSERT_TRUE(size > 0);
+  Append(&file, block, size);
+
+  PerfLogReader reader;
+  TEST_ASSERT_NULL(reader.Open(file.data(), file.size()));
+  TEST_ASSERT_EQUAL_UINT16(kPerfLogVersion, reader.header().version);
+  PerfLogSample sample;
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(reader.Next(&sample));
+    TEST_ASSERT_EQUAL_MEMORY(&records[i], &sample.record,
+                             sizeof(PerfLogRecord));
+  }
+  TEST_ASSERT_FALSE(reader.Next(&sample));
+  TEST_ASSERT_NULL(reader.error());
+  TEST_ASSERT_FALSE(reader.truncated());
+
+  // Torn last block: the first block is still readable
+  std::vector<uint8_t> torn(file.begin(), file.end() - 3);
+  TEST_ASSERT_NULL(reader.Open(torn.data(), torn.size()));
+  int count = 0;
+  while (reader.Next(&sample)) count++;
+  TEST_ASSERT_EQUAL(64, count);
+  TEST_ASSERT_TRUE(reader.truncated());
+
+  // A flipped bit is caught by the CRC; the reader resyncs at the next block
+  // with exact timestamps
+  std::vector<uint8_t> corrupt = file;
+  corrupt[sizeof(header) + sizeof(PerfLogBlockHeader) + 30] ^= 0x04;
+  TEST_ASSERT_NULL(reader.Open(corrupt.data(), corrupt.size()));
+  TEST_ASSERT_TRUE(reader.Next(&sample));
+  TEST_ASSERT_EQUAL_MEMORY(&records[64], &sample.record,
+                           sizeof(PerfLogRecord));
+  TEST_ASSERT_TRUE(sample.uptime_ms == first_offset_ms);
+  count = 1;
+  while (reader.Next(&sample)) count++;
+  TEST_ASSERT_EQUAL(36, count);
+  TEST_ASSERT_NOT_NULL(reader.error());
+  TEST_ASSERT_TRUE(reader.skipped_bytes() > 0);
+  TEST_ASSERT_FALSE(reader.truncated());
+
+  // Capacity and count are checked
+  TEST_ASSERT_EQUAL(0, EncodePerfLogBlock(&records[0], 64, 0, block, 100));
+  TEST_ASSERT_EQUAL(0, EncodePerfLogBlock(&records[0], 0, 0, block,
+                                          sizeof(block)));
+}
+
+// Compression ratio and encode cost. Set PERF_LOG_CAPTURE to a log file
+// downloaded from port 5599 to measure a real capture instead of the
+// synthetic one.
+void test_perf_log_block_benchmark(void) {
+  const char* path = getenv("PERF_LOG_CAPTURE");
+  std::vector<PerfLogRecord> records;
+  if (path != nullptr) records = LoadCapture(path);
+  bool synthetic = records.empty();
+  if (synthetic) records = SyntheticCapture(3600);
+
+  const int kIterations = 20;
+  uint8_t block[kPerfLogMaxBlockSize];
+  size_t encoded = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int iteration = 0; iteration < kIterations; iteration++) {
+    encoded = 0;
+    for (size_t i = 0; i < records.size(); i += kPerfLogMaxBlockRecords) {
+      int count = records.size() - i < (size_t)kPerfLogMaxBlockRecords
+                      ? (int)(records.size() - i)
+                      : kPerfLogMaxBlockRecords;
+      encoded +=
+          EncodePerfLogBlock(&records[i], count, 0, block, sizeof(block));
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count() /
+              (kIterations * records.size());
+
+  size_t raw = records.size() * sizeof(PerfLogRecord);
+  char message[160];
+  snprintf(message, sizeof(message),
+           "%s, %zu records: %zu -> %zu bytes (%.2f bytes/record, %.1fx), "
+           "encode %.1f ns/record",
+           synthetic ? "synthetic" : path, records.size(), raw, encoded,
+           (double)encoded / records.size(), (double)raw / encoded, ns);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(encoded < raw);
+}
+
+// A model estimate, not PerfLogger itself: both writers are reduced to their
+// file access pattern on host files, with the real block encoder
+void test_perf_log_write_benchmark(void) {
+  std::vector<PerfLogRecord> records = SyntheticCapture(3600);
+  char path[] = "/tmp/perf_log_write_XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd >= 0);
+  close(fd);
+  auto elapsed_us = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  // Before: LoggingTask opened, appended to and closed the file per record
+  int writes_before = 0;
+  size_t bytes_before = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const PerfLogRecord& record : records) {
+    FILE* f = fopen(path, "ab");
+    bytes_before += fwrite(&record, 1, sizeof(record), f);
+    fclose(f);
+    writes_before++;
+  }
+  double logging_before_us = elapsed_us(start);
+
+  // After: LoggingTask copies into the RAM buffer, and FlushTask writes each
+  // full buffer as one block with one open/write/close
+  TEST_ASSERT_EQUAL(0, truncate(path, 0));
+  PerfLogRecord buffer[kPerfLogMaxBlockRecords];
+  uint8_t block[kPerfLogMaxBlockSize];
+  int count = 0;
+  int writes_after = 0;
+  size_t bytes_after = 0;
+  double logging_after_us = 0;
+  double flush_after_us = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    start = std::chrono::steady_clock::now();
+    buffer[count++] = records[i];
+    logging_after_us += elapsed_us(start);
+    if (count < kPerfLogMaxBlockRecords && i + 1 < records.size()) continue;
+
+    start = std::chrono::steady_clock::now();
+    size_t size = EncodePerfLogBlock(buffer, count, 0, block, sizeof(block));
+    FILE* f = fopen(path, "ab");
+    bytes_after += fwrite(block, 1, size, f);
+    fclose(f);
+    flush_after_us += elapsed_us(start);
+    writes_after++;
+    count = 0;
+  }
+  unlink(path);
+
+  int n = (int)records.size();
+  char message[240];
+  snprintf(message, sizeof(message),
+           "model estimate, %d records to a host file: per-record append %d writes, %zu "
+           "bytes, %.2f us/record; buffered blocks %d writes, %zu bytes, "
+           "logging %.3f us/record + flush %.2f us/record",
+           n, writes_before, bytes_before, logging_before_us / n, writes_after,
+           bytes_after, logging_after_us / n, flush_after_us / n);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,417 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "perf_log_query.h"
+#include "test_support.h"
+
+namespace {
+
+const uint32_t kFileBytes = 4096;
+const int64_t kWallClockBase = 1700000000000LL;
+
+struct Collected {
+  uint32_t mask;
+  std::vector<PerfLogSample> samples;
+  std::string csv;
+};
+
+void Collect(uint32_t boot_id, const PerfLogSample& sample, void* context) {
+  (void)boot_id;
+  Collected* collected = (Collected*)context;
+  collected->samples.push_back(sample);
+
+  int32_t channels[kPerfLogChannelCount];
+  PerfLogRecordToChannels(sample.record, channels);
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (!(collected->mask & (1u << c))) continue;
+    char value[16];
+    FormatPerfLogChannel(c, channels[c], value, sizeof(value));
+    collected->csv += std::string(",") + value;
+  }
+  collected->csv += "\n";
+}
+
+// Write `hours` of 1 s records the way PerfLogger does: 64-record blocks in
+// files of at most kFileBytes. Returns the uptime of every record.
+std::vector<uint64_t> WriteStore(MemoryStorage* storage, int hours,
+                                 uint32_t boot_id) {
+  std::vector<uint64_t> uptimes;
+  int file_index = -1;
+  uint64_t file_start_ms = 0;
+  uint64_t previous_ms = 0;
+  uint8_t block[kPerfLogMaxBlockSize];
+  PerfLogRecord records[kPerfLogMaxBlockRecords];
+
+  int total = hours * 3600;
+  for (int i = 0; i < total; i += kPerfLogMaxBlockRecords) {
+    int count = std::min(kPerfLogMaxBlockRecords, total - i);
+    for (int r = 0; r < count; r++) {
+      memset(&records[r], 0, sizeof(PerfLogRecord));
+      records[r].fan1_rpm = (uint16_t)((i + r) % 3000);
+      records[r].temp_ambient = (uint8_t)((i + r) / 600);
+      records[r].delta_ms = 1000;
+    }
+    uint64_t first_ms = (uint64_t)i * 1000;
+
+    // Blocks never span files
+    bool new_file = file_index < 0;
+    records[0].delta_ms = new_file ? 0 : (uint16_t)(first_ms - previous_ms);
+    size_t size = EncodePerfLogBlock(records, count,
+                                     (uint32_t)(first_ms - file_start_ms),
+                                     block, sizeof(block));
+    if (!new_file && storage->files[file_index].size() + size > kFileBytes) {
+      new_file = true;
+      records[0].delta_ms = 0;
+      size = EncodePerfLogBlock(records, count, 0, block, sizeof(block));
+    }
+    if (new_file) {
+      file_index++;
+      file_start_ms = first_ms;
+      PerfLogFileHeader header;
+      InitPerfLogHeader(&header, boot_id, 1000, file_start_ms,
+                        kWallClockBase + (int64_t)file_start_ms);
+      header.first_seq = uptimes.size() + 1;
+      const uint8_t* bytes = (const uint8_t*)&header;
+      storage->files[file_index].assign(bytes, bytes + sizeof(header));
+    }
+    std::vector<uint8_t>& file = storage->files[file_index];
+    file.insert(file.end(), block, block + size);
+    for (int r = 0; r < count; r++) uptimes.push_back(first_ms + r * 1000);
+    previous_ms = uptimes.back();
+  }
+  return uptimes;
+}
+
+// What OpenStores() does at boot: read each file header and index its blocks
+std::vector<PerfLogSegment> ScanStore(MemoryStorage* storage) {
+  std::vector<PerfLogSegment> segments;
+  for (auto& entry : storage->files) {
+    PerfLogSegment segment = {};
+    segment.index = entry.first;
+    segment.bytes = entry.second.size();
+    PerfLogFileHeader header;
+    TEST_ASSERT_NULL(ParsePerfLogHeader(entry.second.data(),
+                                        entry.second.size(), &header));
+    segment.version = header.version;
+    segment.boot_id = header.boot_id;
+    segment.start_uptime_ms = header.start_uptime_ms;
+    segment.wall_clock_start_ms = header.wall_clock_base_ms;
+    segment.first_seq = header.first_seq;
+    uint32_t end_offset_ms;
+    uint32_t indexed = IndexPerfLogBlocks(
+        storage, segment.index, header.version, header.header_size,
+        segment.bytes, &segment.blocks, &end_offset_ms, &segment.records);
+    TEST_ASSERT_EQUAL_UINT32(segment.bytes, indexed);
+    segment.end_uptime_ms = segment.start_uptime_ms + end_offset_ms;
+    segments.push_back(segment);
+  }
+  return segments;
+}
+
+struct Delivered {
+  std::vector<uint64_t> seqs;
+  std::vector<uint64_t> uptimes;
+  std::vector<std::pair<uint64_t, uint64_t>> gaps;
+};
+
+void DeliverRecord(uint64_t seq, uint32_t boot_id, const PerfLogSample& sample,
+                   void* context) {
+  (void)boot_id;
+  Delivered* delivered = (Delivered*)context;
+  delivered->seqs.push_back(seq);
+  delivered->uptimes.push_back(sample.uptime_ms);
+}
+
+void DeliverGap(uint64_t first, uint64_t last, void* context) {
+  ((Delivered*)context)->gaps.push_back({first, last});
+}
+
+}  // namespace
+
+// An hour out of two days of raw log, by wall clock: only the blocks of that
+// hour are read
+void test_perf_log_query_range(void) {
+  MemoryStorage storage;
+  std::vector<uint64_t> uptimes = WriteStore(&storage, 48, 7);
+  std::vector<PerfLogSegment> segments = ScanStore(&storage);
+  uint32_t total_bytes = 0;
+  for (const PerfLogSegment& segment : segments) total_bytes += segment.bytes;
+
+  PerfLogRangeQuery query;
+  query.wall_clock = true;
+  query.boot_id = 0;
+  query.from_ms = kWallClockBase + 30 * 3600 * 1000LL + 500;
+  query.to_ms = query.from_ms + 3600 * 1000LL;
+
+  Collected collected;
+  TEST_ASSERT_TRUE(
+      ParsePerfLogChannelList("fan1_rpm,Temp_Ambient", &collected.mask));
+  PerfLogRangeStats stats;
+  storage.reads = 0;
+  auto start = std::chrono::steady_clock::now();
+  TEST_ASSERT_NULL(QueryPerfLogRange(segments, &storage, query, Collect,
+                                     &collected, &stats));
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+
+  // Exactly the records in [from, to)
+  std::vector<uint64_t> expected;
+  for (uint64_t uptime : uptimes) {
+    int64_t wall = kWallClockBase + (int64_t)uptime;
+    if (wall >= query.from_ms && wall < query.to_ms) expected.push_back(uptime);
+  }
+  TEST_ASSERT_EQUAL(expected.size(), collected.samples.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    TEST_ASSERT_TRUE(collected.samples[i].uptime_ms == expected[i]);
+    TEST_ASSERT_TRUE(collected.samples[i].wall_clock_ms ==
+                     kWallClockBase + (int64_t)expected[i]);
+    TEST_ASSERT_EQUAL(expected[i] / 1000 % 3000,
+                      collected.samples[i].record.fan1_rpm);
+  }
+
+  // Projection: two columns per row
+  char first_row[32];
+  snprintf(first_row, sizeof(first_row), ",%u,%.1f\n",
+           (unsigned)(expected[0] / 1000 % 3000),
+           DecodePerfLogTemperature(expected[0] / 1000 / 600));
+  TEST_ASSERT_EQUAL_STRING(first_row,
+                           collected.csv.substr(0, strlen(first_row)).c_str());
+
+  // At most one partial block on each side of the hour
+  uint32_t needed_blocks = 3600 / kPerfLogMaxBlockRecords + 2;
+  TEST_ASSERT_TRUE(stats.blocks_read <= needed_blocks);
+  TEST_ASSERT_TRUE(stats.bytes_read * 20 < total_bytes);
+
+  char message[200];
+  snprintf(message, sizeof(message),
+           "1 h of %u files (%u bytes): %u records, %u blocks, %u of %u "
+           "bytes read in %u reads, %.0f us",
+           (unsigned)segments.size(), (unsigned)total_bytes,
+           (unsigned)stats.records_matched, (unsigned)stats.blocks_read,
+           (unsigned)stats.bytes_read, (unsigned)total_bytes,
+           (unsigned)storage.reads, us);
+  TEST_MESSAGE(message);
+
+  // The same hour by uptime of the boot; other boots match nothing
+  query.wall_clock = false;
+  query.boot_id = 7;
+  query.from_ms -= kWallClockBase;
+  query.to_ms -= kWallClockBase;
+  Collected by_uptime;
+  by_uptime.mask = 0;
+  TEST_ASSERT_NULL(QueryPerfLogRange(segments, &storage, query, Collect,
+                                     &by_uptime, nullptr));
+  TEST_ASSERT_EQUAL(expected.size(), by_uptime.samples.size());
+  query.boot_id = 8;
+  Collected other_boot;
+  other_boot.mask = 0;
+  TEST_ASSERT_NULL(QueryPerfLogRange(segments, &storage, query, Collect,
+                                     &other_boot, nullptr));
+  TEST_ASSERT_EQUAL(0, (int)other_boot.samples.size());
+
+  // A corrupt block is skipped and reported; the rest of the range is intact
+  query.boot_id = 7;
+  const PerfLogSegment* hit = nullptr;
+  for (const PerfLogSegment& segment : segments) {
+    if ((int64_t)segment.start_uptime_ms > query.from_ms + 600 * 1000) {
+      hit = &segment;
+      break;
+    }
+  }
+  TEST_ASSERT_NOT_NULL(hit);
+  storage.files[hit->index][hit->blocks[0].offset + 30] ^= 0x01;
+  Collected corrupt;
+  corrupt.mask = 0;
+  TEST_ASSERT_NOT_NULL(QueryPerfLogRange(segments, &storage, query, Collect,
+                                         &corrupt, &stats));
+  TEST_ASSERT_EQUAL_UINT32(1, stats.corrupt_blocks);
+  TEST_ASSERT_EQUAL(expected.size() - kPerfLogMaxBlockRecords,
+                    corrupt.samples.size());
+}
+
+void test_perf_log_query_channels_and_legacy(void) {
+  uint32_t mask;
+  TEST_ASSERT_TRUE(ParsePerfLogChannelList("Fan1_Target", &mask));
+  TEST_ASSERT_EQUAL_UINT32(1, mask);
+  TEST_ASSERT_TRUE(ParsePerfLogChannelList("temp_coolant_out,fan2_rpm",
+                                           &mask));
+  TEST_ASSERT_EQUAL_UINT32((1u << 14) | (1u << 5), mask);
+  TEST_ASSERT_FALSE(ParsePerfLogChannelList("fan5_rpm", &mask));
+  TEST_ASSERT_FALSE(ParsePerfLogChannelList("fan1_rpm,", &mask));
+
+  char value[16];
+  FormatPerfLogChannel(2, 1230, value, sizeof(value));
+  TEST_ASSERT_EQUAL_STRING("1230", value);
+  FormatPerfLogChannel(0, 255, value, sizeof(value));
+  TEST_ASSERT_EQUAL_STRING("100.0", value);
+  FormatPerfLogChannel(12, 0, value, sizeof(value));
+  TEST_ASSERT_EQUAL_STRING("10.0", value);
+
+  // A version 2 file has no block index and is read whole
+  MemoryStorage storage;
+  std::vector<uint8_t>& file = storage.files[0];
+  PerfLogFileHeader header;
+  InitPerfLogHeader(&header, 3, 1000, 5000, 0);
+  header.version = kPerfLogRawVersion;
+  const uint8_t* bytes = (const uint8_t*)&header;
+  file.insert(file.end(), bytes, bytes + sizeof(header));
+  for (int i = 0; i < 10; i++) {
+    PerfLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.delta_ms = i == 0 ? 0 : 1000;
+    bytes = (const uint8_t*)&record;
+    file.insert(file.end(), bytes, bytes + sizeof(record));
+  }
+  PerfLogSegment segment = {};
+  segment.index = 0;
+  segment.bytes = file.size();
+  segment.version = kPerfLogRawVersion;
+  segment.boot_id = 3;
+  segment.start_uptime_ms = segment.end_uptime_ms = 5000;
+
+  PerfLogRangeQuery query;
+  query.wall_clock = false;
+  query.boot_id = 3;
+  query.from_ms = 7000;
+  query.to_ms = 10000;
+  Collected collected;
+  collected.mask = 0;
+  PerfLogRangeStats stats;
+  TEST_ASSERT_NULL(QueryPerfLogRange({segment}, &storage, query, Collect,
+                                     &collected, &stats));
+  TEST_ASSERT_EQUAL(3, (int)collected.samples.size());
+  TEST_ASSERT_TRUE(collected.samples[0].uptime_ms == 7000);
+  TEST_ASSERT_EQUAL_UINT32(file.size(), stats.bytes_read);
+
+  // Without a wall-clock base it cannot match wall-clock queries
+  query.wall_clock = true;
+  Collected none;
+  none.mask = 0;
+  TEST_ASSERT_NULL(
+      QueryPerfLogRange({segment}, &storage, query, Collect, &none, nullptr));
+  TEST_ASSERT_EQUAL(0, (int)none.samples.size());
+}
+
+// Incremental scrapes by record number, across rotation and corruption
+void test_perf_log_query_since(void) {
+  MemoryStorage storage;
+  std::vector<uint64_t> uptimes = WriteStore(&storage, 2, 7);
+  std::vector<PerfLogSegment> segments = ScanStore(&storage);
+  TEST_ASSERT_TRUE(PerfLogLastSeq(segments) == uptimes.size());
+
+  // The delta since the last scrape: record n (1-based) is uptimes[n - 1]
+  Delivered delta;
+  PerfLogRangeStats stats;
+  TEST_ASSERT_NULL(QueryPerfLogSince(segments, &storage, 7000, DeliverRecord,
+                                     DeliverGap, &delta, &stats));
+  TEST_ASSERT_EQUAL(200, (int)delta.seqs.size());
+  TEST_ASSERT_EQUAL(0, (int)delta.gaps.size());
+  for (size_t i = 0; i < delta.seqs.size(); i++) {
+    TEST_ASSERT_TRUE(delta.seqs[i] == 7001 + i);
+    TEST_ASSERT_TRUE(delta.uptimes[i] == uptimes[7000 + i]);
+  }
+  // Only the blocks holding new records are decoded
+  TEST_ASSERT_TRUE(stats.blocks_read <= 200 / kPerfLogMaxBlockRecords + 2);
+
+  // Up to date: nothing to send
+  Delivered none;
+  TEST_ASSERT_NULL(QueryPerfLogSince(segments, &storage, uptimes.size(),
+                                     DeliverRecord, DeliverGap, &none,
+                                     nullptr));
+  TEST_ASSERT_TRUE(none.seqs.empty() && none.gaps.empty());
+
+  // Rotated out: the missing numbers come first, as one gap
+  uint64_t oldest_seq = segments[3].first_seq;
+  storage.files.erase(segments[0].index);
+  segments.erase(segments.begin(), segments.begin() + 3);
+  Delivered rotated;
+  TEST_ASSERT_NULL(QueryPerfLogSince(segments, &storage, 100, DeliverRecord,
+                                     DeliverGap, &rotated, nullptr));
+  TEST_ASSERT_EQUAL(1, (int)rotated.gaps.size());
+  TEST_ASSERT_TRUE(rotated.gaps[0].first == 101 &&
+                   rotated.gaps[0].second == oldest_seq - 1);
+  TEST_ASSERT_TRUE(rotated.seqs.front() == oldest_seq);
+  TEST_ASSERT_TRUE(rotated.seqs.back() == uptimes.size());
+  TEST_ASSERT_TRUE(rotated.seqs.size() == uptimes.size() - oldest_seq + 1);
+
+  // A corrupt payload loses its block; later numbers are unaffected
+  const PerfLogSegment& hit = segments[1];
+  storage.files[hit.index][hit.blocks[1].offset + 30] ^= 0x01;
+  Delivered corrupt;
+  TEST_ASSERT_NOT_NULL(QueryPerfLogSince(segments, &storage, hit.first_seq,
+                                         DeliverRecord, DeliverGap, &corrupt,
+                                         &stats));
+  TEST_ASSERT_EQUAL_UINT32(1, stats.corrupt_blocks);
+  uint64_t lost_first = hit.first_seq + kPerfLogMaxBlockRecords;
+  TEST_ASSERT_EQUAL(1, (int)corrupt.gaps.size());
+  TEST_ASSERT_TRUE(corrupt.gaps[0].first == lost_first &&
+                   corrupt.gaps[0].second ==
+                       lost_first + kPerfLogMaxBlockRecords - 1);
+  TEST_ASSERT_TRUE(corrupt.seqs.size() + kPerfLogMaxBlockRecords ==
+                   uptimes.size() - hit.first_seq);
+  for (size_t i = 0; i < corrupt.seqs.size(); i++) {
+    TEST_ASSERT_TRUE(corrupt.uptimes[i] == uptimes[corrupt.seqs[i] - 1]);
+  }
+}
+
+// The cursors give the same records a step (at most one block) at a time
+void test_perf_log_query_cursors(void) {
+  MemoryStorage storage;
+  std::vector<uint64_t> uptimes = WriteStore(&storage, 2, 7);
+  std::vector<PerfLogSegment> segments = ScanStore(&storage);
+
+  PerfLogRangeQuery query;
+  query.wall_clock = true;
+  query.boot_id = 0;
+  query.from_ms = kWallClockBase + 1800 * 1000LL + 500;
+  query.to_ms = query.from_ms + 1800 * 1000LL;
+  Collected whole;
+  whole.mask = 0;
+  TEST_ASSERT_NULL(QueryPerfLogRange(segments, &storage, query, Collect,
+                                     &whole, nullptr));
+
+  Collected stepped;
+  stepped.mask = 0;
+  PerfLogRangeCursor range(segments, &storage, query, Collect, &stepped);
+  int steps = 0;
+  for (;;) {
+    uint32_t blocks = range.stats().blocks_read;
+    size_t samples = stepped.samples.size();
+    if (!range.Next()) break;
+    steps++;
+    TEST_ASSERT_EQUAL_UINT32(blocks + 1, range.stats().blocks_read);
+    TEST_ASSERT_TRUE(stepped.samples.size() - samples <=
+                     (size_t)kPerfLogMaxBlockRecords);
+  }
+  TEST_ASSERT_FALSE(range.Next());
+  TEST_ASSERT_NULL(range.error());
+  TEST_ASSERT_EQUAL(whole.samples.size(), stepped.samples.size());
+  TEST_ASSERT_TRUE(stepped.samples.back().uptime_ms ==
+                   whole.samples.back().uptime_ms);
+  TEST_ASSERT_EQUAL_INT(range.stats().blocks_read, steps);
+
+  // From a cursor in the middle of a rotated store: the gap, then a block
+  // per step
+  uint64_t oldest_seq = segments[2].first_seq;
+  segments.erase(segments.begin(), segments.begin() + 2);
+  Delivered delivered;
+  PerfLogSinceCursor since(segments, &storage, 100, DeliverRecord, DeliverGap,
+                           &delivered);
+  TEST_ASSERT_TRUE(since.last_seq() == uptimes.size());
+  TEST_ASSERT_TRUE(since.Next());
+  TEST_ASSERT_EQUAL(1, (int)delivered.gaps.size());
+  TEST_ASSERT_TRUE(delivered.gaps[0].second == oldest_seq - 1);
+  TEST_ASSERT_TRUE(delivered.seqs.size() <= (size_t)kPerfLogMaxBlockRecords);
+  while (since.Next()) {
+  }
+  TEST_ASSERT_TRUE(delivered.seqs.size() == uptimes.size() - oldest_seq + 1);
+  TEST_ASSERT_TRUE(delivered.seqs.back() == uptimes.size());
+  TEST_ASSERT_EQUAL(1, (int)delivered.gaps.size());
+}
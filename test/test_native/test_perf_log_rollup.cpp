@@ -0,0 +1,68 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include "perf_log_rollup.h"
+
+namespace {
+
+PerfLogRecord MakeRecord(uint16_t rpm, uint8_t temp) {
+  PerfLogRecord record;
+  memset(&record, 0, sizeof(record));
+  record.fan1_rpm = rpm;
+  record.temp_coolant_in = temp;
+  return record;
+}
+
+}  // namespace
+
+void test_perf_log_rollup_min_max_mean(void) {
+  PerfLogRollup rollup(60 * 1000);
+  PerfLogRollupRecord finished;
+  uint64_t start_ms = 0;
+
+  // Samples at 120..179 s all belong to the period starting at 120 s
+  const uint16_t kRpms[] = {900, 960, 930};
+  for (int i = 0; i < 60; i++) {
+    TEST_ASSERT_FALSE(rollup.Add(120000 + i * 1000,
+                                 MakeRecord(kRpms[i % 3], 100 + i % 2),
+                                 &finished, &start_ms));
+  }
+
+  // The first sample of the next period closes it
+  TEST_ASSERT_TRUE(
+      rollup.Add(180000, MakeRecord(0, 0), &finished, &start_ms));
+  TEST_ASSERT_TRUE(start_ms == 120000);
+  TEST_ASSERT_EQUAL_UINT16(60, finished.sample_count);
+  TEST_ASSERT_EQUAL_UINT16(900, finished.min.fan1_rpm);
+  TEST_ASSERT_EQUAL_UINT16(960, finished.max.fan1_rpm);
+  TEST_ASSERT_EQUAL_UINT16(930, finished.mean.fan1_rpm);
+  TEST_ASSERT_EQUAL_UINT8(100, finished.min.temp_coolant_in);
+  TEST_ASSERT_EQUAL_UINT8(101, finished.max.temp_coolant_in);
+  TEST_ASSERT_EQUAL_UINT8(101, finished.mean.temp_coolant_in);  // 100.5
+  TEST_ASSERT_EQUAL_UINT16(0, finished.mean.fan2_rpm);
+}
+
+void test_perf_log_rollup_gaps(void) {
+  // An hour tier that skips empty periods
+  PerfLogRollup rollup(3600 * 1000);
+  PerfLogRollupRecord finished;
+  uint64_t start_ms = 0;
+
+  const uint64_t kHour = 3600ULL * 1000;
+  TEST_ASSERT_FALSE(
+      rollup.Add(5 * kHour + 10, MakeRecord(1000, 0), &finished, &start_ms));
+  TEST_ASSERT_FALSE(
+      rollup.Add(6 * kHour - 1, MakeRecord(2000, 0), &finished, &start_ms));
+  TEST_ASSERT_TRUE(
+      rollup.Add(9 * kHour, MakeRecord(3000, 0), &finished, &start_ms));
+  TEST_ASSERT_TRUE(start_ms == 5 * kHour);
+  TEST_ASSERT_EQUAL_UINT16(2, finished.sample_count);
+  TEST_ASSERT_EQUAL_UINT16(1500, finished.mean.fan1_rpm);
+
+  TEST_ASSERT_TRUE(
+      rollup.Add(10 * kHour, MakeRecord(0, 0), &finished, &start_ms));
+  TEST_ASSERT_TRUE(start_ms == 9 * kHour);
+  TEST_ASSERT_EQUAL_UINT16(1, finished.sample_count);
+  TEST_ASSERT_EQUAL_UINT16(3000, finished.min.fan1_rpm);
+}
@@ -0,0 +1,267 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_request.h"
+#include "perf_log_stream.h"
+#include "test_support.h"
+
+namespace {
+
+const uint32_t kFileBytes = 4096;
+
+// A store of `count` files starting at index `first`, the newest one partly
+// written. Returns the catalog segments and the expected concatenation.
+std::vector<PerfLogSegment> MakeStore(MemoryStorage* storage, int first,
+                                      int count, std::vector<uint8_t>* all) {
+  std::vector<PerfLogSegment> segments;
+  uint32_t seed = 1;
+  for (int i = 0; i < count; i++) {
+    uint32_t bytes = i == count - 1 ? kFileBytes / 3 : kFileBytes;
+    std::vector<uint8_t>& file = storage->files[first + i];
+    for (uint32_t b = 0; b < bytes; b++) {
+      seed = seed * 1103515245 + 12345;
+      file.push_back((uint8_t)(seed >> 16));
+    }
+    all->insert(all->end(), file.begin(), file.end());
+    PerfLogSegment segment = {};
+    segment.index = first + i;
+    segment.bytes = bytes;
+    segments.push_back(segment);
+  }
+  return segments;
+}
+
+bool AppendSink(const uint8_t* data, size_t size, void* context) {
+  std::vector<uint8_t>* out = (std::vector<uint8_t>*)context;
+  out->insert(out->end(), data, data + size);
+  return true;
+}
+
+// Socket helpers for the benchmark
+
+int Listen(uint16_t* port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, (sockaddr*)&addr, sizeof(addr));
+  listen(fd, 8);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  socklen_t len = sizeof(addr);
+  getsockname(fd, (sockaddr*)&addr, &len);
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+bool SocketSink(const uint8_t* data, size_t size, void* context) {
+  return SendAll(*(int*)context, data, size);
+}
+
+// Wait for a connection the way a polling server task does: check, then
+// sleep `poll_ms` if nobody is there
+int AcceptPolling(int listen_fd, int poll_ms) {
+  for (;;) {
+    // The listening socket is non-blocking; accepted ones are not
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd >= 0) return fd;
+    std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+  }
+}
+
+// The server this change replaced: polls every `poll_ms` (100 ms), reads the
+// request a char at a time into a growing string and sends files in 64-byte
+// writes, one file per connection
+void LegacyServer(int listen_fd, MemoryStorage* storage, int requests,
+                  int poll_ms) {
+  for (int r = 0; r < requests; r++) {
+    int fd = AcceptPolling(listen_fd, poll_ms);
+    std::string current_line;
+    std::string request_line;
+    for (;;) {
+      char c;
+      if (recv(fd, &c, 1, 0) <= 0) break;
+      if (c == '\n') {
+        if (current_line.empty()) break;
+        if (request_line.empty()) request_line = current_line;
+        current_line = "";
+      } else if (c != '\r') {
+        current_line += c;
+      }
+    }
+    int index = atoi(request_line.c_str() + strlen("GET /perf_logger_"));
+    const std::vector<uint8_t>& file = storage->files[index];
+    const char* lines[] = {"HTTP/1.1 200 OK\r\n",
+                           "Content-Type: application/octet-stream\r\n",
+                           "Connection: close\r\n", "\r\n"};
+    for (const char* line : lines) SendAll(fd, line, strlen(line));
+    for (size_t offset = 0; offset < file.size(); offset += 64) {
+      SendAll(fd, file.data() + offset,
+              std::min<size_t>(64, file.size() - offset));
+    }
+    close(fd);
+  }
+}
+
+// The new server: fixed-buffer request parsing, one /all response streamed
+// in TCP-window-sized writes
+void StreamingServer(int listen_fd, MemoryStorage* storage,
+                     const std::vector<PerfLogSegment>* segments,
+                     size_t chunk_bytes) {
+  int fd = AcceptPolling(listen_fd, 10);
+  HttpRequestParser request;
+  char in[512];
+  while (request.state() == HttpRequestParser::kIncomplete) {
+    ssize_t n = recv(fd, in, sizeof(in), 0);
+    if (n <= 0) break;
+    request.Feed(in, n);
+  }
+
+  uint64_t total = PerfLogSegmentsSize(*segments);
+  char head[128];
+  int length = snprintf(head, sizeof(head),
+                        "HTTP/1.1 200 OK\r\nContent-Length: %llu\r\n"
+                        "Connection: close\r\n\r\n",
+                        (unsigned long long)total);
+  SendAll(fd, head, length);
+  std::vector<uint8_t> buffer(chunk_bytes);
+  StreamPerfLogParts(SlicePerfLogSegments(*segments, 0, total - 1), storage,
+                     buffer.data(), buffer.size(), SocketSink, &fd);
+  close(fd);
+}
+
+// Send a GET and read the response to EOF; returns the body size
+size_t FetchBodySize(uint16_t port, const std::string& target) {
+  return Body(Fetch(port, "GET " + target + " HTTP/1.1\r\n\r\n")).size();
+}
+
+}  // namespace
+
+void test_perf_log_stream_slices(void) {
+  MemoryStorage storage;
+  std::vector<uint8_t> all;
+  std::vector<PerfLogSegment> segments = MakeStore(&storage, 7, 5, &all);
+  uint64_t total = PerfLogSegmentsSize(segments);
+  TEST_ASSERT_EQUAL_UINT32(all.size(), total);
+
+  // Everything, through a buffer that does not divide the files evenly
+  uint8_t buffer[1000];
+  std::vector<uint8_t> out;
+  std::vector<PerfLogFilePart> parts =
+      SlicePerfLogSegments(segments, 0, total - 1);
+  TEST_ASSERT_EQUAL_UINT32(5, parts.size());
+  TEST_ASSERT_EQUAL_UINT64(total, StreamPerfLogParts(parts, &storage, buffer,
+                                                     sizeof(buffer),
+                                                     AppendSink, &out));
+  TEST_ASSERT_TRUE(out == all);
+
+  // A resumed download: a range starting inside the second file
+  uint64_t first = kFileBytes + 123;
+  out.clear();
+  parts = SlicePerfLogSegments(segments, first, total - 1);
+  TEST_ASSERT_EQUAL_UINT32(4, parts.size());
+  TEST_ASSERT_EQUAL_INT(8, parts[0].index);
+  TEST_ASSERT_EQUAL_UINT32(123, parts[0].offset);
+  StreamPerfLogParts(parts, &storage, buffer, sizeof(buffer), AppendSink,
+                     &out);
+  TEST_ASSERT_TRUE(std::equal(out.begin(), out.end(), all.begin() + first) &&
+                   out.size() == total - first);
+
+  // A range within one file
+  parts = SlicePerfLogSegments(segments, 2 * kFileBytes + 10,
+                               2 * kFileBytes + 19);
+  TEST_ASSERT_EQUAL_UINT32(1, parts.size());
+  TEST_ASSERT_EQUAL_INT(9, parts[0].index);
+  TEST_ASSERT_EQUAL_UINT32(10, parts[0].offset);
+  TEST_ASSERT_EQUAL_UINT32(10, parts[0].length);
+  TEST_ASSERT_EQUAL_UINT32(0, SlicePerfLogSegments(segments, total, total + 5)
+                                  .size());
+
+  // Pulled in pieces that straddle the files, as an event loop sends it
+  PerfLogPartsReader reader(SlicePerfLogSegments(segments, 0, total - 1),
+                            &storage);
+  out.clear();
+  size_t n;
+  while ((n = reader.Read(buffer, 777)) > 0) {
+    out.insert(out.end(), buffer, buffer + n);
+  }
+  TEST_ASSERT_TRUE(out == all);
+  TEST_ASSERT_EQUAL_UINT64(total, reader.read());
+
+  // A file rotated away mid-download ends the stream at what was sent
+  storage.files.erase(9);
+  out.clear();
+  parts = SlicePerfLogSegments(segments, 0, total - 1);
+  TEST_ASSERT_EQUAL_UINT64(
+      2 * kFileBytes,
+      StreamPerfLogParts(parts, &storage, buffer, sizeof(buffer), AppendSink,
+                         &out));
+}
+
+void test_perf_log_stream_benchmark(void) {
+  // 20 full 4 KiB files, as PerfLogger writes them
+  MemoryStorage storage;
+  std::vector<uint8_t> all;
+  std::vector<PerfLogSegment> segments = MakeStore(&storage, 0, 21, &all);
+  segments.pop_back();
+  storage.files.erase(20);
+  uint64_t total = PerfLogSegmentsSize(segments);
+
+  uint16_t port;
+  int listen_fd = Listen(&port);
+
+  // One connection per file, as shipped and without the poll wait (the
+  // cost of the connections and small writes alone)
+  double legacy_ms[2];
+  size_t legacy_bytes[2] = {0, 0};
+  const int kPollMs[2] = {100, 0};
+  for (int i = 0; i < 2; i++) {
+    auto start = std::chrono::steady_clock::now();
+    std::thread legacy(LegacyServer, listen_fd, &storage,
+                       (int)segments.size(), kPollMs[i]);
+    for (const PerfLogSegment& segment : segments) {
+      legacy_bytes[i] += FetchBodySize(
+          port, "/perf_logger_" + std::to_string(segment.index) + ".dat");
+    }
+    legacy.join();
+    legacy_ms[i] = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  }
+
+  // One /all response in 5744-byte writes (the ESP32's TCP send buffer)
+  auto start = std::chrono::steady_clock::now();
+  std::thread streaming(StreamingServer, listen_fd, &storage, &segments,
+                        (size_t)5744);
+  size_t streaming_bytes = FetchBodySize(port, "/all");
+  streaming.join();
+  double streaming_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  close(listen_fd);
+
+  TEST_ASSERT_EQUAL_UINT32(total, legacy_bytes[0]);
+  TEST_ASSERT_EQUAL_UINT32(total, legacy_bytes[1]);
+  TEST_ASSERT_EQUAL_UINT32(total, streaming_bytes);
+
+  char message[200];
+  snprintf(message, sizeof(message),
+           "%u files, %u bytes: per-file 64 B writes %.1f ms (%.0f KB/s; "
+           "%.1f ms without the 100 ms poll), /all in 5744 B writes %.1f ms "
+           "(%.0f KB/s)",
+           (unsigned)segments.size(), (unsigned)total, legacy_ms[0],
+           total / legacy_ms[0], legacy_ms[1], streaming_ms,
+           total / streaming_ms);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,329 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "http_event_server.h"
+#include "http_request.h"
+#include "static_assets.h"
+#include "test_support.h"
+
+namespace {
+
+// The web UI as shipped: plain and gzip -9 sizes of data/
+struct AssetSizes {
+  const char* path;
+  const char* content_type;
+  size_t size;
+  size_t gzip_size;
+};
+const AssetSizes kPage[] = {
+    {"/index.html", "text/html", 3739, 1001},
+    {"/script.js", "application/javascript", 10124, 2534},
+    {"/style.css", "text/css", 1471, 561},
+};
+
+std::string Filler(size_t size, uint32_t seed) {
+  std::string data(size, ' ');
+  for (char& c : data) {
+    seed = seed * 1103515245 + 12345;
+    c = 'a' + (seed >> 16) % 26;
+  }
+  return data;
+}
+
+// LittleFS stand-in: file contents by path
+struct Files {
+  std::map<std::string, std::string> contents;
+  StaticAssetTable assets;
+};
+
+class StringSource : public HttpBodySource {
+ public:
+  explicit StringSource(const std::string* data) : data_(data) {}
+  size_t Read(uint8_t* out, size_t size) override {
+    size_t n = std::min(size, data_->size() - offset_);
+    memcpy(out, data_->data() + offset_, n);
+    offset_ += n;
+    return n;
+  }
+
+ private:
+  const std::string* data_;
+  size_t offset_ = 0;
+};
+
+// Serves assets as serveAsset() in http_server.cpp does, from RAM
+void HandleAsset(const HttpRequest& request, HttpResponse* response,
+                 void* context) {
+  Files* files = (Files*)context;
+  const StaticAsset* asset = files->assets.Find(request.target());
+  if (asset == nullptr) {
+    response->Begin("404 Not Found");
+    return;
+  }
+  StaticAssetResponse answer = PrepareStaticAssetResponse(
+      *asset, request.Header("Accept-Encoding"),
+      request.Header("If-None-Match"), "no-cache");
+  response->Begin(answer.status, answer.headers);
+  if (answer.not_modified) return;
+  const std::string& data =
+      files->contents[std::string(asset->path) + (answer.gzip ? ".gz" : "")];
+  response->Stream(std::unique_ptr<HttpBodySource>(new StringSource(&data)),
+                   data.size());
+}
+
+// Value of a response header, or ""
+std::string HeaderValue(const std::string& response, const std::string& name) {
+  size_t at = response.find("\r\n" + name + ": ");
+  if (at == std::string::npos) return "";
+  at += name.size() + 4;
+  return response.substr(at, response.find("\r\n", at) - at);
+}
+
+// The server this change replaced: the whole file on every request, one
+// write per byte (client.write(file.read()))
+void LegacyServer(int listen_fd, Files* files, std::atomic<bool>* stop) {
+  while (!*stop) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    HttpRequestParser head;
+    char in[512];
+    while (head.state() == HttpRequestParser::kIncomplete) {
+      ssize_t n = recv(fd, in, sizeof(in), 0);
+      if (n <= 0) break;
+      head.Feed(in, n);
+    }
+    const std::string& data = files->contents[head.target()];
+    std::string headers =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+        "Connection: close\r\n\r\n";
+    SendAll(fd, headers.data(), headers.size());
+    for (char c : data) SendAll(fd, &c, 1);
+    close(fd);
+  }
+}
+
+struct PageLoads {
+  double cold_ms;  // First load
+  double warm_ms;  // Average reload
+  size_t cold_bytes;
+  size_t warm_bytes;  // Per reload
+};
+
+// A browser loading the page `loads` times: every asset each time, sending
+// back the ETag it was given
+PageLoads LoadPage(uint16_t port, int loads) {
+  std::map<std::string, std::string> etags;
+  PageLoads result = {};
+  for (int i = 0; i < loads; i++) {
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    for (const AssetSizes& asset : kPage) {
+      std::string request = std::string("GET ") + asset.path +
+                            " HTTP/1.1\r\nAccept-Encoding: gzip, deflate\r\n";
+      if (!etags[asset.path].empty()) {
+        request += "If-None-Match: " + etags[asset.path] + "\r\n";
+      }
+      std::string response = Fetch(port, request + "\r\n");
+      std::string etag = HeaderValue(response, "ETag");
+      if (!etag.empty()) etags[asset.path] = etag;
+      bytes += response.size();
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    if (i == 0) {
+      result.cold_ms = ms;
+      result.cold_bytes = bytes;
+    } else {
+      result.warm_ms += ms / (loads - 1);
+      result.warm_bytes = bytes;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+void test_static_assets_table(void) {
+  StaticAssetTable table;
+  TEST_ASSERT_TRUE(table.Add("/index.html", "text/html", 0x1234abcd, 3739,
+                             1001));
+  TEST_ASSERT_TRUE(table.Add("/script.js", "application/javascript", 7, 10,
+                             0));
+  TEST_ASSERT_EQUAL_INT(2, table.size());
+
+  const StaticAsset* asset = table.Find("/index.html");
+  TEST_ASSERT_NOT_NULL(asset);
+  TEST_ASSERT_EQUAL_STRING("text/html", asset->content_type);
+  TEST_ASSERT_EQUAL_UINT32(1001, asset->gzip_size);
+  TEST_ASSERT_NULL(table.Find("/index.htm"));
+  TEST_ASSERT_NULL(table.Find("/"));
+
+  char etag[kStaticAssetEtagSize];
+  FormatStaticAssetEtag(*asset, false, etag);
+  TEST_ASSERT_EQUAL_STRING("\"1234abcd\"", etag);
+  FormatStaticAssetEtag(*asset, true, etag);
+  TEST_ASSERT_EQUAL_STRING("\"1234abcd-gz\"", etag);
+
+  // The response: gzip when accepted, 304 for its own ETag only
+  StaticAssetResponse answer =
+      PrepareStaticAssetResponse(*asset, "br, gzip", nullptr, "no-cache");
+  TEST_ASSERT_EQUAL_STRING("200 OK", answer.status);
+  TEST_ASSERT_TRUE(answer.gzip);
+  TEST_ASSERT_EQUAL_STRING(
+      "ETag: \"1234abcd-gz\"\r\nCache-Control: no-cache\r\n"
+      "Vary: Accept-Encoding\r\nContent-Type: text/html\r\n"
+      "Content-Encoding: gzip\r\n",
+      answer.headers);
+  answer = PrepareStaticAssetResponse(*asset, nullptr, "\"1234abcd-gz\"",
+                                      "max-age=60");
+  TEST_ASSERT_FALSE(answer.not_modified);
+  TEST_ASSERT_FALSE(answer.gzip);
+  TEST_ASSERT_EQUAL_STRING(
+      "ETag: \"1234abcd\"\r\nCache-Control: max-age=60\r\n"
+      "Vary: Accept-Encoding\r\nContent-Type: text/html\r\n",
+      answer.headers);
+  answer = PrepareStaticAssetResponse(*asset, nullptr, "W/\"1234abcd\"",
+                                      "no-cache");
+  TEST_ASSERT_TRUE(answer.not_modified);
+  TEST_ASSERT_EQUAL_STRING("304 Not Modified", answer.status);
+  TEST_ASSERT_EQUAL_STRING(
+      "ETag: \"1234abcd\"\r\nCache-Control: no-cache\r\n"
+      "Vary: Accept-Encoding\r\n",
+      answer.headers);
+
+  // Replacing keeps one entry
+  TEST_ASSERT_TRUE(table.Add("/script.js", "application/javascript", 8, 10,
+                             0));
+  TEST_ASSERT_EQUAL_INT(2, table.size());
+  TEST_ASSERT_EQUAL_UINT32(8, table.Find("/script.js")->hash);
+
+  // Every slot used: colliding paths are all still found
+  for (int i = table.size(); i < StaticAssetTable::kCapacity; i++) {
+    char path[24];
+    snprintf(path, sizeof(path), "/asset%d", i);
+    TEST_ASSERT_TRUE(table.Add(path, "text/plain", i, i, 0));
+  }
+  TEST_ASSERT_FALSE(table.Add("/one-too-many", "text/plain", 0, 0, 0));
+  for (int i = 2; i < StaticAssetTable::kCapacity; i++) {
+    char path[24];
+    snprintf(path, sizeof(path), "/asset%d", i);
+    TEST_ASSERT_EQUAL_UINT32(i, table.Find(path)->hash);
+  }
+  TEST_ASSERT_NULL(table.Find("/missing"));
+  TEST_ASSERT_FALSE(table.Add(std::string(40, 'a').c_str(), "", 0, 0, 0));
+
+  // The hash continues across pieces
+  TEST_ASSERT_EQUAL_UINT32(StaticAssetHash("hello world", 11),
+                           StaticAssetHash("world", 5,
+                                           StaticAssetHash("hello ", 6)));
+}
+
+void test_static_assets_benchmark(void) {
+  Files files;
+  for (const AssetSizes& asset : kPage) {
+    std::string data = Filler(asset.size, asset.size);
+    files.contents[asset.path] = data;
+    files.contents[std::string(asset.path) + ".gz"] =
+        Filler(asset.gzip_size, asset.gzip_size);
+    files.assets.Add(asset.path, asset.content_type,
+                     StaticAssetHash(data.data(), data.size()), asset.size,
+                     asset.gzip_size);
+  }
+  const int kLoads = 10;
+
+  // Legacy
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+  listen(listen_fd, 8);
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+  socklen_t length = sizeof(addr);
+  getsockname(listen_fd, (sockaddr*)&addr, &length);
+  std::atomic<bool> stop{false};
+  std::thread legacy(LegacyServer, listen_fd, &files, &stop);
+  PageLoads before = LoadPage(ntohs(addr.sin_port), kLoads);
+  stop = true;
+  legacy.join();
+  close(listen_fd);
+
+  // Static asset path
+  PageLoads after;
+  {
+    HttpEventServer server(4, 5000, HandleAsset, &files, NowMs);
+    TEST_ASSERT_TRUE(server.Listen(0));
+    std::atomic<bool> done{false};
+    std::thread poll([&] {
+      while (!done) server.Poll(10);
+    });
+    after = LoadPage(server.port(), kLoads);
+
+    // Conditional and negotiated responses
+    std::string response =
+        Fetch(server.port(), "GET /script.js HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_EQUAL_STRING("", HeaderValue(response, "Content-Encoding")
+                                     .c_str());
+    TEST_ASSERT_EQUAL_STRING("10124",
+                             HeaderValue(response, "Content-Length").c_str());
+    std::string etag = HeaderValue(response, "ETag");
+    response = Fetch(server.port(), "GET /script.js HTTP/1.1\r\n"
+                                    "If-None-Match: \"0\", W/" + etag +
+                                        "\r\n\r\n");
+    TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.1 304 Not Modified\r\n"));
+    TEST_ASSERT_EQUAL_STRING("", HeaderValue(response, "Content-Length")
+                                     .c_str());
+    TEST_ASSERT_TRUE(response.size() ==
+                     response.find("\r\n\r\n") + strlen("\r\n\r\n"));
+    // The plain ETag does not validate the gzip copy
+    response = Fetch(server.port(), "GET /script.js HTTP/1.1\r\n"
+                                    "Accept-Encoding: gzip\r\n"
+                                    "If-None-Match: " + etag + "\r\n\r\n");
+    TEST_ASSERT_EQUAL_STRING("gzip", HeaderValue(response, "Content-Encoding")
+                                         .c_str());
+    TEST_ASSERT_EQUAL_STRING("2534",
+                             HeaderValue(response, "Content-Length").c_str());
+    done = true;
+    poll.join();
+  }
+
+  size_t plain = 0;
+  size_t gzip = 0;
+  for (const AssetSizes& asset : kPage) {
+    plain += asset.size;
+    gzip += asset.gzip_size;
+  }
+  TEST_ASSERT_TRUE(before.cold_bytes > plain);
+  TEST_ASSERT_EQUAL_UINT32(before.cold_bytes, before.warm_bytes);
+  TEST_ASSERT_TRUE(after.cold_bytes > gzip && after.cold_bytes < plain / 2);
+  TEST_ASSERT_TRUE(after.warm_bytes < 1000);
+
+  char message[240];
+  snprintf(message, sizeof(message),
+           "page load (3 assets), first / reload: byte writes %.2f / %.2f ms, "
+           "%u / %u bytes; gzip + ETag %.2f / %.2f ms, %u / %u bytes",
+           before.cold_ms, before.warm_ms, (unsigned)before.cold_bytes,
+           (unsigned)before.warm_bytes, after.cold_ms, after.warm_ms,
+           (unsigned)after.cold_bytes, (unsigned)after.warm_bytes);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,224 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "json_writer.h"
+#include "status_binary.h"
+#include "status_json.h"
+
+namespace {
+
+// The default topology, one sensor failed and the pump overridden
+StatusBinaryState MakeState() {
+  StatusBinaryState state = {};
+  state.uptime_ms = 86400123;
+  state.tick_count = 43200;
+  state.log_seq = 1050;
+  state.override_enabled = true;
+  state.delta_t = 6.79f;
+  state.target_intensity = 41.5f;
+
+  state.sensor_count = 3;
+  state.sensors[0] = {"ambient", true, 24.46f};
+  state.sensors[1] = {"coolant_in", true, 31.25f};
+  state.sensors[2] = {"coolant_out", false, 0.0f};
+
+  state.fan_count = 4;
+  state.fans[0] = {"fan1", 40.0f, 41.5f, 1180, 1, false, false};
+  state.fans[1] = {"fan2", 40.0f, 41.5f, 1175, 1, false, false};
+  state.fans[2] = {"fan3", 55.5f, 41.5f, 2410, 1, false, false};
+  state.fans[3] = {"pump", 100.0f, 100.0f, 0, 1, true, true};
+
+  state.zone_count = 1;
+  state.zones[0] = {"loop", 6.79f, 41.5f};
+  return state;
+}
+
+std::vector<uint8_t> Encode(const StatusBinaryState& state) {
+  std::vector<uint8_t> data(kStatusBinaryMaxSize);
+  data.resize(EncodeStatusBinary(state, data.data(), data.size()));
+  return data;
+}
+
+bool CountSink(const char* data, size_t size, void* context) {
+  (void)data;
+  *(size_t*)context += size;
+  return true;
+}
+
+}  // namespace
+
+void test_status_binary_round_trip(void) {
+  StatusBinaryState state = MakeState();
+  std::vector<uint8_t> data = Encode(state);
+  const size_t kIds = sizeof("ambient") + sizeof("coolant_in") +
+                      sizeof("coolant_out") + 3 * sizeof("fan1") +
+                      sizeof("pump") + sizeof("loop");
+  TEST_ASSERT_EQUAL_UINT(28 + 3 * 2 + 4 * 8 + 1 * 4 + kIds, data.size());
+
+  StatusBinaryState decoded;
+  TEST_ASSERT_NULL(DecodeStatusBinary(data.data(), data.size(), &decoded));
+  TEST_ASSERT_EQUAL_UINT32(86400123, decoded.uptime_ms);
+  TEST_ASSERT_EQUAL_UINT32(43200, decoded.tick_count);
+  TEST_ASSERT_EQUAL_UINT32(1050, decoded.log_seq);
+  TEST_ASSERT_TRUE(decoded.override_enabled);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 6.79f, decoded.delta_t);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 41.5f, decoded.target_intensity);
+
+  TEST_ASSERT_EQUAL_INT(3, decoded.sensor_count);
+  TEST_ASSERT_EQUAL_STRING("ambient", decoded.sensors[0].id);
+  TEST_ASSERT_TRUE(decoded.sensors[0].ok);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 24.46f, decoded.sensors[0].temp);
+  TEST_ASSERT_EQUAL_STRING("coolant_out", decoded.sensors[2].id);
+  TEST_ASSERT_FALSE(decoded.sensors[2].ok);
+
+  TEST_ASSERT_EQUAL_INT(4, decoded.fan_count);
+  TEST_ASSERT_EQUAL_STRING("fan3", decoded.fans[2].id);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 55.5f, decoded.fans[2].duty);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 41.5f, decoded.fans[2].target);
+  TEST_ASSERT_EQUAL_INT32(2410, decoded.fans[2].rpm);
+  TEST_ASSERT_EQUAL_UINT8(1, decoded.fans[2].zone_mask);
+  TEST_ASSERT_FALSE(decoded.fans[2].overridden);
+  TEST_ASSERT_EQUAL_STRING("pump", decoded.fans[3].id);
+  TEST_ASSERT_TRUE(decoded.fans[3].overridden);
+  TEST_ASSERT_TRUE(decoded.fans[3].pump);
+
+  TEST_ASSERT_EQUAL_INT(1, decoded.zone_count);
+  TEST_ASSERT_EQUAL_STRING("loop", decoded.zones[0].id);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 6.79f, decoded.zones[0].delta_t);
+
+  // Out of range values saturate; a reading never becomes "failed"
+  state.sensors[0].temp = -400.0f;
+  state.fans[0].rpm = 70000;
+  state.fans[0].duty = -3.0f;
+  data = Encode(state);
+  TEST_ASSERT_NULL(DecodeStatusBinary(data.data(), data.size(), &decoded));
+  TEST_ASSERT_TRUE(decoded.sensors[0].ok);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, -327.67f, decoded.sensors[0].temp);
+  TEST_ASSERT_EQUAL_INT32(65535, decoded.fans[0].rpm);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, decoded.fans[0].duty);
+
+  // Too small a buffer
+  uint8_t small[40];
+  TEST_ASSERT_EQUAL_UINT(0, EncodeStatusBinary(state, small, sizeof(small)));
+}
+
+void test_status_binary_layout(void) {
+  std::vector<uint8_t> data = Encode(MakeState());
+
+  // As documented: little-endian fields at fixed offsets
+  TEST_ASSERT_EQUAL_UINT8(kStatusBinaryVersion, data[0]);
+  TEST_ASSERT_EQUAL_UINT8(28, data[1]);  // header_size
+  TEST_ASSERT_EQUAL_UINT8(kStatusBinaryOverrideEnabled, data[2]);
+  TEST_ASSERT_EQUAL_UINT8(3, data[3]);   // sensor_count
+  TEST_ASSERT_EQUAL_UINT8(2, data[4]);   // sensor_size
+  TEST_ASSERT_EQUAL_UINT8(4, data[5]);   // fan_count
+  TEST_ASSERT_EQUAL_UINT8(8, data[6]);   // fan_size
+  TEST_ASSERT_EQUAL_UINT8(1, data[7]);   // zone_count
+  TEST_ASSERT_EQUAL_UINT8(4, data[8]);   // zone_size
+  TEST_ASSERT_EQUAL_UINT8(679 & 0xFF, data[24]);  // delta_t_centi
+  TEST_ASSERT_EQUAL_UINT8(679 >> 8, data[25]);
+  // ambient: 2446 = 0x098E
+  TEST_ASSERT_EQUAL_UINT8(0x8E, data[28]);
+  TEST_ASSERT_EQUAL_UINT8(0x09, data[29]);
+  // coolant_out failed: INT16_MIN
+  TEST_ASSERT_EQUAL_UINT8(0x00, data[32]);
+  TEST_ASSERT_EQUAL_UINT8(0x80, data[33]);
+  // fan3 RPM 2410 = 0x096A, after its duty and target
+  TEST_ASSERT_EQUAL_UINT8(0x6A, data[34 + 2 * 8 + 4]);
+  TEST_ASSERT_EQUAL_UINT8(0x09, data[34 + 2 * 8 + 5]);
+  TEST_ASSERT_EQUAL_STRING("ambient", (const char*)&data[34 + 32 + 4]);
+}
+
+void test_status_binary_compatibility(void) {
+  StatusBinaryState state = MakeState();
+  std::vector<uint8_t> data = Encode(state);
+  StatusBinaryState decoded;
+
+  // A later version with a longer header and longer fan records
+  std::vector<uint8_t> later(data.begin(), data.begin() + 28);
+  later[1] = 32;
+  later[6] = 10;
+  later.insert(later.end(), {0xAA, 0xBB, 0xCC, 0xDD});
+  later.insert(later.end(), data.begin() + 28, data.begin() + 34);
+  for (int i = 0; i < 4; i++) {
+    later.insert(later.end(), data.begin() + 34 + i * 8,
+                 data.begin() + 42 + i * 8);
+    later.insert(later.end(), {0xEE, 0xFF});
+  }
+  later.insert(later.end(), data.begin() + 66, data.end());
+  TEST_ASSERT_NULL(DecodeStatusBinary(later.data(), later.size(), &decoded));
+  TEST_ASSERT_EQUAL_INT32(0, decoded.fans[3].rpm);
+  TEST_ASSERT_EQUAL_INT32(2410, decoded.fans[2].rpm);
+  TEST_ASSERT_EQUAL_STRING("loop", decoded.zones[0].id);
+
+  // Incompatible or damaged
+  std::vector<uint8_t> bad = data;
+  bad[0] = 2;
+  TEST_ASSERT_EQUAL_STRING(
+      "Unsupported status version",
+      DecodeStatusBinary(bad.data(), bad.size(), &decoded));
+  bad = data;
+  bad[3] = kMaxSensors + 1;
+  TEST_ASSERT_NOT_NULL(DecodeStatusBinary(bad.data(), bad.size(), &decoded));
+  bad = data;
+  bad.back() = 'x';
+  TEST_ASSERT_EQUAL_STRING(
+      "Truncated status ids",
+      DecodeStatusBinary(bad.data(), bad.size(), &decoded));
+  for (size_t size = 0; size < data.size(); size++) {
+    TEST_ASSERT_NOT_NULL(DecodeStatusBinary(data.data(), size, &decoded));
+  }
+}
+
+void test_status_binary_benchmark(void) {
+  StatusBinaryState state = MakeState();
+  StatusSensorReading sensors[3];
+  for (int i = 0; i < 3; i++) {
+    sensors[i] = {state.sensors[i].id, state.sensors[i].ok,
+                  state.sensors[i].temp};
+  }
+  StatusFanReading fans[4];
+  for (int i = 0; i < 4; i++) fans[i] = {state.fans[i].duty, state.fans[i].rpm};
+  StatusDocument document = {sensors, 3, fans, 4, state.log_seq, 0, true};
+
+  const int kIterations = 100000;
+  size_t json_size = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    json_size = 0;
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer), CountSink, &json_size);
+    WriteStatusJson(document, &json);
+    json.Flush();
+  }
+  double json_us = std::chrono::duration<double, std::micro>(
+                       std::chrono::steady_clock::now() - start)
+                       .count() /
+                   kIterations;
+
+  size_t binary_size = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    uint8_t buffer[kStatusBinaryMaxSize];
+    binary_size = EncodeStatusBinary(state, buffer, sizeof(buffer));
+    // Keep the encoding from being optimized away
+    __asm__ __volatile__("" : : "r"(buffer) : "memory");
+  }
+  double binary_us = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - start)
+                         .count() /
+                     kIterations;
+  TEST_ASSERT_TRUE(binary_size < json_size);
+
+  char message[200];
+  snprintf(message, sizeof(message),
+           "status: JSON %u bytes in %.3f us; binary %u bytes in %.3f us "
+           "(with fan targets, zones and controller state)",
+           (unsigned)json_size, json_us, (unsigned)binary_size, binary_us);
+  TEST_MESSAGE(message);
+}
@@ -0,0 +1,193 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "json_writer.h"
+#include "status_history.h"
+
+namespace {
+
+PerfLogRecord MakeRecord(uint16_t rpm, uint8_t temp) {
+  PerfLogRecord record;
+  memset(&record, 0, sizeof(record));
+  record.fan1_rpm = rpm;
+  record.fan1_current_duty = 102;  // 40 %
+  record.temp_coolant_in = temp;
+  return record;
+}
+
+struct Point {
+  uint16_t rpm;
+  uint32_t offset_ms;
+};
+
+void CollectPoint(const PerfLogRecord& record, uint32_t offset_ms,
+                  void* context) {
+  ((std::vector<Point>*)context)->push_back({record.fan1_rpm, offset_ms});
+}
+
+bool AppendSink(const char* data, size_t size, void* context) {
+  ((std::string*)context)->append(data, size);
+  return true;
+}
+
+// 15 minutes at 1 s: a fan ramping slowly, one RPM spike and a temperature
+// step
+void FillQuarterHour(StatusHistory* history) {
+  for (int i = 0; i < 900; i++) {
+    uint16_t rpm = 1000 + i;
+    if (i == 437) rpm = 3000;
+    history->Add(5000 + i * 1000, MakeRecord(rpm, i < 600 ? 100 : 140));
+  }
+}
+
+std::string HistoryJson(const StatusHistory& history, int max_points) {
+  const char* ids[] = {"ambient", "coolant_in", "coolant_out"};
+  std::string out;
+  char buffer[256];
+  JsonWriter json(buffer, sizeof(buffer), AppendSink, &out);
+  WriteStatusHistoryJson(history, max_points, ids, 3, 4, &json);
+  json.Flush();
+  return out;
+}
+
+}  // namespace
+
+void test_status_history_ring(void) {
+  PerfLogRecord storage[4];
+  StatusHistory history(storage, 4);
+  TEST_ASSERT_EQUAL_INT(0, history.size());
+  TEST_ASSERT_EQUAL_UINT32(0, history.span_ms());
+
+  // Times wrap around 2^32 ms; a gap over a minute saturates
+  history.Add(0xFFFFFC18u, MakeRecord(1, 0));  // -1000
+  history.Add(0, MakeRecord(2, 0));
+  history.Add(1500, MakeRecord(3, 0));
+  history.Add(101500, MakeRecord(4, 0));
+  TEST_ASSERT_EQUAL_INT(4, history.size());
+  TEST_ASSERT_EQUAL_UINT16(0, history.at(0).delta_ms);
+  TEST_ASSERT_EQUAL_UINT16(1000, history.at(1).delta_ms);
+  TEST_ASSERT_EQUAL_UINT16(1500, history.at(2).delta_ms);
+  TEST_ASSERT_EQUAL_UINT16(65535, history.at(3).delta_ms);
+  TEST_ASSERT_EQUAL_UINT32(1000 + 1500 + 65535, history.span_ms());
+
+  // Full: the oldest goes, and with it the time to the next one
+  history.Add(102500, MakeRecord(5, 0));
+  history.Add(103500, MakeRecord(6, 0));
+  TEST_ASSERT_EQUAL_INT(4, history.size());
+  TEST_ASSERT_EQUAL_UINT16(3, history.at(0).fan1_rpm);
+  TEST_ASSERT_EQUAL_UINT16(6, history.at(3).fan1_rpm);
+  TEST_ASSERT_EQUAL_UINT32(65535 + 1000 + 1000, history.span_ms());
+
+  history.Clear();
+  TEST_ASSERT_EQUAL_INT(0, history.size());
+  history.Add(7, MakeRecord(7, 0));
+  TEST_ASSERT_EQUAL_UINT16(7, history.at(0).fan1_rpm);
+  TEST_ASSERT_EQUAL_UINT32(0, history.span_ms());
+}
+
+void test_status_history_reduce(void) {
+  std::vector<PerfLogRecord> storage(900);
+  StatusHistory history(storage.data(), 900);
+  std::vector<Point> points;
+
+  // Fewer records than points: all of them
+  for (int i = 0; i < 5; i++) history.Add(i * 1000, MakeRecord(i, 0));
+  ReduceStatusHistory(history, 90, CollectPoint, &points);
+  TEST_ASSERT_EQUAL_INT(5, points.size());
+  TEST_ASSERT_EQUAL_UINT32(4000, points[4].offset_ms);
+
+  // 900 to 90, keeping both ends and the spike
+  history.Clear();
+  FillQuarterHour(&history);
+  points.clear();
+  ReduceStatusHistory(history, 90, CollectPoint, &points);
+  TEST_ASSERT_EQUAL_INT(90, points.size());
+  TEST_ASSERT_EQUAL_UINT32(0, points.front().offset_ms);
+  TEST_ASSERT_EQUAL_UINT16(1000, points.front().rpm);
+  TEST_ASSERT_EQUAL_UINT32(899000, points.back().offset_ms);
+  TEST_ASSERT_EQUAL_UINT16(1899, points.back().rpm);
+  bool spike = false;
+  for (size_t i = 0; i < points.size(); i++) {
+    if (i > 0) TEST_ASSERT_TRUE(points[i].offset_ms > points[i - 1].offset_ms);
+    // Offsets match the records picked
+    if (points[i].rpm != 3000) {
+      TEST_ASSERT_EQUAL_UINT32((points[i].rpm - 1000) * 1000,
+                               points[i].offset_ms);
+    } else {
+      spike = points[i].offset_ms == 437000;
+    }
+  }
+  TEST_ASSERT_TRUE(spike);
+
+  // Just the ends
+  points.clear();
+  ReduceStatusHistory(history, 1, CollectPoint, &points);
+  TEST_ASSERT_EQUAL_INT(2, points.size());
+  TEST_ASSERT_EQUAL_UINT32(899000, points[1].offset_ms);
+}
+
+void test_status_history_json(void) {
+  PerfLogRecord storage[8];
+  StatusHistory history(storage, 8);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"thermistors\":[\"ambient\",\"coolant_in\",\"coolant_out\"],"
+      "\"fans\":4,\"points\":[]}",
+      HistoryJson(history, 90).c_str());
+
+  PerfLogRecord record = MakeRecord(1180, 0);
+  record.temp_ambient = 93;  // 24.6 C
+  history.Add(1000, record);
+  record.temp_coolant_in = 255;
+  record.fan4_rpm = 2410;
+  history.Add(2000, record);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"thermistors\":[\"ambient\",\"coolant_in\",\"coolant_out\"],"
+      "\"fans\":4,\"points\":["
+      "[1000,24.6,null,null,40.0,1180,0.0,0,0.0,0,0.0,0],"
+      "[0,24.6,50.0,null,40.0,1180,0.0,0,0.0,0,0.0,2410]]}",
+      HistoryJson(history, 90).c_str());
+
+  // Only the logged thermistors and fans
+  const char* ids[] = {"a", "b", "c", "d", "e"};
+  std::string out;
+  char buffer[64];
+  JsonWriter json(buffer, sizeof(buffer), AppendSink, &out);
+  WriteStatusHistoryJson(history, 1, ids, 5, 1, &json);
+  json.Flush();
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"thermistors\":[\"a\",\"b\",\"c\"],\"fans\":1,\"points\":["
+      "[1000,24.6,null,null,40.0,1180],[0,24.6,50.0,null,40.0,1180]]}",
+      out.c_str());
+}
+
+void test_status_history_benchmark(void) {
+  std::vector<PerfLogRecord> storage(900);
+  StatusHistory history(storage.data(), 900);
+  FillQuarterHour(&history);
+
+  // What a page load gets: the charts' 180 points instead of 900 polls
+  const int kIterations = 200;
+  std::string reduced;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) reduced = HistoryJson(history, 180);
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - start)
+                  .count() /
+              kIterations;
+  std::string full = HistoryJson(history, 900);
+  TEST_ASSERT_TRUE(reduced.size() < full.size() / 4);
+
+  char message[200];
+  snprintf(message, sizeof(message),
+           "/api/history: 900 records in %u bytes of RAM; 180 points %u "
+           "bytes in %.1f us, all 900 points %u bytes",
+           (unsigned)(sizeof(PerfLogRecord) * 900), (unsigned)reduced.size(),
+           us, (unsigned)full.size());
+  TEST_MESSAGE(message);
+}
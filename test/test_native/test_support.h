@@ -0,0 +1,140 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+// Helpers shared by the host tests: loopback HTTP clients, a thread running
+// an HttpEventServer, and an in-memory stand-in for the log files
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_event_server.h"
+#include "perf_log_query.h"
+
+// Milliseconds of a monotonic clock, as the servers' HttpClockMs
+inline uint32_t NowMs() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// A TCP connection to `port` on the loopback interface
+inline int Connect(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  connect(fd, (sockaddr*)&addr, sizeof(addr));
+  return fd;
+}
+
+inline bool SendAll(int fd, const void* data, size_t size) {
+  const char* p = (const char*)data;
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool SendAll(int fd, const std::string& data) {
+  return SendAll(fd, data.data(), data.size());
+}
+
+// Everything until the peer closes
+inline std::string ReadAll(int fd) {
+  std::string response;
+  char buffer[8192];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, n);
+  }
+  return response;
+}
+
+// One request on a new connection; returns the whole response
+inline std::string Fetch(uint16_t port, const std::string& request) {
+  int fd = Connect(port);
+  SendAll(fd, request);
+  std::string response = ReadAll(fd);
+  close(fd);
+  return response;
+}
+
+// What follows the head of a response, or ""
+inline std::string Body(const std::string& response) {
+  size_t end = response.find("\r\n\r\n");
+  return end == std::string::npos ? "" : response.substr(end + 4);
+}
+
+// Runs Poll() on a thread until destroyed
+class ServerThread {
+ public:
+  explicit ServerThread(HttpEventServer* server, int poll_ms = 10)
+      : thread_([this, server, poll_ms] {
+          while (!stop_) {
+            server->Poll(poll_ms);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (task_) {
+              task_();
+              task_ = nullptr;
+              done_.notify_all();
+            }
+          }
+        }) {}
+  ~ServerThread() {
+    stop_ = true;
+    thread_.join();
+  }
+
+  // Run `task` on the server thread between polls (the server is not
+  // thread-safe) and wait for it
+  void Call(std::function<void()> task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = task;
+    done_.wait(lock, [this] { return !task_; });
+  }
+
+ private:
+  std::atomic<bool> stop_{false};
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::function<void()> task_;
+  std::thread thread_;
+};
+
+// LittleFS stand-in: files in memory, counting reads
+class MemoryStorage : public PerfLogStorage {
+ public:
+  size_t Read(int index, uint32_t offset, uint8_t* out,
+              size_t size) override {
+    auto it = files.find(index);
+    if (it == files.end() || offset >= it->second.size()) return 0;
+    size_t n = std::min(size, it->second.size() - offset);
+    memcpy(out, it->second.data() + offset, n);
+    reads++;
+    return n;
+  }
+
+  std::map<int, std::vector<uint8_t>> files;
+  uint32_t reads = 0;
+};
+
+#endif  // TEST_SUPPORT_H
@@ -0,0 +1,146 @@
+#include <unity.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "topology.h"
+
+namespace {
+
+// "D<n>" maps to n, "A<n>" to 100 + n
+int ResolveTestPin(const char* name) {
+  if (name[0] == 'D') return atoi(name + 1);
+  if (name[0] == 'A') return 100 + atoi(name + 1);
+  return -1;
+}
+
+const char* kTwoZoneTopology =
+    "# Two loops sharing the ambient probe\n"
+    "sensor Ambient A0\n"
+    "sensor Cpu_In A1\n"
+    "sensor Cpu_Out A2\n"
+    "sensor Gpu_Out A3\n"
+    "\n"
+    "fan Front D3 D4 30\n"
+    "fan Top D5 D6 25\n"
+    "pump Pump D10 D9 50\n"
+    "zone Cpu max reference=Ambient sensors=Cpu_In,Cpu_Out fans=Front,Pump\n"
+    "zone Gpu weighted reference=Ambient sensors=Gpu_Out:2,Cpu_Out:1 "
+    "fans=Top,Pump\n";
+
+}  // namespace
+
+void test_topology_parse(void) {
+  Topology topology;
+  char error[64];
+  TEST_ASSERT_NULL(ParseTopology(kTwoZoneTopology, ResolveTestPin, &topology,
+                                 error, sizeof(error)));
+  TEST_ASSERT_EQUAL_INT(4, topology.sensor_count);
+  TEST_ASSERT_EQUAL_INT(3, topology.fan_count);
+  TEST_ASSERT_EQUAL_INT(2, topology.zone_count);
+
+  TEST_ASSERT_EQUAL_STRING("Cpu_Out", topology.sensors[2].id);
+  TEST_ASSERT_EQUAL_INT(102, topology.sensors[2].pin);
+  TEST_ASSERT_EQUAL_INT(10, topology.fans[2].pwm_pin);
+  TEST_ASSERT_EQUAL_INT(9, topology.fans[2].tach_pin);
+  TEST_ASSERT_TRUE(topology.fans[2].is_pump);
+  TEST_ASSERT_FALSE(topology.fans[0].is_pump);
+  TEST_ASSERT_EQUAL_FLOAT(30.0f, topology.fans[0].min_duty_percent);
+
+  const ZoneSpec& gpu = topology.zones[1];
+  TEST_ASSERT_EQUAL_INT(kAggregationWeighted, gpu.aggregation);
+  TEST_ASSERT_EQUAL_INT(1, gpu.reference_count);
+  TEST_ASSERT_EQUAL_INT(2, gpu.sensor_count);
+  TEST_ASSERT_EQUAL_INT(3, gpu.sensors[0]);
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, gpu.weights[0]);
+  TEST_ASSERT_EQUAL_INT(2, gpu.fan_count);
+  TEST_ASSERT_EQUAL_INT(2, gpu.fans[1]);
+}
+
+void test_topology_parse_errors(void) {
+  Topology topology;
+  char error[64];
+
+  TEST_ASSERT_NOT_NULL(ParseTopology("sensor Ambient X0\n", ResolveTestPin,
+                                     &topology, error, sizeof(error)));
+  TEST_ASSERT_EQUAL_STRING("line 1: unknown pin", error);
+
+  TEST_ASSERT_NOT_NULL(ParseTopology(
+      "sensor A A0\nfan F D3 D4 40\nzone Z max sensors=B fans=F\n",
+      ResolveTestPin, &topology, error, sizeof(error)));
+  TEST_ASSERT_EQUAL_STRING("line 3: bad sensor list", error);
+
+  TEST_ASSERT_NOT_NULL(ParseTopology("sensor A A0\n", ResolveTestPin,
+                                     &topology, error, sizeof(error)));
+  TEST_ASSERT_EQUAL_STRING("no zones defined", error);
+
+  TEST_ASSERT_NOT_NULL(ParseTopology("fan F D3 D4 140\n", ResolveTestPin,
+                                     &topology, error, sizeof(error)));
+
+  // Keys past the token limit are an error, not silently dropped
+  TEST_ASSERT_NOT_NULL(ParseTopology(
+      "sensor A A0\nfan F D3 D4 40\n"
+      "zone Z max sensors=A fans=F fans=F fans=F fans=F fans=F fans=F\n",
+      ResolveTestPin, &topology, error, sizeof(error)));
+  TEST_ASSERT_EQUAL_STRING("line 3: too many tokens", error);
+
+  TEST_ASSERT_NOT_NULL(ParseTopology(
+      "sensor A A0\nfan F D3 D4 40\n"
+      "zone Z max sensors=A fans=F\nzone Z mean sensors=A fans=F\n",
+      ResolveTestPin, &topology, error, sizeof(error)));
+  TEST_ASSERT_EQUAL_STRING("line 4: duplicate zone id", error);
+}
+
+void test_topology_aggregation(void) {
+  float values[3] = {30.0f, 34.0f, 40.0f};
+  bool valid[3] = {true, true, false};
+  float weights[3] = {1.0f, 3.0f, 10.0f};
+  float result = 0.0f;
+
+  TEST_ASSERT_TRUE(AggregateReadings(kAggregationMax, values, valid, nullptr,
+                                     3, &result));
+  TEST_ASSERT_EQUAL_FLOAT(34.0f, result);
+
+  TEST_ASSERT_TRUE(AggregateReadings(kAggregationMean, values, valid, nullptr,
+                                     3, &result));
+  TEST_ASSERT_EQUAL_FLOAT(32.0f, result);
+
+  // Invalid entries drop out and the remaining weights are renormalized
+  TEST_ASSERT_TRUE(AggregateReadings(kAggregationWeighted, values, valid,
+                                     weights, 3, &result));
+  TEST_ASSERT_EQUAL_FLOAT(33.0f, result);
+
+  bool none[3] = {false, false, false};
+  TEST_ASSERT_FALSE(AggregateReadings(kAggregationMax, values, none, nullptr,
+                                      3, &result));
+}
+
+void test_topology_channel_hash(void) {
+  Topology topology;
+  char error[64];
+  TEST_ASSERT_NULL(ParseTopology(kTwoZoneTopology, ResolveTestPin, &topology,
+                                 error, sizeof(error)));
+  uint32_t hash = TopologyChannelHash(topology);
+
+  // Pins and zones do not move settings between channels
+  Topology other = topology;
+  other.fans[0].pwm_pin = 7;
+  other.zone_count = 1;
+  TEST_ASSERT_EQUAL_UINT32(hash, TopologyChannelHash(other));
+
+  // A reorder, a new minimum, a fan turned pump or one more fan do
+  other = topology;
+  other.fans[0] = topology.fans[1];
+  other.fans[1] = topology.fans[0];
+  TEST_ASSERT_TRUE(hash != TopologyChannelHash(other));
+  other = topology;
+  other.fans[1].min_duty_percent = 35.0f;
+  TEST_ASSERT_TRUE(hash != TopologyChannelHash(other));
+  other = topology;
+  other.fans[1].is_pump = true;
+  TEST_ASSERT_TRUE(hash != TopologyChannelHash(other));
+  other = topology;
+  other.fans[3] = topology.fans[0];
+  other.fan_count = 4;
+  TEST_ASSERT_TRUE(hash != TopologyChannelHash(other));
+}
@@ -0,0 +1,44 @@
+# PlatformIO pre-build script: writes data/<asset>.gz next to each web UI
+# file, so the filesystem image carries pre-compressed copies the HTTP server
+# sends with Content-Encoding: gzip (see lib/portable/static_assets.h).
+#
+# Also runs standalone: python tools/gzip_assets.py [data_dir]
+import gzip
+import os
+import sys
+
+ASSET_EXTENSIONS = ('.html', '.css', '.js')
+
+def gzip_assets(data_dir):
+    """
+    Compresses every asset whose .gz copy is missing or older; returns the
+    list of (name, size, gzip_size) for the assets written.
+    """
+    written = []
+    for name in sorted(os.listdir(data_dir)):
+        if not name.endswith(ASSET_EXTENSIONS):
+            continue
+        path = os.path.join(data_dir, name)
+        gz_path = path + '.gz'
+        if (os.path.exists(gz_path) and
+                os.path.getmtime(gz_path) >= os.path.getmtime(path)):
+            continue
+        with open(path, 'rb') as f:
+            data = f.read()
+        # mtime=0 keeps the output (and the image) reproducible
+        compressed = gzip.compress(data, compresslevel=9, mtime=0)
+        with open(gz_path, 'wb') as f:
+            f.write(compressed)
+        written.append((name, len(data), len(compressed)))
+    return written
+
+def report(written):
+    for name, size, gzip_size in written:
+        print(f"gzip_assets: {name} {size} -> {gzip_size} bytes")
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+    report(gzip_assets(env.subst("$PROJECT_DATA_DIR")))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        report(gzip_assets(sys.argv[1] if len(sys.argv) > 1 else "data"))
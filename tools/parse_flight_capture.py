@@ -0,0 +1,96 @@
+import struct
+import sys
+
+# Capture header (see lib/portable/flight_capture.h)
+FLIGHT_CAPTURE_MAGIC = 0x52464346  # "FCFR"
+HEADER_FORMAT = '<IHHBBHHBBIQqII'
+TRIGGER_NAMES = {0: 'none', 1: 'sensor_error', 2: 'fan_stall', 3: 'temp_slope', 4: 'manual'}
+
+def read_header(data):
+    """
+    Reads the capture header; raises ValueError if it is not a capture file.
+    """
+    if len(data) < struct.calcsize(HEADER_FORMAT):
+        raise ValueError("File too short")
+    (magic, version, header_size, fan_count, sensor_count, sample_size,
+     sample_rate_hz, reason, reason_index, boot_id, trigger_uptime_ms,
+     trigger_wall_clock_ms, sample_count, trigger_sample) = struct.unpack_from(HEADER_FORMAT, data)
+    if magic != FLIGHT_CAPTURE_MAGIC:
+        raise ValueError(f"Bad magic 0x{magic:08X}")
+    if sample_size != 4 + 2 * fan_count + 2 * sensor_count:
+        raise ValueError(f"Sample size {sample_size} does not match "
+                         f"{fan_count} fans and {sensor_count} sensors")
+    return {
+        'version': version,
+        'header_size': header_size,
+        'fan_count': fan_count,
+        'sensor_count': sensor_count,
+        'sample_size': sample_size,
+        'sample_rate_hz': sample_rate_hz,
+        'reason': TRIGGER_NAMES.get(reason, str(reason)),
+        'reason_index': reason_index,
+        'boot_id': boot_id,
+        'trigger_uptime_ms': trigger_uptime_ms,
+        'trigger_wall_clock_ms': trigger_wall_clock_ms,
+        'sample_count': sample_count,
+        'trigger_sample': trigger_sample,
+    }
+
+def parse_flight_capture(file_path):
+    """
+    Parses a flight recorder capture and prints its samples as CSV to stdout.
+    """
+    try:
+        with open(file_path, 'rb') as f:
+            data = f.read()
+    except FileNotFoundError:
+        sys.stderr.write(f"Error: File not found: {file_path}\n")
+        sys.exit(1)
+
+    try:
+        header = read_header(data)
+    except ValueError as e:
+        sys.stderr.write(f"Error parsing header: {e}\n")
+        sys.exit(1)
+
+    fans = header['fan_count']
+    sensors = header['sensor_count']
+    sys.stderr.write(
+        f"Boot {header['boot_id']}: {header['reason']} trigger ({header['reason_index']}) "
+        f"at uptime {header['trigger_uptime_ms']} ms, {header['sample_count']} samples "
+        f"at {header['sample_rate_hz']} Hz\n")
+
+    columns = ["Boot_Id", "Uptime_ms", "Trigger_Offset_ms"]
+    columns += [f"Fan{i + 1}_Duty%" for i in range(fans)]
+    columns += [f"Fan{i + 1}_Pulses" for i in range(fans)]
+    columns += [f"Sensor{i + 1}_mV" for i in range(sensors)]
+    print(",".join(columns))
+
+    sample_format = f'<I{fans}B{fans}B{sensors}H'
+    trigger_low = header['trigger_uptime_ms'] & 0xFFFFFFFF
+    offset = header['header_size']
+    for _ in range(header['sample_count']):
+        if offset + header['sample_size'] > len(data):
+            sys.stderr.write("Warning: Capture is truncated\n")
+            break
+        fields = struct.unpack_from(sample_format, data, offset)
+        offset += header['sample_size']
+
+        # Samples carry the low 32 bits of the uptime
+        before_trigger = (trigger_low - fields[0]) & 0xFFFFFFFF
+        if before_trigger >= 0x80000000:
+            before_trigger -= 1 << 32
+        uptime_ms = header['trigger_uptime_ms'] - before_trigger
+
+        row = [str(header['boot_id']), str(uptime_ms), str(-before_trigger)]
+        row += [f"{d * 100.0 / 255.0:.1f}" for d in fields[1:1 + fans]]
+        row += [str(p) for p in fields[1 + fans:1 + 2 * fans]]
+        row += [str(mv) for mv in fields[1 + 2 * fans:]]
+        print(",".join(row))
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: python parse_flight_capture.py <path_to_capture_file>")
+        sys.exit(1)
+
+    parse_flight_capture(sys.argv[1])
@@ -1,6 +1,8 @@
 import struct
 import sys
 import os
+import zlib
+from datetime import datetime, timezone
 
 def decode_temperature(encoded_val):
     """
@@ -17,69 +19,371 @@ def decode_duty_cycle(encoded_val):
     """
     return encoded_val * 100.0 / 255.0
 
+# File header (see lib/portable/perf_log_format.h)
+PERF_LOG_MAGIC = 0x4C504346  # "FCPL"
+HEADER_PREFIX_FORMAT = '<IHHHH'  # magic, version, header_size, schema, record size
+HEADER_FORMAT = '<IHHHHIIQqHQ'
+# Fields through schema_size; the schema description follows the last field
+SCHEMA_SIZE_END = struct.calcsize('<IHHHHIIQqH')
+SCHEMA_FOUR_FANS_THREE_TEMPS = 1
+SCHEMA_ROLLUP = 2
+# Channel kinds (PerfLogChannelKind in lib/portable/perf_log_schema.h)
+KIND_FAN_TARGET = 1
+KIND_FAN_DUTY = 2
+KIND_FAN_RPM = 3
+KIND_TEMPERATURE = 4
+FIELD_FORMATS = {1: 'B', 2: 'H', 4: 'I'}
+BLOCK_VERSION = 3
+BLOCK_MAGIC = 0xB10C
+BLOCK_HEADER_FORMAT = '<HHHI'  # magic, record count, payload size, CRC-32
+# Version 4 adds the first and last record time, ms after the file start
+TIMED_BLOCK_VERSION = 4
+TIMED_BLOCK_HEADER_FORMAT = BLOCK_HEADER_FORMAT + 'II'
+MAX_BLOCK_RECORDS = 64
+
+def make_schema(channels):
+    """
+    Builds a record schema from (name, kind, size in bytes) channels, which
+    follow the uint16 timestamp in every record.
+    """
+    record_format = '<H' + ''.join(FIELD_FORMATS[size] for _, _, size in channels)
+    # Rollup records: period start (s), sample count, then min, max and mean
+    # records (see lib/portable/perf_log_rollup.h)
+    rollup_format = '<IH' + record_format[1:] * 3
+    return {
+        'names': [name for name, _, _ in channels],
+        'kinds': [kind for _, kind, _ in channels],
+        'record_format': record_format,
+        'record_size': struct.calcsize(record_format),
+        'rollup_format': rollup_format,
+        'rollup_size': struct.calcsize(rollup_format),
+    }
+
+# Files without a schema description: schema 1, four fans and three
+# thermistors (21-byte records, 69-byte rollups)
+DEFAULT_SCHEMA = make_schema(
+    [(f"Fan{n}_{role}", kind, size) for n in range(1, 5)
+     for role, kind, size in [("Target", KIND_FAN_TARGET, 1),
+                              ("Current", KIND_FAN_DUTY, 1),
+                              ("RPM", KIND_FAN_RPM, 2)]] +
+    [("Temp_Ambient", KIND_TEMPERATURE, 1),
+     ("Temp_Coolant_In", KIND_TEMPERATURE, 1),
+     ("Temp_Coolant_Out", KIND_TEMPERATURE, 1)])
+
+def read_schema(data):
+    """
+    Parses a schema description (see EncodePerfLogHeader() in
+    lib/portable/perf_log_format.h): a channel count, then per channel a
+    size | kind << 4 byte and a NUL-terminated name.
+    """
+    if not data:
+        raise ValueError("empty schema description")
+    channels = []
+    pos = 1
+    for _ in range(data[0]):
+        if pos >= len(data):
+            raise ValueError("truncated schema description")
+        size, kind = data[pos] & 0x0F, data[pos] >> 4
+        end = data.find(b'\0', pos + 1)
+        if size not in FIELD_FORMATS or end < 0:
+            raise ValueError("bad schema description")
+        channels.append((data[pos + 1:end].decode('ascii'), kind, size))
+        pos = end + 1
+    return make_schema(channels)
+
+def read_header(data):
+    """
+    Parses the file header. Returns a dict, or None for legacy (version 1)
+    files, which have no header and store uint16 seconds since boot.
+    """
+    if len(data) < 4 or struct.unpack_from('<I', data)[0] != PERF_LOG_MAGIC:
+        return None
+
+    prefix_size = struct.calcsize(HEADER_PREFIX_FORMAT)
+    if len(data) < prefix_size:
+        raise ValueError("truncated header")
+    _, version, header_size, schema_id, record_size = struct.unpack_from(
+        HEADER_PREFIX_FORMAT, data)
+    if header_size > len(data):
+        raise ValueError("truncated header")
+
+    schema_size = 0
+    if header_size >= SCHEMA_SIZE_END:
+        schema_size = struct.unpack_from('<H', data, SCHEMA_SIZE_END - 2)[0]
+        if schema_size > header_size - SCHEMA_SIZE_END:
+            raise ValueError("invalid schema size")
+
+    # Fields an older writer did not have default to 0
+    full_size = struct.calcsize(HEADER_FORMAT)
+    fields_size = header_size - schema_size
+    padded = data[:fields_size].ljust(full_size, b'\0')[:full_size]
+    fields = struct.unpack(HEADER_FORMAT, padded)
+
+    # Files that describe their channels can be decoded whatever their schema
+    if schema_size:
+        schema = read_schema(data[header_size - schema_size:header_size])
+    elif schema_id in (SCHEMA_FOUR_FANS_THREE_TEMPS, SCHEMA_ROLLUP):
+        schema = DEFAULT_SCHEMA
+    else:
+        raise ValueError(f"unknown schema {schema_id}")
+    min_record_size = (schema['rollup_size'] if schema_id == SCHEMA_ROLLUP
+                       else schema['record_size'])
+    if record_size < min_record_size:
+        raise ValueError(f"record size {record_size} too small for schema")
+
+    return {
+        'version': version,
+        'header_size': header_size,
+        'schema_id': schema_id,
+        'record_size': record_size,
+        'boot_id': fields[5],
+        'sample_interval_ms': fields[6],
+        'start_uptime_ms': fields[7],
+        'wall_clock_base_ms': fields[8],
+        'first_seq': fields[10],
+        'schema': schema,
+    }
+
+def read_varint(payload, pos):
+    """
+    Reads an unsigned LEB128 varint. Returns (value, new position).
+    """
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(payload) or shift > 28:
+            raise ValueError("bad block payload")
+        byte = payload[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+def decode_block(payload, record_count, schema):
+    """
+    Decodes a version 3 block payload: a keyframe record followed by
+    delta-of-delta timestamps and per-channel zig-zag varint deltas.
+    """
+    fields = list(struct.unpack_from(schema['record_format'], payload))
+    records = [tuple(fields)]
+    pos = schema['record_size']
+    for _ in range(record_count - 1):
+        raw, pos = read_varint(payload, pos)
+        fields[0] += unzigzag(raw)
+        mask, pos = read_varint(payload, pos)
+        for c in range(len(schema['names'])):
+            if mask & (1 << c):
+                raw, pos = read_varint(payload, pos)
+                fields[1 + c] += unzigzag(raw)
+        records.append(tuple(fields))
+    if pos != len(payload):
+        raise ValueError("bad block payload")
+    return records
+
+def check_block(data, offset, block_header_format):
+    """
+    Checks the block at offset. Returns ((header fields, payload), None), or
+    (None, error) if the block is cut off or corrupt.
+    """
+    header_size = struct.calcsize(block_header_format)
+    if len(data) - offset < header_size:
+        return None, "truncated block"
+    fields = struct.unpack_from(block_header_format, data, offset)
+    magic, count, payload_size, crc = fields[:4]
+    if magic != BLOCK_MAGIC:
+        return None, "bad block magic"
+    if count < 1 or count > MAX_BLOCK_RECORDS:
+        return None, "bad block record count"
+    payload = data[offset + header_size:offset + header_size + payload_size]
+    if len(payload) < payload_size:
+        return None, "truncated block"
+    if zlib.crc32(payload) != crc:
+        return None, "block CRC mismatch"
+    return (fields, payload), None
+
+def find_block(data, offset, block_header_format):
+    """
+    Returns the offset of the first intact block at or after offset, or None.
+    """
+    magic = struct.pack('<H', BLOCK_MAGIC)
+    while True:
+        offset = data.find(magic, offset)
+        if offset < 0:
+            return None
+        if check_block(data, offset, block_header_format)[1] is None:
+            return offset
+        offset += 1
+
+def iter_records(data, header):
+    """
+    Yields the unpacked fields of each record: the uint16 timestamp (delta
+    ms, or seconds since boot in legacy files), then the schema's channels.
+    """
+    if header is None:
+        schema = DEFAULT_SCHEMA
+        offset = 0
+        record_size = schema['record_size']
+    else:
+        schema = header['schema']
+        offset = header['header_size']
+        record_size = header['record_size']
+
+    if header is not None and header['version'] >= BLOCK_VERSION:
+        block_header_format = (TIMED_BLOCK_HEADER_FORMAT
+                               if header['version'] >= TIMED_BLOCK_VERSION
+                               else BLOCK_HEADER_FORMAT)
+        last_offset_ms = 0
+        while offset < len(data):
+            block, error = check_block(data, offset, block_header_format)
+            if error is not None:
+                # Resync at the next intact block; a torn tail has none
+                next_offset = find_block(data, offset + 1, block_header_format)
+                if next_offset is None:
+                    if error == "truncated block":
+                        sys.stderr.write("Warning: Incomplete block at end of file\n")
+                    else:
+                        sys.stderr.write(f"Warning: {error} at offset {offset}, no intact block after it\n")
+                    return
+                sys.stderr.write(f"Warning: {error} at offset {offset}, skipped {next_offset - offset} bytes\n")
+                offset = next_offset
+                continue
+            fields, payload = block
+            offset += struct.calcsize(block_header_format) + len(payload)
+            records = decode_block(payload, fields[1], schema)
+            if len(fields) > 4:
+                # Version 4 blocks carry their time: re-base the first delta,
+                # which keeps timestamps exact after a skipped block
+                first = list(records[0])
+                first[0] = fields[4] - last_offset_ms
+                records[0] = tuple(first)
+                last_offset_ms = fields[5]
+            yield from records
+        return
+
+    while offset < len(data):
+        chunk = data[offset:offset + record_size]
+        if len(chunk) < record_size:
+            sys.stderr.write(f"Warning: Incomplete record at end of file (got {len(chunk)} bytes, expected {record_size})\n")
+            return
+        offset += record_size
+        # Newer writers may append fields; they are ignored.
+        yield struct.unpack(schema['record_format'],
+                            chunk[:schema['record_size']])
+
+def decode_channel(kind, value):
+    """
+    Decodes one record channel of the given kind as a CSV string.
+    """
+    if kind == KIND_TEMPERATURE:
+        return f"{decode_temperature(value):.1f}"
+    if kind in (KIND_FAN_TARGET, KIND_FAN_DUTY):
+        return f"{decode_duty_cycle(value):.1f}"
+    return f"{value:.0f}"
+
+def column_names(schema):
+    """
+    CSV column names of the channels; duty cycles are marked with %.
+    """
+    return [name + '%' if kind in (KIND_FAN_TARGET, KIND_FAN_DUTY) else name
+            for name, kind in zip(schema['names'], schema['kinds'])]
+
+def format_wall_clock(header, uptime_ms):
+    if not header['wall_clock_base_ms']:
+        return ''
+    wall_ms = header['wall_clock_base_ms'] + (uptime_ms - header['start_uptime_ms'])
+    return datetime.fromtimestamp(wall_ms / 1000.0, tz=timezone.utc).isoformat(timespec='milliseconds')
+
+def parse_rollups(data, header):
+    """
+    Prints the min/max/mean rollup records of a minute or hour file as CSV.
+    """
+    schema = header['schema']
+    channel_count = len(schema['names'])
+    columns = ["Boot_Id", "Period_Start_Uptime_ms", "Wall_Clock_UTC", "Period_s", "Samples"]
+    for name in column_names(schema):
+        columns += [f"{name}_Min", f"{name}_Max", f"{name}_Mean"]
+    print(",".join(columns))
+
+    offset = header['header_size']
+    record_size = header['record_size']
+    while offset + record_size <= len(data):
+        fields = struct.unpack(schema['rollup_format'],
+                               data[offset:offset + schema['rollup_size']])
+        offset += record_size
+        start_ms = header['start_uptime_ms'] + fields[0] * 1000
+        # Each of min/max/mean is a full record; skip its unused timestamp
+        stride = channel_count + 1
+        stats = [fields[2 + i * stride + 1:2 + (i + 1) * stride] for i in range(3)]
+        row = [str(header['boot_id']), str(start_ms), format_wall_clock(header, start_ms),
+               str(header['sample_interval_ms'] // 1000), str(fields[1])]
+        for c, kind in enumerate(schema['kinds']):
+            row += [decode_channel(kind, stats[0][c]), decode_channel(kind, stats[1][c]),
+                    decode_channel(kind, stats[2][c])]
+        print(",".join(row))
+    if offset < len(data):
+        sys.stderr.write("Warning: Incomplete rollup record at end of file\n")
+
 def parse_perf_log(file_path):
     """
     Parses a binary perf log file and prints CSV to stdout.
     """
-    record_size = 21
-    
-    # CSV Header
-    print("Timestamp,Fan1_Target%,Fan1_Current%,Fan1_RPM,Fan2_Target%,Fan2_Current%,Fan2_RPM,Fan3_Target%,Fan3_Current%,Fan3_RPM,Fan4_Target%,Fan4_Current%,Fan4_RPM,Temp_Ambient,Temp_Coolant_In,Temp_Coolant_Out")
-    
     try:
         with open(file_path, 'rb') as f:
-            while True:
-                chunk = f.read(record_size)
-                if not chunk:
-                    break
-                if len(chunk) < record_size:
-                    sys.stderr.write(f"Warning: Incomplete record at end of file (got {len(chunk)} bytes, expected {record_size})\n")
-                    break
-                
-                # Unpack binary data
-                # <H: uint16_t (timestamp)
-                # 4 groups of (B B H): uint8_t, uint8_t, uint16_t (Fan data)
-                # 3 B: uint8_t (Thermistors)
-                # Total format: <H BBH BBH BBH BBH BBB
-                
-                data = struct.unpack('<HBBHBBHBBHBBHBBB', chunk)
-                
-                timestamp = data[0]
-                
-                # Fan 1
-                f1_target = decode_duty_cycle(data[1])
-                f1_current = decode_duty_cycle(data[2])
-                f1_rpm = data[3]
-                
-                # Fan 2
-                f2_target = decode_duty_cycle(data[4])
-                f2_current = decode_duty_cycle(data[5])
-                f2_rpm = data[6]
-                
-                # Fan 3
-                f3_target = decode_duty_cycle(data[7])
-                f3_current = decode_duty_cycle(data[8])
-                f3_rpm = data[9]
-                
-                # Fan 4
-                f4_target = decode_duty_cycle(data[10])
-                f4_current = decode_duty_cycle(data[11])
-                f4_rpm = data[12]
-                
-                # Thermistors
-                t_ambient = decode_temperature(data[13])
-                t_coolant_in = decode_temperature(data[14])
-                t_coolant_out = decode_temperature(data[15])
-                
-                print(f"{timestamp},{f1_target:.1f},{f1_current:.1f},{f1_rpm},{f2_target:.1f},{f2_current:.1f},{f2_rpm},{f3_target:.1f},{f3_current:.1f},{f3_rpm},{f4_target:.1f},{f4_current:.1f},{f4_rpm},{t_ambient:.1f},{t_coolant_in:.1f},{t_coolant_out:.1f}")
-                
+            data = f.read()
     except FileNotFoundError:
         sys.stderr.write(f"Error: File not found: {file_path}\n")
         sys.exit(1)
-    except Exception as e:
-        sys.stderr.write(f"Error parsing file: {e}\n")
+
+    try:
+        header = read_header(data)
+    except ValueError as e:
+        sys.stderr.write(f"Error parsing header: {e}\n")
         sys.exit(1)
 
+    if header and header['schema_id'] == SCHEMA_ROLLUP:
+        parse_rollups(data, header)
+        return
+
+    boot_id = header['boot_id'] if header else ''
+    schema = header['schema'] if header else DEFAULT_SCHEMA
+
+    # CSV Header
+    print(",".join(["Boot_Id", "Uptime_ms", "Wall_Clock_UTC"] + column_names(schema)))
+
+    uptime_ms = header['start_uptime_ms'] if header else 0
+    legacy_wraps = 0
+    last_seconds = None
+
+    records = iter_records(data, header)
+    while True:
+        try:
+            data_fields = next(records, None)
+        except ValueError as e:
+            sys.stderr.write(f"Error: {e}; stopping\n")
+            break
+        if data_fields is None:
+            break
+
+        if header is None:
+            # Unwrap the 16-bit seconds counter
+            seconds = data_fields[0]
+            if last_seconds is not None and seconds < last_seconds:
+                legacy_wraps += 1
+            last_seconds = seconds
+            uptime_ms = ((legacy_wraps << 16) + seconds) * 1000
+        else:
+            uptime_ms += data_fields[0]
+
+        wall_clock = format_wall_clock(header, uptime_ms) if header else ''
+
+        channels = [decode_channel(kind, value)
+                    for kind, value in zip(schema['kinds'], data_fields[1:])]
+        print(f"{boot_id},{uptime_ms},{wall_clock},{','.join(channels)}")
+
 if __name__ == "__main__":
     if len(sys.argv) != 2:
         print("Usage: python parse_perf_log.py <path_to_binary_log_file>")
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Compare perf_log_tool with parse_perf_log.py on a synthetic fleet.
+#
+#   tools/perf_log_tool/benchmark.sh BUILD_DIR [DEVICES] [DAYS] [PY_FILES]
+#
+# Generates DEVICES x DAYS of 1 s records (default 16 x 30, about 2 GB of
+# logs in 1 MiB files) under BUILD_DIR/bench, converts all of it to CSV and
+# to columns, then times the Python parser on the first PY_FILES files
+# (default 4) and prints records/s for both.
+set -e
+
+BUILD_DIR=${1:?usage: benchmark.sh BUILD_DIR [DEVICES] [DAYS] [PY_FILES]}
+DEVICES=${2:-16}
+DAYS=${3:-30}
+PY_FILES=${4:-4}
+TOOL=$BUILD_DIR/perf_log_tool
+DATA=$BUILD_DIR/bench
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+
+rm -rf "$DATA" "$DATA.columns"
+mkdir -p "$DATA.columns"
+"$TOOL" generate --output "$DATA" --devices "$DEVICES" --days "$DAYS" \
+    --file-bytes 1048576
+du -sh "$DATA"
+
+echo "perf_log_tool, CSV:"
+"$TOOL" convert --stats --output /dev/null "$DATA"
+echo "perf_log_tool, columns:"
+"$TOOL" convert --stats --format columns --output "$DATA.columns" "$DATA"
+echo "perf_log_tool, one hour of one boot:"
+"$TOOL" convert --stats --boot 1 --from 86400 --to 90000 \
+    --output /dev/null "$DATA"
+
+FILES=$(find "$DATA" -name '*.dat' | sort | head -n "$PY_FILES")
+RECORDS=$("$TOOL" convert --stats --threads 1 --output /dev/null $FILES 2>&1 |
+          sed -n 's/.* \([0-9]*\) records decoded.*/\1/p')
+START=$(date +%s.%N)
+for f in $FILES; do
+  python3 "$SCRIPT_DIR/../parse_perf_log.py" "$f" > /dev/null
+done
+END=$(date +%s.%N)
+echo "parse_perf_log.py, $PY_FILES files:"
+echo "$RECORDS $START $END" | awk '{ s = $3 - $2;
+    printf "%d records in %.3f s: %.0f records/s\n", $1, s, $1 / s }'
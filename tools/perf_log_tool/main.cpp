@@ -0,0 +1,421 @@
+// perf_log_tool - Bulk decoder and converter for perf log files
+//
+// The C++ counterpart of parse_perf_log.py for large collections of logs:
+// files are memory-mapped and decoded by a pool of threads straight into
+// columns, then written in file order as CSV or as raw column arrays.
+//
+//   perf_log_tool convert [options] PATH...
+//     PATH                   Log file, or directory searched for *.dat
+//     --format csv|columns   CSV (default) or one array file per column
+//     --output PATH          CSV file (default stdout) or columns directory
+//     --from S --to S        Keep records in [from, to), Unix seconds, or
+//                            uptime seconds of the boot given by --boot
+//     --boot N               Only records of boot N, times are uptime
+//     --channels a,b         Only these channels (names as in /range)
+//     --threads N            Decoder threads (default: all cores)
+//     --stats                Print throughput to stderr
+//
+//   perf_log_tool generate --output DIR [--devices N] [--days D]
+//                          [--file-bytes B]
+//     Writes a synthetic fleet (one directory per device, 1 s records) for
+//     benchmarking; see benchmark.sh.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "perf_log_decoder.h"
+#include "perf_log_format.h"
+#include "perf_log_query.h"
+#include "perf_log_writers.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Decoded files allowed to wait for the writer, per thread
+constexpr size_t kFilesAheadPerThread = 4;
+
+int Usage() {
+  fprintf(stderr,
+          "Usage: perf_log_tool convert [--format csv|columns] "
+          "[--output PATH] [--from S] [--to S] [--boot N] [--channels a,b] "
+          "[--threads N] [--stats] PATH...\n"
+          "       perf_log_tool generate --output DIR [--devices N] "
+          "[--days D] [--file-bytes B]\n");
+  return 2;
+}
+
+// "perf_logger_12.dat" sorts after "perf_logger_9.dat"
+bool NaturalLess(const fs::path& a, const fs::path& b) {
+  if (a.parent_path() != b.parent_path()) {
+    return a.parent_path() < b.parent_path();
+  }
+  std::string sa = a.stem().string();
+  std::string sb = b.stem().string();
+  size_t da = sa.find_last_not_of("0123456789") + 1;
+  size_t db = sb.find_last_not_of("0123456789") + 1;
+  if (sa.compare(0, da, sb, 0, db) != 0 || da == sa.size() ||
+      db == sb.size()) {
+    return sa < sb;
+  }
+  return std::stoull(sa.substr(da)) < std::stoull(sb.substr(db));
+}
+
+std::vector<fs::path> ListFiles(const std::vector<std::string>& paths) {
+  std::vector<fs::path> files;
+  for (const std::string& path : paths) {
+    if (fs::is_directory(path)) {
+      for (const auto& entry : fs::recursive_directory_iterator(path)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".dat") {
+          files.push_back(entry.path());
+        }
+      }
+    } else {
+      files.push_back(path);
+    }
+  }
+  std::sort(files.begin(), files.end(), NaturalLess);
+  return files;
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+ public:
+  explicit MappedFile(const fs::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        data_ = (const uint8_t*)data;
+        size_ = st.st_size;
+      }
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data_ != nullptr) munmap((void*)data_, size_);
+  }
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+struct FileResult {
+  ColumnBatch batch;
+  DecodeStats stats;
+  std::string error;
+  bool ready = false;
+};
+
+int Convert(int argc, char** argv) {
+  std::string format = "csv";
+  std::string output;
+  DecodeFilter filter;
+  bool have_from = false, have_to = false;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  bool print_stats = false;
+  std::vector<std::string> paths;
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--format" && has_value) {
+      format = argv[++i];
+    } else if (arg == "--output" && has_value) {
+      output = argv[++i];
+    } else if (arg == "--from" && has_value) {
+      filter.from_ms = atoll(argv[++i]) * 1000;
+      have_from = true;
+    } else if (arg == "--to" && has_value) {
+      filter.to_ms = atoll(argv[++i]) * 1000;
+      have_to = true;
+    } else if (arg == "--boot" && has_value) {
+      filter.wall_clock = false;
+      filter.boot_id = atoll(argv[++i]);
+      filter.filtered = true;
+    } else if (arg == "--channels" && has_value) {
+      if (!ParsePerfLogChannelList(argv[++i], &filter.channel_mask)) {
+        fprintf(stderr, "Unknown channel in: %s\n", argv[i]);
+        return 2;
+      }
+    } else if (arg == "--threads" && has_value) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--stats") {
+      print_stats = true;
+    } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+      return Usage();
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (have_from || have_to) filter.filtered = true;
+  if (paths.empty() || (format != "csv" && format != "columns") ||
+      (format == "columns" && output.empty())) {
+    return Usage();
+  }
+
+  std::unique_ptr<BatchWriter> writer;
+  FILE* csv_file = nullptr;
+  if (format == "csv") {
+    csv_file = output.empty() ? stdout : fopen(output.c_str(), "wb");
+    if (csv_file == nullptr) {
+      fprintf(stderr, "Cannot create %s\n", output.c_str());
+      return 1;
+    }
+    writer.reset(new CsvWriter(csv_file, filter.channel_mask));
+  } else {
+    fs::create_directories(output);
+    ColumnWriter* columns = new ColumnWriter(output, filter.channel_mask);
+    writer.reset(columns);
+    if (!columns->error().empty()) {
+      fprintf(stderr, "%s\n", columns->error().c_str());
+      return 1;
+    }
+  }
+
+  std::vector<fs::path> files = ListFiles(paths);
+  std::vector<FileResult> results(files.size());
+  auto start = std::chrono::steady_clock::now();
+
+  // Workers decode files in any order; this thread writes them in file order.
+  // Workers stay at most `window` files ahead of the writer to bound memory.
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t next_file = 0;
+  size_t written = 0;
+  const size_t window = kFilesAheadPerThread * threads;
+
+  auto worker = [&]() {
+    for (;;) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] {
+          return next_file >= files.size() || next_file < written + window;
+        });
+        if (next_file >= files.size()) return;
+        index = next_file++;
+      }
+      FileResult& result = results[index];
+      MappedFile file(files[index]);
+      if (file.data() != nullptr) {
+        result.error = DecodePerfLogFile(file.data(), file.size(), filter,
+                                         &result.batch, &result.stats);
+      } else {
+        result.error = "cannot map file (missing, unreadable or empty)";
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.ready = true;
+      }
+      changed.notify_all();
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; i++) pool.emplace_back(worker);
+
+  DecodeStats total;
+  bool ok = true;
+  bool failed = false;  // A log file could not be decoded; the rest still is
+  for (size_t i = 0; i < files.size(); i++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&] { return results[i].ready; });
+    }
+    FileResult& result = results[i];
+    if (!result.error.empty() && result.error != "rollup file skipped") {
+      fprintf(stderr, "%s: %s\n", files[i].c_str(), result.error.c_str());
+      failed = true;
+    }
+    if (ok && !writer->Write(result.batch)) {
+      fprintf(stderr, "Write error\n");
+      ok = false;
+    }
+    total.records_decoded += result.stats.records_decoded;
+    total.records_kept += result.stats.records_kept;
+    total.blocks_skipped += result.stats.blocks_skipped;
+    total.corrupt_blocks += result.stats.corrupt_blocks;
+    total.bytes += result.stats.bytes;
+    result.batch = ColumnBatch();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      written = i + 1;
+    }
+    changed.notify_all();
+  }
+  for (std::thread& thread : pool) thread.join();
+  ok = writer->Finish() && ok;
+  writer.reset();
+  if (csv_file != nullptr && csv_file != stdout) ok = fclose(csv_file) == 0 && ok;
+
+  if (print_stats) {
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    fprintf(stderr,
+            "%zu files, %.1f MB, %llu records decoded, %llu kept, %llu "
+            "blocks skipped, %llu corrupt in %.3f s: %.0f records/s, "
+            "%.1f MB/s (%d threads)\n",
+            files.size(), total.bytes / 1e6,
+            (unsigned long long)total.records_decoded,
+            (unsigned long long)total.records_kept,
+            (unsigned long long)total.blocks_skipped,
+            (unsigned long long)total.corrupt_blocks, seconds,
+            total.records_decoded / seconds, total.bytes / 1e6 / seconds,
+            threads);
+  }
+  return ok && !failed ? 0 : 1;
+}
+
+// One device's log: slowly drifting duties and temperatures, RPMs in whole
+// tach steps, a reboot every few days, files rotated like PerfLogger does
+void GenerateDevice(const fs::path& directory, int device, int days,
+                    uint32_t file_bytes) {
+  fs::create_directories(directory);
+  uint32_t seed = 12345 + device;
+  auto noise = [&seed](int range) {
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) % (2 * range + 1)) - range;
+  };
+
+  const int kBootDays = 3;
+  const int64_t kWallClockStart = 1700000000000LL;
+  int file_index = 0;
+  FILE* file = nullptr;
+  uint32_t file_size = 0;
+  uint64_t file_start_ms = 0;
+  uint64_t previous_ms = 0;
+  PerfLogRecord records[kPerfLogMaxBlockRecords];
+  uint64_t uptimes[kPerfLogMaxBlockRecords];
+  uint8_t block[kPerfLogMaxBlockSize];
+
+  int64_t total = (int64_t)days * 86400;
+  int64_t boot_length = (int64_t)kBootDays * 86400;
+  for (int64_t second = 0; second < total;) {
+    // Fill a block without crossing a reboot
+    int64_t boot = second / boot_length;
+    int64_t boot_end = std::min(total, (boot + 1) * boot_length);
+    int count = (int)std::min<int64_t>(kPerfLogMaxBlockRecords,
+                                       boot_end - second);
+    bool new_boot = second % boot_length == 0;
+    uint64_t uptime_ms = (second - boot * boot_length) * 1000;
+    for (int r = 0; r < count; r++, second++) {
+      double t = second / 600.0;
+      uint8_t duty = (uint8_t)(150 + 60 * sin(t));
+      PerfLogRecord& record = records[r];
+      memset(&record, 0, sizeof(record));
+      record.fan1_target_duty = record.fan2_target_duty = duty;
+      record.fan3_target_duty = duty;
+      record.fan1_current_duty = record.fan2_current_duty = duty;
+      record.fan3_current_duty = duty;
+      record.fan4_target_duty = record.fan4_current_duty = 255;
+      record.fan1_rpm = (900 + duty * 3 + noise(15)) / 30 * 30;
+      record.fan2_rpm = (920 + duty * 3 + noise(15)) / 30 * 30;
+      record.fan3_rpm = (880 + duty * 3 + noise(15)) / 30 * 30;
+      record.fan4_rpm = (2400 + noise(30)) / 30 * 30;
+      record.temp_ambient = 80;
+      record.temp_coolant_in = (uint8_t)(120 + 20 * sin(t) + noise(1) * 0.5);
+      record.temp_coolant_out = (uint8_t)(126 + 20 * sin(t));
+      uptimes[r] = uptime_ms + r * 1000 + (r > 0 ? noise(1) * 2 : 0);
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool start_file = file == nullptr || new_boot || attempt > 0;
+      if (start_file) {
+        if (file != nullptr) fclose(file);
+        fs::path path = directory / ("perf_logger_" +
+                                     std::to_string(file_index++) + ".dat");
+        file = fopen(path.c_str(), "wb");
+        file_start_ms = uptimes[0];
+        PerfLogFileHeader header;
+        InitPerfLogHeader(&header, (uint32_t)boot + 1, 1000, file_start_ms,
+                          kWallClockStart + boot * boot_length * 1000 +
+                              (int64_t)file_start_ms);
+        uint8_t header_data[kPerfLogEncodedHeaderSize];
+        file_size = fwrite(header_data, 1,
+                           EncodePerfLogHeader(&header, header_data), file);
+        previous_ms = file_start_ms;
+        new_boot = false;
+      }
+      for (int r = 0; r < count; r++) {
+        records[r].delta_ms = (uint16_t)(uptimes[r] - previous_ms);
+        previous_ms = uptimes[r];
+      }
+      size_t size = EncodePerfLogBlock(
+          records, count, (uint32_t)(uptimes[0] - file_start_ms), block,
+          sizeof(block));
+      if (!start_file && file_size + size > file_bytes) continue;
+      file_size += fwrite(block, 1, size, file);
+      break;
+    }
+  }
+  if (file != nullptr) fclose(file);
+}
+
+int Generate(int argc, char** argv) {
+  std::string output;
+  int devices = 4;
+  int days = 30;
+  uint32_t file_bytes = 4096;
+  for (int i = 0; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--output") {
+      output = argv[i + 1];
+    } else if (arg == "--devices") {
+      devices = atoi(argv[i + 1]);
+    } else if (arg == "--days") {
+      days = atoi(argv[i + 1]);
+    } else if (arg == "--file-bytes") {
+      file_bytes = atoi(argv[i + 1]);
+    } else {
+      return Usage();
+    }
+  }
+  if (output.empty() || argc % 2 != 0 || devices < 1 || days < 1 ||
+      file_bytes < 1024) {
+    return Usage();
+  }
+
+  std::vector<std::thread> pool;
+  for (int d = 0; d < devices; d++) {
+    pool.emplace_back(GenerateDevice,
+                      fs::path(output) / ("device" + std::to_string(d)), d,
+                      days, file_bytes);
+  }
+  for (std::thread& thread : pool) thread.join();
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) return Usage();
+  std::string command = argv[1];
+  if (command == "convert") return Convert(argc - 2, argv + 2);
+  if (command == "generate") return Generate(argc - 2, argv + 2);
+  return Usage();
+}
@@ -0,0 +1,211 @@
+#include "perf_log_decoder.h"
+
+#include <cstring>
+
+namespace {
+
+// Physical value = raw value * scale + offset: duty cycles in percent, RPMs
+// as is, temperatures in degrees C (see DecodePerfLogDutyCycle() and
+// DecodePerfLogTemperature())
+constexpr float ChannelScale(PerfLogChannelKind kind) {
+  return kind == kPerfLogFanTarget || kind == kPerfLogFanDuty ? 100.0f / 255.0f
+         : kind == kPerfLogTemperature                        ? 40.0f / 255.0f
+                                                              : 1.0f;
+}
+
+constexpr float ChannelOffset(PerfLogChannelKind kind) {
+  return kind == kPerfLogTemperature ? 10.0f : 0.0f;
+}
+
+// Where records of a file fall on the filter's time axis
+struct FileTime {
+  uint32_t boot_id;
+  uint64_t start_uptime_ms;
+  int64_t wall_clock_base_ms;
+  int64_t shift;  // Filter time minus uptime
+};
+
+// Append records [lo, hi) of a block with their uptimes to the columns. The
+// channel loops run over contiguous arrays so the compiler vectorizes them.
+void AppendRows(const PerfLogRecord* records, const int64_t* uptime_ms,
+                int lo, int hi, const FileTime& file,
+                const DecodeFilter& filter, ColumnBatch* batch) {
+  int n = hi - lo;
+  if (n <= 0) return;
+  size_t base = batch->rows();
+  batch->boot_id.resize(base + n, file.boot_id);
+  batch->uptime_ms.insert(batch->uptime_ms.end(), uptime_ms + lo,
+                          uptime_ms + hi);
+  batch->unix_ms.resize(base + n);
+  int64_t* unix_ms = batch->unix_ms.data() + base;
+  int64_t wall_shift =
+      file.wall_clock_base_ms - (int64_t)file.start_uptime_ms;
+  for (int i = 0; i < n; i++) {
+    unix_ms[i] = file.wall_clock_base_ms != 0 ? uptime_ms[lo + i] + wall_shift
+                                              : 0;
+  }
+
+  // Transpose to one array per channel
+  int32_t columns[kPerfLogChannelCount][kPerfLogMaxBlockRecords];
+  for (int i = 0; i < n; i++) {
+    int32_t values[kPerfLogChannelCount];
+    PerfLogRecordToChannels(records[lo + i], values);
+    for (int c = 0; c < kPerfLogChannelCount; c++) columns[c][i] = values[c];
+  }
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (!(filter.channel_mask & (1u << c))) continue;
+    std::vector<float>& column = batch->channels[c];
+    column.resize(base + n);
+    float* out = column.data() + base;
+    const int32_t* in = columns[c];
+    const float scale = ChannelScale(kPerfLogChannels[c].kind);
+    const float offset = ChannelOffset(kPerfLogChannels[c].kind);
+    for (int i = 0; i < n; i++) out[i] = in[i] * scale + offset;
+  }
+}
+
+// Rows [lo, hi) of ascending times that fall in the filter range
+void FilterRange(const int64_t* uptime_ms, int count, const FileTime& file,
+                 const DecodeFilter& filter, int* lo, int* hi) {
+  *lo = 0;
+  *hi = count;
+  if (!filter.filtered) return;
+  while (*lo < count && uptime_ms[*lo] + file.shift < filter.from_ms) (*lo)++;
+  *hi = *lo;
+  while (*hi < count && uptime_ms[*hi] + file.shift < filter.to_ms) (*hi)++;
+}
+
+void DecodeBlocks(const uint8_t* data, size_t size,
+                  const PerfLogFileHeader& header, const FileTime& file,
+                  const DecodeFilter& filter, ColumnBatch* batch,
+                  DecodeStats* stats) {
+  uint16_t version = header.version;
+  size_t header_size = PerfLogBlockHeaderSize(version);
+  size_t offset = header.header_size;
+  int64_t uptime = header.start_uptime_ms;
+  bool first = true;
+  PerfLogRecord records[kPerfLogMaxBlockRecords];
+  int64_t uptime_ms[kPerfLogMaxBlockRecords];
+
+  while (offset < size) {
+    PerfLogBlockHeader block;
+    bool have_header = ParsePerfLogBlockHeader(data + offset, size - offset,
+                                               version, &block) == nullptr;
+
+    // Version 4 blocks outside the range are skipped unread
+    if (have_header && version >= kPerfLogVersion && filter.filtered &&
+        size - offset >= header_size + block.payload_size) {
+      int64_t start = (int64_t)header.start_uptime_ms + file.shift;
+      if (start + block.first_offset_ms >= filter.to_ms) {
+        // Blocks are in time order
+        stats->blocks_skipped++;
+        return;
+      }
+      if (start + block.last_offset_ms < filter.from_ms) {
+        offset += header_size + block.payload_size;
+        stats->blocks_skipped++;
+        continue;
+      }
+    }
+
+    int count;
+    size_t block_size;
+    const char* error = DecodePerfLogBlock(data + offset, size - offset,
+                                           version, records, &count,
+                                           &block_size);
+    if (error != nullptr) {
+      size_t next = FindPerfLogBlock(data, size, offset + 1, version);
+      if (strcmp(error, "truncated block") != 0 || next < size) {
+        stats->corrupt_blocks++;
+      }
+      offset = next;
+      continue;
+    }
+    offset += block_size;
+    stats->records_decoded += count;
+
+    if (version >= kPerfLogVersion) {
+      uptime = header.start_uptime_ms + block.first_offset_ms;
+      first = true;
+    }
+    for (int r = 0; r < count; r++) {
+      if (!first) uptime += records[r].delta_ms;
+      first = false;
+      uptime_ms[r] = uptime;
+    }
+
+    int lo, hi;
+    FilterRange(uptime_ms, count, file, filter, &lo, &hi);
+    stats->records_kept += hi - lo;
+    AppendRows(records, uptime_ms, lo, hi, file, filter, batch);
+  }
+}
+
+// Headerless and version 2 files, through PerfLogReader
+void DecodeRecords(const uint8_t* data, size_t size, const FileTime& file,
+                   const DecodeFilter& filter, ColumnBatch* batch,
+                   DecodeStats* stats) {
+  PerfLogReader reader;
+  if (reader.Open(data, size) != nullptr) return;
+  PerfLogRecord records[kPerfLogMaxBlockRecords];
+  int64_t uptime_ms[kPerfLogMaxBlockRecords];
+  int count = 0;
+  PerfLogSample sample;
+  while (reader.Next(&sample)) {
+    stats->records_decoded++;
+    int64_t time = (int64_t)sample.uptime_ms + file.shift;
+    if (filter.filtered && (time < filter.from_ms || time >= filter.to_ms)) {
+      continue;
+    }
+    records[count] = sample.record;
+    uptime_ms[count] = sample.uptime_ms;
+    if (++count == kPerfLogMaxBlockRecords) {
+      AppendRows(records, uptime_ms, 0, count, file, filter, batch);
+      stats->records_kept += count;
+      count = 0;
+    }
+  }
+  AppendRows(records, uptime_ms, 0, count, file, filter, batch);
+  stats->records_kept += count;
+}
+
+}  // namespace
+
+std::string DecodePerfLogFile(const uint8_t* data, size_t size,
+                              const DecodeFilter& filter, ColumnBatch* batch,
+                              DecodeStats* stats) {
+  stats->bytes += size;
+  PerfLogReader reader;
+  const char* error = reader.Open(data, size);
+  if (error != nullptr) {
+    PerfLogFileHeader header;
+    if (ParsePerfLogHeader(data, size, &header) == nullptr &&
+        header.schema_id == kPerfLogSchemaRollup) {
+      return "rollup file skipped";
+    }
+    return error;
+  }
+  const PerfLogFileHeader& header = reader.header();
+
+  FileTime file;
+  file.boot_id = header.boot_id;
+  file.start_uptime_ms = header.start_uptime_ms;
+  file.wall_clock_base_ms = header.wall_clock_base_ms;
+  file.shift = 0;
+  if (filter.filtered) {
+    if (filter.wall_clock) {
+      // Without a wall-clock base the file cannot match
+      if (header.wall_clock_base_ms == 0) return "";
+      file.shift = header.wall_clock_base_ms - (int64_t)header.start_uptime_ms;
+    } else if (header.boot_id != filter.boot_id) {
+      return "";
+    }
+  }
+
+  if (header.version >= kPerfLogUntimedBlockVersion) {
+    DecodeBlocks(data, size, header, file, filter, batch, stats);
+  } else {
+    DecodeRecords(data, size, file, filter, batch, stats);
+  }
+  return "";
+}
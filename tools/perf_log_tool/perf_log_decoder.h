@@ -0,0 +1,50 @@
+#ifndef PERF_LOG_DECODER_H
+#define PERF_LOG_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "perf_log_format.h"
+
+// Which records and channels to keep
+struct DecodeFilter {
+  // Half-open range [from_ms, to_ms) in Unix ms, or in uptime ms of boot
+  // `boot_id` if wall_clock is false
+  bool wall_clock = true;
+  uint32_t boot_id = 0;
+  int64_t from_ms = INT64_MIN;
+  int64_t to_ms = INT64_MAX;
+  bool filtered = false;  // False: keep everything, even files without time
+  uint32_t channel_mask = (1u << kPerfLogChannelCount) - 1;
+};
+
+// Decoded records as columns. Channel values are in physical units (duty
+// percent, RPM, degrees C); only the channels in the filter mask are filled.
+struct ColumnBatch {
+  std::vector<uint32_t> boot_id;
+  std::vector<int64_t> uptime_ms;
+  std::vector<int64_t> unix_ms;  // 0 if the file has no wall-clock base
+  std::vector<float> channels[kPerfLogChannelCount];
+
+  size_t rows() const { return uptime_ms.size(); }
+};
+
+struct DecodeStats {
+  uint64_t records_decoded = 0;
+  uint64_t records_kept = 0;
+  uint64_t blocks_skipped = 0;  // Outside the time filter, never decoded
+  uint64_t corrupt_blocks = 0;
+  uint64_t bytes = 0;
+};
+
+// Decode one whole log file (any version) into `batch`. Version 3+ raw files
+// are decoded block by block straight into columns; version 4 blocks outside
+// the time filter are skipped from their headers alone. Returns an empty
+// string, or why the file was not decoded (rollup files are skipped).
+std::string DecodePerfLogFile(const uint8_t* data, size_t size,
+                              const DecodeFilter& filter, ColumnBatch* batch,
+                              DecodeStats* stats);
+
+#endif  // PERF_LOG_DECODER_H
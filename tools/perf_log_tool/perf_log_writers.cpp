@@ -0,0 +1,132 @@
+#include "perf_log_writers.h"
+
+#include <cmath>
+
+#include "perf_log_query.h"
+
+namespace {
+
+// Flush the CSV buffer once it holds this much
+constexpr size_t kCsvFlushBytes = 1 << 20;
+
+void AppendUint(std::string* out, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) out->push_back(digits[--n]);
+}
+
+// One decimal, as FormatPerfLogChannel() prints it
+void AppendTenths(std::string* out, float value) {
+  long tenths = lrintf(value * 10.0f);
+  AppendUint(out, tenths / 10);
+  out->push_back('.');
+  out->push_back('0' + tenths % 10);
+}
+
+// Integer channels; the others are scaled to one decimal
+bool IsRpmChannel(int channel) {
+  return kPerfLogChannels[channel].kind == kPerfLogFanRpm;
+}
+
+}  // namespace
+
+CsvWriter::CsvWriter(FILE* out, uint32_t channel_mask)
+    : out_(out), channel_mask_(channel_mask) {
+  buffer_ = "Boot_Id,Uptime_ms,Unix_ms";
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (channel_mask_ & (1u << c)) {
+      buffer_ += ",";
+      buffer_ += kPerfLogChannels[c].name;
+    }
+  }
+  buffer_ += "\n";
+}
+
+bool CsvWriter::Write(const ColumnBatch& batch) {
+  for (size_t row = 0; row < batch.rows(); row++) {
+    AppendUint(&buffer_, batch.boot_id[row]);
+    buffer_.push_back(',');
+    AppendUint(&buffer_, batch.uptime_ms[row]);
+    buffer_.push_back(',');
+    if (batch.unix_ms[row] != 0) AppendUint(&buffer_, batch.unix_ms[row]);
+    for (int c = 0; c < kPerfLogChannelCount; c++) {
+      if (!(channel_mask_ & (1u << c))) continue;
+      buffer_.push_back(',');
+      if (IsRpmChannel(c)) {
+        AppendUint(&buffer_, (uint64_t)batch.channels[c][row]);
+      } else {
+        AppendTenths(&buffer_, batch.channels[c][row]);
+      }
+    }
+    buffer_.push_back('\n');
+
+    if (buffer_.size() >= kCsvFlushBytes) {
+      if (fwrite(buffer_.data(), 1, buffer_.size(), out_) != buffer_.size()) {
+        return false;
+      }
+      buffer_.clear();
+    }
+  }
+  return true;
+}
+
+bool CsvWriter::Finish() {
+  bool ok = fwrite(buffer_.data(), 1, buffer_.size(), out_) == buffer_.size();
+  buffer_.clear();
+  return fflush(out_) == 0 && ok;
+}
+
+ColumnWriter::ColumnWriter(const std::string& directory, uint32_t channel_mask)
+    : channel_mask_(channel_mask) {
+  auto open = [&](const std::string& name) -> FILE* {
+    std::string path = directory + "/" + name;
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr && error_.empty()) error_ = "cannot create " + path;
+    return f;
+  };
+  boot_id_ = open("boot_id.u32");
+  uptime_ms_ = open("uptime_ms.i64");
+  unix_ms_ = open("unix_ms.i64");
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (channel_mask_ & (1u << c)) {
+      channels_[c] = open(std::string(kPerfLogChannels[c].name) + ".f32");
+    }
+  }
+}
+
+ColumnWriter::~ColumnWriter() {
+  FILE* files[] = {boot_id_, uptime_ms_, unix_ms_};
+  for (FILE* f : files) {
+    if (f != nullptr) fclose(f);
+  }
+  for (FILE* f : channels_) {
+    if (f != nullptr) fclose(f);
+  }
+}
+
+bool ColumnWriter::Write(const ColumnBatch& batch) {
+  if (!error_.empty()) return false;
+  size_t n = batch.rows();
+  bool ok = fwrite(batch.boot_id.data(), sizeof(uint32_t), n, boot_id_) == n;
+  ok &= fwrite(batch.uptime_ms.data(), sizeof(int64_t), n, uptime_ms_) == n;
+  ok &= fwrite(batch.unix_ms.data(), sizeof(int64_t), n, unix_ms_) == n;
+  for (int c = 0; c < kPerfLogChannelCount; c++) {
+    if (channels_[c] == nullptr) continue;
+    ok &= fwrite(batch.channels[c].data(), sizeof(float), n, channels_[c]) == n;
+  }
+  return ok;
+}
+
+bool ColumnWriter::Finish() {
+  if (!error_.empty()) return false;
+  bool ok = fflush(boot_id_) == 0 && fflush(uptime_ms_) == 0 &&
+            fflush(unix_ms_) == 0;
+  for (FILE* f : channels_) {
+    if (f != nullptr) ok &= fflush(f) == 0;
+  }
+  return ok;
+}
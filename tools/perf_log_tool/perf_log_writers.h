@@ -0,0 +1,58 @@
+#ifndef PERF_LOG_WRITERS_H
+#define PERF_LOG_WRITERS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "perf_log_decoder.h"
+
+// Output of the converter. Batches arrive in file order from one thread.
+class BatchWriter {
+ public:
+  virtual ~BatchWriter() = default;
+
+  // Returns false on a write error
+  virtual bool Write(const ColumnBatch& batch) = 0;
+  virtual bool Finish() = 0;
+};
+
+// CSV with the columns of the device's /range endpoint:
+// Boot_Id,Uptime_ms,Unix_ms,<selected channels>
+class CsvWriter : public BatchWriter {
+ public:
+  CsvWriter(FILE* out, uint32_t channel_mask);
+
+  bool Write(const ColumnBatch& batch) override;
+  bool Finish() override;
+
+ private:
+  FILE* out_;
+  uint32_t channel_mask_;
+  std::string buffer_;
+};
+
+// One raw little-endian array per column in a directory, readable with e.g.
+// numpy.fromfile: boot_id.u32, uptime_ms.i64, unix_ms.i64 and
+// <channel name>.f32 for each selected channel
+class ColumnWriter : public BatchWriter {
+ public:
+  ColumnWriter(const std::string& directory, uint32_t channel_mask);
+  ~ColumnWriter() override;
+
+  // Empty, or why the output files could not be created
+  const std::string& error() const { return error_; }
+
+  bool Write(const ColumnBatch& batch) override;
+  bool Finish() override;
+
+ private:
+  uint32_t channel_mask_;
+  FILE* boot_id_ = nullptr;
+  FILE* uptime_ms_ = nullptr;
+  FILE* unix_ms_ = nullptr;
+  FILE* channels_[kPerfLogChannelCount] = {};
+  std::string error_;
+};
+
+#endif  // PERF_LOG_WRITERS_H
@@ -0,0 +1,60 @@
+# Generates a small fleet, converts it and checks the row counts.
+#   cmake -DTOOL=<perf_log_tool> -DWORK_DIR=<dir> -P round_trip_test.cmake
+
+file(REMOVE_RECURSE ${WORK_DIR})
+
+function(run)
+  execute_process(COMMAND ${TOOL} ${ARGN} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "perf_log_tool ${ARGN} failed: ${result}")
+  endif()
+endfunction()
+
+function(run_fails)
+  execute_process(COMMAND ${TOOL} ${ARGN} RESULT_VARIABLE result
+                  ERROR_QUIET)
+  if(result EQUAL 0)
+    message(FATAL_ERROR "perf_log_tool ${ARGN} succeeded, expected failure")
+  endif()
+endfunction()
+
+function(expect_lines path expected)
+  file(STRINGS ${path} lines)
+  list(LENGTH lines count)
+  if(NOT count EQUAL expected)
+    message(FATAL_ERROR "${path}: ${count} lines, expected ${expected}")
+  endif()
+endfunction()
+
+# Two devices, one day each (one boot): 86400 records per device
+run(generate --output ${WORK_DIR}/fleet --devices 2 --days 1)
+
+run(convert --output ${WORK_DIR}/all.csv ${WORK_DIR}/fleet)
+expect_lines(${WORK_DIR}/all.csv 172801)
+
+# A path that is not a log fails the run, after converting the others
+file(WRITE ${WORK_DIR}/empty.dat "")
+run_fails(convert --output ${WORK_DIR}/some.csv ${WORK_DIR}/fleet
+          ${WORK_DIR}/missing.dat ${WORK_DIR}/empty.dat)
+expect_lines(${WORK_DIR}/some.csv 172801)
+
+# One hour of wall clock from both devices, two channels, single-threaded
+math(EXPR from "1700000000 + 3600")
+math(EXPR to "${from} + 3600")
+run(convert --threads 1 --from ${from} --to ${to}
+    --channels fan1_rpm,temp_coolant_in
+    --output ${WORK_DIR}/hour.csv ${WORK_DIR}/fleet)
+expect_lines(${WORK_DIR}/hour.csv 7201)
+file(STRINGS ${WORK_DIR}/hour.csv header LIMIT_COUNT 1)
+if(NOT header STREQUAL "Boot_Id,Uptime_ms,Unix_ms,Fan1_RPM,Temp_Coolant_In")
+  message(FATAL_ERROR "Unexpected CSV header: ${header}")
+endif()
+
+# The same hour by uptime of boot 1, as columns
+run(convert --format columns --boot 1 --from 3600 --to 7200
+    --output ${WORK_DIR}/columns ${WORK_DIR}/fleet)
+file(SIZE ${WORK_DIR}/columns/uptime_ms.i64 uptime_bytes)
+file(SIZE ${WORK_DIR}/columns/Fan4_RPM.f32 rpm_bytes)
+if(NOT uptime_bytes EQUAL 57600 OR NOT rpm_bytes EQUAL 28800)
+  message(FATAL_ERROR "Unexpected column sizes ${uptime_bytes} ${rpm_bytes}")
+endif()
@@ -0,0 +1,36 @@
+# Encodes the example status, decodes it and checks a few lines.
+#   cmake -DTOOL=<status_dump> -DWORK_DIR=<dir> -P example_test.cmake
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+execute_process(COMMAND ${TOOL} example
+  OUTPUT_FILE ${WORK_DIR}/status.bin RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "status_dump example failed: ${result}")
+endif()
+
+execute_process(COMMAND ${TOOL} ${WORK_DIR}/status.bin
+  OUTPUT_VARIABLE text RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "status_dump failed: ${result}")
+endif()
+
+foreach(expected
+    "controller delta_t=6.79 target=41.50"
+    "sensor Coolant_Out temp=ERR"
+    "fan Fan3 duty=55.50 target=41.50 rpm=2410 zones=0x1"
+    "zone Loop delta_t=6.79 target=41.50")
+  string(FIND "${text}" "${expected}" found)
+  if(found EQUAL -1)
+    message(FATAL_ERROR "Missing \"${expected}\" in:\n${text}")
+  endif()
+endforeach()
+
+# Damaged input is refused
+file(WRITE ${WORK_DIR}/bad.bin "x")
+execute_process(COMMAND ${TOOL} ${WORK_DIR}/bad.bin
+  OUTPUT_QUIET ERROR_QUIET RESULT_VARIABLE result)
+if(result EQUAL 0)
+  message(FATAL_ERROR "status_dump accepted a damaged status")
+endif()
@@ -0,0 +1,106 @@
+// status_dump - Prints a binary status (GET /api/status.bin) as text
+//
+//   curl -s http://fan-controller/api/status.bin | status_dump
+//   status_dump FILE
+//     One line per value, e.g. "fan fan3 duty=55.50 target=41.50 rpm=2410"
+//
+//   status_dump example > FILE
+//     Writes a status of the default topology, for trying out scrapers.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "status_binary.h"
+
+namespace {
+
+int Usage() {
+  fprintf(stderr,
+          "Usage: status_dump [FILE]   (standard input without FILE)\n"
+          "       status_dump example\n");
+  return 2;
+}
+
+int WriteExample() {
+  StatusBinaryState state = {};
+  state.uptime_ms = 86400123;
+  state.tick_count = 43200;
+  state.log_seq = 1050;
+  state.delta_t = 6.79f;
+  state.target_intensity = 41.5f;
+  state.sensor_count = 3;
+  state.sensors[0] = {"Ambient", true, 24.46f};
+  state.sensors[1] = {"Coolant_In", true, 31.25f};
+  state.sensors[2] = {"Coolant_Out", false, 0.0f};
+  state.fan_count = 4;
+  state.fans[0] = {"Fan1", 40.0f, 41.5f, 1180, 1, false, false};
+  state.fans[1] = {"Fan2", 40.0f, 41.5f, 1175, 1, false, false};
+  state.fans[2] = {"Fan3", 55.5f, 41.5f, 2410, 1, false, false};
+  state.fans[3] = {"Pump", 60.0f, 60.0f, 2900, 1, false, true};
+  state.zone_count = 1;
+  state.zones[0] = {"Loop", 6.79f, 41.5f};
+
+  uint8_t data[kStatusBinaryMaxSize];
+  size_t size = EncodeStatusBinary(state, data, sizeof(data));
+  return fwrite(data, 1, size, stdout) == size ? 0 : 1;
+}
+
+void Print(const StatusBinaryState& state) {
+  printf("uptime_ms=%u ticks=%u log_seq=%u override=%d\n",
+         (unsigned)state.uptime_ms, (unsigned)state.tick_count,
+         (unsigned)state.log_seq, state.override_enabled ? 1 : 0);
+  printf("controller delta_t=%.2f target=%.2f\n", state.delta_t,
+         state.target_intensity);
+  for (int i = 0; i < state.sensor_count; i++) {
+    const StatusBinarySensorState& sensor = state.sensors[i];
+    if (sensor.ok) {
+      printf("sensor %s temp=%.2f\n", sensor.id, sensor.temp);
+    } else {
+      printf("sensor %s temp=ERR\n", sensor.id);
+    }
+  }
+  for (int i = 0; i < state.fan_count; i++) {
+    const StatusBinaryFanState& fan = state.fans[i];
+    printf("%s %s duty=%.2f target=%.2f rpm=%d zones=0x%x%s\n",
+           fan.pump ? "pump" : "fan", fan.id, fan.duty, fan.target,
+           (int)fan.rpm, fan.zone_mask, fan.overridden ? " overridden" : "");
+  }
+  for (int i = 0; i < state.zone_count; i++) {
+    const StatusBinaryZoneState& zone = state.zones[i];
+    printf("zone %s delta_t=%.2f target=%.2f\n", zone.id, zone.delta_t,
+           zone.target_intensity);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 2) return Usage();
+  if (argc == 2 && strcmp(argv[1], "example") == 0) return WriteExample();
+
+  FILE* in = stdin;
+  if (argc == 2) {
+    in = fopen(argv[1], "rb");
+    if (in == nullptr) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[512];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  if (in != stdin) fclose(in);
+
+  StatusBinaryState state;
+  const char* error = DecodeStatusBinary(data.data(), data.size(), &state);
+  if (error != nullptr) {
+    fprintf(stderr, "status_dump: %s\n", error);
+    return 1;
+  }
+  Print(state);
+  return 0;
+}